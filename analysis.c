@@ -0,0 +1,844 @@
+/* analysis.c - Incremental analysis of an edited source (language server)
+ *
+ * Every line of a document is a doc_line. The names of the document live
+ * in file_names, like the names of a file being assembled, and for every
+ * name the document keeps the list of lines that define, reference or
+ * (as a macro) declare it. A change re-parses its own lines, updates
+ * those lists and marks the names whose lists changed; check_name() then
+ * re-validates exactly the lines on the lists of the marked names.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "globals.h"
+#include "table.h"
+#include "names.h"
+#include "arena.h"
+#include "errors.h"
+#include "scanner.h"
+#include "first_pass.h"
+#include "code_conversion.h"
+#include "macros.h"
+#include "second_pass.h"
+#include "analysis.h"
+
+/* Roles of a line */
+#define ROLE_BLANK        0   /* Empty or comment */
+#define ROLE_STATEMENT    1   /* Instruction or directive, assembled as it is */
+#define ROLE_MACRO_START  2   /* mcro line */
+#define ROLE_MACRO_BODY   3
+#define ROLE_MACRO_END    4
+#define ROLE_MACRO_CALL   5
+#define ROLE_PREPROCESSOR 6   /* .include or a conditional directive */
+#define ROLE_TOO_LONG     7   /* Dropped by the macro stage */
+
+/* One line of a document */
+typedef struct doc_line {
+    char *text;               /* The line, without its newline */
+    int length;
+    int index;                /* Position in the document */
+    line_info info;           /* Scan of the line (offset 0) */
+    int role;                 /* ROLE_*, or -1 before the line is parsed */
+    int in_macro;             /* Inside a macro definition before this line */
+    line_summary summary;     /* ROLE_STATEMENT and ROLE_MACRO_BODY */
+    int data_words;           /* Data words of the line */
+    int label;                /* Name defined by the label (statements), or NO_NAME */
+    int external;             /* Name declared by .extern, or NO_NAME */
+    int refs[2];              /* Names referenced, summary.ref_count of them */
+    int macro;                /* Macro defined (mcro line) or called, or NO_NAME */
+    node *shared;             /* Library macro called, or NULL */
+    char *error;              /* The line's own error, or NULL */
+    int undefined;            /* Bit i set: refs[i] is defined nowhere */
+    int duplicate;            /* Label (or macro) already defined above */
+    int address;              /* Layout: code address or data offset */
+    int macro_words;          /* Layout of a mcro line: words of the body */
+    int macro_data;
+} doc_line;
+
+/* Lines a name appears on */
+typedef struct name_lines {
+    doc_line **lines;
+    int count;
+    int capacity;
+    int dirty;                /* Waiting for check_name() */
+} name_lines;
+
+struct document {
+    doc_line **lines;
+    int count;
+    int capacity;
+    node *shared;             /* Library macros (may be NULL) */
+    name_lines *names;        /* Indexed by file_names id */
+    int name_capacity;
+    int *dirty;               /* Names to check again */
+    int dirty_count;
+    int dirty_capacity;
+    int layout_valid;         /* Addresses are up to date */
+    int final_address;        /* inst_counter at the end of the first pass */
+    doc_diagnostic *diagnostics;
+    int diagnostic_count;
+    int diagnostic_capacity;
+    arena messages;           /* Texts of the diagnostics */
+};
+
+/* Exits like add_symbol() does when memory runs out mid-update. */
+static void *grow(void *block, size_t size) {
+    void *grown = realloc(block, size);
+    if (!grown) {
+        fprintf(stderr, "Memory allocation error while analyzing the document\n");
+        exit(1);
+    }
+    return grown;
+}
+
+/* Copies the line as the first pass reads it: with its newline, cut like the .am line. */
+static void first_pass_text(const doc_line *l, char *buf) {
+    int len = l->length + 1;
+    if (len > MAX_LINE_LENGTH - 1) len = MAX_LINE_LENGTH - 1;
+    if (len > l->length) {
+        memcpy(buf, l->text, l->length);
+        buf[l->length] = '\n';
+    } else {
+        memcpy(buf, l->text, len);
+    }
+    buf[len] = '\0';
+}
+
+/* Copies the line as the second pass reads it: without its newline. */
+static void second_pass_text(const doc_line *l, char *buf) {
+    int len = l->length;
+    if (len > MAX_LINE_LENGTH - 1) len = MAX_LINE_LENGTH - 1;
+    memcpy(buf, l->text, len);
+    buf[len] = '\0';
+}
+
+/*
+ * Splits a block of text into new, unparsed lines: one more line than
+ * the block has newlines, so a block ending in a newline ends with an
+ * empty line. Returns the lines (count in *count), or NULL if memory is
+ * exhausted.
+ */
+static doc_line **split_lines(const char *text, long length, int *count) {
+    line_index index;
+    doc_line **lines;
+    long p;
+    int n = 1, i;
+
+    for (p = 0; p < length; p++)
+        if (text[p] == '\n') n++;
+    if (!scan_lines(text, length, &index)) return NULL;
+    lines = calloc(n, sizeof(doc_line *));
+    if (!lines) {
+        free_line_index(&index);
+        return NULL;
+    }
+
+    for (i = 0; i < n; i++) {
+        doc_line *l = calloc(1, sizeof(doc_line));
+        long start = length;
+        int len = 0;
+
+        if (l && i < index.count) {
+            l->info = index.lines[i];
+            start = l->info.offset;
+            len = l->info.length;
+        } else if (l) {
+            /* Empty last line */
+            l->info.colon = l->info.semicolon = l->info.comma = -1;
+            l->info.quote = l->info.bracket = -1;
+        }
+        if (l) l->text = malloc(len + 1);
+        if (!l || !l->text) {
+            free(l);
+            while (--i >= 0) {
+                free(lines[i]->text);
+                free(lines[i]);
+            }
+            free(lines);
+            free_line_index(&index);
+            return NULL;
+        }
+        memcpy(l->text, text + start, len);
+        l->text[len] = '\0';
+        l->length = len;
+        l->info.offset = 0;
+        l->role = -1;
+        l->label = l->external = l->macro = NO_NAME;
+        lines[i] = l;
+    }
+    free_line_index(&index);
+    *count = n;
+    return lines;
+}
+
+static void free_line(doc_line *l) {
+    free(l->text);
+    free(l->error);
+    free(l);
+}
+
+/* Makes room in the name tables for every name of file_names. */
+static void ensure_names(document *d) {
+    if (d->name_capacity >= file_names.count) return;
+    {
+        int capacity = d->name_capacity ? d->name_capacity : 256;
+        while (capacity < file_names.count) capacity *= 2;
+        d->names = grow(d->names, capacity * sizeof(name_lines));
+        memset(d->names + d->name_capacity, 0, (capacity - d->name_capacity) * sizeof(name_lines));
+        d->name_capacity = capacity;
+    }
+}
+
+static void mark_dirty(document *d, int name) {
+    if (d->names[name].dirty) return;
+    if (d->dirty_count == d->dirty_capacity) {
+        d->dirty_capacity = d->dirty_capacity ? d->dirty_capacity * 2 : 64;
+        d->dirty = grow(d->dirty, d->dirty_capacity * sizeof(int));
+    }
+    d->names[name].dirty = 1;
+    d->dirty[d->dirty_count++] = name;
+}
+
+/* Collects the distinct names a line appears on its name lists under. */
+static int line_names(const doc_line *l, int names[5]) {
+    int candidates[5], count = 0, i, j;
+
+    candidates[0] = l->label;
+    candidates[1] = l->external;
+    candidates[2] = l->role == ROLE_MACRO_START ? l->macro : NO_NAME;
+    candidates[3] = l->summary.ref_count > 0 ? l->refs[0] : NO_NAME;
+    candidates[4] = l->summary.ref_count > 1 ? l->refs[1] : NO_NAME;
+    for (i = 0; i < 5; i++) {
+        if (candidates[i] == NO_NAME) continue;
+        for (j = 0; j < count && names[j] != candidates[i]; j++)
+            ;
+        if (j == count) names[count++] = candidates[i];
+    }
+    return count;
+}
+
+/* Adds a parsed line to the lists of its names. */
+static void register_line(document *d, doc_line *l) {
+    int names[5], count = line_names(l, names), i;
+
+    ensure_names(d);
+    for (i = 0; i < count; i++) {
+        name_lines *n = &d->names[names[i]];
+        if (n->count == n->capacity) {
+            n->capacity = n->capacity ? n->capacity * 2 : 4;
+            n->lines = grow(n->lines, n->capacity * sizeof(doc_line *));
+        }
+        n->lines[n->count++] = l;
+        mark_dirty(d, names[i]);
+    }
+}
+
+/* Removes a line from the lists of its names. */
+static void unregister_line(document *d, doc_line *l) {
+    int names[5], count = line_names(l, names), i, k;
+
+    for (i = 0; i < count; i++) {
+        name_lines *n = &d->names[names[i]];
+        for (k = 0; k < n->count; k++) {
+            if (n->lines[k] == l) {
+                n->lines[k] = n->lines[--n->count];
+                break;
+            }
+        }
+        mark_dirty(d, names[i]);
+    }
+}
+
+/* Returns the first (valid) definition of a macro above line index, or NULL. */
+static doc_line *macro_definition(const document *d, int name, int index) {
+    const name_lines *n;
+    doc_line *first = NULL;
+    int k;
+
+    if (name == NO_NAME || name >= d->name_capacity) return NULL;
+    n = &d->names[name];
+    for (k = 0; k < n->count; k++) {
+        doc_line *l = n->lines[k];
+        if (l->role == ROLE_MACRO_START && l->macro == name && l->index < index &&
+            (!first || l->index < first->index))
+            first = l;
+    }
+    return first;
+}
+
+/* Returns the line that defines a label (its first definition), or NULL. */
+static doc_line *symbol_definition(const document *d, int name) {
+    const name_lines *n;
+    doc_line *first = NULL;
+    int k;
+
+    if (name == NO_NAME || name >= d->name_capacity) return NULL;
+    n = &d->names[name];
+    for (k = 0; k < n->count; k++) {
+        doc_line *l = n->lines[k];
+        if ((l->label == name || l->external == name) && (!first || l->index < first->index))
+            first = l;
+    }
+    return first;
+}
+
+/* .include and the conditional directives, which the macro stage consumes */
+static int is_preprocessor_line(const char *line, const line_info *info) {
+    static const char *const words[] = { ".include", ".ifdef", ".ifndef", ".else", ".endif" };
+    const char *p = line + info->indent;
+    int length = info->word_end - info->indent, i;
+
+    for (i = 0; i < 5; i++)
+        if ((int)strlen(words[i]) == length && strncmp(p, words[i], length) == 0) return 1;
+    return 0;
+}
+
+/*
+ * Finds the role of a line the way the macro stage sees it, given
+ * whether the line is inside a macro definition.
+ */
+static int line_role(const document *d, const doc_line *l, int in_macro, int *macro, node **shared) {
+    char buf[MAX_LINE_LENGTH];
+    char name[32];
+    int id;
+
+    *macro = NO_NAME;
+    *shared = NULL;
+    if (l->length >= MAX_LINE_LENGTH - 1) return ROLE_TOO_LONG;
+    first_pass_text(l, buf);
+
+    if (in_macro)
+        return is_macro_end(buf) ? ROLE_MACRO_END : ROLE_MACRO_BODY;
+    if (is_macro_start(buf, &l->info, name)) {
+        *macro = intern_name(&file_names, name, (int)strlen(name));
+        return ROLE_MACRO_START;
+    }
+    if (is_comment_or_empty(buf, &l->info)) return ROLE_BLANK;
+    if (is_preprocessor_line(buf, &l->info)) return ROLE_PREPROCESSOR;
+
+    get_opcode_from_line(buf, &l->info, name);
+    id = find_name(&file_names, name, (int)strlen(name));
+    if (macro_definition(d, id, l->index)) {
+        *macro = id;
+        return ROLE_MACRO_CALL;
+    }
+    if (d->shared) {
+        id = find_name(&batch_names, name, (int)strlen(name));
+        if (id != NO_NAME && (*shared = find_macro(d->shared, id)) != NULL)
+            return ROLE_MACRO_CALL;
+    }
+    return ROLE_STATEMENT;
+}
+
+/* Whether the line after l is inside a macro definition */
+static int macro_state_after(const doc_line *l) {
+    if (l->role == ROLE_MACRO_START) return 1;
+    if (l->role == ROLE_MACRO_END) return 0;
+    return l->in_macro;
+}
+
+/*
+ * Parses a line for its role: the first pass summary (scan_line()), the
+ * error the passes would report for it, and its names.
+ */
+static void analyze_line(doc_line *l) {
+    char buf[MAX_LINE_LENGTH];
+    char code[MAX_LINE_LENGTH];
+    char opcode[MAX_OPCODE_LENGTH];
+    char message[MAX_ERROR_MESSAGE];
+    int words[MAX_DATA_SIZE];
+    const char *error = NULL;
+    data_sink data;
+    int i;
+
+    free(l->error);
+    l->error = NULL;
+    memset(&l->summary, 0, sizeof(line_summary));
+    l->data_words = 0;
+    l->label = l->external = NO_NAME;
+    l->undefined = 0;
+    l->duplicate = 0;
+
+    if (l->role == ROLE_TOO_LONG) {
+        sprintf(message, "Line exceeds maximum allowed length of %d characters.", MAX_LINE_LENGTH);
+        error = message;
+    } else if (l->role == ROLE_STATEMENT || l->role == ROLE_MACRO_BODY) {
+        first_pass_text(l, buf);
+        if (!is_comment_or_empty(buf, &l->info)) {
+            data.words = words;
+            data.count = 0;
+            scan_line(buf, &l->info, &l->summary, &data);
+            l->data_words = data.count;
+            error = l->summary.error;
+
+            /* The second pass encodes the line without its newline */
+            if (!error && l->summary.kind == LINE_CODE) {
+                const char *inst;
+                second_pass_text(l, code);
+                inst = find_instruction(code, opcode);
+                if (inst) error = instruction_error(inst, opcode, message);
+            }
+            for (i = 0; i < l->summary.ref_count; i++)
+                l->refs[i] = intern_name(&file_names, buf + l->summary.ref_start[i],
+                                         l->summary.ref_length[i]);
+            /* A body's labels are only defined where it is expanded */
+            if (l->role == ROLE_STATEMENT && l->summary.label_length)
+                l->label = symbol_name(buf + l->summary.label_start, l->summary.label_length);
+            if (l->role == ROLE_STATEMENT && l->summary.extern_length)
+                l->external = symbol_name(buf + l->summary.extern_start, l->summary.extern_length);
+        }
+    }
+
+    if (error) {
+        l->error = malloc(strlen(error) + 1);
+        if (l->error) strcpy(l->error, error);
+    }
+}
+
+/*
+ * Walks the lines from `from` on, finding their roles again. The lines
+ * before `end` are new and always parsed; a later line is only parsed
+ * again if its role changed. The walk stops at the first later line
+ * whose macro state is unchanged, unless a macro definition changed (a
+ * call anywhere below may then resolve differently).
+ */
+static void refresh_lines(document *d, int from, int end, int macros_changed) {
+    int in_macro = from > 0 ? macro_state_after(d->lines[from - 1]) : 0;
+    int k;
+
+    for (k = from; k < d->count; k++) {
+        doc_line *l = d->lines[k];
+        node *shared;
+        int macro, role;
+
+        if (k >= end && !macros_changed && l->in_macro == in_macro) break;
+        role = line_role(d, l, in_macro, &macro, &shared);
+        if (k < end || role != l->role || macro != l->macro || shared != l->shared) {
+            if (k >= end) {
+                if (l->role == ROLE_MACRO_START) macros_changed = 1;
+                unregister_line(d, l);
+            }
+            l->role = role;
+            l->macro = macro;
+            l->shared = shared;
+            analyze_line(l);
+            register_line(d, l);
+            if (role == ROLE_MACRO_START) macros_changed = 1;
+        }
+        l->in_macro = in_macro;
+        in_macro = macro_state_after(l);
+    }
+}
+
+/*
+ * Validates the lines a name appears on: references to it are undefined
+ * if no line defines it, and every definition but the first is a
+ * duplicate (the first pass's rules, where an .extern counts as a
+ * definition too).
+ */
+static void check_name(document *d, int name) {
+    name_lines *n = &d->names[name];
+    doc_line *first_def = symbol_definition(d, name);
+    doc_line *first_macro = macro_definition(d, name, d->count);
+    int k, i;
+
+    n->dirty = 0;
+    for (k = 0; k < n->count; k++) {
+        doc_line *l = n->lines[k];
+        for (i = 0; i < l->summary.ref_count; i++) {
+            if (l->refs[i] != name) continue;
+            if (first_def) l->undefined &= ~(1 << i);
+            else l->undefined |= 1 << i;
+        }
+        if (l->label == name)
+            l->duplicate = first_def != l;
+        if (l->role == ROLE_MACRO_START && l->macro == name)
+            l->duplicate = first_macro != l;
+    }
+}
+
+int doc_change(document *d, int start_line, int start_column, int end_line, int end_column,
+               const char *text, long length) {
+    doc_line **lines;
+    char *block;
+    int new_count, removed, macros_changed = 0, k;
+    long prefix, suffix;
+
+    /* Clamp the range to the document */
+    if (start_line < 0) start_line = start_column = 0;
+    if (start_line >= d->count) {
+        start_line = d->count - 1;
+        start_column = d->lines[start_line]->length;
+    }
+    if (end_line >= d->count) {
+        end_line = d->count - 1;
+        end_column = d->lines[end_line]->length;
+    }
+    if (start_column < 0) start_column = 0;
+    if (start_column > d->lines[start_line]->length) start_column = d->lines[start_line]->length;
+    if (end_column > d->lines[end_line]->length) end_column = d->lines[end_line]->length;
+    if (end_line < start_line || (end_line == start_line && end_column < start_column)) {
+        end_line = start_line;
+        end_column = start_column;
+    }
+    if (end_column < 0) end_column = 0;
+
+    /* New text of the lines: kept start, inserted text, kept end */
+    prefix = start_column;
+    suffix = d->lines[end_line]->length - end_column;
+    block = malloc(prefix + length + suffix + 1);
+    if (!block) return 0;
+    memcpy(block, d->lines[start_line]->text, prefix);
+    memcpy(block + prefix, text, length);
+    memcpy(block + prefix + length, d->lines[end_line]->text + end_column, suffix);
+    lines = split_lines(block, prefix + length + suffix, &new_count);
+    free(block);
+    if (!lines) return 0;
+
+    removed = end_line - start_line + 1;
+    if (d->count - removed + new_count > d->capacity) {
+        int capacity = d->capacity ? d->capacity : 256;
+        doc_line **grown;
+        while (capacity < d->count - removed + new_count) capacity *= 2;
+        grown = realloc(d->lines, capacity * sizeof(doc_line *));
+        if (!grown) {
+            for (k = 0; k < new_count; k++) free_line(lines[k]);
+            free(lines);
+            return 0;
+        }
+        d->lines = grown;
+        d->capacity = capacity;
+    }
+
+    for (k = start_line; k <= end_line; k++) {
+        doc_line *l = d->lines[k];
+        if (l->role == ROLE_MACRO_START) macros_changed = 1;
+        unregister_line(d, l);
+        free_line(l);
+    }
+    memmove(d->lines + start_line + new_count, d->lines + end_line + 1,
+            (d->count - end_line - 1) * sizeof(doc_line *));
+    memcpy(d->lines + start_line, lines, new_count * sizeof(doc_line *));
+    free(lines);
+    d->count += new_count - removed;
+    for (k = start_line; k < d->count; k++)
+        d->lines[k]->index = k;
+
+    refresh_lines(d, start_line, start_line + new_count, macros_changed);
+    for (k = 0; k < d->dirty_count; k++)
+        check_name(d, d->dirty[k]);
+    d->dirty_count = 0;
+    d->layout_valid = 0;
+    return 1;
+}
+
+document *doc_open(const char *text, long length, node *shared_macros) {
+    document *d = calloc(1, sizeof(document));
+    int count;
+
+    if (!d) return NULL;
+    d->shared = shared_macros;
+    d->lines = split_lines("", 0, &count);
+    if (!d->lines) {
+        free(d);
+        return NULL;
+    }
+    d->count = d->capacity = count;
+    d->lines[0]->role = ROLE_BLANK;
+    if (!doc_change(d, 0, 0, 0, 0, text, length)) {
+        doc_close(d);
+        return NULL;
+    }
+    return d;
+}
+
+int doc_line_count(const document *d) {
+    return d->count;
+}
+
+/* Appends a diagnostic whose message lives in the document's arena (or is static). */
+static void add_diagnostic(document *d, int line, int start, int end, const char *message) {
+    doc_diagnostic *diag;
+
+    if (!message) return;
+    if (d->diagnostic_count == d->diagnostic_capacity) {
+        d->diagnostic_capacity = d->diagnostic_capacity ? d->diagnostic_capacity * 2 : 64;
+        d->diagnostics = grow(d->diagnostics, d->diagnostic_capacity * sizeof(doc_diagnostic));
+    }
+    diag = &d->diagnostics[d->diagnostic_count++];
+    diag->line = line;
+    diag->start = start;
+    diag->end = end > start ? end : start;
+    diag->message = message;
+}
+
+/* Formats a message into the document's arena. */
+static const char *format_message(document *d, const char *format, const char *name) {
+    char message[MAX_ERROR_MESSAGE];
+    int length = sprintf(message, format, MAX_LABEL_LENGTH, name);
+    return arena_strndup(&d->messages, message, length);
+}
+
+/*
+ * doc_diagnostics
+ * Collects the stored results of every line: its own error, its
+ * undefined references and a duplicate definition.
+ */
+int doc_diagnostics(document *d, const doc_diagnostic **list) {
+    int k, i;
+
+    arena_reset(&d->messages);
+    d->diagnostic_count = 0;
+    for (k = 0; k < d->count; k++) {
+        const doc_line *l = d->lines[k];
+
+        if (l->error)
+            add_diagnostic(d, k, l->info.indent, l->length, l->error);
+        for (i = 0; i < l->summary.ref_count; i++) {
+            if (!(l->undefined & (1 << i))) continue;
+            add_diagnostic(d, k, l->summary.ref_start[i],
+                           l->summary.ref_start[i] + l->summary.ref_length[i],
+                           format_message(d, "Undefined label '%.*s'", name_text(&file_names, l->refs[i])));
+        }
+        if (l->duplicate && l->role == ROLE_MACRO_START)
+            add_diagnostic(d, k, l->info.indent, l->length,
+                           format_message(d, "Duplicate macro name '%.*s'. Skipping this macro definition.",
+                                          name_text(&file_names, l->macro)));
+        else if (l->duplicate)
+            add_diagnostic(d, k, l->summary.label_start,
+                           l->summary.label_start + l->summary.label_length, "Duplicate label");
+    }
+    *list = d->diagnostics;
+    return d->diagnostic_count;
+}
+
+/* Words and data words of a library macro's body */
+static void shared_macro_words(const node *macro, int *code, int *data) {
+    int words[MAX_DATA_SIZE];
+    int i;
+
+    *code = *data = 0;
+    for (i = 0; i < macro->line_count; i++) {
+        const char *line = macro->lines[i];
+        line_index index;
+        line_summary s;
+        data_sink sink;
+
+        if (!scan_lines(line, (long)strlen(line), &index)) continue;
+        if (index.count > 0 && !is_comment_or_empty(line, &index.lines[0])) {
+            sink.words = words;
+            sink.count = 0;
+            scan_line(line, &index.lines[0], &s, &sink);
+            *code += s.words;
+            *data += sink.count;
+        }
+        free_line_index(&index);
+    }
+}
+
+/*
+ * Lays out the addresses the first pass would assign: instructions count
+ * up from IC_START, data from 0 (moved after the code when a data
+ * label is resolved), and a call takes the words of its macro's body.
+ */
+static void layout(document *d) {
+    int address = IC_START, data = 0, k;
+    doc_line *macro = NULL;   /* Definition whose body is being counted */
+
+    if (d->layout_valid) return;
+    for (k = 0; k < d->count; k++) {
+        doc_line *l = d->lines[k];
+        int code_words, data_words;
+
+        switch (l->role) {
+        case ROLE_STATEMENT:
+            l->address = l->summary.kind == LINE_DATA ? data : address;
+            address += l->summary.words;
+            data += l->data_words;
+            break;
+        case ROLE_MACRO_START:
+            macro = l->duplicate ? NULL : l;
+            l->macro_words = l->macro_data = 0;
+            break;
+        case ROLE_MACRO_BODY:
+            if (macro) {
+                macro->macro_words += l->summary.words;
+                macro->macro_data += l->data_words;
+            }
+            break;
+        case ROLE_MACRO_END:
+            macro = NULL;
+            break;
+        case ROLE_MACRO_CALL:
+            l->address = address;
+            if (l->shared) {
+                shared_macro_words(l->shared, &code_words, &data_words);
+            } else {
+                const doc_line *def = macro_definition(d, l->macro, k);
+                code_words = def ? def->macro_words : 0;
+                data_words = def ? def->macro_data : 0;
+            }
+            address += code_words;
+            data += data_words;
+            break;
+        }
+    }
+    d->final_address = address;
+    d->layout_valid = 1;
+}
+
+/* Finds the word (letters and digits) at a column: returns its start, length in *length. */
+static int word_at(const doc_line *l, int column, int *length) {
+    int start, end;
+
+    if (column > l->length) column = l->length;
+    if (column < 0) column = 0;
+    if ((column == l->length || !isalnum((unsigned char)l->text[column])) &&
+        column > 0 && isalnum((unsigned char)l->text[column - 1]))
+        column--;
+    if (column >= l->length || !isalnum((unsigned char)l->text[column])) return -1;
+    for (start = column; start > 0 && isalnum((unsigned char)l->text[start - 1]); start--)
+        ;
+    for (end = column; end < l->length && isalnum((unsigned char)l->text[end]); end++)
+        ;
+    *length = end - start;
+    return start;
+}
+
+/*
+ * Returns the definition of the label named at a position (its name id
+ * in *name), or NULL.
+ */
+static doc_line *label_at(document *d, int line, int column, int *name) {
+    const doc_line *l;
+    int start, length;
+
+    if (line < 0 || line >= d->count) return NULL;
+    l = d->lines[line];
+    start = word_at(l, column, &length);
+    if (start < 0) return NULL;
+    *name = find_name(&file_names, l->text + start, length);
+    return symbol_definition(d, *name);
+}
+
+int doc_definition(document *d, int line, int column, int *def_line, int *def_start, int *def_end) {
+    int name;
+    const doc_line *def = label_at(d, line, column, &name);
+
+    if (!def) return 0;
+    *def_line = def->index;
+    if (def->label == name) {
+        *def_start = def->summary.label_start;
+        *def_end = def->summary.label_start + def->summary.label_length;
+    } else {
+        *def_start = def->summary.extern_start;
+        *def_end = def->summary.extern_start + def->summary.extern_length;
+    }
+    return 1;
+}
+
+/* Address of a defined label, as the first pass resolves it */
+static int label_address(const document *d, const doc_line *def, int name) {
+    if (def->label != name) return 0;   /* .extern */
+    if (def->summary.kind == LINE_DATA) return d->final_address + def->address;
+    return def->address;
+}
+
+/*
+ * Appends the words of a statement as the .ob file holds them, or
+ * returns 0 if the line cannot be encoded.
+ */
+static int append_encoding(document *d, const doc_line *l, out_buffer *text) {
+    char buf[MAX_LINE_LENGTH];
+    char opcode[MAX_OPCODE_LENGTH];
+    int words[MAX_DATA_SIZE];
+    int names[MAX_INSTRUCTION_WORDS];
+    char header[64];
+    int count, i;
+
+    if (l->summary.kind == LINE_DATA) {
+        data_sink data;
+        line_summary s;
+        first_pass_text(l, buf);
+        data.words = words;
+        data.count = 0;
+        scan_line(buf, &l->info, &s, &data);
+        out_append(text, header, sprintf(header, "data address %04d, %d word%s\n",
+                                         d->final_address + l->address, data.count,
+                                         data.count == 1 ? "" : "s"));
+        for (i = 0; i < data.count; i++)
+            write_encoded_word(text, words[i]);
+        return 1;
+    }
+
+    if (l->summary.kind != LINE_CODE || l->error) return 0;
+    second_pass_text(l, buf);
+    {
+        const char *inst = find_instruction(buf, opcode);
+        count = inst ? instruction_words(inst, opcode, words, names) : -1;
+    }
+    if (count < 0) return 0;
+    for (i = 0; i < count; i++) {
+        if (names[i] != NO_NAME) {
+            const doc_line *def = symbol_definition(d, names[i]);
+            if (!def) return 0;
+            words[i] = label_address(d, def, names[i]);
+        }
+    }
+    out_append(text, header, sprintf(header, "address %04d, %d word%s\n", l->address, count,
+                                     count == 1 ? "" : "s"));
+    for (i = 0; i < count; i++)
+        write_encoded_word(text, words[i]);
+    return 1;
+}
+
+/*
+ * doc_hover
+ * A label under the cursor is described by its kind and address;
+ * anywhere else on a statement, the statement's address and words are.
+ */
+int doc_hover(document *d, int line, int column, out_buffer *text) {
+    int name;
+    const doc_line *def = label_at(d, line, column, &name);
+    const doc_line *l;
+    char description[MAX_LABEL_LENGTH + 64];
+
+    if (line < 0 || line >= d->count) return 0;
+    layout(d);
+    if (def) {
+        if (def->label != name)
+            out_append(text, description, sprintf(description, "%.*s: external label\n",
+                                                  MAX_LABEL_LENGTH, name_text(&file_names, name)));
+        else
+            out_append(text, description, sprintf(description, "%.*s: %s label, address %04d\n",
+                                                  MAX_LABEL_LENGTH, name_text(&file_names, name),
+                                                  def->summary.kind == LINE_DATA ? "data" : "code",
+                                                  label_address(d, def, name)));
+        return 1;
+    }
+
+    l = d->lines[line];
+    if (l->role == ROLE_MACRO_CALL) {
+        out_append(text, description, sprintf(description, "macro call, address %04d\n", l->address));
+        return 1;
+    }
+    if (l->role != ROLE_STATEMENT) return 0;
+    return append_encoding(d, l, text);
+}
+
+void doc_close(document *d) {
+    int k;
+
+    for (k = 0; k < d->count; k++)
+        free_line(d->lines[k]);
+    for (k = 0; k < d->name_capacity; k++)
+        free(d->names[k].lines);
+    free(d->lines);
+    free(d->names);
+    free(d->dirty);
+    free(d->diagnostics);
+    arena_free(&d->messages);
+    free(d);
+}
@@ -0,0 +1,89 @@
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include "data_struct.h"
+#include "output.h"
+
+/*
+ * Incremental analysis of a source file being edited (the --lsp option):
+ * - A document is kept as lines. Each line remembers what the assembler
+ *   learns from it on its own: its role (statement, macro definition,
+ *   macro call...), its first pass summary (scan_line()), its own error
+ *   (scan_line() or instruction_error()) and the names it defines and
+ *   references.
+ * - A change replaces a range of text. Only the lines of the range are
+ *   parsed again, together with the lines whose role it changes (a
+ *   mcro/endmcro line moves the lines after it in or out of a macro
+ *   body). The names those lines define or reference are marked, and
+ *   only the lines that define or reference a marked name are checked
+ *   again for undefined and duplicate labels.
+ * - Addresses are only laid out when they are asked for (hover and
+ *   go-to-label), in one pass over the stored summaries.
+ * - The text is analyzed before macro expansion, the way it is edited:
+ *   a macro body is checked where it is defined, and its labels are not
+ *   defined at the call sites. Conditionals and includes are not
+ *   followed; every line counts as enabled.
+ * - Columns are byte offsets in the line.
+ */
+
+typedef struct document document;
+
+/* A problem found in a document */
+typedef struct doc_diagnostic {
+    int line;             /* 0-based line */
+    int start;            /* Columns of the text it is about */
+    int end;
+    const char *message;
+} doc_diagnostic;
+
+/*
+ * Opens a document and analyzes its whole text. shared_macros (may be
+ * NULL) are the library macros, which calls may use as well.
+ * Returns the document, or NULL if memory is exhausted.
+ */
+document *doc_open(const char *text, long length, node *shared_macros);
+
+/*
+ * Replaces the text between two positions (the end is exclusive) with
+ * length bytes of text, and updates the analysis. Positions past the
+ * end of a line or of the document are clamped.
+ * Returns 1 on success, 0 if memory is exhausted (the document is left
+ * as it was).
+ */
+int doc_change(document *d, int start_line, int start_column, int end_line, int end_column,
+               const char *text, long length);
+
+/*
+ * Returns the number of lines of a document.
+ */
+int doc_line_count(const document *d);
+
+/*
+ * Lists every diagnostic of the document, in line order, in *list. The
+ * list stays valid until the document changes.
+ * Returns the number of diagnostics.
+ */
+int doc_diagnostics(document *d, const doc_diagnostic **list);
+
+/*
+ * Finds where the label named at a position is defined (its label, or
+ * its .extern declaration).
+ * Returns 1 and the line and columns of the definition, or 0 if there is
+ * no defined name at the position.
+ */
+int doc_definition(document *d, int line, int column, int *def_line, int *def_start, int *def_end);
+
+/*
+ * Describes what is at a position: a label's address, or the address
+ * and encoding (as the .ob file holds it) of the statement on the line.
+ * Returns 1 with the description appended to text, 0 if there is nothing
+ * to describe.
+ */
+int doc_hover(document *d, int line, int column, out_buffer *text);
+
+/*
+ * Frees a document.
+ */
+void doc_close(document *d);
+
+#endif /* ANALYSIS_H */
@@ -0,0 +1,88 @@
+/* arena.c - Region allocator with O(1) reset */
+
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+/* Usable bytes of an ordinary page (larger requests get a page of their own size) */
+#define ARENA_PAGE_SIZE 16384
+
+/* Strictest alignment any allocation may need */
+typedef union arena_align {
+    long l;
+    double d;
+    void *p;
+} arena_align;
+
+#define ALIGN_UP(n) (((n) + sizeof(arena_align) - 1) / sizeof(arena_align) * sizeof(arena_align))
+
+typedef struct arena_page {
+    struct arena_page *next;
+    size_t size;   /* Usable bytes after the header */
+    size_t used;   /* Bytes handed out (only meaningful up to the current page) */
+} arena_page;
+
+/* Page header size, rounded so the data that follows is aligned */
+#define PAGE_HEADER ALIGN_UP(sizeof(arena_page))
+
+arena file_arena = { NULL, NULL };
+arena batch_arena = { NULL, NULL };
+
+/*
+ * arena_alloc
+ * Serves the request from the current page. When it does not fit, the
+ * next page kept from before the last reset is reused (it is empty
+ * again), and only past the last page is a new one allocated.
+ */
+void *arena_alloc(arena *a, size_t size) {
+    arena_page *p = a->current;
+    void *mem;
+
+    size = ALIGN_UP(size ? size : 1);
+    while (!p || p->used + size > p->size) {
+        if (p && p->next) {
+            p = p->next;
+            p->used = 0;
+            continue;
+        }
+        {
+            size_t page_size = size > ARENA_PAGE_SIZE ? size : ARENA_PAGE_SIZE;
+            arena_page *np = malloc(PAGE_HEADER + page_size);
+            if (!np) return NULL;
+            np->next = NULL;
+            np->size = page_size;
+            np->used = 0;
+            if (p) p->next = np;
+            else a->pages = np;
+            p = np;
+        }
+    }
+    a->current = p;
+
+    mem = (char *)p + PAGE_HEADER + p->used;
+    p->used += size;
+    return mem;
+}
+
+char *arena_strndup(arena *a, const char *text, size_t length) {
+    char *copy = arena_alloc(a, length + 1);
+    if (!copy) return NULL;
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+/* Rewinds to the first page; the others are emptied when reached again. */
+void arena_reset(arena *a) {
+    a->current = a->pages;
+    if (a->current) a->current->used = 0;
+}
+
+void arena_free(arena *a) {
+    while (a->pages) {
+        arena_page *p = a->pages;
+        a->pages = p->next;
+        free(p);
+    }
+    a->current = NULL;
+}
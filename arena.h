@@ -0,0 +1,51 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+struct arena_page;
+
+/*
+ * Region allocator:
+ * - Memory is handed out from large pages and never freed piecemeal;
+ *   arena_reset() releases everything at once in O(1) and keeps the
+ *   pages, so the next file of a batch reuses them.
+ * - file_arena holds what belongs to the file being assembled (symbols,
+ *   its macros, macro call records, file names) and is reset after
+ *   every file; batch_arena holds what lives for the whole run (the
+ *   library macros, names shared by the files).
+ */
+typedef struct arena {
+    struct arena_page *pages;     /* Every page, in allocation order */
+    struct arena_page *current;   /* Page allocations are served from */
+} arena;
+
+/* Memory of the file being assembled */
+extern arena file_arena;
+
+/* Memory that stays valid for the whole run */
+extern arena batch_arena;
+
+/*
+ * Allocates size bytes, aligned for any type.
+ * Returns NULL if memory is exhausted.
+ */
+void *arena_alloc(arena *a, size_t size);
+
+/*
+ * Copies length characters of text into the arena and NUL terminates them.
+ * Returns NULL if memory is exhausted.
+ */
+char *arena_strndup(arena *a, const char *text, size_t length);
+
+/*
+ * Releases every allocation of the arena at once; its pages are kept.
+ */
+void arena_reset(arena *a);
+
+/*
+ * Returns all pages of the arena to the system.
+ */
+void arena_free(arena *a);
+
+#endif /* ARENA_H */
@@ -0,0 +1,772 @@
+/* async_io.c - Read-ahead and background writes (io_uring or a thread pool)
+ *
+ * Every transfer is an io_request. Reads are kept in request order until
+ * io_load() claims them; writes are kept in request order until they are
+ * retired, i.e. renamed into place (or reported as failed), so a path
+ * written twice always ends up with the later contents.
+ *
+ * With io_uring the files are opened on the calling thread and the
+ * transfers are queued on the submission ring, which is handed to the
+ * kernel in batches (URING_BATCH requests, or io_submit()). With the
+ * thread pool each request is performed by a worker of its stage with
+ * blocking calls, and the read stage also scans the lines of what it read.
+ */
+
+#if defined(__linux__)
+#define _GNU_SOURCE            /* syscall() */
+#elif defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#define ASYNC_IO_POSIX
+#endif
+
+#if defined(__linux__) && defined(HAVE_IO_URING) && defined(__GNUC__)
+#define ASYNC_IO_URING
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "async_io.h"
+#include "scanner.h"
+
+#ifdef ASYNC_IO_POSIX
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef ASYNC_IO_URING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+/* Request kinds */
+#define IO_READ  0
+#define IO_WRITE 1
+
+/* Request states */
+#define IO_PENDING 0
+#define IO_DONE    1
+#define IO_FAILED  2
+
+/* Writes allowed in flight before the oldest one is waited for */
+#define MAX_PENDING_WRITES 64
+
+/* Largest single transfer (longer ones are split) */
+#define MAX_TRANSFER (1L << 30)
+
+typedef struct io_request {
+    int kind;
+    int status;            /* With the thread pool, guarded by pool_lock */
+    char *path;
+    char *temp;            /* Writes: the temporary file */
+    char *data;
+    long length;
+    long done;             /* Bytes transferred so far */
+    int fd;
+    line_index index;      /* Reads: the lines, if scanned by the read stage */
+    int scanned;
+    struct io_request *next;       /* Next read or write, in request order */
+    struct io_request *next_job;   /* Next job of the thread pool */
+} io_request;
+
+static int backend = IO_BACKEND_NONE;
+
+static io_request *reads = NULL;
+static io_request **reads_tail = &reads;
+static io_request *writes = NULL;
+static io_request **writes_tail = &writes;
+static int pending_writes = 0;
+static int failed_writes = 0;
+static int completed_writes = 0;   /* Renamed into place (io_written()) */
+
+/* ---------------- Blocking transfers ---------------- */
+
+/*
+ * Opens the file of a request; a read also gets a buffer for the whole
+ * file. Returns 1 on success, 0 on failure.
+ */
+static int open_request(io_request *r) {
+    if (r->kind == IO_READ) {
+        struct stat st;
+        r->fd = open(r->path, O_RDONLY);
+        if (r->fd < 0) return 0;
+        if (fstat(r->fd, &st) != 0 || st.st_size < 0 ||
+            !(r->data = malloc((size_t)st.st_size + 1))) {
+            close(r->fd);
+            r->fd = -1;
+            return 0;
+        }
+        r->length = (long)st.st_size;
+    } else {
+        r->fd = open(r->temp, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (r->fd < 0) return 0;
+    }
+    return 1;
+}
+
+/*
+ * Closes the file of a finished request and NUL terminates a read.
+ * Returns the request's final state.
+ */
+static int finish_request(io_request *r, int ok) {
+    if (r->fd >= 0 && close(r->fd) != 0 && r->kind == IO_WRITE) ok = 0;
+    r->fd = -1;
+    if (ok && r->kind == IO_READ) {
+        r->length = r->done;
+        r->data[r->done] = '\0';
+    }
+    return ok ? IO_DONE : IO_FAILED;
+}
+
+/*
+ * Performs (the rest of) a request with blocking calls.
+ * Returns the request's final state.
+ */
+static int transfer_sync(io_request *r) {
+    int ok = r->fd >= 0 || open_request(r);
+
+    while (ok && r->done < r->length) {
+        long want = r->length - r->done;
+        ssize_t n;
+        if (want > MAX_TRANSFER) want = MAX_TRANSFER;
+        if (r->kind == IO_READ)
+            n = read(r->fd, r->data + r->done, (size_t)want);
+        else
+            n = write(r->fd, r->data + r->done, (size_t)want);
+        if (n < 0 && errno == EINTR) continue;
+        if (n == 0 && r->kind == IO_READ) break;   /* File got shorter */
+        if (n <= 0) ok = 0;
+        else r->done += (long)n;
+    }
+    return finish_request(r, ok);
+}
+
+/* ---------------- Thread pool backend ---------------- */
+
+/*
+ * The pool is split into two I/O stages, each with its own workers
+ * and job queue: the read stage loads upcoming sources and scans their
+ * lines, the write stage writes finished outputs. Both overlap with the
+ * assembler, which runs on the calling thread.
+ */
+typedef struct io_stage {
+    pthread_t workers[IO_MAX_STAGE_THREADS];
+    int worker_count;
+    pthread_cond_t job_ready;
+    io_request *jobs;            /* Queue of the stage, guarded by pool_lock */
+    io_request **jobs_tail;
+} io_stage;
+
+static io_stage stages[2];     /* Indexed by request kind */
+static int stage_threads[2] = { IO_STAGE_THREADS, IO_STAGE_THREADS };   /* Workers to start */
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_done = PTHREAD_COND_INITIALIZER;
+static int stopping = 0;
+
+/* Worker of a stage: performs its queued requests until the pool is stopped. */
+static void *worker_main(void *arg) {
+    io_stage *stage = arg;
+
+    pthread_mutex_lock(&pool_lock);
+    while (1) {
+        io_request *r;
+        int status;
+
+        while (!stage->jobs && !stopping)
+            pthread_cond_wait(&stage->job_ready, &pool_lock);
+        if (!stage->jobs) break;
+        r = stage->jobs;
+        stage->jobs = r->next_job;
+        if (!stage->jobs) stage->jobs_tail = &stage->jobs;
+        pthread_mutex_unlock(&pool_lock);
+
+        status = transfer_sync(r);
+        if (status == IO_DONE && r->kind == IO_READ)
+            r->scanned = scan_lines(r->data, r->length, &r->index);
+
+        pthread_mutex_lock(&pool_lock);
+        r->status = status;
+        pthread_cond_broadcast(&job_done);
+    }
+    pthread_mutex_unlock(&pool_lock);
+    return NULL;
+}
+
+static void pool_stop(void);
+
+/* Starts the workers of both stages. Returns 1 if each stage has one running. */
+static int pool_start(void) {
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        io_stage *stage = &stages[i];
+        pthread_cond_init(&stage->job_ready, NULL);
+        stage->jobs = NULL;
+        stage->jobs_tail = &stage->jobs;
+        stage->worker_count = 0;
+    }
+    for (i = 0; i < 2; i++) {
+        io_stage *stage = &stages[i];
+        while (stage->worker_count < stage_threads[i] &&
+               pthread_create(&stage->workers[stage->worker_count], NULL, worker_main, stage) == 0)
+            stage->worker_count++;
+    }
+    if (stages[IO_READ].worker_count == 0 || stages[IO_WRITE].worker_count == 0) {
+        pool_stop();
+        return 0;
+    }
+    return 1;
+}
+
+static void pool_submit(io_request *r) {
+    io_stage *stage = &stages[r->kind];
+
+    pthread_mutex_lock(&pool_lock);
+    r->next_job = NULL;
+    *stage->jobs_tail = r;
+    stage->jobs_tail = &r->next_job;
+    pthread_cond_signal(&stage->job_ready);
+    pthread_mutex_unlock(&pool_lock);
+}
+
+/* Lets the workers finish the queued jobs, then joins them. */
+static void pool_stop(void) {
+    int i, j;
+
+    pthread_mutex_lock(&pool_lock);
+    stopping = 1;
+    for (i = 0; i < 2; i++)
+        pthread_cond_broadcast(&stages[i].job_ready);
+    pthread_mutex_unlock(&pool_lock);
+    for (i = 0; i < 2; i++) {
+        for (j = 0; j < stages[i].worker_count; j++)
+            pthread_join(stages[i].workers[j], NULL);
+        stages[i].worker_count = 0;
+        pthread_cond_destroy(&stages[i].job_ready);
+    }
+    stopping = 0;
+}
+
+/* ---------------- io_uring backend ---------------- */
+
+#ifdef ASYNC_IO_URING
+
+/* Submission ring size and the number of requests per io_uring_enter() */
+#define URING_ENTRIES 64
+#define URING_BATCH   16
+
+/* The rings shared with the kernel */
+typedef struct uring {
+    int fd;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    unsigned sq_entries;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring, *cq_ring;
+    size_t sq_size, cq_size, sqes_size;
+    unsigned unsubmitted;    /* Queued on the ring, not yet handed to the kernel */
+} uring;
+
+static uring ring;
+
+/* Returns 1 if the kernel supports IORING_OP_READ and IORING_OP_WRITE. */
+static int uring_supports_rw(int fd) {
+    size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, size);
+    int ok;
+
+    if (!probe) return 0;
+    ok = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) == 0 &&
+         probe->last_op >= IORING_OP_WRITE &&
+         (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED) &&
+         (probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED);
+    free(probe);
+    return ok;
+}
+
+/* Sets up the ring. Returns 1 on success, 0 if io_uring is unavailable. */
+static int uring_start(void) {
+    struct io_uring_params p;
+    int single;
+
+    memset(&p, 0, sizeof(p));
+    ring.fd = (int)syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+    if (ring.fd < 0) return 0;
+    if (!uring_supports_rw(ring.fd)) {
+        close(ring.fd);
+        return 0;
+    }
+
+    ring.sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring.cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single) {
+        if (ring.cq_size > ring.sq_size) ring.sq_size = ring.cq_size;
+        ring.cq_size = ring.sq_size;
+    }
+    ring.sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    ring.sq_ring = mmap(NULL, ring.sq_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                        ring.fd, IORING_OFF_SQ_RING);
+    ring.cq_ring = single ? ring.sq_ring
+                 : mmap(NULL, ring.cq_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                        ring.fd, IORING_OFF_CQ_RING);
+    ring.sqes = mmap(NULL, ring.sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                     ring.fd, IORING_OFF_SQES);
+    if (ring.sq_ring == MAP_FAILED || ring.cq_ring == MAP_FAILED || ring.sqes == MAP_FAILED) {
+        if (ring.sq_ring != MAP_FAILED) munmap(ring.sq_ring, ring.sq_size);
+        if (!single && ring.cq_ring != MAP_FAILED) munmap(ring.cq_ring, ring.cq_size);
+        if (ring.sqes != MAP_FAILED) munmap(ring.sqes, ring.sqes_size);
+        close(ring.fd);
+        return 0;
+    }
+
+    ring.sq_head = (unsigned *)((char *)ring.sq_ring + p.sq_off.head);
+    ring.sq_tail = (unsigned *)((char *)ring.sq_ring + p.sq_off.tail);
+    ring.sq_mask = (unsigned *)((char *)ring.sq_ring + p.sq_off.ring_mask);
+    ring.sq_array = (unsigned *)((char *)ring.sq_ring + p.sq_off.array);
+    ring.cq_head = (unsigned *)((char *)ring.cq_ring + p.cq_off.head);
+    ring.cq_tail = (unsigned *)((char *)ring.cq_ring + p.cq_off.tail);
+    ring.cq_mask = (unsigned *)((char *)ring.cq_ring + p.cq_off.ring_mask);
+    ring.cqes = (struct io_uring_cqe *)((char *)ring.cq_ring + p.cq_off.cqes);
+    ring.sq_entries = p.sq_entries;
+    ring.unsubmitted = 0;
+    return 1;
+}
+
+static void uring_stop(void) {
+    munmap(ring.sqes, ring.sqes_size);
+    if (ring.cq_ring != ring.sq_ring) munmap(ring.cq_ring, ring.cq_size);
+    munmap(ring.sq_ring, ring.sq_size);
+    close(ring.fd);
+}
+
+/*
+ * Puts the rest of a request on the submission ring.
+ * Returns 0 if the ring is full.
+ */
+static int uring_queue(io_request *r) {
+    unsigned tail = *ring.sq_tail;
+    unsigned head = __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE);
+    unsigned index;
+    long want = r->length - r->done;
+    struct io_uring_sqe *sqe;
+
+    if (tail - head >= ring.sq_entries) return 0;
+    if (want > MAX_TRANSFER) want = MAX_TRANSFER;
+
+    index = tail & *ring.sq_mask;
+    sqe = &ring.sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = r->kind == IO_READ ? IORING_OP_READ : IORING_OP_WRITE;
+    sqe->fd = r->fd;
+    sqe->addr = (unsigned long)(r->data + r->done);
+    sqe->len = (unsigned)want;
+    sqe->off = (unsigned long)r->done;
+    sqe->user_data = (unsigned long)r;
+    ring.sq_array[index] = index;
+    __atomic_store_n(ring.sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring.unsubmitted++;
+    return 1;
+}
+
+/* Hands the queued requests to the kernel; with wait, also waits for a completion. */
+static void uring_enter(int wait) {
+    long ret;
+
+    if (!ring.unsubmitted && !wait) return;
+    do {
+        ret = syscall(__NR_io_uring_enter, ring.fd, ring.unsubmitted, wait ? 1 : 0,
+                      wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    } while (ret < 0 && errno == EINTR);
+    if (ret > 0) ring.unsubmitted -= (unsigned)ret;
+}
+
+/* Handles one completion: a short transfer is continued, errors are retried blocking. */
+static void uring_complete(io_request *r, int res) {
+    if (res < 0) {
+        r->status = transfer_sync(r);
+    } else if (res == 0 && r->done < r->length) {
+        r->status = r->kind == IO_READ ? finish_request(r, 1) : transfer_sync(r);
+    } else {
+        r->done += res;
+        if (r->done >= r->length)
+            r->status = finish_request(r, 1);
+        else if (!uring_queue(r))
+            r->status = transfer_sync(r);
+    }
+}
+
+/* Processes every completion the kernel has posted. */
+static void uring_reap(void) {
+    unsigned head = *ring.cq_head;
+    unsigned tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+
+    while (head != tail) {
+        struct io_uring_cqe *cqe = &ring.cqes[head & *ring.cq_mask];
+        io_request *r = (io_request *)(unsigned long)cqe->user_data;
+        int res = cqe->res;
+
+        head++;
+        __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+        uring_complete(r, res);
+    }
+}
+
+#endif /* ASYNC_IO_URING */
+
+/* ---------------- Requests ---------------- */
+
+/* Allocates a request for path (and its temporary file for a write). */
+static io_request *new_request(int kind, const char *path) {
+    io_request *r = calloc(1, sizeof(io_request));
+    size_t length = strlen(path);
+
+    if (!r) return NULL;
+    r->kind = kind;
+    r->fd = -1;
+    r->path = malloc(length + 1);
+    if (r->path) strcpy(r->path, path);
+    if (kind == IO_WRITE) {
+        r->temp = malloc(length + sizeof(".tmp"));
+        if (r->temp) {
+            strcpy(r->temp, path);
+            strcat(r->temp, ".tmp");
+        }
+    }
+    if (!r->path || (kind == IO_WRITE && !r->temp)) {
+        free(r->path);
+        free(r);
+        return NULL;
+    }
+    return r;
+}
+
+static void free_request(io_request *r) {
+    if (r->scanned) free_line_index(&r->index);
+    free(r->path);
+    free(r->temp);
+    free(r->data);
+    free(r);
+}
+
+/* Hands a new request to the backend. */
+static void start_request(io_request *r) {
+    r->status = IO_PENDING;
+#ifdef ASYNC_IO_URING
+    if (backend == IO_BACKEND_URING) {
+        if (!open_request(r)) {
+            r->status = IO_FAILED;
+        } else if (r->length == 0) {
+            r->status = finish_request(r, 1);
+        } else {
+            if (!uring_queue(r)) {
+                uring_enter(0);
+                uring_reap();
+                if (!uring_queue(r)) r->status = transfer_sync(r);
+            }
+            if (ring.unsubmitted >= URING_BATCH) uring_enter(0);
+        }
+        return;
+    }
+#endif
+    pool_submit(r);
+}
+
+/* Returns the state of a request without waiting. */
+static int request_status(io_request *r) {
+    int status;
+#ifdef ASYNC_IO_URING
+    if (backend == IO_BACKEND_URING) {
+        uring_reap();
+        return r->status;
+    }
+#endif
+    pthread_mutex_lock(&pool_lock);
+    status = r->status;
+    pthread_mutex_unlock(&pool_lock);
+    return status;
+}
+
+/* Waits until a request is finished. */
+static void wait_request(io_request *r) {
+#ifdef ASYNC_IO_URING
+    if (backend == IO_BACKEND_URING) {
+        while (r->status == IO_PENDING) {
+            uring_enter(1);
+            uring_reap();
+        }
+        return;
+    }
+#endif
+    pthread_mutex_lock(&pool_lock);
+    while (r->status == IO_PENDING)
+        pthread_cond_wait(&job_done, &pool_lock);
+    pthread_mutex_unlock(&pool_lock);
+}
+
+/* Waits for the oldest write and renames it into place (or reports it). */
+static void retire_oldest_write(void) {
+    io_request *r = writes;
+
+    wait_request(r);
+    writes = r->next;
+    if (!writes) writes_tail = &writes;
+    pending_writes--;
+
+    if (r->status != IO_DONE || rename(r->temp, r->path) != 0) {
+        fprintf(stderr, "Error writing %s\n", r->path);
+        remove(r->temp);
+        failed_writes++;
+    } else {
+        completed_writes++;
+    }
+    free_request(r);
+}
+
+/* Retires the writes that are already finished, oldest first. */
+static void retire_finished_writes(void) {
+    while (writes && request_status(writes) != IO_PENDING)
+        retire_oldest_write();
+}
+
+/* ---------------- Public interface ---------------- */
+
+void io_set_stage_threads(int read_threads, int write_threads) {
+    if (backend != IO_BACKEND_NONE) return;
+    stage_threads[IO_READ] = read_threads < 1 ? 1 :
+                             read_threads > IO_MAX_STAGE_THREADS ? IO_MAX_STAGE_THREADS : read_threads;
+    stage_threads[IO_WRITE] = write_threads < 1 ? 1 :
+                              write_threads > IO_MAX_STAGE_THREADS ? IO_MAX_STAGE_THREADS : write_threads;
+}
+
+int io_start(int allow_uring) {
+    if (backend != IO_BACKEND_NONE) return backend;
+#ifdef ASYNC_IO_URING
+    if (allow_uring && uring_start()) {
+        backend = IO_BACKEND_URING;
+        return backend;
+    }
+#else
+    (void)allow_uring;
+#endif
+    if (pool_start()) backend = IO_BACKEND_THREADS;
+    return backend;
+}
+
+int io_backend(void) {
+    return backend;
+}
+
+void io_prefetch(const char *path) {
+    io_request *r;
+
+    /* Standard input is read once, when its turn comes */
+    if (backend == IO_BACKEND_NONE || strcmp(path, STDIN_NAME) == 0) return;
+    r = new_request(IO_READ, path);
+    if (!r) return;
+    *reads_tail = r;
+    reads_tail = &r->next;
+    start_request(r);
+}
+
+/* Loads a file with source_load() and scans it; nothing is kept on failure. */
+static int load_and_scan(source_text *src, line_index *index, const char *path) {
+    if (!source_load(src, path)) return 0;
+    if (!scan_lines(src->text, src->length, index)) {
+        source_free(src);
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * io_load_lines
+ * Claims the oldest read-ahead of path; the buffer becomes the source
+ * text (released by source_free() like a copied file) and the read
+ * stage's line index, if it made one, is handed over too.
+ */
+int io_load_lines(source_text *src, line_index *index, const char *path) {
+    io_request **link = &reads;
+    io_request *r;
+
+    while (*link && strcmp((*link)->path, path) != 0)
+        link = &(*link)->next;
+    if (!*link) return load_and_scan(src, index, path);
+
+    r = *link;
+    *link = r->next;
+    if (!*link) reads_tail = link;
+    wait_request(r);
+
+    if (r->status == IO_DONE) {
+        src->text = r->data;
+        src->length = r->length;
+        src->mapped = 0;
+        r->data = NULL;
+        if (r->scanned) {
+            *index = r->index;
+            r->scanned = 0;
+        } else if (!scan_lines(src->text, src->length, index)) {
+            source_free(src);
+            free_request(r);
+            return 0;
+        }
+        free_request(r);
+        return 1;
+    }
+    free_request(r);
+    return load_and_scan(src, index, path);
+}
+
+int io_write(const char *path, const char *data, long length) {
+    io_request *r;
+
+    io_settle(path);
+    if (pending_writes >= MAX_PENDING_WRITES)
+        retire_oldest_write();
+
+    r = new_request(IO_WRITE, path);
+    if (!r) return 0;
+    r->data = malloc(length > 0 ? (size_t)length : 1);
+    if (!r->data) {
+        free_request(r);
+        return 0;
+    }
+    memcpy(r->data, data, (size_t)length);
+    r->length = length;
+
+    *writes_tail = r;
+    writes_tail = &r->next;
+    pending_writes++;
+    start_request(r);
+    return 1;
+}
+
+/*
+ * io_settle
+ * Writes are renamed in request order, so every write up to the last
+ * one to path is retired.
+ */
+void io_settle(const char *path) {
+    io_request *r, *last = NULL;
+
+    for (r = writes; r; r = r->next)
+        if (strcmp(r->path, path) == 0) last = r;
+    while (last) {
+        int was_last = writes == last;
+        retire_oldest_write();
+        if (was_last) break;
+    }
+}
+
+void io_submit(void) {
+#ifdef ASYNC_IO_URING
+    if (backend == IO_BACKEND_URING) {
+        uring_enter(0);
+        uring_reap();
+    }
+#endif
+    if (backend != IO_BACKEND_NONE)
+        retire_finished_writes();
+}
+
+int io_flush(void) {
+    int failed;
+
+    if (backend == IO_BACKEND_NONE) return 0;
+    io_submit();
+    while (writes)
+        retire_oldest_write();
+    failed = failed_writes;
+    failed_writes = 0;
+    return failed;
+}
+
+int io_written(void) {
+    return completed_writes;
+}
+
+void io_stop(void) {
+    if (backend == IO_BACKEND_NONE) return;
+    io_flush();
+    while (reads) {
+        io_request *r = reads;
+        wait_request(r);
+        reads = r->next;
+        free_request(r);
+    }
+    reads_tail = &reads;
+#ifdef ASYNC_IO_URING
+    if (backend == IO_BACKEND_URING)
+        uring_stop();
+    else
+#endif
+        pool_stop();
+    backend = IO_BACKEND_NONE;
+}
+
+#else /* !ASYNC_IO_POSIX: no asynchronous I/O, callers stay synchronous */
+
+void io_set_stage_threads(int read_threads, int write_threads) {
+    (void)read_threads;
+    (void)write_threads;
+}
+
+int io_start(int allow_uring) {
+    (void)allow_uring;
+    return IO_BACKEND_NONE;
+}
+
+int io_backend(void) {
+    return IO_BACKEND_NONE;
+}
+
+void io_prefetch(const char *path) {
+    (void)path;
+}
+
+int io_load_lines(source_text *src, line_index *index, const char *path) {
+    if (!source_load(src, path)) return 0;
+    if (!scan_lines(src->text, src->length, index)) {
+        source_free(src);
+        return 0;
+    }
+    return 1;
+}
+
+int io_write(const char *path, const char *data, long length) {
+    (void)path;
+    (void)data;
+    (void)length;
+    return 0;
+}
+
+void io_settle(const char *path) {
+    (void)path;
+}
+
+void io_submit(void) {
+}
+
+int io_flush(void) {
+    return 0;
+}
+
+int io_written(void) {
+    return 0;
+}
+
+void io_stop(void) {
+}
+
+#endif /* ASYNC_IO_POSIX */
@@ -0,0 +1,115 @@
+#ifndef ASYNC_IO_H
+#define ASYNC_IO_H
+
+#include "source.h"
+#include "scanner.h"
+
+/*
+ * Asynchronous file I/O for batch runs (the --async-io option):
+ * - Upcoming source files are read ahead (io_prefetch()) while the
+ *   current one is assembled; io_load_lines() then hands over the
+ *   contents and their line index.
+ * - Output files are written in the background (io_write()): the data
+ *   goes to a temporary file and is renamed over the final name once
+ *   written, in the order the writes were requested.
+ * - On Linux the requests are batched into an io_uring; where io_uring
+ *   is not available (or --io-threads asks for threads) a pool of threads
+ *   performs them instead. The pool has two stages: a read stage, which
+ *   also scans the lines of each source, and a write stage, each with
+ *   its own worker threads. Only the I/O overlaps: macro expansion and
+ *   both passes still run one file at a time on the calling thread.
+ *   Without either backend, io_start() fails and the caller stays
+ *   synchronous.
+ * - Memory stays bounded: at most IO_PREFETCH_AHEAD sources are read
+ *   ahead and at most 64 writes are in flight.
+ */
+
+/* I/O backends */
+#define IO_BACKEND_NONE    0   /* Synchronous I/O (io_start() not called or failed) */
+#define IO_BACKEND_URING   1
+#define IO_BACKEND_THREADS 2
+
+/* Number of source files read ahead of the one being assembled */
+#define IO_PREFETCH_AHEAD 4
+
+/* Worker threads per stage of the thread pool: default and maximum */
+#define IO_STAGE_THREADS     2
+#define IO_MAX_STAGE_THREADS 16
+
+/*
+ * Sets the worker threads of the read and write stages of the thread
+ * pool (each clamped to 1..IO_MAX_STAGE_THREADS). Must be called before
+ * io_start(); the io_uring backend has no workers and ignores it.
+ */
+void io_set_stage_threads(int read_threads, int write_threads);
+
+/*
+ * Starts the I/O layer.
+ *
+ * Parameters:
+ *   allow_uring - 0 to skip io_uring and use the thread pool directly
+ *
+ * Returns:
+ *   The backend in use, or IO_BACKEND_NONE if none could be started.
+ */
+int io_start(int allow_uring);
+
+/*
+ * Returns the backend in use (IO_BACKEND_NONE when inactive).
+ */
+int io_backend(void);
+
+/*
+ * Starts reading a whole file in the background. A later io_load() of
+ * the same path picks up the result.
+ */
+void io_prefetch(const char *path);
+
+/*
+ * Loads a source and its line index (as scan_lines() builds it), taking
+ * the contents read by an earlier io_prefetch() of the same path
+ * (waiting for it if needed) and the index its read stage made. Falls
+ * back to source_load() when the file was not prefetched or the read
+ * failed. Release with source_free() and free_line_index().
+ * Returns 1 on success, 0 if the file cannot be read or scanned.
+ */
+int io_load_lines(source_text *src, line_index *index, const char *path);
+
+/*
+ * Queues a write of length bytes of data (copied) to path, through a
+ * temporary file and a rename. Errors are reported when the write is
+ * retired (see io_flush()).
+ * Returns 1 if the write was queued, 0 on allocation failure.
+ */
+int io_write(const char *path, const char *data, long length);
+
+/*
+ * Waits for every queued write to path, so the file can be read,
+ * compared or removed.
+ */
+void io_settle(const char *path);
+
+/*
+ * Sends every request prepared so far to the backend in one batch.
+ */
+void io_submit(void);
+
+/*
+ * Waits for all queued writes and renames them into place.
+ * Returns the number of writes that failed.
+ */
+int io_flush(void);
+
+/*
+ * Returns the number of writes renamed into place so far. A queued write
+ * only counts once it has been retired, so call io_flush() first for an
+ * exact total.
+ */
+int io_written(void);
+
+/*
+ * Flushes the writes, frees any unused read-ahead and stops the backend.
+ */
+void io_stop(void);
+
+#endif /* ASYNC_IO_H */
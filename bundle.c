@@ -0,0 +1,263 @@
+/* bundle.c - Single file archive of a run's outputs */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bundle.h"
+
+#define BUNDLE_MAGIC   "MMN14PAK"
+#define TRAILER_MAGIC  "TOC1"
+#define HEADER_SIZE    8
+#define TRAILER_SIZE   16
+#define ENTRY_SIZE     18   /* Offset, length, name length (name follows) */
+#define MAX_NAME       0xFFFF
+
+/* Stores n as a little endian number of size bytes. */
+static void put_number(unsigned char *p, unsigned long n, int size) {
+    int i;
+    for (i = 0; i < size; i++) {
+        p[i] = (unsigned char)(n & 0xFF);
+        n >>= 8;
+    }
+}
+
+/* Reads a little endian number of size bytes. */
+static unsigned long get_number(const unsigned char *p, int size) {
+    unsigned long n = 0;
+    int i;
+    for (i = size - 1; i >= 0; i--)
+        n = (n << 8) | p[i];
+    return n;
+}
+
+/* Writes length bytes and advances the position; marks the writer failed on error. */
+static int write_bytes(bundle_writer *b, const void *data, unsigned long length) {
+    if (b->failed) return 0;
+    if (length && fwrite(data, 1, length, b->fp) != length) {
+        b->failed = 1;
+        return 0;
+    }
+    b->position += length;
+    return 1;
+}
+
+int bundle_create(bundle_writer *b, const char *path) {
+    b->members = NULL;
+    b->count = 0;
+    b->capacity = 0;
+    b->position = 0;
+    b->failed = 0;
+    b->fp = fopen(path, "wb");
+    if (!b->fp) return 0;
+    return write_bytes(b, BUNDLE_MAGIC, HEADER_SIZE);
+}
+
+/*
+ * bundle_add
+ * Appends the contents right away and remembers the member for the table
+ * of contents.
+ */
+int bundle_add(bundle_writer *b, const char *name, const char *data, unsigned long length) {
+    bundle_member *m;
+    char *copy;
+    size_t name_length = strlen(name);
+
+    if (b->failed || name_length > MAX_NAME) return 0;
+    if (b->count == b->capacity) {
+        int capacity = b->capacity ? b->capacity * 2 : 64;
+        bundle_member *list = realloc(b->members, capacity * sizeof(bundle_member));
+        if (!list) return 0;
+        b->members = list;
+        b->capacity = capacity;
+    }
+    copy = malloc(name_length + 1);
+    if (!copy) return 0;
+    memcpy(copy, name, name_length + 1);
+
+    m = &b->members[b->count];
+    m->name = copy;
+    m->offset = b->position;
+    m->length = length;
+    if (!write_bytes(b, data, length)) {
+        free(copy);
+        return 0;
+    }
+    b->count++;
+    return 1;
+}
+
+/*
+ * bundle_close
+ * Appends the table of contents and the trailer, then releases the
+ * writer's memory.
+ */
+int bundle_close(bundle_writer *b) {
+    unsigned char entry[ENTRY_SIZE];
+    unsigned char trailer[TRAILER_SIZE];
+    unsigned long toc_offset = b->position;
+    int i, ok;
+
+    for (i = 0; i < b->count; i++) {
+        size_t name_length = strlen(b->members[i].name);
+        put_number(entry, b->members[i].offset, 8);
+        put_number(entry + 8, b->members[i].length, 8);
+        put_number(entry + 16, (unsigned long)name_length, 2);
+        write_bytes(b, entry, ENTRY_SIZE);
+        write_bytes(b, b->members[i].name, name_length);
+    }
+    put_number(trailer, toc_offset, 8);
+    put_number(trailer + 8, (unsigned long)b->count, 4);
+    memcpy(trailer + 12, TRAILER_MAGIC, 4);
+    write_bytes(b, trailer, TRAILER_SIZE);
+
+    ok = !b->failed;
+    if (fclose(b->fp) != 0) ok = 0;
+    b->fp = NULL;
+
+    for (i = 0; i < b->count; i++)
+        free((char *)b->members[i].name);
+    free(b->members);
+    b->members = NULL;
+    b->count = b->capacity = 0;
+    return ok;
+}
+
+/* qsort order: name, then archive order */
+static int compare_members(const void *a, const void *b) {
+    const bundle_member *x = *(const bundle_member * const *)a;
+    const bundle_member *y = *(const bundle_member * const *)b;
+    int c = strcmp(x->name, y->name);
+    if (c != 0) return c;
+    return x < y ? -1 : x > y;
+}
+
+/*
+ * Parses a table of contents of toc_length bytes into r.
+ * Returns 1 on success, 0 if the table is malformed.
+ */
+static int parse_toc(bundle_reader *r, const unsigned char *toc, unsigned long toc_length,
+                     unsigned long toc_offset) {
+    unsigned long pos = 0;
+    char *name = r->names;
+    int i;
+
+    for (i = 0; i < r->count; i++) {
+        bundle_member *m = &r->members[i];
+        unsigned long name_length;
+
+        if (toc_length - pos < ENTRY_SIZE) return 0;
+        m->offset = get_number(toc + pos, 8);
+        m->length = get_number(toc + pos + 8, 8);
+        name_length = get_number(toc + pos + 16, 2);
+        pos += ENTRY_SIZE;
+        if (toc_length - pos < name_length) return 0;
+        if (m->offset < HEADER_SIZE || m->offset > toc_offset || m->length > toc_offset - m->offset)
+            return 0;
+
+        memcpy(name, toc + pos, name_length);
+        name[name_length] = '\0';
+        m->name = name;
+        name += name_length + 1;
+        pos += name_length;
+        r->sorted[i] = m;
+    }
+    return pos == toc_length;
+}
+
+/*
+ * bundle_open
+ * Checks the header and trailer, then reads the table of contents in one
+ * read and builds a sorted index of the member names.
+ */
+int bundle_open(bundle_reader *r, const char *path) {
+    unsigned char header[HEADER_SIZE];
+    unsigned char trailer[TRAILER_SIZE];
+    unsigned char *toc = NULL;
+    unsigned long toc_offset, toc_length;
+    long size;
+    int ok = 0;
+
+    r->members = NULL;
+    r->sorted = NULL;
+    r->names = NULL;
+    r->count = 0;
+    r->fp = fopen(path, "rb");
+    if (!r->fp) return 0;
+
+    if (fread(header, 1, HEADER_SIZE, r->fp) != HEADER_SIZE ||
+        memcmp(header, BUNDLE_MAGIC, HEADER_SIZE) != 0 ||
+        fseek(r->fp, 0L, SEEK_END) != 0 || (size = ftell(r->fp)) < HEADER_SIZE + TRAILER_SIZE ||
+        fseek(r->fp, size - TRAILER_SIZE, SEEK_SET) != 0 ||
+        fread(trailer, 1, TRAILER_SIZE, r->fp) != TRAILER_SIZE ||
+        memcmp(trailer + 12, TRAILER_MAGIC, 4) != 0) {
+        bundle_close_reader(r);
+        return 0;
+    }
+
+    toc_offset = get_number(trailer, 8);
+    r->count = (int)get_number(trailer + 8, 4);
+    if (toc_offset < HEADER_SIZE || toc_offset > (unsigned long)(size - TRAILER_SIZE) || r->count < 0) {
+        bundle_close_reader(r);
+        return 0;
+    }
+    toc_length = (unsigned long)(size - TRAILER_SIZE) - toc_offset;
+    if ((unsigned long)r->count > toc_length / ENTRY_SIZE) {
+        bundle_close_reader(r);
+        return 0;
+    }
+
+    toc = malloc(toc_length + 1);
+    r->members = malloc((r->count + 1) * sizeof(bundle_member));
+    r->sorted = malloc((r->count + 1) * sizeof(bundle_member *));
+    r->names = malloc(toc_length + r->count + 1);
+    if (toc && r->members && r->sorted && r->names &&
+        fseek(r->fp, (long)toc_offset, SEEK_SET) == 0 &&
+        fread(toc, 1, toc_length, r->fp) == toc_length &&
+        parse_toc(r, toc, toc_length, toc_offset)) {
+        qsort(r->sorted, r->count, sizeof(bundle_member *), compare_members);
+        ok = 1;
+    }
+    free(toc);
+    if (!ok) bundle_close_reader(r);
+    return ok;
+}
+
+/* Binary search for the last member with the given name. */
+const bundle_member *bundle_find(const bundle_reader *r, const char *name) {
+    int low = 0, high = r->count;   /* First entry with a name > name */
+
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (strcmp(r->sorted[mid]->name, name) <= 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    if (low > 0 && strcmp(r->sorted[low - 1]->name, name) == 0)
+        return r->sorted[low - 1];
+    return NULL;
+}
+
+char *bundle_read(const bundle_reader *r, const bundle_member *m) {
+    char *data = malloc(m->length + 1);
+    if (!data) return NULL;
+    if (fseek(r->fp, (long)m->offset, SEEK_SET) != 0 ||
+        fread(data, 1, m->length, r->fp) != m->length) {
+        free(data);
+        return NULL;
+    }
+    data[m->length] = '\0';
+    return data;
+}
+
+void bundle_close_reader(bundle_reader *r) {
+    if (r->fp) fclose(r->fp);
+    free(r->members);
+    free(r->sorted);
+    free(r->names);
+    r->fp = NULL;
+    r->members = NULL;
+    r->sorted = NULL;
+    r->names = NULL;
+    r->count = 0;
+}
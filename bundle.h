@@ -0,0 +1,90 @@
+#ifndef BUNDLE_H
+#define BUNDLE_H
+
+#include <stdio.h>
+
+/*
+ * Bundle archive (the --bundle option):
+ * - Every output of a run (.am, .ob, .ent, .ext) is appended to one file
+ *   instead of being created as a file of its own.
+ * - Layout: an 8 byte header ("MMN14PAK"), the members' contents back to
+ *   back, a table of contents and a 16 byte trailer. The table has one
+ *   entry per member: offset and length (8 bytes each), name length
+ *   (2 bytes) and the name. The trailer holds the offset of the table
+ *   (8 bytes), the member count (4 bytes) and "TOC1". All numbers are
+ *   little endian.
+ * - The archive is written strictly sequentially; the table is kept in
+ *   memory and written by bundle_close().
+ */
+
+/* One member of an archive */
+typedef struct bundle_member {
+    const char *name;       /* Output path, e.g. "prog.as.ob" */
+    unsigned long offset;   /* Start of the contents in the archive */
+    unsigned long length;
+} bundle_member;
+
+/* Archive being written */
+typedef struct bundle_writer {
+    FILE *fp;
+    unsigned long position;   /* Bytes written so far */
+    bundle_member *members;
+    int count;
+    int capacity;
+    int failed;               /* Set after a write error */
+} bundle_writer;
+
+/* Archive opened for reading */
+typedef struct bundle_reader {
+    FILE *fp;
+    bundle_member *members;   /* In archive order */
+    bundle_member **sorted;   /* Same members sorted by name, for lookups */
+    int count;
+    char *names;              /* Storage of the member names */
+} bundle_reader;
+
+/*
+ * Creates (or truncates) an archive and writes its header.
+ * Returns 1 on success, 0 if the file cannot be created.
+ */
+int bundle_create(bundle_writer *b, const char *path);
+
+/*
+ * Appends a member. A later member with the same name replaces an
+ * earlier one for readers.
+ * Returns 1 on success, 0 on a write or allocation error.
+ */
+int bundle_add(bundle_writer *b, const char *name, const char *data, unsigned long length);
+
+/*
+ * Writes the table of contents and closes the archive.
+ * Returns 1 if the whole archive was written, 0 otherwise.
+ */
+int bundle_close(bundle_writer *b);
+
+/*
+ * Opens an archive and loads its table of contents; the members'
+ * contents are only read on demand.
+ * Returns 1 on success, 0 if the file is missing or not an archive.
+ */
+int bundle_open(bundle_reader *r, const char *path);
+
+/*
+ * Returns the member with the given name (the last one added if the
+ * name occurs more than once), or NULL.
+ */
+const bundle_member *bundle_find(const bundle_reader *r, const char *name);
+
+/*
+ * Reads the contents of one member into a new NUL terminated buffer
+ * (release with free()).
+ * Returns NULL on a read or allocation error.
+ */
+char *bundle_read(const bundle_reader *r, const bundle_member *m);
+
+/*
+ * Closes an archive opened with bundle_open().
+ */
+void bundle_close_reader(bundle_reader *r);
+
+#endif /* BUNDLE_H */
@@ -1,316 +1,550 @@
-/* code_conversion.c
- * Converts assembly instructions to encoded machine words.
- * MMN14, ANSI C (C90) - supports matrix/indexed addressing.
- */
-
-#include <stdio.h>
-#include <string.h>
-#include <stdlib.h>
-#include <ctype.h>
-#include "globals.h"
-#include "table.h"
-#include "util.h"
-
-extern int inst_counter;
-extern int data_counter;
-extern int code_array[];
-extern int data_memory[];
-extern label_entry *symbol_table;
-extern int error_flag;
-extern FILE *ext_file;  /* For writing to .ext output file */
-
-#define ADDR_IMMEDIATE 0 /* #number */
-#define ADDR_DIRECT    1 /* label */
-#define ADDR_MATRIX    2 /* label[index][index] */
-#define ADDR_REGISTER  3 /* r0 - r7 */
-
-/* Safely store a word in code_array, with overflow protection */
-static int safe_store_code(int word, int line_num) {
-    if (inst_counter + 1 >= MAX_INSTRUCTIONS) {
-        printf("Error (line %d): instruction memory overflow (max = %d)\n", line_num, MAX_INSTRUCTIONS);
-        error_flag = 1;
-        return 0;
-    }
-
-    code_array[inst_counter] = word & 0x3FF; /* 10 bits only */
-    inst_counter++;
-    printf("DEBUG: Writing word for line %d, inst_counter now %d\n", line_num, inst_counter);
-    return 1;
-}
-
-
-
-
-/* Converts an opcode name to its numerical value. */
-static int get_opcode_value(const char *opcode) {
-    if (strcmp(opcode, "mov") == 0) return 0;
-    if (strcmp(opcode, "cmp") == 0) return 1;
-    if (strcmp(opcode, "add") == 0) return 2;
-    if (strcmp(opcode, "sub") == 0) return 3;
-    if (strcmp(opcode, "not") == 0) return 4;
-    if (strcmp(opcode, "clr") == 0) return 5;
-    if (strcmp(opcode, "lea") == 0) return 6;
-    if (strcmp(opcode, "inc") == 0) return 7;
-    if (strcmp(opcode, "dec") == 0) return 8;
-    if (strcmp(opcode, "jmp") == 0) return 9;
-    if (strcmp(opcode, "bne") == 0) return 10;
-    if (strcmp(opcode, "red") == 0) return 11;
-    if (strcmp(opcode, "prn") == 0) return 12;
-    if (strcmp(opcode, "jsr") == 0) return 13;
-    if (strcmp(opcode, "rts") == 0) return 14;
-    if (strcmp(opcode, "stop") == 0) return 15;
-    return -1;
-}
-
-static int get_register(const char *s) {
-    if (s[0] == '@') return -1;
-    if (strlen(s) == 2 && s[0] == 'r' && s[1] >= '0' && s[1] <= '7' && s[2] == '\0')
-        return s[1] - '0';
-    return -1;
-}
-
-static void trim(char *s) {
-    char *start = s, *end;
-    int len;
-    while (*start && isspace((unsigned char)*start)) start++;
-    if (start != s) memmove(s, start, strlen(start) + 1);
-    len = strlen(s);
-    if (len == 0) return;
-    end = s + len - 1;
-    while (end > s && isspace((unsigned char)*end)) {
-        *end = '\0';
-        end--;
-    }
-}
-
-static void parse_operands(const char *line, char *src, char *dst) {
-    const char *p = line;
-    char *comma;
-    src[0] = '\0';
-    dst[0] = '\0';
-
-    while (*p && isspace((unsigned char)*p)) p++;
-    while (*p && !isspace((unsigned char)*p)) p++;
-    while (*p && isspace((unsigned char)*p)) p++;
-    if (*p == '\0' || *p == '\n') return;
-
-    {
-        char operands[100], *first, *second;
-        strncpy(operands, p, 99);
-        operands[99] = '\0';
-        comma = strchr(operands, ',');
-        if (comma) {
-            *comma = '\0';
-            first = operands;
-            second = comma + 1;
-            while (*first && isspace((unsigned char)*first)) first++;
-            while (*second && isspace((unsigned char)*second)) second++;
-            strcpy(src, first);
-            strcpy(dst, second);
-        } else {
-            first = operands;
-            while (*first && isspace((unsigned char)*first)) first++;
-            strcpy(dst, first);
-            src[0] = '\0';
-        }
-        trim(src);
-        trim(dst);
-    }
-}
-
-/* Checks if operand is a matrix (label[reg][reg]), sets out_label, out_reg1, out_reg2 */
-static int is_matrix_operand(const char *operand, char *out_label, int *out_reg1, int *out_reg2) {
-    int len, r1 = -1, r2 = -1;
-    char label[MAX_LABEL_LENGTH+1];
-    const char *p = strchr(operand, '[');
-    if (!p) return 0; /* not a matrix */
-    len = p - operand;
-    if (len > MAX_LABEL_LENGTH) return 0;
-    strncpy(label, operand, len);
-    label[len] = '\0';
-    /* Strict match: [rX][rY] */
-    if (sscanf(p, "[r%d][r%d]", &r1, &r2) == 2 &&
-        r1 >= 0 && r1 <= 7 && r2 >= 0 && r2 <= 7) {
-        strcpy(out_label, label);
-        *out_reg1 = r1;
-        *out_reg2 = r2;
-        return 1;
-    }
-    return 0;
-}
-
-/* Determines addressing mode: immediate, direct, matrix, register */
-static int get_addressing(const char *operand) {
-    char label[MAX_LABEL_LENGTH+1];
-    int r1, r2;
-    if (operand[0] == '#') return ADDR_IMMEDIATE;
-    if (get_register(operand) != -1) return ADDR_REGISTER;
-    if (is_matrix_operand(operand, label, &r1, &r2)) return ADDR_MATRIX;
-    return ADDR_DIRECT;
-}
-
-/* Extract base label from operand (e.g. M1[r2][r7] -> M1) */
-static void extract_base_label(const char* operand, char* out_label) {
-    int i = 0;
-    while (operand[i] && operand[i] != '[' && i < MAX_LABEL_LENGTH) {
-        out_label[i] = operand[i];
-        i++;
-    }
-    out_label[i] = '\0';
-}
-
-void assemble_instruction(const char *line, const char *opcode, int line_num)
-{
-    int opcode_val;
-    int word;
-    char src[50], dst[50];
-    int src_addr = 0, dst_addr = 0;
-    int src_reg = 0, dst_reg = 0;
-    int src_num = 0, dst_num = 0;
-    int need_extra_src = 0, need_extra_dst = 0;
-    char label[MAX_LABEL_LENGTH+1];
-    int mreg1, mreg2;
-    label_entry *sym;
-    int val;
-
-    printf("assemble_instruction CALLED: '%s', opcode: '%s', line: %d\n", line, opcode, line_num);
-
-    opcode_val = get_opcode_value(opcode);
-    if (opcode_val == -1) {
-        printf("Error (line %d): Unknown opcode '%s'\n", line_num, opcode);
-        error_flag = 1;
-        return;
-    }
-
-    parse_operands(line, src, dst);
-
-    if ((src[0] == '@') || (dst[0] == '@')) {
-        printf("Error (line %d): Illegal register syntax: '%s' or '%s'\n", line_num, src, dst);
-        error_flag = 1;
-        return;
-    }
-
-    /* Source operand */
-    if (src[0]) {
-        src_addr = get_addressing(src);
-        if (src_addr == ADDR_IMMEDIATE) {
-            src_num = atoi(src + 1); /* skip '#' */
-            need_extra_src = 1;
-        } else if (src_addr == ADDR_REGISTER) {
-            src_reg = get_register(src);
-        } else if (src_addr == ADDR_MATRIX) {
-            need_extra_src = 3; /* label, r1, r2 */
-        } else {
-            need_extra_src = 1;
-        }
-    }
-    /* Destination operand */
-    if (dst[0]) {
-        dst_addr = get_addressing(dst);
-        if (dst_addr == ADDR_IMMEDIATE) {
-            dst_num = atoi(dst + 1);
-            need_extra_dst = 1;
-        } else if (dst_addr == ADDR_REGISTER) {
-            dst_reg = get_register(dst);
-        } else if (dst_addr == ADDR_MATRIX) {
-            need_extra_dst = 3;
-        } else {
-            need_extra_dst = 1;
-        }
-    }
-
-    word = (opcode_val << 8) | (src_addr << 6) | (dst_addr << 4) | (src_reg << 2) | dst_reg;
-    printf("DEBUG: Writing main word for line %d, inst_counter = %d\n", line_num, inst_counter);
-    if (!safe_store_code(word, line_num)) return;
-
-    /* Extra words for source */
-    if (need_extra_src) {
-        if (src_addr == ADDR_IMMEDIATE) {
-            printf("DEBUG: Writing src immediate for line %d, value=%d, inst_counter=%d\n", line_num, src_num, inst_counter);
-            if (!safe_store_code(src_num, line_num)) return;
-        } else if (src_addr == ADDR_MATRIX) {
-            if (is_matrix_operand(src, label, &mreg1, &mreg2)) {
-                sym = find_symbol(symbol_table, label);
-                val = 0;
-                if (sym) {
-                    val = sym->address;
-                    if (sym->attributes & EXTERN_ATTRIBUTE && ext_file)
-                        fprintf(ext_file, "%s %04d\n", sym->name, inst_counter);
-                } else {
-                    printf("Error (line %d): Undefined label '%s'\n", line_num, label);
-                    error_flag = 1;
-                }
-                printf("DEBUG: Writing src matrix label for line %d, val=%d, inst_counter=%d\n", line_num, val, inst_counter);
-                if (!safe_store_code(val, line_num)) return;
-                printf("DEBUG: Writing src matrix reg1 for line %d, mreg1=%d, inst_counter=%d\n", line_num, mreg1, inst_counter);
-                if (!safe_store_code(mreg1, line_num)) return;
-                printf("DEBUG: Writing src matrix reg2 for line %d, mreg2=%d, inst_counter=%d\n", line_num, mreg2, inst_counter);
-                if (!safe_store_code(mreg2, line_num)) return;
-            }
-        } else if (src_addr == ADDR_DIRECT) {
-            char label_only[MAX_LABEL_LENGTH+1];
-            extract_base_label(src, label_only);
-            sym = find_symbol(symbol_table, label_only);
-            val = 0;
-            if (sym) {
-                val = sym->address;
-                if (sym->attributes & EXTERN_ATTRIBUTE && ext_file)
-                    fprintf(ext_file, "%s %04d\n", sym->name, inst_counter);
-            } else {
-                printf("Error (line %d): Undefined label '%s'\n", line_num, label_only);
-                error_flag = 1;
-            }
-            printf("DEBUG: Writing src direct for line %d, val=%d, inst_counter=%d\n", line_num, val, inst_counter);
-            if (!safe_store_code(val, line_num)) return;
-        }
-    }
-
-    /* Extra words for destination */
-    if (need_extra_dst) {
-        if (dst_addr == ADDR_IMMEDIATE) {
-            printf("DEBUG: Writing dst immediate for line %d, value=%d, inst_counter=%d\n", line_num, dst_num, inst_counter);
-            if (!safe_store_code(dst_num, line_num)) return;
-        } else if (dst_addr == ADDR_MATRIX) {
-            if (is_matrix_operand(dst, label, &mreg1, &mreg2)) {
-                sym = find_symbol(symbol_table, label);
-                val = 0;
-                if (sym) {
-                    val = sym->address;
-                    if (sym->attributes & EXTERN_ATTRIBUTE && ext_file)
-                        fprintf(ext_file, "%s %04d\n", sym->name, inst_counter);
-                } else {
-                    printf("Error (line %d): Undefined label '%s'\n", line_num, label);
-                    error_flag = 1;
-                }
-                printf("DEBUG: Writing dst matrix label for line %d, val=%d, inst_counter=%d\n", line_num, val, inst_counter);
-                if (!safe_store_code(val, line_num)) return;
-                printf("DEBUG: Writing dst matrix reg1 for line %d, mreg1=%d, inst_counter=%d\n", line_num, mreg1, inst_counter);
-                if (!safe_store_code(mreg1, line_num)) return;
-                printf("DEBUG: Writing dst matrix reg2 for line %d, mreg2=%d, inst_counter=%d\n", line_num, mreg2, inst_counter);
-                if (!safe_store_code(mreg2, line_num)) return;
-            }
-        } else if (dst_addr == ADDR_DIRECT) {
-            char label_only[MAX_LABEL_LENGTH+1];
-            extract_base_label(dst, label_only);
-            sym = find_symbol(symbol_table, label_only);
-            val = 0;
-            if (sym) {
-                val = sym->address;
-                if (sym->attributes & EXTERN_ATTRIBUTE && ext_file)
-                    fprintf(ext_file, "%s %04d\n", sym->name, inst_counter);
-            } else {
-                printf("Error (line %d): Undefined label '%s'\n", line_num, label_only);
-                error_flag = 1;
-            }
-            printf("DEBUG: Writing dst direct for line %d, val=%d, inst_counter=%d\n", line_num, val, inst_counter);
-            if (!safe_store_code(val, line_num)) return;
-        }
-    }
-}
-
-
-void write_encoded_word(FILE *ob_file, int word) {
-    print_base4(ob_file, word & 0x3FF, 5);
-    fprintf(ob_file, "\n");
-}
-
+/* code_conversion.c
+ * Converts assembly instructions to encoded machine words.
+ * MMN14, ANSI C (C90) - supports matrix/indexed addressing.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <limits.h>
+#include "globals.h"
+#include "table.h"
+#include "util.h"
+#include "data_struct.h"
+#include "numbers.h"
+#include "names.h"
+#include "errors.h"
+#include "output.h"
+#include "code_conversion.h"
+
+extern int inst_counter;
+extern int data_counter;
+extern int code_array[];
+extern int data_memory[];
+extern label_entry *symbol_table;
+extern int error_flag;
+extern out_buffer ext_output;  /* Contents of the .ext output file */
+
+#define ADDR_IMMEDIATE 0 /* #number */
+#define ADDR_DIRECT    1 /* label */
+#define ADDR_MATRIX    2 /* label[index][index] */
+#define ADDR_REGISTER  3 /* r0 - r7 */
+
+/* Template being recorded while a macro body is encoded (NULL if none) */
+static macro_template *recording = NULL;
+static int recording_line;    /* .am line of the first body line */
+static int recording_failed;  /* Set if the body could not be encoded cleanly */
+
+/* Safely store a word in code_array, with overflow protection */
+static int safe_store_code(int word, int line_num) {
+    if (inst_counter + 1 >= MAX_INSTRUCTIONS) {
+        report_errorf(line_num, "instruction memory overflow (max = %d)", MAX_INSTRUCTIONS);
+        error_flag = 1;
+        recording_failed = 1;
+        return 0;
+    }
+
+    code_array[inst_counter] = word & 0x3FF; /* 10 bits only */
+    code_relocation[inst_counter] = RELOC_NONE;
+    inst_counter++;
+    if (recording && !template_add_word(recording, word & 0x3FF))
+        recording_failed = 1;
+    return 1;
+}
+
+/*
+ * Resolves a symbol operand and stores its address word.
+ * Extern references are listed in the .ext file; when a template is
+ * being recorded the word becomes one of its relocation slots.
+ */
+static int store_symbol_word(int name, int line_num) {
+    label_entry *sym = find_symbol(symbol_table, name);
+    char ext_line[MAX_LINE_LENGTH + 16];
+    int val = 0;
+
+    if (sym) {
+        val = sym->address;
+        if (sym->attributes & EXTERN_ATTRIBUTE)
+            out_append(&ext_output, ext_line,
+                       sprintf(ext_line, "%s %04d\n", name_text(&file_names, name), inst_counter));
+    } else {
+        report_errorf(line_num, "Undefined label '%s'", name_text(&file_names, name));
+        error_flag = 1;
+    }
+    if (recording && !template_add_slot(recording, recording->shared
+                                        ? intern_name(&batch_names, name_text(&file_names, name),
+                                                      (int)strlen(name_text(&file_names, name)))
+                                        : name,
+                                        line_num - recording_line))
+        recording_failed = 1;
+    if (!safe_store_code(val, line_num)) return 0;
+    if (sym) code_relocation[inst_counter - 1] = (unsigned char)symbol_relocation(sym);
+    return 1;
+}
+
+
+
+
+/* Converts an opcode name to its numerical value. */
+static int get_opcode_value(const char *opcode) {
+    if (strcmp(opcode, "mov") == 0) return 0;
+    if (strcmp(opcode, "cmp") == 0) return 1;
+    if (strcmp(opcode, "add") == 0) return 2;
+    if (strcmp(opcode, "sub") == 0) return 3;
+    if (strcmp(opcode, "not") == 0) return 4;
+    if (strcmp(opcode, "clr") == 0) return 5;
+    if (strcmp(opcode, "lea") == 0) return 6;
+    if (strcmp(opcode, "inc") == 0) return 7;
+    if (strcmp(opcode, "dec") == 0) return 8;
+    if (strcmp(opcode, "jmp") == 0) return 9;
+    if (strcmp(opcode, "bne") == 0) return 10;
+    if (strcmp(opcode, "red") == 0) return 11;
+    if (strcmp(opcode, "prn") == 0) return 12;
+    if (strcmp(opcode, "jsr") == 0) return 13;
+    if (strcmp(opcode, "rts") == 0) return 14;
+    if (strcmp(opcode, "stop") == 0) return 15;
+    return -1;
+}
+
+/*
+ * Operand lexer
+ * Each operand is classified in a single left-to-right pass over the
+ * line itself: a character class table feeds a transition table, and
+ * the numbers (immediate value, register indices) are accumulated on the
+ * way, so no operand text is copied or re-scanned.
+ *
+ * Grammar, in the order the encoder has always applied it:
+ *   #<number>                      immediate, read by parse_word_value()
+ *                                  (the rest of the text is ignored)
+ *   r0 .. r7                       register
+ *   <label>[r<num>][r<num>]...     matrix (<num> as read by scanf "%d", 0..7)
+ *   anything else                  direct, the label ends at the first '['
+ */
+
+/* Character classes */
+#define K_OTH   0   /* Anything not listed below */
+#define K_HASH  1   /* '#' */
+#define K_R     2   /* 'r' */
+#define K_D07   3   /* '0' - '7' */
+#define K_D89   4   /* '8', '9' */
+#define K_SIGN  5   /* '+', '-' */
+#define K_BLNK  6   /* isspace() */
+#define K_LB    7   /* '[' */
+#define K_RB    8   /* ']' */
+#define CLASS_COUNT 9
+
+/* ASCII to character class; bytes from 128 up are K_OTH */
+static const unsigned char char_class[256] = {
+    K_OTH, K_OTH, K_OTH, K_OTH, K_OTH, K_OTH, K_OTH, K_OTH,
+    K_OTH, K_BLNK, K_BLNK, K_BLNK, K_BLNK, K_BLNK, K_OTH, K_OTH,
+    K_OTH, K_OTH, K_OTH, K_OTH, K_OTH, K_OTH, K_OTH, K_OTH,
+    K_OTH, K_OTH, K_OTH, K_OTH, K_OTH, K_OTH, K_OTH, K_OTH,
+    K_BLNK, K_OTH, K_OTH, K_HASH, K_OTH, K_OTH, K_OTH, K_OTH,    /*  !"#$%&' */
+    K_OTH, K_OTH, K_OTH, K_SIGN, K_OTH, K_SIGN, K_OTH, K_OTH,    /* ()*+,-./ */
+    K_D07, K_D07, K_D07, K_D07, K_D07, K_D07, K_D07, K_D07,      /* 01234567 */
+    K_D89, K_D89, K_OTH, K_OTH, K_OTH, K_OTH, K_OTH, K_OTH,      /* 89:;<=>? */
+    K_OTH, K_OTH, K_OTH, K_OTH, K_OTH, K_OTH, K_OTH, K_OTH,
+    K_OTH, K_OTH, K_OTH, K_OTH, K_OTH, K_OTH, K_OTH, K_OTH,
+    K_OTH, K_OTH, K_OTH, K_OTH, K_OTH, K_OTH, K_OTH, K_OTH,
+    K_OTH, K_OTH, K_OTH, K_LB, K_OTH, K_RB, K_OTH, K_OTH,        /* XYZ[\]^_ */
+    K_OTH, K_OTH, K_OTH, K_OTH, K_OTH, K_OTH, K_OTH, K_OTH,
+    K_OTH, K_OTH, K_OTH, K_OTH, K_OTH, K_OTH, K_OTH, K_OTH,
+    K_OTH, K_OTH, K_R, K_OTH, K_OTH, K_OTH, K_OTH, K_OTH,        /* pqrstuvw */
+    K_OTH, K_OTH, K_OTH, K_OTH, K_OTH, K_OTH, K_OTH, K_OTH
+};
+
+/* Lexer states */
+#define S_START    0   /* Nothing read yet */
+#define S_IMM      1   /* "#": the number is left to parse_word_value() */
+#define S_REG      2   /* "r" */
+#define S_REG_NUM  3   /* "r3" */
+#define S_LABEL    4   /* Label characters before any '[' */
+#define S_OPEN1    5   /* "M[" */
+#define S_R1       6   /* "M[r", blanks may follow */
+#define S_SIGN1    7   /* "M[r-" */
+#define S_DIG1     8   /* "M[r1" */
+#define S_CLOSE1   9   /* "M[r1]" */
+#define S_OPEN2   10   /* "M[r1][" */
+#define S_R2      11   /* "M[r1][r", blanks may follow */
+#define S_SIGN2   12   /* "M[r1][r-" */
+#define S_DIG2    13   /* "M[r1][r2" */
+#define S_MATRIX  14   /* Matrix done, the rest is ignored */
+#define S_DIRECT  15   /* Not a matrix after all: direct */
+#define STATE_COUNT 16
+
+/* Next state for every state and character class */
+static const unsigned char next_state[STATE_COUNT][CLASS_COUNT] = {
+    /*             OTH       #         r         0-7        8-9       +-        blank     [         ]        */
+    /* START   */ {S_LABEL,  S_IMM,    S_REG,    S_LABEL,   S_LABEL,  S_LABEL,  S_LABEL,  S_OPEN1,  S_LABEL},
+    /* IMM     */ {S_IMM,    S_IMM,    S_IMM,    S_IMM,     S_IMM,    S_IMM,    S_IMM,    S_IMM,    S_IMM},
+    /* REG     */ {S_LABEL,  S_LABEL,  S_LABEL,  S_REG_NUM, S_LABEL,  S_LABEL,  S_LABEL,  S_OPEN1,  S_LABEL},
+    /* REG_NUM */ {S_LABEL,  S_LABEL,  S_LABEL,  S_LABEL,   S_LABEL,  S_LABEL,  S_LABEL,  S_OPEN1,  S_LABEL},
+    /* LABEL   */ {S_LABEL,  S_LABEL,  S_LABEL,  S_LABEL,   S_LABEL,  S_LABEL,  S_LABEL,  S_OPEN1,  S_LABEL},
+    /* OPEN1   */ {S_DIRECT, S_DIRECT, S_R1,     S_DIRECT,  S_DIRECT, S_DIRECT, S_DIRECT, S_DIRECT, S_DIRECT},
+    /* R1      */ {S_DIRECT, S_DIRECT, S_DIRECT, S_DIG1,    S_DIG1,   S_SIGN1,  S_R1,     S_DIRECT, S_DIRECT},
+    /* SIGN1   */ {S_DIRECT, S_DIRECT, S_DIRECT, S_DIG1,    S_DIG1,   S_DIRECT, S_DIRECT, S_DIRECT, S_DIRECT},
+    /* DIG1    */ {S_DIRECT, S_DIRECT, S_DIRECT, S_DIG1,    S_DIG1,   S_DIRECT, S_DIRECT, S_DIRECT, S_CLOSE1},
+    /* CLOSE1  */ {S_DIRECT, S_DIRECT, S_DIRECT, S_DIRECT,  S_DIRECT, S_DIRECT, S_DIRECT, S_OPEN2,  S_DIRECT},
+    /* OPEN2   */ {S_DIRECT, S_DIRECT, S_R2,     S_DIRECT,  S_DIRECT, S_DIRECT, S_DIRECT, S_DIRECT, S_DIRECT},
+    /* R2      */ {S_DIRECT, S_DIRECT, S_DIRECT, S_DIG2,    S_DIG2,   S_SIGN2,  S_R2,     S_DIRECT, S_DIRECT},
+    /* SIGN2   */ {S_DIRECT, S_DIRECT, S_DIRECT, S_DIG2,    S_DIG2,   S_DIRECT, S_DIRECT, S_DIRECT, S_DIRECT},
+    /* DIG2    */ {S_MATRIX, S_MATRIX, S_MATRIX, S_DIG2,    S_DIG2,   S_MATRIX, S_MATRIX, S_MATRIX, S_MATRIX},
+    /* MATRIX  */ {S_MATRIX, S_MATRIX, S_MATRIX, S_MATRIX,  S_MATRIX, S_MATRIX, S_MATRIX, S_MATRIX, S_MATRIX},
+    /* DIRECT  */ {S_DIRECT, S_DIRECT, S_DIRECT, S_DIRECT,  S_DIRECT, S_DIRECT, S_DIRECT, S_DIRECT, S_DIRECT}
+};
+
+/* Addressing mode of the operand for each final state */
+static const unsigned char final_mode[STATE_COUNT] = {
+    ADDR_DIRECT, ADDR_IMMEDIATE,                         /* START, IMM */
+    ADDR_DIRECT, ADDR_REGISTER, ADDR_DIRECT,             /* REG, REG_NUM, LABEL */
+    ADDR_DIRECT, ADDR_DIRECT, ADDR_DIRECT, ADDR_DIRECT,  /* OPEN1 .. DIG1 */
+    ADDR_DIRECT, ADDR_DIRECT, ADDR_DIRECT, ADDR_DIRECT,  /* CLOSE1 .. SIGN2 */
+    ADDR_MATRIX, ADDR_MATRIX, ADDR_DIRECT                /* DIG2, MATRIX, DIRECT */
+};
+
+/* One lexed operand; text and label point into the instruction line */
+typedef struct operand {
+    const char *text;   /* Operand with surrounding blanks removed */
+    int length;         /* 0 if the operand is absent */
+    int mode;           /* ADDR_* */
+    const char *label;  /* Symbol of a direct or matrix operand */
+    int label_length;
+    int value;          /* Immediate value or register number */
+    int out_of_range;   /* Immediate that does not fit in a word */
+    int reg1, reg2;     /* Index registers of a matrix operand */
+} operand;
+
+/* Appends a decimal digit to a magnitude, saturating instead of overflowing */
+static int add_digit(int acc, char c) {
+    int d = c - '0';
+    return acc <= (INT_MAX - d) / 10 ? acc * 10 + d : INT_MAX;
+}
+
+/* Classifies op->text[0..length) and fills in the rest of op. */
+static void lex_operand(operand *op) {
+    int state = S_START, i, bracket = -1;
+    int value = 0, r1 = 0, neg1 = 0, r2 = 0, neg2 = 0;
+    const char *p, *end = op->text + op->length;
+
+    for (i = 0; i < op->length; i++) {
+        char c = op->text[i];
+        state = next_state[state][char_class[(unsigned char)c]];
+        switch (state) {
+        case S_REG_NUM:  value = c - '0'; break;
+        case S_OPEN1:    bracket = i; break;
+        case S_SIGN1:    neg1 = (c == '-'); break;
+        case S_DIG1:     r1 = add_digit(r1, c); break;
+        case S_SIGN2:    neg2 = (c == '-'); break;
+        case S_DIG2:     r2 = add_digit(r2, c); break;
+        }
+        if (state == S_IMM || state == S_MATRIX || state == S_DIRECT) break;
+    }
+
+    op->mode = final_mode[state];
+    op->label = op->text;
+    op->label_length = bracket < 0 ? op->length : bracket;
+    if (op->mode == ADDR_IMMEDIATE) {
+        /* Blanks may follow '#'; no digits at all reads as 0 */
+        for (p = op->text + 1; p < end && isspace((unsigned char)*p); p++);
+        op->value = 0;
+        op->out_of_range = parse_word_value(p, end, &p, &op->value) == NUM_RANGE;
+    } else if (op->mode == ADDR_REGISTER) {
+        op->value = value;
+    } else if (op->mode == ADDR_MATRIX) {
+        op->reg1 = neg1 ? -r1 : r1;
+        op->reg2 = neg2 ? -r2 : r2;
+        if (op->label_length > MAX_LABEL_LENGTH ||
+            op->reg1 < 0 || op->reg1 > 7 || op->reg2 < 0 || op->reg2 > 7)
+            op->mode = ADDR_DIRECT;
+    }
+    if (op->mode == ADDR_DIRECT && op->label_length > MAX_LABEL_LENGTH)
+        op->label_length = MAX_LABEL_LENGTH;
+}
+
+/* Sets op to text[from..to) without surrounding blanks. */
+static void trim_operand(operand *op, const char *from, const char *to) {
+    while (from < to && isspace((unsigned char)*from)) from++;
+    while (to > from && isspace((unsigned char)to[-1])) to--;
+    op->text = from;
+    op->length = (int)(to - from);
+    op->out_of_range = 0;
+}
+
+/*
+ * Locates the operands after the opcode: with a comma the first part is
+ * the source and the rest the destination, otherwise the single operand
+ * is the destination. Absent operands get length 0.
+ */
+static void split_operands(const char *line, operand *src, operand *dst) {
+    const char *p = line, *end, *comma;
+
+    while (*p && isspace((unsigned char)*p)) p++;
+    while (*p && !isspace((unsigned char)*p)) p++;
+    while (*p && isspace((unsigned char)*p)) p++;
+
+    end = p + strlen(p);
+    comma = memchr(p, ',', end - p);
+    if (comma) {
+        trim_operand(src, p, comma);
+        trim_operand(dst, comma + 1, end);
+    } else {
+        trim_operand(src, p, p);
+        trim_operand(dst, p, end);
+    }
+}
+
+/*
+ * Lays out the words of a lexed instruction in the order they are
+ * stored: the instruction word, then the extra words of each operand
+ * (the value of an immediate, the symbol of a direct operand, or the
+ * symbol and both index registers of a matrix; registers live in the
+ * instruction word and add nothing).
+ * Symbol words are left 0 and their operand is recorded in symbols[]
+ * (NULL for every other word), to be resolved when they are stored.
+ * Returns the number of words (at most MAX_INSTRUCTION_WORDS).
+ */
+static int build_words(int opcode_val, const operand *src, const operand *dst,
+                       int words[], const operand *symbols[]) {
+    const operand *ops[2];
+    int src_addr = 0, dst_addr = 0;
+    int src_reg = 0, dst_reg = 0;
+    int count = 0, i;
+
+    if (src->length) {
+        src_addr = src->mode;
+        if (src_addr == ADDR_REGISTER) src_reg = src->value;
+    }
+    if (dst->length) {
+        dst_addr = dst->mode;
+        if (dst_addr == ADDR_REGISTER) dst_reg = dst->value;
+    }
+    words[count] = (opcode_val << 8) | (src_addr << 6) | (dst_addr << 4) | (src_reg << 2) | dst_reg;
+    symbols[count++] = NULL;
+
+    ops[0] = src;
+    ops[1] = dst;
+    for (i = 0; i < 2; i++) {
+        const operand *op = ops[i];
+        if (!op->length) continue;
+        switch (op->mode) {
+        case ADDR_IMMEDIATE:
+            words[count] = op->value;
+            symbols[count++] = NULL;
+            break;
+        case ADDR_DIRECT:
+            words[count] = 0;
+            symbols[count++] = op;
+            break;
+        case ADDR_MATRIX:
+            words[count] = 0;
+            symbols[count++] = op;
+            words[count] = op->reg1;
+            symbols[count++] = NULL;
+            words[count] = op->reg2;
+            symbols[count++] = NULL;
+            break;
+        }
+    }
+    return count;
+}
+
+/* Results of decode_instruction() */
+#define DECODE_OK             0
+#define DECODE_BAD_OPCODE     1
+#define DECODE_BAD_REGISTER   2
+#define DECODE_IMM_RANGE      3
+
+/*
+ * Looks up the opcode and lexes both operands of an instruction line.
+ * Absent operands have length 0. Returns DECODE_OK or the first error.
+ */
+static int decode_instruction(const char *line, const char *opcode,
+                              int *opcode_val, operand *src, operand *dst) {
+    *opcode_val = get_opcode_value(opcode);
+    if (*opcode_val == -1) return DECODE_BAD_OPCODE;
+
+    split_operands(line, src, dst);
+    if ((src->length && src->text[0] == '@') || (dst->length && dst->text[0] == '@'))
+        return DECODE_BAD_REGISTER;
+
+    if (src->length) lex_operand(src);
+    if (dst->length) lex_operand(dst);
+    if (src->out_of_range || dst->out_of_range)
+        return DECODE_IMM_RANGE;
+    return DECODE_OK;
+}
+
+/*
+ * Formats the message of a decode_instruction() error into message
+ * (MAX_ERROR_MESSAGE bytes).
+ */
+static void decode_error_message(int status, const char *opcode, const operand *src,
+                                 const operand *dst, char *message) {
+    switch (status) {
+    case DECODE_BAD_OPCODE:
+        sprintf(message, "Unknown opcode '%s'", opcode);
+        break;
+    case DECODE_BAD_REGISTER:
+        sprintf(message, "Illegal register syntax: '%.*s' or '%.*s'",
+                src->length, src->text, dst->length, dst->text);
+        break;
+    default:
+        sprintf(message, "Immediate value out of range (%d to %d)",
+                WORD_MIN_VALUE, WORD_MAX_VALUE);
+        break;
+    }
+}
+
+void assemble_instruction(const char *line, const char *opcode, int line_num)
+{
+    int opcode_val;
+    operand src, dst;
+    int words[MAX_INSTRUCTION_WORDS];
+    const operand *symbols[MAX_INSTRUCTION_WORDS];
+    int count, i, status;
+
+    status = decode_instruction(line, opcode, &opcode_val, &src, &dst);
+    if (status != DECODE_OK) {
+        char message[MAX_ERROR_MESSAGE];
+        decode_error_message(status, opcode, &src, &dst, message);
+        report_error(message, line_num);
+        error_flag = 1;
+        recording_failed = 1;
+        return;
+    }
+
+    /* Store word by word, stopping when memory runs out */
+    count = build_words(opcode_val, &src, &dst, words, symbols);
+    for (i = 0; i < count; i++) {
+        int stored = symbols[i]
+            ? store_symbol_word(intern_name(&file_names, symbols[i]->label, symbols[i]->label_length), line_num)
+            : safe_store_code(words[i], line_num);
+        if (!stored) return;
+    }
+}
+
+/*
+ * Encodes an instruction without storing it; symbol words are returned
+ * as name ids for the caller to resolve. Only reads shared state (the
+ * name pool is searched, never extended), so several threads may encode
+ * lines of the same file at once.
+ */
+int instruction_words(const char *line, const char *opcode, int words[], int names[]) {
+    int opcode_val, count, i;
+    operand src, dst;
+    const operand *symbols[MAX_INSTRUCTION_WORDS];
+
+    if (decode_instruction(line, opcode, &opcode_val, &src, &dst) != DECODE_OK)
+        return -1;
+    count = build_words(opcode_val, &src, &dst, words, symbols);
+    for (i = 0; i < count; i++) {
+        names[i] = NO_NAME;
+        if (symbols[i]) {
+            names[i] = find_name(&file_names, symbols[i]->label, symbols[i]->label_length);
+            if (names[i] == NO_NAME) return -1;
+        }
+    }
+    return count;
+}
+
+/*
+ * Decodes the instruction only to find out whether it is valid; reports
+ * nothing, so it is safe to call from several threads at once.
+ */
+const char *instruction_error(const char *line, const char *opcode, char *message) {
+    int opcode_val, status;
+    operand src, dst;
+
+    status = decode_instruction(line, opcode, &opcode_val, &src, &dst);
+    if (status == DECODE_OK) return NULL;
+    decode_error_message(status, opcode, &src, &dst, message);
+    return message;
+}
+
+/*
+ * Lists the symbols assemble_instruction() will resolve for this line,
+ * source operand first. Lines it would reject refer to nothing and
+ * return -1.
+ */
+int instruction_symbols(const char *line, const char *opcode, const char *labels[2], int lengths[2]) {
+    int opcode_val, count = 0;
+    operand src, dst;
+
+    if (decode_instruction(line, opcode, &opcode_val, &src, &dst) != DECODE_OK)
+        return -1;
+    if (src.length && (src.mode == ADDR_DIRECT || src.mode == ADDR_MATRIX)) {
+        labels[count] = src.label;
+        lengths[count++] = src.label_length;
+    }
+    if (dst.length && (dst.mode == ADDR_DIRECT || dst.mode == ADDR_MATRIX)) {
+        labels[count] = dst.label;
+        lengths[count++] = dst.label_length;
+    }
+    return count;
+}
+
+/*
+ * Starts recording the words encoded from now on into tmpl.
+ * first_line is the .am line where the macro body begins.
+ */
+void begin_template(macro_template *tmpl, int first_line, int shared) {
+    tmpl->word_count = 0;
+    tmpl->slot_count = 0;
+    tmpl->valid = 0;
+    tmpl->shared = shared;
+    recording = tmpl;
+    recording_line = first_line;
+    recording_failed = 0;
+}
+
+/*
+ * Stops recording. The template is only marked valid if every line of
+ * the body was encoded without errors, so a broken body keeps being
+ * encoded (and reported) line by line.
+ */
+int end_template(void) {
+    int ok = 0;
+    if (recording) {
+        ok = !recording_failed;
+        recording->valid = ok;
+        recording = NULL;
+    }
+    return ok;
+}
+
+/*
+ * Encodes a macro call site by copying the template words and patching
+ * the symbol slots, exactly as encoding the body line by line would.
+ * Returns 0 (and stores nothing) if the words do not fit in memory, so
+ * the caller can fall back to line by line encoding for the errors.
+ * Slot names of a shared template are looked up again in file_names,
+ * since the template may have been recorded in an earlier file.
+ */
+int stamp_template(const macro_template *tmpl, int first_line) {
+    int i, s = 0;
+
+    if (!tmpl || !tmpl->valid) return 0;
+    if (inst_counter + tmpl->word_count >= MAX_INSTRUCTIONS) return 0;
+
+    for (i = 0; i < tmpl->word_count; i++) {
+        if (s < tmpl->slot_count && tmpl->slots[s].word == i) {
+            int name = tmpl->slots[s].name;
+            if (tmpl->shared)
+                name = intern_name(&file_names, name_text(&batch_names, name),
+                                   (int)strlen(name_text(&batch_names, name)));
+            store_symbol_word(name, first_line + tmpl->slots[s].line);
+            s++;
+        } else {
+            code_relocation[inst_counter] = RELOC_NONE;
+            code_array[inst_counter++] = tmpl->words[i];
+        }
+    }
+    return 1;
+}
+
+void write_encoded_word(out_buffer *out, int word) {
+    out_base4(out, word & 0x3FF, 5);
+    out_append(out, "\n", 1);
+}
+
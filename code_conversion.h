@@ -1,34 +1,118 @@
-/* code_conversion.h
-* Instruction encoding for assembler (C90)
- * Provides functions for translating assembly lines into encoded machine code.
- */
-
-#ifndef CODE_CONVERSION_H
-#define CODE_CONVERSION_H
-
-#include <stdio.h>
-
-/*
- * Encodes a single assembly instruction line.
- * - Parses operands and opcode, performs error checking.
- * - Stores the resulting machine words into the instruction memory.
- * - May also update object/ext files if relevant (usually during second pass).
- *
- * Parameters:
- *   line     - The full instruction line, including operands (e.g., "mov r1, r2")
- *   opcode   - The operation string ("mov", "add", etc.), must be extracted already
- *   line_num - The line number in the original file (for error reporting)
- */
-void assemble_instruction(const char *line, const char *opcode, int line_num);
-
-/*
- * Writes a 16-bit machine word in hexadecimal format to the given output file.
- * Used for both instruction and data memory outputs.
- *
- * Parameters:
- *   out   - File handle to write to (.ob file, for example)
- *   value - The 16-bit integer value to output (will be masked to 4 hex digits)
- */
-void write_encoded_word(FILE *out, int value);
-
-#endif /* CODE_CONVERSION_H */
+/* code_conversion.h
+* Instruction encoding for assembler (C90)
+ * Provides functions for translating assembly lines into encoded machine code.
+ */
+
+#ifndef CODE_CONVERSION_H
+#define CODE_CONVERSION_H
+
+#include <stdio.h>
+#include "data_struct.h"
+#include "output.h"
+
+/*
+ * Encodes a single assembly instruction line.
+ * - Parses operands and opcode, performs error checking.
+ * - Stores the resulting machine words into the instruction memory.
+ * - May also update object/ext files if relevant (usually during second pass).
+ *
+ * Parameters:
+ *   line     - The full instruction line, including operands (e.g., "mov r1, r2")
+ *   opcode   - The operation string ("mov", "add", etc.), must be extracted already
+ *   line_num - The line number in the original file (for error reporting)
+ */
+void assemble_instruction(const char *line, const char *opcode, int line_num);
+
+/* Longest instruction: the instruction word and two matrix operands */
+#define MAX_INSTRUCTION_WORDS 7
+
+/*
+ * Encodes an instruction line without storing it, for the parallel
+ * second pass (safe to call from several threads at once).
+ *
+ * Parameters:
+ *   line   - The instruction, as passed to assemble_instruction()
+ *   opcode - Its opcode
+ *   words  - Receives the words, in storage order (MAX_INSTRUCTION_WORDS)
+ *   names  - Receives, per word, the file_names id of the symbol whose
+ *            address the word holds, or NO_NAME for a fixed word
+ *
+ * Returns the number of words, or -1 if the line has an error (or names
+ * a symbol the first pass never saw); assemble_instruction() reports it.
+ */
+int instruction_words(const char *line, const char *opcode, int words[], int names[]);
+
+/*
+ * Checks an instruction line the way assemble_instruction() does, without
+ * encoding or reporting anything.
+ *
+ * Parameters:
+ *   line    - The instruction, as passed to assemble_instruction()
+ *   opcode  - Its opcode
+ *   message - Buffer of MAX_ERROR_MESSAGE bytes for the error text
+ *
+ * Returns message holding the error assemble_instruction() would report,
+ * or NULL if the instruction is valid.
+ */
+const char *instruction_error(const char *line, const char *opcode, char *message);
+
+/*
+ * Finds the symbols an instruction line refers to, exactly as
+ * assemble_instruction() would resolve them (a line it would reject
+ * refers to none). Lets the first pass check references before any
+ * encoding is done. Interns nothing, so it is safe to call from several
+ * threads at once.
+ *
+ * Parameters:
+ *   line    - The instruction, as passed to assemble_instruction()
+ *   opcode  - Its opcode
+ *   labels  - Receives the referenced names (pointers into line)
+ *   lengths - Receives their lengths
+ *
+ * Returns the number of names stored (0 to 2), or -1 if the encoder
+ * would reject the line (see instruction_error()).
+ */
+int instruction_symbols(const char *line, const char *opcode, const char *labels[2], int lengths[2]);
+
+/*
+ * Starts recording every word encoded from now on into a macro template.
+ *
+ * Parameters:
+ *   tmpl       - The template to fill (its previous content is discarded)
+ *   first_line - The .am line number where the macro body starts
+ *   shared     - 1 to keep the slot names as batch_names ids, so the
+ *                template can be stamped in later files of the run
+ */
+void begin_template(macro_template *tmpl, int first_line, int shared);
+
+/*
+ * Stops recording the current template.
+ * Returns 1 if the template is valid (the body encoded without errors).
+ */
+int end_template(void);
+
+/*
+ * Encodes a macro call site from a valid template: the fixed words are
+ * copied and the symbol slots resolved as line by line encoding would.
+ *
+ * Parameters:
+ *   tmpl       - A template filled by begin_template()/end_template()
+ *   first_line - The .am line number where this expansion starts
+ *
+ * Returns 1 if the call site was encoded, 0 if the caller must encode
+ * (and may re-record) the body line by line instead.
+ */
+int stamp_template(const macro_template *tmpl, int first_line);
+
+/*
+ * Appends a machine word, in base 4 (5 letters) and followed by a
+ * newline, to an output buffer.
+ * Used for both instruction and data memory outputs.
+ *
+ * Parameters:
+ *   out   - Output to append to (the .ob contents, for example)
+ *   value - The word to output (masked to its 10 bits)
+ */
+void write_encoded_word(out_buffer *out, int value);
+
+#endif /* CODE_CONVERSION_H */
@@ -1,53 +1,116 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include "data_struct.h"
-
-/* Adds a new macro to the linked list.
- * Parameters:
- *   head - pointer to the pointer of the head node of the list
- *   name - the macro name string (assumed <= MAX_MACRO_NAME)
- * Returns:
- *   Pointer to the new node, or NULL on memory allocation failure.
- */
-node *create_macro(node **head, const char *name) {
-    node *new_node = malloc(sizeof(node));
-    if (!new_node) return NULL; /* Memory allocation failed */
-
-    strcpy(new_node->name, name);    /* Copy macro name */
-    new_node->line_count = 0;        /* Start with 0 lines */
-    new_node->next = *head;          /* Insert at list head */
-    *head = new_node;
-    return new_node;
-}
-
-/* Adds a line of text to a given macro's line array.
- * Parameters:
- *   macro - pointer to the macro node to add a line to
- *   line  - the text of the line to add (will be duplicated)
- * Note: Will not add more than MAX_MACRO_LINES.
- */
-void add_line_to_macro(node *macro, const char *line) {
-    if (macro->line_count >= MAX_MACRO_LINES) return; /* Too many lines, ignore */
-    macro->lines[macro->line_count] = malloc(strlen(line) + 1); /* Allocate for new line */
-    strcpy(macro->lines[macro->line_count], line);
-    macro->line_count++;
-}
-
-/* Frees the entire macro linked list, including all allocated lines for each macro.
- * Parameters:
- *   head - pointer to the first node in the list (can be NULL)
- * After this call, all memory allocated by macros is freed.
- */
-void free_macro_list(node *head) {
-    node *temp;
-    while (head) {
-        int i;
-        for (i = 0; i < head->line_count; i++) {
-            free(head->lines[i]); /* Free each line */
-        }
-        temp = head;
-        head = head->next;
-        free(temp); /* Free macro node itself */
-    }
-}
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "data_struct.h"
+
+/* Adds a new macro to the linked list.
+ * Parameters:
+ *   mem  - the arena the list is allocated in
+ *   head - pointer to the pointer of the head node of the list
+ *   name - the interned macro name
+ * Returns:
+ *   Pointer to the new node, or NULL on memory allocation failure.
+ */
+node *create_macro(arena *mem, node **head, int name, int shared) {
+    node *new_node = arena_alloc(mem, sizeof(node));
+    if (!new_node) return NULL; /* Memory allocation failed */
+
+    new_node->name = name;           /* Interned macro name */
+    new_node->line_count = 0;        /* Start with 0 lines */
+    new_node->tmpl = NULL;           /* Body is encoded on first use */
+    new_node->shared = shared;       /* Template slots use batch_names ids */
+    new_node->next = *head;          /* Insert at list head */
+    *head = new_node;
+    return new_node;
+}
+
+/* Adds a line of text to a given macro's line array.
+ * Parameters:
+ *   mem   - the arena the macro is allocated in
+ *   macro - pointer to the macro node to add a line to
+ *   line  - the text of the line to add (will be duplicated)
+ * Note: Will not add more than MAX_MACRO_LINES.
+ */
+void add_line_to_macro(arena *mem, node *macro, const char *line) {
+    char *copy;
+    if (macro->line_count >= MAX_MACRO_LINES) return; /* Too many lines, ignore */
+    copy = arena_strndup(mem, line, strlen(line));
+    if (!copy) return;
+    macro->lines[macro->line_count++] = copy;
+}
+
+/* Frees the templates built for a macro list.
+ * Parameters:
+ *   head - pointer to the first node in the list (can be NULL)
+ * The nodes and lines themselves go away with their arena.
+ */
+void free_macro_list(node *head) {
+    while (head) {
+        free_template(head->tmpl);
+        head->tmpl = NULL;
+        head = head->next;
+    }
+}
+
+/* Appends a macro call to the end of the call list.
+ * Parameters:
+ *   mem   - the arena the list is allocated in
+ *   head  - pointer to the pointer of the head node of the list
+ *   tail  - pointer to the pointer of the last node of the list
+ *   line  - first .am line of the expanded body
+ *   macro - the macro that was expanded
+ * Returns:
+ *   Pointer to the new node, or NULL on memory allocation failure.
+ */
+macro_call *add_macro_call(arena *mem, macro_call **head, macro_call **tail, int line, node *macro) {
+    macro_call *call = arena_alloc(mem, sizeof(macro_call));
+    if (!call) return NULL; /* Memory allocation failed */
+
+    call->line = line;
+    call->macro = macro;
+    call->next = NULL;
+    if (*tail)
+        (*tail)->next = call;
+    else
+        *head = call;
+    *tail = call;
+    return call;
+}
+
+/* Adds an encoded word to the template, doubling the storage when full. */
+int template_add_word(macro_template *tmpl, int word) {
+    if (tmpl->word_count == tmpl->word_capacity) {
+        int capacity = tmpl->word_capacity ? tmpl->word_capacity * 2 : 16;
+        int *words = realloc(tmpl->words, capacity * sizeof(int));
+        if (!words) return 0;
+        tmpl->words = words;
+        tmpl->word_capacity = capacity;
+    }
+    tmpl->words[tmpl->word_count++] = word;
+    return 1;
+}
+
+/* Adds a relocation slot that refers to the next word of the template. */
+int template_add_slot(macro_template *tmpl, int name, int line) {
+    template_slot *slot;
+    if (tmpl->slot_count == tmpl->slot_capacity) {
+        int capacity = tmpl->slot_capacity ? tmpl->slot_capacity * 2 : 4;
+        template_slot *slots = realloc(tmpl->slots, capacity * sizeof(template_slot));
+        if (!slots) return 0;
+        tmpl->slots = slots;
+        tmpl->slot_capacity = capacity;
+    }
+    slot = &tmpl->slots[tmpl->slot_count++];
+    slot->word = tmpl->word_count;
+    slot->line = line;
+    slot->name = name;
+    return 1;
+}
+
+/* Frees a template's word and slot storage and the template itself. */
+void free_template(macro_template *tmpl) {
+    if (!tmpl) return;
+    free(tmpl->words);
+    free(tmpl->slots);
+    free(tmpl);
+}
@@ -1,45 +1,128 @@
-#ifndef DATA_STRCT_H
-#define DATA_STRCT_H
-
-/* Maximum lines that a macro can contain */
-#define MAX_MACRO_LINES 100
-
-/*
- * Macro list node structure:
- * - Represents a macro in the program, storing its name and the lines that define it.
- * - Linked list: Each macro points to the next defined macro (if any).
- */
-typedef struct node {
-    char name[32];                   /* Macro name (null-terminated string) */
-    char *lines[MAX_MACRO_LINES];    /* Pointers to the lines inside the macro */
-    int line_count;                  /* Current number of lines stored */
-    struct node *next;               /* Pointer to the next macro node */
-} node;
-
-/*
- * Adds a new macro node to the macro list.
- * Parameters:
- *   head - pointer to pointer to the macro list head
- *   name - macro name to insert (copied into node)
- * Returns:
- *   Pointer to the new node, or NULL on allocation failure.
- */
-node *create_macro(node **head, const char *name);
-
-/*
- * Adds a line to a macro's storage.
- * Parameters:
- *   macro - pointer to the macro node to modify
- *   line  - the line string to add (will be duplicated)
- * Does nothing if line limit reached.
- */
-void add_line_to_macro(node *macro, const char *line);
-
-/*
- * Frees the entire macro list, including all stored lines.
- * Parameters:
- *   head - pointer to the head of the list
- */
-void free_macro_list(node *head);
-
-#endif /* DATA_STRCT_H */
+#ifndef DATA_STRCT_H
+#define DATA_STRCT_H
+
+#include "globals.h"
+#include "arena.h"
+
+/* Maximum lines that a macro can contain */
+#define MAX_MACRO_LINES 100
+
+/*
+ * Relocation slot of a macro template:
+ * - A word of the encoded body that holds a symbol address and therefore
+ *   has to be patched every time the template is stamped.
+ */
+typedef struct template_slot {
+    int word;                          /* Index of the word in the template */
+    int line;                          /* Body line the operand came from (0-based) */
+    int name;                          /* Symbol referenced by the operand (see macro_template) */
+} template_slot;
+
+/*
+ * Encode-once template of a macro body:
+ * - The machine words of the body encoded a single time, plus the slots
+ *   that depend on symbol addresses.
+ * - Instruction encoding is position independent apart from the slots,
+ *   so a call site is encoded by copying the words and patching the slots.
+ * - Slot names are file_names ids, except in the template of a library
+ *   or included macro: those are batch_names ids, so the template is
+ *   recorded once and stamped in every file of the run.
+ */
+typedef struct macro_template {
+    int *words;                      /* Encoded words of the whole body */
+    int word_count;
+    int word_capacity;
+    template_slot *slots;            /* Symbol operand words, in word order */
+    int slot_count;
+    int slot_capacity;
+    int valid;                       /* 1 once the body was encoded without errors */
+    int shared;                      /* Slot names are batch_names ids */
+} macro_template;
+
+/*
+ * Macro list node structure:
+ * - Represents a macro in the program, storing its name and the lines that define it.
+ * - Linked list: Each macro points to the next defined macro (if any).
+ */
+typedef struct node {
+    int name;                        /* Macro name id (file_names or batch_names, as the list) */
+    char *lines[MAX_MACRO_LINES];    /* Pointers to the lines inside the macro */
+    int line_count;                  /* Current number of lines stored */
+    macro_template *tmpl;            /* Encoded body, built on first use (may be NULL) */
+    int shared;                      /* 1 for library and included macros (kept for the run) */
+    struct node *next;               /* Pointer to the next macro node */
+} node;
+
+/*
+ * Macro call list node:
+ * - Records where a macro body was expanded in the .am file, so the
+ *   second pass can encode the call site from the macro's template.
+ */
+typedef struct macro_call {
+    int line;                        /* First .am line of the expanded body */
+    node *macro;                     /* Macro that was expanded there */
+    struct macro_call *next;         /* Next call, in increasing line order */
+} macro_call;
+
+/*
+ * Adds a new macro node to the macro list.
+ * Parameters:
+ *   mem  - arena the list lives in (file_arena or batch_arena)
+ *   head - pointer to pointer to the macro list head
+ *   name - interned macro name (see names.h)
+ *   shared - 1 if the macro outlives the file (library or included macro)
+ * Returns:
+ *   Pointer to the new node, or NULL on allocation failure.
+ */
+node *create_macro(arena *mem, node **head, int name, int shared);
+
+/*
+ * Adds a line to a macro's storage.
+ * Parameters:
+ *   mem   - arena the macro lives in
+ *   macro - pointer to the macro node to modify
+ *   line  - the line string to add (will be duplicated)
+ * Does nothing if line limit reached.
+ */
+void add_line_to_macro(arena *mem, node *macro, const char *line);
+
+/*
+ * Frees the templates of a macro list. The nodes and their lines belong
+ * to the arena the list was built in.
+ * Parameters:
+ *   head - pointer to the head of the list
+ */
+void free_macro_list(node *head);
+
+/*
+ * Appends a macro call to the end of a call list.
+ * Parameters:
+ *   mem   - arena the list lives in
+ *   head  - pointer to pointer to the list head
+ *   tail  - pointer to pointer to the last node (kept up to date)
+ *   line  - first .am line of the expansion
+ *   macro - the expanded macro
+ * Returns:
+ *   Pointer to the new node, or NULL on allocation failure.
+ */
+macro_call *add_macro_call(arena *mem, macro_call **head, macro_call **tail, int line, node *macro);
+
+/*
+ * Adds a word to a macro template, growing its storage as needed.
+ * Returns 1 on success, 0 on allocation failure.
+ */
+int template_add_word(macro_template *tmpl, int word);
+
+/*
+ * Adds a relocation slot for the next word of a macro template.
+ * name is the id of the referenced symbol (see macro_template).
+ * Returns 1 on success, 0 on allocation failure.
+ */
+int template_add_slot(macro_template *tmpl, int name, int line);
+
+/*
+ * Frees a macro template and all its storage (NULL is allowed).
+ */
+void free_template(macro_template *tmpl);
+
+#endif /* DATA_STRCT_H */
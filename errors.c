@@ -1,16 +1,178 @@
-#include <stdio.h>
-#include "errors.h"
-
-/*
- * Prints a formatted error message to stderr, including the line number.
- * Parameters:
- *   msg      - Description of the error (should be a string literal or valid pointer)
- *   line_num - The line number in the source file where the error occurred
- *
- * Usage:
- *   report_error("Unknown opcode", 7);
- */
-void report_error(const char *msg, int line_num)
-{
-    fprintf(stderr, "Error (line %d): %s\n", line_num, msg);
-}
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include "errors.h"
+
+/* Prefix of every message: "Error (line N): " */
+#define ERROR_PREFIX_LENGTH 32
+
+/* One buffered error; its text is text[offset..offset+length) */
+typedef struct diagnostic {
+    int stage;
+    int line_num;
+    int order;      /* Report order, keeps sorting stable */
+    long offset;
+    int length;
+} diagnostic;
+
+static diagnostic *diags = NULL;
+static int diag_count = 0;
+static int diag_capacity = 0;
+
+static char *text = NULL;      /* Formatted messages, back to back */
+static long text_length = 0;
+static long text_capacity = 0;
+
+static int current_stage = STAGE_MACROS;
+static int max_errors = 0;     /* 0: no limit */
+
+/* Grows the buffers so one more message of up to extra bytes fits. */
+static int reserve(long extra) {
+    if (diag_count == diag_capacity) {
+        int capacity = diag_capacity ? diag_capacity * 2 : 32;
+        diagnostic *list = realloc(diags, capacity * sizeof(diagnostic));
+        if (!list) return 0;
+        diags = list;
+        diag_capacity = capacity;
+    }
+    if (text_length + extra > text_capacity) {
+        long capacity = text_capacity ? text_capacity : 4096;
+        char *buf;
+        while (text_length + extra > capacity) capacity *= 2;
+        buf = realloc(text, capacity);
+        if (!buf) return 0;
+        text = buf;
+        text_capacity = capacity;
+    }
+    return 1;
+}
+
+/*
+ * Adds a message to the buffer. If the buffer cannot grow the message
+ * is printed right away instead, so no error is ever lost.
+ */
+static void add_error(const char *msg, int line_num) {
+    long length = (long)strlen(msg) + ERROR_PREFIX_LENGTH;
+    diagnostic *d;
+
+    if (error_limit_reached()) return;
+    if (!reserve(length)) {
+        fprintf(stderr, "Error (line %d): %s\n", line_num, msg);
+        return;
+    }
+
+    d = &diags[diag_count];
+    d->stage = current_stage;
+    d->line_num = line_num;
+    d->order = diag_count;
+    d->offset = text_length;
+    d->length = sprintf(text + text_length, "Error (line %d): %s\n", line_num, msg);
+    text_length += d->length;
+    diag_count++;
+}
+
+/*
+ * Buffers an error message for the current file, including the line number.
+ * Parameters:
+ *   msg      - Description of the error (should be a string literal or valid pointer)
+ *   line_num - The line number in the source file where the error occurred
+ *
+ * Usage:
+ *   report_error("Unknown opcode", 7);
+ */
+void report_error(const char *msg, int line_num)
+{
+    add_error(msg, line_num);
+}
+
+/*
+ * Formats a message (at most MAX_ERROR_MESSAGE - 1 characters) and
+ * buffers it like report_error().
+ *
+ * Usage:
+ *   report_errorf(7, "Unknown opcode '%s'", opcode);
+ */
+void report_errorf(int line_num, const char *format, ...)
+{
+    char msg[MAX_ERROR_MESSAGE];
+    va_list args;
+
+    va_start(args, format);
+    vsprintf(msg, format, args);
+    va_end(args);
+    add_error(msg, line_num);
+}
+
+void set_error_stage(int stage)
+{
+    current_stage = stage;
+}
+
+void set_max_errors(int max)
+{
+    max_errors = max;
+}
+
+int error_limit_reached(void)
+{
+    return max_errors > 0 && diag_count >= max_errors;
+}
+
+/* qsort order: stage, then line, then report order */
+static int compare_diagnostics(const void *a, const void *b)
+{
+    const diagnostic *x = a;
+    const diagnostic *y = b;
+
+    if (x->stage != y->stage) return x->stage - y->stage;
+    if (x->line_num != y->line_num) return x->line_num - y->line_num;
+    return x->order - y->order;
+}
+
+/*
+ * Sorts the file's errors and writes them with one fwrite(). The sorted
+ * text is built in a second buffer; if that cannot be allocated the
+ * messages are written in report order instead.
+ */
+void flush_errors(void)
+{
+    char note[96];
+    char *out;
+    long length = 0;
+    int i, note_length = 0;
+
+    if (error_limit_reached())
+        note_length = sprintf(note, "Error limit reached (--max-errors %d), processing of the file stopped.\n", max_errors);
+    if (diag_count == 0 && note_length == 0) return;
+
+    qsort(diags, diag_count, sizeof(diagnostic), compare_diagnostics);
+    out = malloc(text_length + note_length + 1);
+    if (out) {
+        for (i = 0; i < diag_count; i++) {
+            memcpy(out + length, text + diags[i].offset, diags[i].length);
+            length += diags[i].length;
+        }
+        memcpy(out + length, note, note_length);
+        length += note_length;
+        fwrite(out, 1, length, stderr);
+        free(out);
+    } else {
+        fwrite(text, 1, text_length, stderr);
+        fwrite(note, 1, note_length, stderr);
+    }
+    fflush(stderr);
+
+    diag_count = 0;
+    text_length = 0;
+}
+
+void free_errors(void)
+{
+    free(diags);
+    free(text);
+    diags = NULL;
+    text = NULL;
+    diag_count = diag_capacity = 0;
+    text_length = text_capacity = 0;
+}
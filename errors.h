@@ -1,14 +1,68 @@
-#ifndef ERRORS_H
-#define ERRORS_H
-
-/*
- * Prints a formatted error message with line number to stderr.
- * Intended to standardize error output throughout the assembler project.
- *
- * Parameters:
- *   msg      - Null-terminated string describing the error
- *   line_num - Line number in the input source file (for context)
- */
-void report_error(const char *msg, int line_num);
-
-#endif /* ERRORS_H */
+#ifndef ERRORS_H
+#define ERRORS_H
+
+/*
+ * Diagnostics of the file being assembled:
+ * - Errors are not printed when they are reported but collected in a
+ *   buffer. flush_errors() sorts them by stage and line and writes them
+ *   to stderr in a single write, so the messages of one file are never
+ *   interleaved with anything else.
+ * - An optional cap (--max-errors) stops the current file early: once it
+ *   is reached, further errors are dropped and error_limit_reached()
+ *   tells the stages to stop.
+ */
+
+/* Stages of the assembler, in the order they run */
+#define STAGE_MACROS      0   /* Macro expansion (and library loading) */
+#define STAGE_FIRST_PASS  1
+#define STAGE_SECOND_PASS 2
+
+/*
+ * Longest message report_errorf() can format. Strings passed to it must
+ * be bounded (names are limited by the line length, paths by a precision
+ * such as "%.200s").
+ */
+#define MAX_ERROR_MESSAGE 512
+
+/*
+ * Records an error with the line number of the input source file.
+ * Intended to standardize error output throughout the assembler project.
+ *
+ * Parameters:
+ *   msg      - Null-terminated string describing the error
+ *   line_num - Line number in the input source file (for context)
+ */
+void report_error(const char *msg, int line_num);
+
+/*
+ * Same as report_error(), with a printf style message.
+ */
+void report_errorf(int line_num, const char *format, ...);
+
+/*
+ * Sets the stage the next errors are reported from.
+ */
+void set_error_stage(int stage);
+
+/*
+ * Sets the maximum number of errors per file (0 means no limit).
+ */
+void set_max_errors(int max);
+
+/*
+ * Returns 1 once the current file has reached the error limit.
+ */
+int error_limit_reached(void);
+
+/*
+ * Writes the collected errors to stderr, sorted by stage and line, and
+ * starts a new (empty) list for the next file.
+ */
+void flush_errors(void);
+
+/*
+ * Frees the error buffers.
+ */
+void free_errors(void);
+
+#endif /* ERRORS_H */
@@ -0,0 +1,3 @@
+; Fails in macro expansion (missing include file): no output file may remain
+.include "missing.inc"
+MAIN: stop
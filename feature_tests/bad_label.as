@@ -0,0 +1,3 @@
+; Fails in the first pass (duplicate label): no output file may remain
+MAIN: mov #1, r1
+MAIN: stop
@@ -0,0 +1,17 @@
+; Every operand mode, entries in both segments and extern uses
+.entry MAIN
+.entry MAT
+.extern SHOW
+.extern COUNT
+MAIN:   mov #-5, r1
+        mov MAT[r1][r2], COUNT
+        add LEN, r3
+        lea MSG, r4
+        cmp r3, #511
+        bne MAIN
+        jsr SHOW
+        prn MAT[r3][r4]
+        stop
+LEN:    .data 12, -512, 511
+MSG:    .string "bin"
+MAT:    .mat [2][2] 1, -2, 3, -4
@@ -0,0 +1,16 @@
+; .ifdef/.ifndef/.else/.endif: assembled without -D (conditional.*),
+; with -D DEBUG (conditional.debug.*) and with -D DEBUG -D QUIET
+; (conditional.quiet.*)
+MAIN:   mov #1, r1
+.ifdef DEBUG
+        prn r1
+.ifndef QUIET
+        prn #7
+.endif
+.else
+        inc r1
+.endif
+.ifndef DEBUG
+        clr r2
+.endif
+        stop
@@ -0,0 +1,10 @@
+; Includes a shared file twice (the guard skips the second one); that
+; file includes a second one, which the source includes again itself
+.include "include/common.inc"
+.include "include/common.inc"
+.include "include/regs.inc"
+MAIN:   mov r1, r2
+        PRINT_R1
+        SAVE_R2
+        lea TABLE, r3
+        stop
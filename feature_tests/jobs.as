@@ -0,0 +1,1064 @@
+; More than 4 x 256 lines, so --jobs 4 splits the file into 4 chunks
+.entry START
+.entry T0
+.extern OUTSIDE
+START:  mov #1, r1
+L0:    add #0, r0
+; line group 1
+        inc r1
+        inc r2
+; line group 3
+
+        inc r4
+; line group 5
+        inc r5
+        inc r6
+; line group 7
+        ; step 7
+        inc r0
+; line group 9
+        inc r1
+        inc r2
+; line group 11
+        inc r3
+        jmp L3
+; line group 13
+        inc r5
+        inc r6
+; line group 15
+        inc r7
+        inc r0
+; line group 17
+        inc r1
+        cmp T0, r2
+; line group 19
+        inc r3
+        inc r4
+; line group 21
+        jsr OUTSIDE
+        inc r6
+; line group 23
+        inc r7
+        inc r0
+; line group 25
+L1:    add #25, r1
+        inc r2
+; line group 27
+        inc r3
+
+; line group 29
+        inc r5
+        inc r6
+; line group 31
+        inc r7
+        ; step 32
+; line group 33
+        inc r1
+        inc r2
+; line group 35
+        inc r3
+        inc r4
+; line group 37
+        jmp L4
+        inc r6
+; line group 39
+        inc r7
+        inc r0
+; line group 41
+        inc r1
+        inc r2
+; line group 43
+        cmp T0, r2
+        inc r4
+; line group 45
+        inc r5
+        inc r6
+; line group 47
+        inc r7
+        inc r0
+; line group 49
+        inc r1
+L2:    add #50, r2
+; line group 51
+        inc r3
+        inc r4
+; line group 53
+
+        inc r6
+; line group 55
+        inc r7
+        inc r0
+; line group 57
+        ; step 57
+        inc r2
+; line group 59
+        inc r3
+        inc r4
+; line group 61
+        inc r5
+        jmp L5
+; line group 63
+        inc r7
+        inc r0
+; line group 65
+        inc r1
+        inc r2
+; line group 67
+        inc r3
+        cmp T0, r2
+; line group 69
+        inc r5
+        inc r6
+; line group 71
+        jsr OUTSIDE
+        inc r0
+; line group 73
+        inc r1
+        inc r2
+; line group 75
+L3:    add #75, r3
+        inc r4
+; line group 77
+        inc r5
+
+; line group 79
+        inc r7
+        inc r0
+; line group 81
+        inc r1
+        ; step 82
+; line group 83
+        inc r3
+        inc r4
+; line group 85
+        inc r5
+        inc r6
+; line group 87
+        jmp L6
+        inc r0
+; line group 89
+        inc r1
+        inc r2
+; line group 91
+        inc r3
+        inc r4
+; line group 93
+        cmp T0, r2
+        inc r6
+; line group 95
+        inc r7
+        inc r0
+; line group 97
+        inc r1
+        inc r2
+; line group 99
+        inc r3
+L4:    add #0, r4
+; line group 101
+        inc r5
+        inc r6
+; line group 103
+
+        inc r0
+; line group 105
+        inc r1
+        inc r2
+; line group 107
+        ; step 107
+        inc r4
+; line group 109
+        inc r5
+        inc r6
+; line group 111
+        inc r7
+        jmp L7
+; line group 113
+        inc r1
+        inc r2
+; line group 115
+        inc r3
+        inc r4
+; line group 117
+        inc r5
+        cmp T1, r2
+; line group 119
+        inc r7
+        inc r0
+; line group 121
+        jsr OUTSIDE
+        inc r2
+; line group 123
+        inc r3
+        inc r4
+; line group 125
+L5:    add #25, r5
+        inc r6
+; line group 127
+        inc r7
+
+; line group 129
+        inc r1
+        inc r2
+; line group 131
+        inc r3
+        ; step 132
+; line group 133
+        inc r5
+        inc r6
+; line group 135
+        inc r7
+        inc r0
+; line group 137
+        jmp L8
+        inc r2
+; line group 139
+        inc r3
+        inc r4
+; line group 141
+        inc r5
+        inc r6
+; line group 143
+        cmp T1, r2
+        inc r0
+; line group 145
+        inc r1
+        inc r2
+; line group 147
+        inc r3
+        inc r4
+; line group 149
+        inc r5
+L6:    add #50, r6
+; line group 151
+        inc r7
+        inc r0
+; line group 153
+
+        inc r2
+; line group 155
+        inc r3
+        inc r4
+; line group 157
+        ; step 157
+        inc r6
+; line group 159
+        inc r7
+        inc r0
+; line group 161
+        inc r1
+        jmp L9
+; line group 163
+        inc r3
+        inc r4
+; line group 165
+        inc r5
+        inc r6
+; line group 167
+        inc r7
+        cmp T1, r2
+; line group 169
+        inc r1
+        inc r2
+; line group 171
+        jsr OUTSIDE
+        inc r4
+; line group 173
+        inc r5
+        inc r6
+; line group 175
+L7:    add #75, r7
+        inc r0
+; line group 177
+        inc r1
+
+; line group 179
+        inc r3
+        inc r4
+; line group 181
+        inc r5
+        ; step 182
+; line group 183
+        inc r7
+        inc r0
+; line group 185
+        inc r1
+        inc r2
+; line group 187
+        jmp L10
+        inc r4
+; line group 189
+        inc r5
+        inc r6
+; line group 191
+        inc r7
+        inc r0
+; line group 193
+        cmp T1, r2
+        inc r2
+; line group 195
+        inc r3
+        inc r4
+; line group 197
+        inc r5
+        inc r6
+; line group 199
+        inc r7
+L8:    add #0, r0
+; line group 201
+        inc r1
+        inc r2
+; line group 203
+
+        inc r4
+; line group 205
+        inc r5
+        inc r6
+; line group 207
+        ; step 207
+        inc r0
+; line group 209
+        inc r1
+        inc r2
+; line group 211
+        inc r3
+        jmp L11
+; line group 213
+        inc r5
+        inc r6
+; line group 215
+        inc r7
+        inc r0
+; line group 217
+        inc r1
+        cmp T2, r2
+; line group 219
+        inc r3
+        inc r4
+; line group 221
+        jsr OUTSIDE
+        inc r6
+; line group 223
+        inc r7
+        inc r0
+; line group 225
+L9:    add #25, r1
+        inc r2
+; line group 227
+        inc r3
+
+; line group 229
+        inc r5
+        inc r6
+; line group 231
+        inc r7
+        ; step 232
+; line group 233
+        inc r1
+        inc r2
+; line group 235
+        inc r3
+        inc r4
+; line group 237
+        jmp L12
+        inc r6
+; line group 239
+        inc r7
+        inc r0
+; line group 241
+        inc r1
+        inc r2
+; line group 243
+        cmp T2, r2
+        inc r4
+; line group 245
+        inc r5
+        inc r6
+; line group 247
+        inc r7
+        inc r0
+; line group 249
+        inc r1
+L10:    add #50, r2
+; line group 251
+        inc r3
+        inc r4
+; line group 253
+
+        inc r6
+; line group 255
+        inc r7
+        inc r0
+; line group 257
+        ; step 257
+        inc r2
+; line group 259
+        inc r3
+        inc r4
+; line group 261
+        inc r5
+        jmp L13
+; line group 263
+        inc r7
+        inc r0
+; line group 265
+        inc r1
+        inc r2
+; line group 267
+        inc r3
+        cmp T2, r2
+; line group 269
+        inc r5
+        inc r6
+; line group 271
+        jsr OUTSIDE
+        inc r0
+; line group 273
+        inc r1
+        inc r2
+; line group 275
+L11:    add #75, r3
+        inc r4
+; line group 277
+        inc r5
+
+; line group 279
+        inc r7
+        inc r0
+; line group 281
+        inc r1
+        ; step 282
+; line group 283
+        inc r3
+        inc r4
+; line group 285
+        inc r5
+        inc r6
+; line group 287
+        jmp L14
+        inc r0
+; line group 289
+        inc r1
+        inc r2
+; line group 291
+        inc r3
+        inc r4
+; line group 293
+        cmp T2, r2
+        inc r6
+; line group 295
+        inc r7
+        inc r0
+; line group 297
+        inc r1
+        inc r2
+; line group 299
+        inc r3
+L12:    add #0, r4
+; line group 301
+        inc r5
+        inc r6
+; line group 303
+
+        inc r0
+; line group 305
+        inc r1
+        inc r2
+; line group 307
+        ; step 307
+        inc r4
+; line group 309
+        inc r5
+        inc r6
+; line group 311
+        inc r7
+        jmp L15
+; line group 313
+        inc r1
+        inc r2
+; line group 315
+        inc r3
+        inc r4
+; line group 317
+        inc r5
+        cmp T3, r2
+; line group 319
+        inc r7
+        inc r0
+; line group 321
+        jsr OUTSIDE
+        inc r2
+; line group 323
+        inc r3
+        inc r4
+; line group 325
+L13:    add #25, r5
+        inc r6
+; line group 327
+        inc r7
+
+; line group 329
+        inc r1
+        inc r2
+; line group 331
+        inc r3
+        ; step 332
+; line group 333
+        inc r5
+        inc r6
+; line group 335
+        inc r7
+        inc r0
+; line group 337
+        jmp L16
+        inc r2
+; line group 339
+        inc r3
+        inc r4
+; line group 341
+        inc r5
+        inc r6
+; line group 343
+        cmp T3, r2
+        inc r0
+; line group 345
+        inc r1
+        inc r2
+; line group 347
+        inc r3
+        inc r4
+; line group 349
+        inc r5
+L14:    add #50, r6
+; line group 351
+        inc r7
+        inc r0
+; line group 353
+
+        inc r2
+; line group 355
+        inc r3
+        inc r4
+; line group 357
+        ; step 357
+        inc r6
+; line group 359
+        inc r7
+        inc r0
+; line group 361
+        inc r1
+        jmp L17
+; line group 363
+        inc r3
+        inc r4
+; line group 365
+        inc r5
+        inc r6
+; line group 367
+        inc r7
+        cmp T3, r2
+; line group 369
+        inc r1
+        inc r2
+; line group 371
+        jsr OUTSIDE
+        inc r4
+; line group 373
+        inc r5
+        inc r6
+; line group 375
+L15:    add #75, r7
+        inc r0
+; line group 377
+        inc r1
+
+; line group 379
+        inc r3
+        inc r4
+; line group 381
+        inc r5
+        ; step 382
+; line group 383
+        inc r7
+        inc r0
+; line group 385
+        inc r1
+        inc r2
+; line group 387
+        jmp L18
+        inc r4
+; line group 389
+        inc r5
+        inc r6
+; line group 391
+        inc r7
+        inc r0
+; line group 393
+        cmp T3, r2
+        inc r2
+; line group 395
+        inc r3
+        inc r4
+; line group 397
+        inc r5
+        inc r6
+; line group 399
+        inc r7
+L16:    add #0, r0
+; line group 401
+        inc r1
+        inc r2
+; line group 403
+
+        inc r4
+; line group 405
+        inc r5
+        inc r6
+; line group 407
+        ; step 407
+        inc r0
+; line group 409
+        inc r1
+        inc r2
+; line group 411
+        inc r3
+        jmp L19
+; line group 413
+        inc r5
+        inc r6
+; line group 415
+        inc r7
+        inc r0
+; line group 417
+        inc r1
+        cmp T4, r2
+; line group 419
+        inc r3
+        inc r4
+; line group 421
+        jsr OUTSIDE
+        inc r6
+; line group 423
+        inc r7
+        inc r0
+; line group 425
+L17:    add #25, r1
+        inc r2
+; line group 427
+        inc r3
+
+; line group 429
+        inc r5
+        inc r6
+; line group 431
+        inc r7
+        ; step 432
+; line group 433
+        inc r1
+        inc r2
+; line group 435
+        inc r3
+        inc r4
+; line group 437
+        jmp L20
+        inc r6
+; line group 439
+        inc r7
+        inc r0
+; line group 441
+        inc r1
+        inc r2
+; line group 443
+        cmp T4, r2
+        inc r4
+; line group 445
+        inc r5
+        inc r6
+; line group 447
+        inc r7
+        inc r0
+; line group 449
+        inc r1
+L18:    add #50, r2
+; line group 451
+        inc r3
+        inc r4
+; line group 453
+
+        inc r6
+; line group 455
+        inc r7
+        inc r0
+; line group 457
+        ; step 457
+        inc r2
+; line group 459
+        inc r3
+        inc r4
+; line group 461
+        inc r5
+        jmp L21
+; line group 463
+        inc r7
+        inc r0
+; line group 465
+        inc r1
+        inc r2
+; line group 467
+        inc r3
+        cmp T4, r2
+; line group 469
+        inc r5
+        inc r6
+; line group 471
+        jsr OUTSIDE
+        inc r0
+; line group 473
+        inc r1
+        inc r2
+; line group 475
+L19:    add #75, r3
+        inc r4
+; line group 477
+        inc r5
+
+; line group 479
+        inc r7
+        inc r0
+; line group 481
+        inc r1
+        ; step 482
+; line group 483
+        inc r3
+        inc r4
+; line group 485
+        inc r5
+        inc r6
+; line group 487
+        jmp L22
+        inc r0
+; line group 489
+        inc r1
+        inc r2
+; line group 491
+        inc r3
+        inc r4
+; line group 493
+        cmp T4, r2
+        inc r6
+; line group 495
+        inc r7
+        inc r0
+; line group 497
+        inc r1
+        inc r2
+; line group 499
+        inc r3
+L20:    add #0, r4
+; line group 501
+        inc r5
+        inc r6
+; line group 503
+
+        inc r0
+; line group 505
+        inc r1
+        inc r2
+; line group 507
+        ; step 507
+        inc r4
+; line group 509
+        inc r5
+        inc r6
+; line group 511
+        inc r7
+        jmp L23
+; line group 513
+        inc r1
+        inc r2
+; line group 515
+        inc r3
+        inc r4
+; line group 517
+        inc r5
+        cmp T5, r2
+; line group 519
+        inc r7
+        inc r0
+; line group 521
+        jsr OUTSIDE
+        inc r2
+; line group 523
+        inc r3
+        inc r4
+; line group 525
+L21:    add #25, r5
+        inc r6
+; line group 527
+        inc r7
+
+; line group 529
+        inc r1
+        inc r2
+; line group 531
+        inc r3
+        ; step 532
+; line group 533
+        inc r5
+        inc r6
+; line group 535
+        inc r7
+        inc r0
+; line group 537
+        jmp L24
+        inc r2
+; line group 539
+        inc r3
+        inc r4
+; line group 541
+        inc r5
+        inc r6
+; line group 543
+        cmp T5, r2
+        inc r0
+; line group 545
+        inc r1
+        inc r2
+; line group 547
+        inc r3
+        inc r4
+; line group 549
+        inc r5
+L22:    add #50, r6
+; line group 551
+        inc r7
+        inc r0
+; line group 553
+
+        inc r2
+; line group 555
+        inc r3
+        inc r4
+; line group 557
+        ; step 557
+        inc r6
+; line group 559
+        inc r7
+        inc r0
+; line group 561
+        inc r1
+        jmp L25
+; line group 563
+        inc r3
+        inc r4
+; line group 565
+        inc r5
+        inc r6
+; line group 567
+        inc r7
+        cmp T5, r2
+; line group 569
+        inc r1
+        inc r2
+; line group 571
+        jsr OUTSIDE
+        inc r4
+; line group 573
+        inc r5
+        inc r6
+; line group 575
+L23:    add #75, r7
+        inc r0
+; line group 577
+        inc r1
+
+; line group 579
+        inc r3
+        inc r4
+; line group 581
+        inc r5
+        ; step 582
+; line group 583
+        inc r7
+        inc r0
+; line group 585
+        inc r1
+        inc r2
+; line group 587
+        jmp L26
+        inc r4
+; line group 589
+        inc r5
+        inc r6
+; line group 591
+        inc r7
+        inc r0
+; line group 593
+        cmp T5, r2
+        inc r2
+; line group 595
+        inc r3
+        inc r4
+; line group 597
+        inc r5
+        inc r6
+; line group 599
+        inc r7
+L24:    add #0, r0
+; line group 601
+        inc r1
+        inc r2
+; line group 603
+
+        inc r4
+; line group 605
+        inc r5
+        inc r6
+; line group 607
+        ; step 607
+        inc r0
+; line group 609
+        inc r1
+        inc r2
+; line group 611
+        inc r3
+        jmp L27
+; line group 613
+        inc r5
+        inc r6
+; line group 615
+        inc r7
+        inc r0
+; line group 617
+        inc r1
+        cmp T6, r2
+; line group 619
+        inc r3
+        inc r4
+; line group 621
+        jsr OUTSIDE
+        inc r6
+; line group 623
+        inc r7
+        inc r0
+; line group 625
+L25:    add #25, r1
+        inc r2
+; line group 627
+        inc r3
+
+; line group 629
+        inc r5
+        inc r6
+; line group 631
+        inc r7
+        ; step 632
+; line group 633
+        inc r1
+        inc r2
+; line group 635
+        inc r3
+        inc r4
+; line group 637
+        jmp L0
+        inc r6
+; line group 639
+        inc r7
+        inc r0
+; line group 641
+        inc r1
+        inc r2
+; line group 643
+        cmp T6, r2
+        inc r4
+; line group 645
+        inc r5
+        inc r6
+; line group 647
+        inc r7
+        inc r0
+; line group 649
+        inc r1
+L26:    add #50, r2
+; line group 651
+        inc r3
+        inc r4
+; line group 653
+
+        inc r6
+; line group 655
+        inc r7
+        inc r0
+; line group 657
+        ; step 657
+        inc r2
+; line group 659
+        inc r3
+        inc r4
+; line group 661
+        inc r5
+        jmp L1
+; line group 663
+        inc r7
+        inc r0
+; line group 665
+        inc r1
+        inc r2
+; line group 667
+        inc r3
+        cmp T6, r2
+; line group 669
+        inc r5
+        inc r6
+; line group 671
+        jsr OUTSIDE
+        inc r0
+; line group 673
+        inc r1
+        inc r2
+; line group 675
+L27:    add #75, r3
+        inc r4
+; line group 677
+        inc r5
+
+; line group 679
+        inc r7
+        inc r0
+; line group 681
+        inc r1
+        ; step 682
+; line group 683
+        inc r3
+        inc r4
+; line group 685
+        inc r5
+        inc r6
+; line group 687
+        jmp L2
+        inc r0
+; line group 689
+        inc r1
+        inc r2
+; line group 691
+        inc r3
+        inc r4
+; line group 693
+        cmp T6, r2
+        inc r6
+; line group 695
+        inc r7
+        inc r0
+; line group 697
+        inc r1
+        inc r2
+; line group 699
+        inc r3
+        stop
+T0:     .data 0, -0
+T1:     .data 1, -1
+T2:     .data 2, -2
+T3:     .data 3, -3
+T4:     .data 4, -4
+T5:     .data 5, -5
+T6:     .data 6, -6
+MSG:    .string "done"
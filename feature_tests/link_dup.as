@@ -0,0 +1,3 @@
+; Defines an entry link_lib.as defines as well
+.entry INCR
+INCR: rts
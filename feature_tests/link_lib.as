@@ -0,0 +1,9 @@
+; Library module: a routine and the counter it updates
+.entry INCR
+.entry TOTAL
+INCR: inc TOTAL
+         cmp TOTAL, #10
+         bne DONE
+         clr TOTAL
+DONE:    rts
+TOTAL:   .data 0
@@ -0,0 +1,10 @@
+; Main module of the linked program: uses the entries of link_lib.as
+.entry MAIN
+.extern INCR
+.extern TOTAL
+MAIN:   mov TOTAL, r1
+        jsr INCR
+        lea NAME, r2
+        mov r1, TOTAL
+        stop
+NAME:   .string "main"
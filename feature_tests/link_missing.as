@@ -0,0 +1,4 @@
+; Uses an extern no module of the link defines
+.extern SUBTRACT
+        jsr SUBTRACT
+        stop
@@ -0,0 +1,11 @@
+; Calls two library macros; its own "finish" overrides the library's
+mcro finish
+        inc r1
+        stop
+endmcro
+MAIN:   mov #5, r1
+        save_regs
+        mov VAL, r2
+        save_regs
+        finish
+VAL:    .data 7
@@ -0,0 +1,6 @@
+; Four broken lines: --max-errors 2 reports the first two and stops
+MAIN:   .data 1, x
+MAIN:   stop
+        .mat [0][1] 1
+        .string abc
+        stop
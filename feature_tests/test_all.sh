@@ -0,0 +1,294 @@
+#!/bin/sh
+
+# Runs the feature fixtures of this folder and compares what the tools
+# write with the outputs committed next to each fixture.
+
+ASSEMBLER=${ASSEMBLER:-../assembler}   # <- path to your assembler executable
+OBJCONV=${OBJCONV:-../objconv}         # <- path to the object converter
+LINKER=${LINKER:-../mmn14_link}        # <- path to the linker
+UNPACK=${UNPACK:-../unpack}            # <- path to the bundle extractor
+
+HERE=$(pwd)
+ASSEMBLER=$(cd "$(dirname "$ASSEMBLER")" && pwd)/$(basename "$ASSEMBLER")
+OBJCONV=$(cd "$(dirname "$OBJCONV")" && pwd)/$(basename "$OBJCONV")
+LINKER=$(cd "$(dirname "$LINKER")" && pwd)/$(basename "$LINKER")
+UNPACK=$(cd "$(dirname "$UNPACK")" && pwd)/$(basename "$UNPACK")
+WORK=$(mktemp -d)
+failures=0
+
+# check <test name> <written file> <committed file>: both missing also passes
+check() {
+    if [ ! -f "$2" ] && [ ! -f "$3" ]; then
+        echo "✅ $1"
+    elif cmp -s "$2" "$3"; then
+        echo "✅ $1"
+    else
+        echo "❌ $1: $2 does not match $3"
+        failures=$((failures + 1))
+    fi
+}
+
+echo "Running the feature tests..."
+
+# Two copies of a source in one run must both match the single-file
+# outputs, with synchronous and with background (--async-io) I/O
+echo "---------------------------"
+for io in sync async; do
+    options=
+    [ $io = async ] && options=--async-io
+    mkdir "$WORK/two_files_$io"
+    cp two_files.as "$WORK/two_files_$io/first.as"
+    cp two_files.as "$WORK/two_files_$io/second.as"
+    (cd "$WORK/two_files_$io" && "$ASSEMBLER" $options first.as second.as > /dev/null 2>&1)
+    for ext in ob ent ext; do
+        check "two_files.as ($io): first file .$ext" "$WORK/two_files_$io/first.as.$ext" "$HERE/two_files.as.$ext"
+        check "two_files.as ($io): second file .$ext" "$WORK/two_files_$io/second.as.$ext" "$HERE/two_files.as.$ext"
+    done
+done
+
+# A background write that cannot be put in place is reported and not
+# counted as rewritten
+mkdir "$WORK/async_fail" "$WORK/async_fail/first.as.ob"
+cp two_files.as "$WORK/async_fail/first.as"
+(cd "$WORK/async_fail" && "$ASSEMBLER" --async-io --write-if-changed first.as 2>&1 | grep -E "^(Error|Outputs)" > async_fail.log)
+check "two_files.as: failed --async-io write" "$WORK/async_fail/async_fail.log" "$HERE/async_fail.log"
+
+# --io-threads reads and writes on worker threads; the outputs are the same
+echo "---------------------------"
+mkdir "$WORK/io_threads"
+cp two_files.as "$WORK/io_threads/first.as"
+cp two_files.as "$WORK/io_threads/second.as"
+(cd "$WORK/io_threads" && "$ASSEMBLER" --io-threads=2,1 first.as second.as > /dev/null 2>&1)
+for ext in ob ent ext; do
+    check "two_files.as: --io-threads first file .$ext" "$WORK/io_threads/first.as.$ext" "$HERE/two_files.as.$ext"
+    check "two_files.as: --io-threads second file .$ext" "$WORK/io_threads/second.as.$ext" "$HERE/two_files.as.$ext"
+done
+
+# --macro-lib macros are expanded in every file of the run; a file's own
+# macro of the same name wins
+echo "---------------------------"
+mkdir "$WORK/macro_lib"
+cp macro_lib.mac "$WORK/macro_lib/"
+cp macro_lib.as "$WORK/macro_lib/first.as"
+cp macro_lib.as "$WORK/macro_lib/second.as"
+(cd "$WORK/macro_lib" && "$ASSEMBLER" --macro-lib macro_lib.mac first.as second.as > /dev/null 2>&1)
+for name in first second; do
+    check "macro_lib.as: $name file .am" "$WORK/macro_lib/$name.am" "$HERE/macro_lib.am"
+    for ext in ob ent ext; do
+        check "macro_lib.as: $name file .$ext" "$WORK/macro_lib/$name.as.$ext" "$HERE/macro_lib.as.$ext"
+    done
+done
+
+# -D defines names for .ifdef/.ifndef; each set of names keeps its own
+# lines of the source
+echo "---------------------------"
+for variant in plain debug quiet; do
+    case $variant in
+        plain) defines= ; expected=conditional ;;
+        debug) defines="-D DEBUG" ; expected=conditional.debug ;;
+        quiet) defines="-D DEBUG -D QUIET" ; expected=conditional.quiet ;;
+    esac
+    mkdir "$WORK/$variant"
+    cp conditional.as "$WORK/$variant/"
+    (cd "$WORK/$variant" && "$ASSEMBLER" $defines conditional.as > /dev/null 2>&1)
+    check "conditional.as ($variant): .am" "$WORK/$variant/conditional.am" "$HERE/$expected.am"
+    for ext in ob ent ext; do
+        check "conditional.as ($variant): .$ext" "$WORK/$variant/conditional.as.$ext" "$HERE/$expected.as.$ext"
+    done
+done
+
+# .include pulls files in once each, nested ones resolved next to the
+# file that includes them
+echo "---------------------------"
+mkdir "$WORK/include"
+cp -r include.as include "$WORK/include/"
+(cd "$WORK/include" && "$ASSEMBLER" include.as > /dev/null 2>&1)
+check "include.as: .am" "$WORK/include/include.am" "$HERE/include.am"
+for ext in ob ent ext; do
+    check "include.as: .$ext" "$WORK/include/include.as.$ext" "$HERE/include.as.$ext"
+done
+
+# A file that fails at any stage removes the outputs of an earlier run
+echo "---------------------------"
+for name in bad_label bad_include; do
+    for ext in ob ent ext; do
+        cp "two_files.as.$ext" "$WORK/$name.as.$ext"
+    done
+    cp "$name.as" "$WORK/$name.as"
+    (cd "$WORK" && "$ASSEMBLER" "$name.as" > /dev/null 2>&1)
+    for ext in ob ent ext; do
+        check "$name.as: stale .$ext removed" "$WORK/$name.as.$ext" "$HERE/$name.as.$ext"
+    done
+done
+
+# --binary writes the .obj next to the text outputs; objconv converts
+# either form into the other
+echo "---------------------------"
+mkdir "$WORK/binary" "$WORK/binary_async" "$WORK/to_text" "$WORK/to_binary"
+cp binary.as "$WORK/binary/"
+cp binary.as "$WORK/binary_async/"
+(cd "$WORK/binary" && "$ASSEMBLER" --binary binary.as > /dev/null 2>&1)
+(cd "$WORK/binary_async" && "$ASSEMBLER" --async-io --binary binary.as > /dev/null 2>&1)
+for ext in ob ent ext obj; do
+    check "binary.as: --binary .$ext" "$WORK/binary/binary.as.$ext" "$HERE/binary.as.$ext"
+    check "binary.as: --async-io --binary .$ext" "$WORK/binary_async/binary.as.$ext" "$HERE/binary.as.$ext"
+done
+cp binary.as.obj "$WORK/to_text/"
+(cd "$WORK/to_text" && "$OBJCONV" -t binary.as > /dev/null 2>&1)
+for ext in ob ent ext; do
+    check "binary.as: objconv -t .$ext" "$WORK/to_text/binary.as.$ext" "$HERE/binary.as.$ext"
+done
+# An object made from the text has no relocations, so it is only
+# compared after converting it back
+cp binary.as.ob binary.as.ent binary.as.ext "$WORK/to_binary/"
+(cd "$WORK/to_binary" && "$OBJCONV" binary.as > /dev/null 2>&1 &&
+    rm binary.as.ob binary.as.ent binary.as.ext && "$OBJCONV" -t binary.as > /dev/null 2>&1)
+for ext in ob ent ext; do
+    check "binary.as: objconv round trip .$ext" "$WORK/to_binary/binary.as.$ext" "$HERE/binary.as.$ext"
+done
+
+# Two modules link into one .ob; a missing or a duplicate entry fails
+# the link with a message and writes nothing
+echo "---------------------------"
+mkdir "$WORK/link"
+cp link_main.as link_lib.as link_missing.as link_dup.as "$WORK/link/"
+(cd "$WORK/link" && "$ASSEMBLER" --binary link_main.as link_lib.as link_missing.as link_dup.as > /dev/null 2>&1)
+(cd "$WORK/link" && "$LINKER" linked link_main.as link_lib.as > /dev/null 2>&1)
+check "link_main.as + link_lib.as: linked .ob" "$WORK/link/linked.ob" "$HERE/linked.ob"
+for name in missing dup; do
+    (cd "$WORK/link" && "$LINKER" "$name" link_main.as link_lib.as "link_$name.as" > /dev/null 2> "link_$name.log")
+    check "link_$name.as: link error" "$WORK/link/link_$name.log" "$HERE/link_$name.log"
+    check "link_$name.as: no .ob written" "$WORK/link/$name.ob" "$HERE/$name.ob"
+done
+
+# --max-errors stops reporting (and assembling) at the limit
+echo "---------------------------"
+cp max_errors.as "$WORK/"
+(cd "$WORK" && "$ASSEMBLER" --max-errors 2 max_errors.as 2> max_errors.log > /dev/null)
+check "max_errors.as: --max-errors 2 messages" "$WORK/max_errors.log" "$HERE/max_errors.log"
+check "max_errors.as: no .ob written" "$WORK/max_errors.as.ob" "$HERE/max_errors.as.ob"
+
+# An undefined label fails the first pass, which skips the second; the
+# instruction errors only the encoder reports are still listed
+echo "---------------------------"
+cp undefined_label.as "$WORK/"
+(cd "$WORK" && "$ASSEMBLER" undefined_label.as 2> undefined_label.log > /dev/null)
+check "undefined_label.as: every error reported" "$WORK/undefined_label.log" "$HERE/undefined_label.log"
+
+# --write-if-changed leaves outputs that would not change alone (their
+# modification times are kept) and counts them; after an edit only the
+# changed outputs are rewritten
+echo "---------------------------"
+mkdir "$WORK/unchanged"
+cp two_files.as "$WORK/unchanged/"
+(cd "$WORK/unchanged" &&
+    "$ASSEMBLER" --write-if-changed two_files.as | grep "^Outputs" > ../write_if_changed.log &&
+    touch -t 200001010000 stamp two_files.am two_files.as.ob two_files.as.ent two_files.as.ext &&
+    "$ASSEMBLER" --write-if-changed two_files.as | grep "^Outputs" >> ../write_if_changed.log &&
+    find . -type f -newer stamp ! -name two_files.as > ../rewritten &&
+    sed 's/#4/#5/' two_files.as > edited.as && mv edited.as two_files.as &&
+    "$ASSEMBLER" --write-if-changed two_files.as | grep "^Outputs" >> ../write_if_changed.log &&
+    find . -type f -newer stamp ! -name two_files.as | sort >> ../rewritten)
+check "two_files.as: --write-if-changed counts" "$WORK/write_if_changed.log" "$HERE/write_if_changed.log"
+check "two_files.as: --write-if-changed keeps the times" "$WORK/rewritten" "$HERE/write_if_changed.rewritten"
+
+# --jobs splits a long file (over 4 x 256 lines) into chunks scanned and
+# encoded on several threads; the outputs and the errors must be those
+# of a plain run, which the committed files hold
+echo "---------------------------"
+for jobs in 1 4; do
+    mkdir "$WORK/jobs$jobs"
+    cp jobs.as jobs_errors.as "$WORK/jobs$jobs/"
+    (cd "$WORK/jobs$jobs" && "$ASSEMBLER" --jobs $jobs jobs.as jobs_errors.as 2> jobs_errors.log > /dev/null)
+    for ext in ob ent ext; do
+        check "jobs.as: --jobs $jobs .$ext" "$WORK/jobs$jobs/jobs.as.$ext" "$HERE/jobs.as.$ext"
+    done
+    check "jobs_errors.as: --jobs $jobs messages" "$WORK/jobs$jobs/jobs_errors.log" "$HERE/jobs_errors.log"
+done
+
+# --bundle writes every output into one archive and none next to the
+# sources; unpack extracts the same files the plain run writes
+echo "---------------------------"
+mkdir "$WORK/bundle" "$WORK/bundle/out"
+cp two_files.as binary.as "$WORK/bundle/"
+(cd "$WORK/bundle" && "$ASSEMBLER" --bundle outputs.bundle two_files.as binary.as > /dev/null 2>&1)
+check "two_files.as: no .ob next to the source with --bundle" "$WORK/bundle/two_files.as.ob" "$HERE/bundle_two_files.as.ob"
+(cd "$WORK/bundle/out" && "$UNPACK" ../outputs.bundle > /dev/null 2>&1)
+for name in two_files binary; do
+    for ext in ob ent ext; do
+        check "$name.as: unpacked .$ext" "$WORK/bundle/out/$name.as.$ext" "$HERE/$name.as.$ext"
+    done
+done
+
+# --stream reads the source and the .am in blocks; the outputs are the same
+echo "---------------------------"
+mkdir "$WORK/stream"
+cp two_files.as binary.as "$WORK/stream/"
+(cd "$WORK/stream" && "$ASSEMBLER" --stream two_files.as binary.as > /dev/null 2>&1)
+for name in two_files binary; do
+    for ext in ob ent ext; do
+        check "$name.as: --stream .$ext" "$WORK/stream/$name.as.$ext" "$HERE/$name.as.$ext"
+    done
+done
+
+# "-" reads the source from standard input and writes its outputs to
+# standard output as framed sections ("<name> <length>" then the text)
+echo "---------------------------"
+mkdir "$WORK/stdin"
+for ext in ob ent ext; do
+    printf '%s %d\n' "$ext" "$(wc -c < "two_files.as.$ext")"
+    cat "two_files.as.$ext"
+done > "$WORK/stdin/expected"
+(cd "$WORK/stdin" && "$ASSEMBLER" - < "$HERE/two_files.as" > written 2> /dev/null)
+check "two_files.as: - (standard input) frames" "$WORK/stdin/written" "$WORK/stdin/expected"
+
+# --lsp answers a framed JSON-RPC session (initialize, didOpen, two
+# ranged didChange edits, hover, definition, shutdown and exit) with the
+# committed responses and diagnostics, and exits with status 0
+echo "---------------------------"
+"$ASSEMBLER" --lsp < lsp_session.in > "$WORK/lsp_session.out" 2> /dev/null
+echo "$?" > "$WORK/lsp_session.status"
+echo 0 > "$WORK/lsp_session.expected_status"
+check "lsp_session.in: responses" "$WORK/lsp_session.out" "$HERE/lsp_session.out"
+check "lsp_session.in: exit status" "$WORK/lsp_session.status" "$WORK/lsp_session.expected_status"
+
+# --watch assembles every source once, then once per burst of saves each
+# source that changed or includes a changed file (inotify, so Linux only)
+echo "---------------------------"
+mkdir "$WORK/watch" "$WORK/watch/src"
+cp watch_a.as watch_b.as watch_c.as watch_shared.inc "$WORK/watch/src/"
+(
+    cd "$WORK/watch"
+    # The timeout never leaves the watcher behind, even if a step hangs
+    timeout 20 "$ASSEMBLER" --watch src > watch.log 2>&1 &
+    pid=$!
+    seen=0
+    burst() {
+        sleep 1
+        grep "^----- Assembling" watch.log | sed 's|.*/||; s| -----$||' > assembled
+        tail -n +$((seen + 1)) assembled | sort | sed "s/^/$1: /" >> bursts
+        seen=$(wc -l < assembled)
+    }
+    : > bursts
+    burst start
+    touch src/watch_c.as; touch src/watch_c.as; touch src/watch_c.as
+    burst source
+    touch src/watch_shared.inc; touch src/watch_shared.inc
+    burst include
+    kill $pid 2> /dev/null
+    wait $pid 2> /dev/null
+)
+if grep -q "Cannot watch" "$WORK/watch/watch.log"; then
+    echo "⏭ watch: not available on this system"
+else
+    check "watch: one assembly per source per burst" "$WORK/watch/bursts" "$HERE/watch.bursts"
+fi
+
+rm -rf "$WORK"
+echo "---------------------------"
+if [ $failures -eq 0 ]; then
+    echo "All feature tests passed!"
+else
+    echo "$failures feature test(s) failed"
+    exit 1
+fi
@@ -0,0 +1,12 @@
+; Labels in both segments, an entry of each kind and an extern use
+.entry MAIN
+.entry LIST
+.extern PRINT
+MAIN:   mov LIST, r1
+        lea STR, r2
+LOOP:   cmp r1, #4
+        bne LOOP
+        jsr PRINT
+        stop
+LIST:   .data 3, -7, 12
+STR:    .string "ok"
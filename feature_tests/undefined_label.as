@@ -0,0 +1,6 @@
+; An undefined label fails the first pass; the errors the encoder
+; finds in the other lines are still reported
+MAIN:   bogus r1
+        mov #9999, r1
+        jmp NOPE
+        stop
@@ -0,0 +1,4 @@
+; Watched source that includes watch_shared.inc
+.include "watch_shared.inc"
+MAIN:   mov ONE, r1
+        stop
@@ -0,0 +1,4 @@
+; A second watched source that includes watch_shared.inc
+.include "watch_shared.inc"
+MAIN:   add ONE, r2
+        stop
@@ -0,0 +1,3 @@
+; Watched source without includes
+MAIN:   inc r3
+        stop
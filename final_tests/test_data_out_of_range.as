@@ -0,0 +1,3 @@
+; test_data_out_of_range.as
+A: .data 511, -512
+B: .data 512, -513
@@ -0,0 +1,5 @@
+; test_immediate_out_of_range.as
+mov #511, r1
+prn #-512
+cmp #512, r2
+prn #-513
@@ -0,0 +1,3 @@
+; test_mat_out_of_range.as
+M1: .mat [2][2] 511, -512, 0, 1
+M2: .mat [2][2] 1, 2, 600, 4
@@ -1,319 +1,734 @@
-#include <stdio.h>
-#include <string.h>
-#include <stdlib.h>
-#include <ctype.h>
-#include "globals.h"
-#include "table.h"
-#include "errors.h"
-
-int is_comment_or_empty(const char *line) {
-    while (*line) {
-        if (!isspace(*line)) return (*line == ';' || *line == '\n');
-        line++;
-    }
-    return 1;
-}
-
-const char *skip_whitespace(const char *str) {
-    while (*str && isspace((unsigned char)*str)) str++;
-    return str;
-}
-
-int validate_label(const char *label) {
-    int i, len = strlen(label);
-    const char *reserved[] = {
-        "mov","cmp","add","sub","not","clr","lea","inc","dec","jmp","bne",
-        "red","prn","jsr","rts","stop",
-        "r0","r1","r2","r3","r4","r5","r6","r7",
-        ".data",".string",".mat",".entry",".extern"
-    };
-    int reserved_count = sizeof(reserved) / sizeof(reserved[0]);
-
-    if (!isalpha(label[0]) || len > MAX_LABEL_LENGTH)
-        return 0;
-
-    for (i = 1; i < len; i++) {
-        if (!isalnum(label[i]))
-            return 0;
-    }
-
-    for (i = 0; i < reserved_count; i++) {
-        if (strcmp(label, reserved[i]) == 0)
-            return 0;
-    }
-
-    return 1;
-}
-
-int is_reserved_word(const char *word) {
-    const char *reserved[] = {
-        "mov", "cmp", "add", "sub", "not", "clr",
-        "lea", "inc", "dec", "jmp", "bne", "red",
-        "prn", "jsr", "rts", "stop",
-        "r0", "r1", "r2", "r3", "r4", "r5", "r6", "r7",
-        ".data", ".string", ".entry", ".extern", ".mat"
-    };
-    int i;
-    for (i = 0; i < sizeof(reserved)/sizeof(reserved[0]); i++) {
-        if (strcmp(word, reserved[i]) == 0)
-            return 1;
-    }
-    return 0;
-}
-
-int detectlabel(const char *line, char *label) {
-    const char *p = skip_whitespace(line);
-    int i = 0;
-
-    while (*p && *p != ':' && !isspace(*p) && i < MAX_LABEL_LENGTH) {
-        label[i++] = *p++;
-    }
-
-    label[i] = '\0';
-
-    if (*p == ':' && validate_label(label)) {
-        return 1; /* valid label */
-    }
-
-    return 0; /* not a valid label */
-}
-
-const char* skip_label_colon(const char *line) {
-    const char *p = strchr(line, ':');
-    if (!p) return line;
-    p++;
-    while (*p && isspace(*p)) p++;
-    return p;
-}
-
-int is_directive(const char *line, char *directive_name) {
-    const char *p = skip_whitespace(line);
-    int i = 0;
-    if (*p != '.') return 0;
-    while (*p && !isspace(*p) && i < 9) directive_name[i++] = *p++;
-    directive_name[i] = '\0';
-    return (!strcmp(directive_name, ".data") || !strcmp(directive_name, ".string") ||
-            !strcmp(directive_name, ".extern") || !strcmp(directive_name, ".entry") ||
-            !strcmp(directive_name, ".mat"));
-}
-
-/* Count how many words will be generated by a given instruction line */
-int count_instruction_words(const char *line) {
-    char copy[MAX_LINE_LENGTH], opcode[10], src[50], dst[50];
-    const char *p = skip_whitespace(line);
-    int count = 1; /* Always at least one word for the instruction itself */
-    int comma;
-    int op_len = 0, i;
-
-    /* Extract opcode */
-    while (*p && !isspace(*p) && op_len < 9) {
-        opcode[op_len++] = *p++;
-    }
-    opcode[op_len] = '\0';
-
-    /* Only handle real instructions (skip .directives) */
-    if (opcode[0] == '.') return 0;
-
-    /* Parse operands */
-    while (*p && isspace((unsigned char)*p)) p++;
-    strncpy(copy, p, MAX_LINE_LENGTH - 1);
-    copy[MAX_LINE_LENGTH-1] = '\0';
-    comma = 0;
-    for (i = 0; copy[i]; i++) {
-        if (copy[i] == ',') comma = 1;
-    }
-    src[0] = dst[0] = '\0';
-
-    if (comma) {
-        /* Two operands */
-        char *comma_ptr = strchr(copy, ',');
-        if (comma_ptr) {
-            *comma_ptr = '\0';
-            strncpy(src, copy, 49); src[49] = '\0';
-            strncpy(dst, comma_ptr + 1, 49); dst[49] = '\0';
-        }
-    } else if (copy[0]) {
-        /* One operand */
-        strncpy(dst, copy, 49); dst[49] = '\0';
-    }
-    /* Clean whitespace */
-    for (i = strlen(src)-1; i >= 0 && isspace((unsigned char)src[i]); i--) src[i] = '\0';
-    for (i = strlen(dst)-1; i >= 0 && isspace((unsigned char)dst[i]); i--) dst[i] = '\0';
-    for (i = 0; src[i] && isspace((unsigned char)src[i]); i++);
-    if (i > 0) memmove(src, src+i, strlen(src)-i+1);
-    for (i = 0; dst[i] && isspace((unsigned char)dst[i]); i++);
-    if (i > 0) memmove(dst, dst+i, strlen(dst)-i+1);
-
-    /* Source operand */
-    if (src[0]) {
-        if (src[0] == '#') {
-            count++; /* Immediate value needs extra word */
-        } else if (strncmp(src, "r", 1) == 0 && strlen(src) == 2 && src[1] >= '0' && src[1] <= '7') {
-            /* Register only, no extra word */
-        } else if (strchr(src, '[')) {
-            /* Matrix operand: needs extra words for label and each index register */
-            count += 2; /* Base label + two indices */
-        } else {
-            count++; /* Label addressing: needs extra word */
-        }
-    }
-    /* Destination operand */
-    if (dst[0]) {
-        if (dst[0] == '#') {
-            count++;
-        } else if (strncmp(dst, "r", 1) == 0 && strlen(dst) == 2 && dst[1] >= '0' && dst[1] <= '7') {
-            /* Register only, no extra word */
-        } else if (strchr(dst, '[')) {
-            count += 2;
-        } else {
-            count++;
-        }
-    }
-    /* Remove over-count if both src & dst are registers (as only main word needed) */
-    if (src[0] && dst[0] &&
-        strncmp(src, "r", 1) == 0 && strlen(src) == 2 && src[1] >= '0' && src[1] <= '7' &&
-        strncmp(dst, "r", 1) == 0 && strlen(dst) == 2 && dst[1] >= '0' && dst[1] <= '7') {
-        count = 1;
-    }
-    return count;
-}
-
-/* Handle .data directive */
-void handle_data_directive(const char *line, int line_num) {
-    const char *p = strstr(line, ".data");
-    char num_str[20]; int val, i = 0; char *endptr;
-    if (!p) return;
-    p += 5;
-    while (*p) {
-        p = skip_whitespace(p);
-        if (!*p) break;
-        i = 0;
-        while (*p && *p != ',' && !isspace(*p) && i < 19) num_str[i++] = *p++;
-        num_str[i] = '\0';
-        if (i == 0) { report_error("Missing number in .data", line_num); error_flag = 1; return; }
-        val = strtol(num_str, &endptr, 10);
-        if (*endptr != '\0') { report_error("Invalid number in .data", line_num); error_flag = 1; return; }
-        if (data_counter >= MAX_DATA_SIZE) { report_error("Data memory overflow", line_num); error_flag = 1; return; }
-        data_memory[data_counter++] = val;
-        p = skip_whitespace(p);
-        if (*p == ',') p++;
-    }
-}
-
-void handle_string_directive(const char *line, int line_num) {
-    const char *start = strchr(line, '"');
-    const char *end;
-    if (!start) { report_error("Missing opening quote", line_num); error_flag = 1; return; }
-    start++;
-    end = strchr(start, '"');
-    if (!end) { report_error("Missing closing quote", line_num); error_flag = 1; return; }
-    while (start < end) {
-        if (data_counter >= MAX_DATA_SIZE) { report_error("Data memory overflow", line_num); error_flag = 1; return; }
-        data_memory[data_counter++] = *start++;
-    }
-    data_memory[data_counter++] = 0;
-}
-
-void handle_mat_directive(const char *line, int line_num) {
-    const char *p = strstr(line, ".mat");
-    int rows = 0, cols = 0, val, i = 0; char *endptr;
-    if (!p) return;
-    p += 4;
-    p = skip_whitespace(p);
-    if (*p++ != '[' || (rows = strtol(p, &endptr, 10)) <= 0 || *endptr != ']') {
-        report_error("Invalid matrix rows", line_num); error_flag = 1; return;
-    }
-    p = endptr + 1;
-    if (*p++ != '[' || (cols = strtol(p, &endptr, 10)) <= 0 || *endptr != ']') {
-        report_error("Invalid matrix cols", line_num); error_flag = 1; return;
-    }
-    p = endptr + 1;
-    for (i = 0; i < rows * cols; i++) {
-        p = skip_whitespace(p);
-        if (!*p) break;
-        val = strtol(p, &endptr, 10);
-        if (p == endptr) {
-            report_error("Invalid matrix value", line_num); error_flag = 1; return;
-        }
-        if (data_counter >= MAX_DATA_SIZE) {
-            report_error("Matrix data overflow", line_num); error_flag = 1; return;
-        }
-        data_memory[data_counter++] = val;
-        p = endptr;
-        p = skip_whitespace(p);
-        if (*p == ',') p++;
-    }
-}
-
-void update_data_symbol_addresses(label_entry *head) {
-    while (head) {
-        if ((head->attributes & 2) != 0)
-            head->address += inst_counter;
-        head = head->next;
-    }
-}
-
-int first_pass(FILE *fp) {
-    char line[MAX_LINE_LENGTH];
-    char label[MAX_LABEL_LENGTH + 1];
-    char directive[10];
-    int line_num = 0, has_label, i;
-    const char *after_label;
-
-
-    data_counter = 0;
-    error_flag = 0;
-
-    while (fgets(line, MAX_LINE_LENGTH, fp)) {
-        line_num++;
-        if (is_comment_or_empty(line)) continue;
-
-        has_label = detectlabel(line, label);
-        after_label = line;
-        if (has_label) {
-            if (!validate_label(label)) {
-                report_error("Invalid label name", line_num);
-                error_flag = 1;
-            } else if (find_symbol(symbol_table, label)) {
-                report_error("Duplicate label", line_num);
-                error_flag = 1;
-            } else {
-                add_symbol(&symbol_table, label, inst_counter, 1);
-            }
-            after_label = skip_label_colon(line);
-        }
-
-        if (is_directive(after_label, directive)) {
-            if (has_label && strcmp(directive, ".extern") && strcmp(directive, ".entry")) {
-                /* mark as data */
-                symbol_table->attributes = 2;
-                symbol_table->address = data_counter;
-            }
-            if (!strcmp(directive, ".data")) handle_data_directive(after_label, line_num);
-            else if (!strcmp(directive, ".string")) handle_string_directive(after_label, line_num);
-            else if (!strcmp(directive, ".mat")) handle_mat_directive(after_label, line_num);
-            else if (!strcmp(directive, ".extern")) {
-                const char *p = strstr(after_label, ".extern") + 7;
-                char extern_label[MAX_LABEL_LENGTH];
-                i = 0;
-                p = skip_whitespace(p);
-                while (*p && !isspace(*p) && i < MAX_LABEL_LENGTH) extern_label[i++] = *p++;
-                extern_label[i] = '\0';
-                if (!validate_label(extern_label)) {
-                    report_error("Invalid extern label", line_num);
-                    error_flag = 1;
-                } else {
-                    add_symbol(&symbol_table, extern_label, 0, 4);
-                }
-            }
-            continue;
-        }
-
-        /* --------- KEY FIX: count words per instruction ---------- */
-        inst_counter += count_instruction_words(after_label);
-
-    }
-
-    update_data_symbol_addresses(symbol_table);
-    return error_flag;
-}
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include "globals.h"
+#include "table.h"
+#include "errors.h"
+#include "source.h"
+#include "scanner.h"
+#include "numbers.h"
+#include "names.h"
+#include "arena.h"
+#include "code_conversion.h"
+#include "parallel.h"
+#include "stream.h"
+#include "first_pass.h"
+#include "second_pass.h"
+
+/*
+ * Symbol reference made by an instruction:
+ * - Collected during the first pass and checked against the symbol
+ *   table once every label is known.
+ */
+typedef struct symbol_ref {
+    int name;                  /* file_names id of the symbol */
+    int line;                  /* .am line of the reference */
+    struct symbol_ref *next;
+} symbol_ref;
+
+/* .entry names collected so far, in line order */
+static symbol_ref *entries = NULL;
+static symbol_ref **entries_tail = &entries;
+
+/*
+ * Error the encoder will report for an instruction. Kept until the end
+ * of the pass: if the pass fails the second pass is skipped, so they are
+ * reported then instead.
+ */
+typedef struct line_error {
+    char *message;             /* In file_arena */
+    int line;
+    struct line_error *next;
+} line_error;
+
+/* Instruction errors collected so far, in line order */
+static line_error *bad_lines = NULL;
+static line_error **bad_lines_tail = &bad_lines;
+
+/* Empty or comment line: the first non-blank character (if any) is ';' */
+int is_comment_or_empty(const char *line, const line_info *info) {
+    if (info->indent >= info->length) return 1;
+    return line[info->indent] == ';';
+}
+
+const char *skip_whitespace(const char *str) {
+    while (*str && isspace((unsigned char)*str)) str++;
+    return str;
+}
+
+/* Checks a label of len characters (not necessarily NUL terminated). */
+int validate_label(const char *label, int len) {
+    int i;
+    const char *reserved[] = {
+        "mov","cmp","add","sub","not","clr","lea","inc","dec","jmp","bne",
+        "red","prn","jsr","rts","stop",
+        "r0","r1","r2","r3","r4","r5","r6","r7",
+        ".data",".string",".mat",".entry",".extern"
+    };
+    int reserved_count = sizeof(reserved) / sizeof(reserved[0]);
+
+    if (len < 1 || !isalpha((unsigned char)label[0]) || len > MAX_LABEL_LENGTH)
+        return 0;
+
+    for (i = 1; i < len; i++) {
+        if (!isalnum((unsigned char)label[i]))
+            return 0;
+    }
+
+    for (i = 0; i < reserved_count; i++) {
+        if (strncmp(label, reserved[i], len) == 0 && reserved[i][len] == '\0')
+            return 0;
+    }
+
+    return 1;
+}
+
+int is_reserved_word(const char *word) {
+    const char *reserved[] = {
+        "mov", "cmp", "add", "sub", "not", "clr",
+        "lea", "inc", "dec", "jmp", "bne", "red",
+        "prn", "jsr", "rts", "stop",
+        "r0", "r1", "r2", "r3", "r4", "r5", "r6", "r7",
+        ".data", ".string", ".entry", ".extern", ".mat"
+    };
+    int i;
+    for (i = 0; i < sizeof(reserved)/sizeof(reserved[0]); i++) {
+        if (strcmp(word, reserved[i]) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+/*
+ * A label is the first word of the line when it ends right at the first
+ * ':' of the line (positions come from the line's scan info). The label
+ * itself starts at line + info->indent; its length goes to *len.
+ */
+int detectlabel(const char *line, const line_info *info, int *len) {
+    *len = info->colon - info->indent;
+
+    if (info->colon < 0 || info->colon > info->word_end || *len > MAX_LABEL_LENGTH) {
+        *len = 0;
+        return 0; /* not a label */
+    }
+
+    return validate_label(line + info->indent, *len); /* 1 if valid label */
+}
+
+const char* skip_label_colon(const char *line, const line_info *info) {
+    if (info->colon < 0) return line;
+    return line + info->after_colon;
+}
+
+int is_directive(const char *line, char *directive_name) {
+    const char *p = skip_whitespace(line);
+    int i = 0;
+    if (*p != '.') return 0;
+    while (*p && !isspace(*p) && i < 9) directive_name[i++] = *p++;
+    directive_name[i] = '\0';
+    return (!strcmp(directive_name, ".data") || !strcmp(directive_name, ".string") ||
+            !strcmp(directive_name, ".extern") || !strcmp(directive_name, ".entry") ||
+            !strcmp(directive_name, ".mat"));
+}
+
+/*
+ * Count how many words will be generated by a given instruction line.
+ * first_comma is the first ',' of the whole line (from its scan info),
+ * or NULL if the line has none.
+ */
+int count_instruction_words(const char *line, const char *first_comma) {
+    char copy[MAX_LINE_LENGTH], opcode[10], src[50], dst[50];
+    const char *p = skip_whitespace(line);
+    int count = 1; /* Always at least one word for the instruction itself */
+    int comma;
+    int op_len = 0, i;
+
+    /* Extract opcode */
+    while (*p && !isspace(*p) && op_len < 9) {
+        opcode[op_len++] = *p++;
+    }
+    opcode[op_len] = '\0';
+
+    /* Only handle real instructions (skip .directives) */
+    if (opcode[0] == '.') return 0;
+
+    /* Parse operands */
+    while (*p && isspace((unsigned char)*p)) p++;
+    strncpy(copy, p, MAX_LINE_LENGTH - 1);
+    copy[MAX_LINE_LENGTH-1] = '\0';
+    /* The line's first comma is the operands' one unless it sits in the opcode */
+    if (first_comma && first_comma < p)
+        first_comma = strchr(p, ',');
+    comma = first_comma != NULL && first_comma - p < MAX_LINE_LENGTH - 1;
+    src[0] = dst[0] = '\0';
+
+    if (comma) {
+        /* Two operands */
+        char *comma_ptr = copy + (first_comma - p);
+        *comma_ptr = '\0';
+        strncpy(src, copy, 49); src[49] = '\0';
+        strncpy(dst, comma_ptr + 1, 49); dst[49] = '\0';
+    } else if (copy[0]) {
+        /* One operand */
+        strncpy(dst, copy, 49); dst[49] = '\0';
+    }
+    /* Clean whitespace */
+    for (i = strlen(src)-1; i >= 0 && isspace((unsigned char)src[i]); i--) src[i] = '\0';
+    for (i = strlen(dst)-1; i >= 0 && isspace((unsigned char)dst[i]); i--) dst[i] = '\0';
+    for (i = 0; src[i] && isspace((unsigned char)src[i]); i++);
+    if (i > 0) memmove(src, src+i, strlen(src)-i+1);
+    for (i = 0; dst[i] && isspace((unsigned char)dst[i]); i++);
+    if (i > 0) memmove(dst, dst+i, strlen(dst)-i+1);
+
+    /* Source operand */
+    if (src[0]) {
+        if (src[0] == '#') {
+            count++; /* Immediate value needs extra word */
+        } else if (strncmp(src, "r", 1) == 0 && strlen(src) == 2 && src[1] >= '0' && src[1] <= '7') {
+            /* Register only, no extra word */
+        } else if (strchr(src, '[')) {
+            /* Matrix operand: needs extra words for label and each index register */
+            count += 3; /* Base label + two indices */
+        } else {
+            count++; /* Label addressing: needs extra word */
+        }
+    }
+    /* Destination operand */
+    if (dst[0]) {
+        if (dst[0] == '#') {
+            count++;
+        } else if (strncmp(dst, "r", 1) == 0 && strlen(dst) == 2 && dst[1] >= '0' && dst[1] <= '7') {
+            /* Register only, no extra word */
+        } else if (strchr(dst, '[')) {
+            count += 3;
+        } else {
+            count++;
+        }
+    }
+    /* Remove over-count if both src & dst are registers (as only main word needed) */
+    if (src[0] && dst[0] &&
+        strncmp(src, "r", 1) == 0 && strlen(src) == 2 && src[1] >= '0' && src[1] <= '7' &&
+        strncmp(dst, "r", 1) == 0 && strlen(dst) == 2 && dst[1] >= '0' && dst[1] <= '7') {
+        count = 1;
+    }
+    return count;
+}
+
+/*
+ * Handle .data directive
+ * The list is parsed in place: each number is range checked and stored
+ * as soon as it is read.
+ * Returns an error message, or NULL if the list is valid.
+ */
+const char *handle_data_directive(const char *line, data_sink *data) {
+    const char *p = strstr(line, ".data");
+    const char *end, *next;
+    int val, status;
+    if (!p) return NULL;
+    p += 5;
+    end = p + strlen(p);
+    while (p < end) {
+        p = skip_whitespace(p);
+        if (p == end) break;
+        if (*p == ',') return "Missing number in .data";
+        status = parse_word_value(p, end, &next, &val);
+        if (status == NUM_MISSING || (next < end && *next != ',' && !isspace((unsigned char)*next)))
+            return "Invalid number in .data";
+        if (status == NUM_RANGE) return "Value out of range in .data";
+        if (data->count >= MAX_DATA_SIZE) return "Data memory overflow";
+        data->words[data->count++] = val;
+        p = skip_whitespace(next);
+        if (*p == ',') p++;
+    }
+    return NULL;
+}
+
+const char *handle_string_directive(const char *line, data_sink *data) {
+    const char *start = strchr(line, '"');
+    const char *end;
+    if (!start) return "Missing opening quote";
+    start++;
+    end = strchr(start, '"');
+    if (!end) return "Missing closing quote";
+    while (start < end) {
+        if (data->count >= MAX_DATA_SIZE) return "Data memory overflow";
+        data->words[data->count++] = *start++;
+    }
+    data->words[data->count++] = 0;
+    return NULL;
+}
+
+const char *handle_mat_directive(const char *line, data_sink *data) {
+    const char *p = strstr(line, ".mat");
+    const char *end, *next;
+    int rows = 0, cols = 0, val, status, i = 0; char *endptr;
+    if (!p) return NULL;
+    p += 4;
+    p = skip_whitespace(p);
+    if (*p++ != '[' || (rows = strtol(p, &endptr, 10)) <= 0 || *endptr != ']')
+        return "Invalid matrix rows";
+    p = endptr + 1;
+    if (*p++ != '[' || (cols = strtol(p, &endptr, 10)) <= 0 || *endptr != ']')
+        return "Invalid matrix cols";
+    p = endptr + 1;
+    end = p + strlen(p);
+    for (i = 0; i < rows * cols; i++) {
+        p = skip_whitespace(p);
+        if (!*p) break;
+        status = parse_word_value(p, end, &next, &val);
+        if (status == NUM_MISSING) return "Invalid matrix value";
+        if (status == NUM_RANGE) return "Matrix value out of range";
+        if (data->count >= MAX_DATA_SIZE) return "Matrix data overflow";
+        data->words[data->count++] = val;
+        p = skip_whitespace(next);
+        if (*p == ',') p++;
+    }
+    return NULL;
+}
+
+void update_data_symbol_addresses(label_entry *head) {
+    while (head) {
+        if ((head->attributes & 2) != 0)
+            head->address += inst_counter;
+        head = head->next;
+    }
+}
+
+/*
+ * scan_line
+ * Summarizes a non-empty line: its label, what it defines or references,
+ * its instruction word count, and its data words (stored into data).
+ * Only reads shared state, so chunks of a file may be scanned by
+ * several threads at once.
+ */
+void scan_line(const char *line, const line_info *info, line_summary *s, data_sink *data) {
+    char directive[10];
+    char opcode[MAX_OPCODE_LENGTH];
+    const char *labels[2];
+    const char *after_label = line;
+    const char *inst;
+    int has_label, label_len, i;
+
+    s->kind = LINE_CODE;
+    s->label_length = 0;
+    s->words = 0;
+    s->data_start = data->count;
+    s->extern_length = 0;
+    s->entry_length = 0;
+    s->ref_count = 0;
+    s->bad_instruction = 0;
+    s->error = NULL;
+
+    /* Symbols the encoder will resolve for this line */
+    inst = find_instruction(line, opcode);
+    if (inst) {
+        s->ref_count = instruction_symbols(inst, opcode, labels, s->ref_length);
+        if (s->ref_count < 0) {
+            s->bad_instruction = 1;
+            s->ref_count = 0;
+        }
+        for (i = 0; i < s->ref_count; i++)
+            s->ref_start[i] = (int)(labels[i] - line);
+    }
+
+    has_label = detectlabel(line, info, &label_len);
+    if (has_label) {
+        s->label_start = info->indent;
+        s->label_length = label_len;
+        after_label = skip_label_colon(line, info);
+    }
+
+    if (is_directive(after_label, directive)) {
+        if (!strcmp(directive, ".extern")) {
+            const char *p = skip_whitespace(strstr(after_label, ".extern") + 7);
+            int len = 0;
+            s->kind = LINE_EXTERN;
+            while (p[len] && !isspace((unsigned char)p[len]) && len < MAX_LABEL_LENGTH) len++;
+            if (!validate_label(p, len)) {
+                s->error = "Invalid extern label";
+            } else {
+                s->extern_start = (int)(p - line);
+                s->extern_length = len;
+            }
+        } else if (!strcmp(directive, ".entry")) {
+            const char *p = skip_whitespace(strstr(after_label, ".entry") + 6);
+            int len = 0;
+            s->kind = LINE_ENTRY;
+            while (p[len] && !isspace((unsigned char)p[len]) && len < MAX_LABEL_LENGTH) len++;
+            if (!validate_label(p, len)) {
+                s->error = "Invalid entry label";
+            } else {
+                s->entry_start = (int)(p - line);
+                s->entry_length = len;
+            }
+        } else {
+            s->kind = LINE_DATA;
+            if (!strcmp(directive, ".data")) s->error = handle_data_directive(after_label, data);
+            else if (!strcmp(directive, ".string")) s->error = handle_string_directive(after_label, data);
+            else s->error = handle_mat_directive(after_label, data);
+        }
+        return;
+    }
+
+    /* --------- KEY FIX: count words per instruction ---------- */
+    s->words = count_instruction_words(after_label, info->comma >= 0 ? line + info->comma : NULL);
+}
+
+/*
+ * Decodes a line the encoder rejects again, on its text without the
+ * newline as the second pass sees it, and keeps the error it reports.
+ */
+static void keep_instruction_error(const char *text, int line_num) {
+    char line[MAX_LINE_LENGTH];
+    char opcode[MAX_OPCODE_LENGTH];
+    char message[MAX_ERROR_MESSAGE];
+    const char *inst;
+    size_t len = strcspn(text, "\r\n");
+    line_error *bad;
+
+    if (len > MAX_LINE_LENGTH - 1) len = MAX_LINE_LENGTH - 1;
+    memcpy(line, text, len);
+    line[len] = '\0';
+    inst = find_instruction(line, opcode);
+    if (!inst || !instruction_error(inst, opcode, message)) return;
+    bad = arena_alloc(&file_arena, sizeof(line_error));
+    if (!bad) return;
+    bad->message = arena_strndup(&file_arena, message, strlen(message));
+    if (!bad->message) return;
+    bad->line = line_num;
+    bad->next = NULL;
+    *bad_lines_tail = bad;
+    bad_lines_tail = &bad->next;
+}
+
+/*
+ * Defines what a scanned line declares, in line order: records its
+ * symbol references and .entry name (file_names ids, in file_arena), adds
+ * its label and .extern name to the symbol table, reports its errors and advances
+ * inst_counter. text is the line the summary was made from;
+ * data_address is the data address of its first data word.
+ */
+static void define_line(const char *text, const line_summary *s, int data_address,
+                        symbol_ref ***refs_tail) {
+    int name, i;
+
+    for (i = 0; i < s->ref_count; i++) {
+        symbol_ref *ref = arena_alloc(&file_arena, sizeof(symbol_ref));
+        if (!ref) break;
+        ref->name = intern_name(&file_names, text + s->ref_start[i], s->ref_length[i]);
+        ref->line = s->line_num;
+        ref->next = NULL;
+        **refs_tail = ref;
+        *refs_tail = &ref->next;
+    }
+
+    if (s->label_length) {
+        name = symbol_name(text + s->label_start, s->label_length);
+        if (find_symbol(symbol_table, name)) {
+            report_error("Duplicate label", s->line_num);
+            error_flag = 1;
+        } else {
+            add_symbol(&symbol_table, name, inst_counter, 1);
+        }
+        if (s->kind == LINE_DATA) {
+            /* mark as data */
+            symbol_table->attributes = 2;
+            symbol_table->address = data_address;
+        }
+    }
+
+    if (s->entry_length) {
+        symbol_ref *entry = arena_alloc(&file_arena, sizeof(symbol_ref));
+        if (entry) {
+            entry->name = symbol_name(text + s->entry_start, s->entry_length);
+            entry->line = s->line_num;
+            entry->next = NULL;
+            *entries_tail = entry;
+            entries_tail = &entry->next;
+        }
+    }
+    if (s->extern_length)
+        add_symbol(&symbol_table, symbol_name(text + s->extern_start, s->extern_length), 0, 4);
+    if (s->bad_instruction)
+        keep_instruction_error(text, s->line_num);
+    if (s->error) {
+        report_error(s->error, s->line_num);
+        error_flag = 1;
+    }
+    inst_counter += s->words;
+}
+
+/*
+ * Reports every reference to a symbol that was never defined, in line
+ * order. The defined names are marked in a table indexed by name id, so
+ * each reference is checked in constant time.
+ */
+static void report_undefined_symbols(const symbol_ref *refs) {
+    char *defined;
+    const label_entry *sym;
+
+    if (!refs) return;
+    defined = arena_alloc(&file_arena, file_names.count);
+    if (!defined) return;
+    memset(defined, 0, file_names.count);
+    for (sym = symbol_table; sym; sym = sym->next)
+        defined[sym->name] = 1;
+
+    for (; refs; refs = refs->next) {
+        if (!defined[refs->name]) {
+            report_errorf(refs->line, "Undefined label '%.*s'", MAX_LABEL_LENGTH,
+                          name_text(&file_names, refs->name));
+            error_flag = 1;
+        }
+    }
+}
+
+/*
+ * Marks the symbols named by .entry lines as entries, so the second pass
+ * lists them in the .ent file. An entry must be a label of the file.
+ */
+static void mark_entry_symbols(const symbol_ref *entry) {
+    label_entry *sym;
+
+    for (; entry; entry = entry->next) {
+        sym = find_symbol(symbol_table, entry->name);
+        if (!sym) {
+            report_errorf(entry->line, "Undefined entry label '%.*s'", MAX_LABEL_LENGTH,
+                          name_text(&file_names, entry->name));
+            error_flag = 1;
+        } else if (sym->attributes & EXTERN_ATTRIBUTE) {
+            report_errorf(entry->line, "Entry label '%.*s' is declared extern", MAX_LABEL_LENGTH,
+                          name_text(&file_names, entry->name));
+            error_flag = 1;
+        } else {
+            sym->attributes |= ENTRY_ATTRIBUTE;
+        }
+    }
+}
+
+/* One chunk of lines scanned by its own thread */
+typedef struct scan_chunk {
+    int first_line;            /* Line index range [first_line, end_line) */
+    int end_line;
+    line_summary *summaries;   /* One per non-empty line */
+    int count;
+    data_sink data;            /* The chunk's data words */
+    int data_base;             /* Data address of its first data word */
+    int failed;                /* Set if the file needs the sequential pass */
+} scan_chunk;
+
+/* Work shared by the threads of scan_parallel() */
+typedef struct scan_job {
+    const source_text *am;
+    const line_index *lines;
+    scan_chunk *chunks;
+} scan_job;
+
+/*
+ * First round: summarizes the lines of one chunk. A line with an error
+ * fails the chunk, so every diagnostic comes from the sequential pass.
+ */
+static void scan_chunk_lines(void *context, int index) {
+    scan_job *job = context;
+    scan_chunk *chunk = &job->chunks[index];
+    char line[MAX_LINE_LENGTH];
+    int k;
+
+    chunk->summaries = malloc((chunk->end_line - chunk->first_line) * sizeof(line_summary));
+    chunk->data.words = malloc((MAX_DATA_SIZE + 1) * sizeof(int));   /* + .string's terminator */
+    if (!chunk->summaries || !chunk->data.words) {
+        chunk->failed = 1;
+        return;
+    }
+    for (k = chunk->first_line; k < chunk->end_line; k++) {
+        const line_info *info = &job->lines->lines[k];
+        line_summary *s = &chunk->summaries[chunk->count];
+        int len = info->length + info->has_newline;
+
+        if (len > MAX_LINE_LENGTH - 1) len = MAX_LINE_LENGTH - 1;
+        memcpy(line, job->am->text + info->offset, len);
+        line[len] = '\0';
+        if (is_comment_or_empty(line, info)) continue;
+        scan_line(line, info, s, &chunk->data);
+        if (s->error) {
+            chunk->failed = 1;
+            return;
+        }
+        s->line_num = k + 1;
+        chunk->count++;
+    }
+}
+
+/* Second round: copies the data words of one chunk to its slice of data_memory. */
+static void store_chunk_data(void *context, int index) {
+    scan_job *job = context;
+    scan_chunk *chunk = &job->chunks[index];
+
+    memcpy(data_memory + chunk->data_base, chunk->data.words, chunk->data.count * sizeof(int));
+}
+
+/*
+ * Runs the line loop of the first pass on several threads. The chunks
+ * are scanned independently, each counting its own data words from 0;
+ * an exclusive prefix sum over the chunk totals gives each chunk its
+ * data base. The symbols are then defined on the calling thread in line
+ * order (names are interned and duplicates found in that order), each
+ * label getting its final address from the running inst_counter and its
+ * chunk's data base, while the data words are copied into place in
+ * parallel.
+ * Returns 0, having changed nothing, if the file is too small to split
+ * or a line has an error; the sequential loop then runs and reports it.
+ */
+static int scan_parallel(const source_text *am, const line_index *lines, symbol_ref ***refs_tail) {
+    scan_job job;
+    int chunk_count = parallel_chunks(lines->count);
+    int data_total = 0;
+    int ok = 1;
+    int i, j;
+
+    if (chunk_count < 2) return 0;
+    job.am = am;
+    job.lines = lines;
+    job.chunks = calloc(chunk_count, sizeof(scan_chunk));
+    if (!job.chunks) return 0;
+
+    for (i = 0; i < chunk_count; i++) {
+        job.chunks[i].first_line = (int)((long)lines->count * i / chunk_count);
+        job.chunks[i].end_line = (int)((long)lines->count * (i + 1) / chunk_count);
+    }
+    run_parallel(scan_chunk_lines, &job, chunk_count);
+
+    /* Data bases: exclusive prefix sum of the chunks' data words */
+    for (i = 0; i < chunk_count && ok; i++) {
+        job.chunks[i].data_base = data_total;
+        data_total += job.chunks[i].data.count;
+        if (job.chunks[i].failed || data_total > MAX_DATA_SIZE) ok = 0;
+    }
+
+    if (ok) {
+        run_parallel(store_chunk_data, &job, chunk_count);
+        for (i = 0; i < chunk_count; i++) {
+            const scan_chunk *chunk = &job.chunks[i];
+            for (j = 0; j < chunk->count && !error_limit_reached(); j++) {
+                const line_summary *s = &chunk->summaries[j];
+                define_line(am->text + lines->lines[s->line_num - 1].offset, s,
+                            chunk->data_base + s->data_start, refs_tail);
+                data_counter = chunk->data_base +
+                               (j + 1 < chunk->count ? s[1].data_start : chunk->data.count);
+            }
+            if (j < chunk->count) break;   /* Error limit: stop where the loop would */
+        }
+    }
+
+    for (i = 0; i < chunk_count; i++) {
+        free(job.chunks[i].summaries);
+        free(job.chunks[i].data.words);
+    }
+    free(job.chunks);
+    return ok;
+}
+
+/* Symbol references collected so far, in line order */
+static symbol_ref *refs = NULL;
+static symbol_ref **refs_tail = &refs;
+
+/* Starts the first pass of a file. */
+static void first_pass_begin(void) {
+    inst_counter = IC_START;
+    data_counter = 0;
+    error_flag = 0;
+    refs = NULL;
+    refs_tail = &refs;
+    entries = NULL;
+    entries_tail = &entries;
+    bad_lines = NULL;
+    bad_lines_tail = &bad_lines;
+}
+
+/*
+ * Runs the first pass over a stretch of the .am text; first_line is the
+ * number of lines before it.
+ */
+static void first_pass_lines(const source_text *am, const line_index *lines, int first_line) {
+    char line[MAX_LINE_LENGTH];
+    int k;
+    line_summary summary;
+    data_sink data;
+
+    data.words = data_memory;
+    for (k = 0; k < lines->count && !error_limit_reached(); k++) {
+        const line_info *info = &lines->lines[k];
+        int len = info->length + info->has_newline;
+
+        if (len > MAX_LINE_LENGTH - 1) len = MAX_LINE_LENGTH - 1;
+        memcpy(line, am->text + info->offset, len);
+        line[len] = '\0';
+        if (is_comment_or_empty(line, info)) continue;
+
+        data.count = data_counter;
+        scan_line(line, info, &summary, &data);
+        summary.line_num = first_line + k + 1;
+        define_line(line, &summary, summary.data_start, &refs_tail);
+        data_counter = data.count;
+    }
+}
+
+/*
+ * Finishes the first pass: moves the data symbols after the code, checks
+ * the symbol references and marks the entries. Returns error_flag; when
+ * it is set the second pass is skipped, so the instruction errors it
+ * would have found are reported here.
+ */
+static int first_pass_end(void) {
+    const line_error *bad;
+
+    update_data_symbol_addresses(symbol_table);
+    report_undefined_symbols(refs);
+    mark_entry_symbols(entries);
+    if (error_flag)
+        for (bad = bad_lines; bad; bad = bad->next)
+            report_error(bad->message, bad->line);
+    return error_flag;
+}
+
+/*
+ * First pass over the expanded source: builds the symbol table, fills the
+ * data memory and counts instruction words. The lines are taken from the
+ * .am text through its scan index (shared with the second pass).
+ * Symbol references are checked at the end, so a source with undefined
+ * labels fails here and never reaches the second pass.
+ * Large files are scanned by several threads when --jobs allows it (see
+ * scan_parallel()); the line loop is the fallback.
+ */
+int first_pass(const source_text *am, const line_index *lines) {
+    first_pass_begin();
+    if (error_limit_reached() || !scan_parallel(am, lines, &refs_tail))
+        first_pass_lines(am, lines, 0);
+    return first_pass_end();
+}
+
+/*
+ * First pass in stream mode: the .am file is read back in blocks (see
+ * stream.h) and each block is passed through the line loop, so only the
+ * symbol table outlives a block.
+ * Returns error_flag, or -1 if the file could not be read.
+ */
+int first_pass_stream(const char *am_path) {
+    source_stream stream;
+    source_text block;
+    line_index lines;
+    int line_count = 0, ok;
+
+    first_pass_begin();
+    if (!stream_open(&stream, am_path)) return -1;
+    while (!error_limit_reached() && stream_next(&stream, &block, &lines)) {
+        first_pass_lines(&block, &lines, line_count);
+        line_count += lines.count;
+        free_line_index(&lines);
+    }
+    ok = !stream.failed;
+    stream_close(&stream);
+    if (!ok) return -1;
+    return first_pass_end();
+}
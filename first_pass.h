@@ -0,0 +1,57 @@
+#ifndef FIRST_PASS_H
+#define FIRST_PASS_H
+
+#include "scanner.h"
+
+/*
+ * Data words produced by the directives of a line:
+ * - The sequential pass stores them straight into data_memory; a chunk of
+ *   the parallel pass collects them in a buffer of its own.
+ */
+typedef struct data_sink {
+    int *words;
+    int count;      /* Words stored so far (at most MAX_DATA_SIZE checked) */
+} data_sink;
+
+/* Kinds of non-empty lines */
+#define LINE_CODE    0   /* Instruction (or an unknown directive, 0 words) */
+#define LINE_DATA    1   /* .data, .string or .mat */
+#define LINE_EXTERN  2
+#define LINE_ENTRY   3
+
+/*
+ * What the first pass learns from one line on its own, before any
+ * symbol is defined. Names are kept as positions in the line text, so a
+ * summary can be made without touching the name pool.
+ */
+typedef struct line_summary {
+    int line_num;
+    int kind;                 /* LINE_* */
+    int label_start;          /* Valid label at the start of the line... */
+    int label_length;         /* ...or 0 if none */
+    int words;                /* Instruction words (LINE_CODE) */
+    int data_start;           /* Sink count before the line's data words */
+    int extern_start;         /* Valid .extern name... */
+    int extern_length;        /* ...or 0 if none */
+    int entry_start;          /* Valid .entry name... */
+    int entry_length;         /* ...or 0 if none */
+    int ref_start[2];         /* Symbols referenced by the instruction */
+    int ref_length[2];
+    int ref_count;
+    int bad_instruction;      /* The encoder rejects the instruction */
+    const char *error;        /* Error found in the line, or NULL */
+} line_summary;
+
+/* Empty or comment line: the first non-blank character (if any) is ';' */
+int is_comment_or_empty(const char *line, const line_info *info);
+
+/*
+ * Summarizes one line of the expanded source the way the first pass sees
+ * it, before any symbol is defined (see line_summary). The line must be
+ * non-empty and not a comment; its data words are appended to data.
+ * Safe to call from several threads at once. s->line_num is left to the
+ * caller.
+ */
+void scan_line(const char *line, const line_info *info, line_summary *s, data_sink *data);
+
+#endif /* FIRST_PASS_H */
@@ -1,37 +1,62 @@
-#include "globals.h"
-
-/* ----------------------------------------------------------
- * IC (Instruction Counter):
- *   - Tracks the next available instruction address in memory.
- *   - Initialized to 100 (MMN14 convention).
- * ---------------------------------------------------------- */
-int inst_counter = 99;
-
-/* ----------------------------------------------------------
- * DC (Data Counter):
- *   - Tracks the next available data memory address.
- *   - Starts at 0 and increments for every .data/.string entry.
- * ---------------------------------------------------------- */
-int data_counter = 0;
-
-/* ----------------------------------------------------------
- * had_error:
- *   - Boolean flag (0 = no error, 1 = error occurred)
- *   - Set to 1 if an error is detected during assembly passes.
- *   - Can be checked after each pass to determine if output files should be written.
- * ---------------------------------------------------------- */
-int error_flag = 0;
-
-/* ----------------------------------------------------------
- * code_array:
- *   - Array storing encoded instruction words.
- *   - Size limited by MAX_INSTRUCTIONS (from globals.h).
- * ---------------------------------------------------------- */
-int code_array[MAX_INSTRUCTIONS];
-
-/* ----------------------------------------------------------
- * data_memory:
- *   - Array storing all .data and .string directive values.
- *   - Size limited by MAX_DATA_SIZE (from globals.h).
- * ---------------------------------------------------------- */
-int data_memory[MAX_DATA_SIZE];
+#include "globals.h"
+
+/* ----------------------------------------------------------
+ * IC (Instruction Counter):
+ *   - Tracks the next available instruction address in memory.
+ *   - Initialized to 100 (MMN14 convention).
+ * ---------------------------------------------------------- */
+int inst_counter = IC_START;
+
+/* ----------------------------------------------------------
+ * DC (Data Counter):
+ *   - Tracks the next available data memory address.
+ *   - Starts at 0 and increments for every .data/.string entry.
+ * ---------------------------------------------------------- */
+int data_counter = 0;
+
+/* ----------------------------------------------------------
+ * had_error:
+ *   - Boolean flag (0 = no error, 1 = error occurred)
+ *   - Set to 1 if an error is detected during assembly passes.
+ *   - Can be checked after each pass to determine if output files should be written.
+ * ---------------------------------------------------------- */
+int error_flag = 0;
+
+/* ----------------------------------------------------------
+ * stream_mode:
+ *   - Set by the --stream option.
+ *   - The source and the .am text are read in fixed-size blocks
+ *     (see stream.h) and the .am file is written as it is expanded,
+ *     so memory does not grow with the size of the program.
+ * ---------------------------------------------------------- */
+int stream_mode = 0;
+
+/* ----------------------------------------------------------
+ * binary_object:
+ *   - Set by the --binary option.
+ *   - The second pass also writes the outputs as one binary
+ *     object file (see object.h).
+ * ---------------------------------------------------------- */
+int binary_object = 0;
+
+/* ----------------------------------------------------------
+ * code_array:
+ *   - Array storing encoded instruction words.
+ *   - Size limited by MAX_INSTRUCTIONS (from globals.h).
+ * ---------------------------------------------------------- */
+int code_array[MAX_INSTRUCTIONS];
+
+/* ----------------------------------------------------------
+ * code_relocation:
+ *   - RELOC_* of each word of code_array: whether it holds the
+ *     address of a code, data or extern label.
+ *   - Written into the relocation records of --binary objects.
+ * ---------------------------------------------------------- */
+unsigned char code_relocation[MAX_INSTRUCTIONS];
+
+/* ----------------------------------------------------------
+ * data_memory:
+ *   - Array storing all .data and .string directive values.
+ *   - Size limited by MAX_DATA_SIZE (from globals.h).
+ * ---------------------------------------------------------- */
+int data_memory[MAX_DATA_SIZE];
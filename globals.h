@@ -1,54 +1,91 @@
-#ifndef GLOBALS_H
-#define GLOBALS_H
-
-/* -----------------------------------------------------------------
- * MAX_INSTRUCTIONS:
- *   - The maximum number of machine code instructions that can be
- *     stored in the instruction memory.
- *   - Used for bounds checking and array sizing.
- * ----------------------------------------------------------------- */
-#define MAX_INSTRUCTIONS 1024
-
-/* -----------------------------------------------------------------
- * MAX_DATA_SIZE:
- *   - The maximum number of data elements (.data/.string) that can
- *     be stored in the data memory.
- *   - Used for bounds checking and array sizing.
- * ----------------------------------------------------------------- */
-#define MAX_DATA_SIZE 1024
-
-/* -----------------------------------------------------------------
- * MAX_LINE_LENGTH:
- *   - The maximum allowed length for a line in the assembly source file.
- *   - Used to allocate buffers for reading lines.
- * ----------------------------------------------------------------- */
-#define MAX_LINE_LENGTH 80
-
-/* -----------------------------------------------------------------
- * MAX_LABEL_LENGTH:
- *   - The maximum allowed length for a label name.
- *   - Used for validation and to size label buffers.
- * ----------------------------------------------------------------- */
-#define MAX_LABEL_LENGTH 32
-
-/* -----------------------------------------------------------------
- * Global variables shared across the assembler components:
- *   - Declared as 'extern' here, defined in globals.c.
- * ----------------------------------------------------------------- */
-
-/* Instruction Counter: Points to the next available instruction memory slot. */
-extern int inst_counter;
-
-/* Data Counter: Points to the next available data memory slot. */
-extern int data_counter;
-
-/* Error flag: Set to 1 if an error is encountered anywhere in the assembler. */
-extern int error_flag;
-
-/* The main instruction memory array, storing encoded instruction words. */
-extern int code_array[MAX_INSTRUCTIONS];
-
-/* The data memory array, storing all .data/.string directive values. */
-extern int data_memory[MAX_DATA_SIZE];
-
-#endif /* GLOBALS_H */
+#ifndef GLOBALS_H
+#define GLOBALS_H
+
+/* -----------------------------------------------------------------
+ * MAX_INSTRUCTIONS:
+ *   - The maximum number of machine code instructions that can be
+ *     stored in the instruction memory.
+ *   - Used for bounds checking and array sizing.
+ * ----------------------------------------------------------------- */
+#define MAX_INSTRUCTIONS 1024
+
+/* -----------------------------------------------------------------
+ * MAX_DATA_SIZE:
+ *   - The maximum number of data elements (.data/.string) that can
+ *     be stored in the data memory.
+ *   - Used for bounds checking and array sizing.
+ * ----------------------------------------------------------------- */
+#define MAX_DATA_SIZE 1024
+
+/* -----------------------------------------------------------------
+ * MAX_LINE_LENGTH:
+ *   - The maximum allowed length for a line in the assembly source file.
+ *   - Used to allocate buffers for reading lines.
+ * ----------------------------------------------------------------- */
+#define MAX_LINE_LENGTH 80
+
+/* -----------------------------------------------------------------
+ * MAX_LABEL_LENGTH:
+ *   - The maximum allowed length for a label name.
+ *   - Used for validation and to size label buffers.
+ * ----------------------------------------------------------------- */
+#define MAX_LABEL_LENGTH 32
+
+/* -----------------------------------------------------------------
+ * IC_START:
+ *   - The address the code is loaded at (MMN14 convention).
+ *   - Both passes of every file start inst_counter at it, so the
+ *     first pass gives each label the address of the word the second
+ *     pass stores there.
+ * ----------------------------------------------------------------- */
+#define IC_START 100
+
+/* -----------------------------------------------------------------
+ * WORD_MIN_VALUE / WORD_MAX_VALUE:
+ *   - The range of a signed 10-bit machine word.
+ *   - Numbers in .data, .mat and immediate operands must fit in it.
+ * ----------------------------------------------------------------- */
+#define WORD_MIN_VALUE (-512)
+#define WORD_MAX_VALUE 511
+
+/* -----------------------------------------------------------------
+ * RELOC_NONE / RELOC_CODE / RELOC_DATA / RELOC_EXTERN:
+ *   - What the value of a code word depends on (code_relocation):
+ *     nothing, the address of a code label, of a data label, or of
+ *     an extern label.
+ * ----------------------------------------------------------------- */
+#define RELOC_NONE   0
+#define RELOC_CODE   1
+#define RELOC_DATA   2
+#define RELOC_EXTERN 3
+
+/* -----------------------------------------------------------------
+ * Global variables shared across the assembler components:
+ *   - Declared as 'extern' here, defined in globals.c.
+ * ----------------------------------------------------------------- */
+
+/* Instruction Counter: Points to the next available instruction memory slot. */
+extern int inst_counter;
+
+/* Data Counter: Points to the next available data memory slot. */
+extern int data_counter;
+
+/* Error flag: Set to 1 if an error is encountered anywhere in the assembler. */
+extern int error_flag;
+
+/* Streaming mode (--stream): sources and .am text are read in blocks, never held whole. */
+extern int stream_mode;
+
+/* Binary objects (--binary): a .obj file (see object.h) is written next to each .ob. */
+extern int binary_object;
+
+/* The main instruction memory array, storing encoded instruction words. */
+extern int code_array[MAX_INSTRUCTIONS];
+
+/* RELOC_* of each word of code_array, set as the second pass stores it. */
+extern unsigned char code_relocation[MAX_INSTRUCTIONS];
+
+/* The data memory array, storing all .data/.string directive values. */
+extern int data_memory[MAX_DATA_SIZE];
+
+#endif /* GLOBALS_H */
@@ -0,0 +1,327 @@
+/* json.c - Minimal JSON reader and writer for the language server */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "json.h"
+
+/* Parser state over one document */
+typedef struct json_parser {
+    const char *p;
+    const char *end;
+    arena *mem;
+    int depth;
+} json_parser;
+
+static json_value *parse_value(json_parser *jp);
+
+static void skip_blanks(json_parser *jp) {
+    while (jp->p < jp->end &&
+           (*jp->p == ' ' || *jp->p == '\t' || *jp->p == '\n' || *jp->p == '\r'))
+        jp->p++;
+}
+
+static json_value *new_value(json_parser *jp, int type) {
+    json_value *v = arena_alloc(jp->mem, sizeof(json_value));
+    if (!v) return NULL;
+    memset(v, 0, sizeof(json_value));
+    v->type = type;
+    return v;
+}
+
+/* Reads 4 hex digits. Returns the value, or -1 if they are not hex. */
+static long hex4(const char *p) {
+    long n = 0;
+    int i;
+    for (i = 0; i < 4; i++) {
+        int c = p[i];
+        n <<= 4;
+        if (c >= '0' && c <= '9') n |= c - '0';
+        else if (c >= 'a' && c <= 'f') n |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') n |= c - 'A' + 10;
+        else return -1;
+    }
+    return n;
+}
+
+/* Appends a code point to out as UTF-8; returns the bytes written. */
+static int put_utf8(char *out, unsigned long c) {
+    if (c < 0x80) {
+        out[0] = (char)c;
+        return 1;
+    }
+    if (c < 0x800) {
+        out[0] = (char)(0xC0 | (c >> 6));
+        out[1] = (char)(0x80 | (c & 0x3F));
+        return 2;
+    }
+    if (c < 0x10000) {
+        out[0] = (char)(0xE0 | (c >> 12));
+        out[1] = (char)(0x80 | ((c >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (c & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (c >> 18));
+    out[1] = (char)(0x80 | ((c >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((c >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (c & 0x3F));
+    return 4;
+}
+
+/*
+ * Parses a string starting at its opening quote into a NUL terminated
+ * copy. An escape never unescapes to more bytes than it takes, so the
+ * raw length bounds the copy.
+ * Returns the copy (its length in *length), or NULL if it is malformed.
+ */
+static char *parse_string(json_parser *jp, long *length) {
+    const char *start = ++jp->p;
+    const char *q = start;
+    char *text, *out;
+
+    while (q < jp->end && *q != '"') {
+        if (*q == '\\') q++;
+        q++;
+    }
+    if (q >= jp->end) return NULL;
+    text = out = arena_alloc(jp->mem, (size_t)(q - start) + 1);
+    if (!text) return NULL;
+
+    while (jp->p < q) {
+        char c = *jp->p++;
+        if ((unsigned char)c < 0x20) return NULL;
+        if (c != '\\') {
+            *out++ = c;
+            continue;
+        }
+        c = *jp->p++;
+        switch (c) {
+        case '"': case '\\': case '/': *out++ = c; break;
+        case 'b': *out++ = '\b'; break;
+        case 'f': *out++ = '\f'; break;
+        case 'n': *out++ = '\n'; break;
+        case 'r': *out++ = '\r'; break;
+        case 't': *out++ = '\t'; break;
+        case 'u': {
+            long c1, c2;
+            if (q - jp->p < 4 || (c1 = hex4(jp->p)) < 0) return NULL;
+            jp->p += 4;
+            if (c1 >= 0xD800 && c1 < 0xDC00 && q - jp->p >= 6 && jp->p[0] == '\\' &&
+                jp->p[1] == 'u' && (c2 = hex4(jp->p + 2)) >= 0xDC00 && c2 < 0xE000) {
+                /* Surrogate pair */
+                c1 = 0x10000 + ((c1 - 0xD800) << 10) + (c2 - 0xDC00);
+                jp->p += 6;
+            }
+            out += put_utf8(out, (unsigned long)c1);
+            break;
+        }
+        default:
+            return NULL;
+        }
+    }
+    jp->p = q + 1;
+    *out = '\0';
+    *length = (long)(out - text);
+    return text;
+}
+
+/* Parses the elements of an array or the members of an object. */
+static json_value *parse_container(json_parser *jp, int type) {
+    json_value *v = new_value(jp, type);
+    json_value **tail;
+    char close = type == JSON_ARRAY ? ']' : '}';
+
+    if (!v || ++jp->depth > JSON_MAX_DEPTH) return NULL;
+    tail = &v->child;
+    jp->p++;
+    skip_blanks(jp);
+    if (jp->p < jp->end && *jp->p == close) {
+        jp->p++;
+        jp->depth--;
+        return v;
+    }
+    for (;;) {
+        json_value *item;
+        const char *key = NULL;
+
+        skip_blanks(jp);
+        if (type == JSON_OBJECT) {
+            long key_length;
+            if (jp->p >= jp->end || *jp->p != '"') return NULL;
+            key = parse_string(jp, &key_length);
+            if (!key) return NULL;
+            skip_blanks(jp);
+            if (jp->p >= jp->end || *jp->p != ':') return NULL;
+            jp->p++;
+        }
+        item = parse_value(jp);
+        if (!item) return NULL;
+        item->key = key;
+        *tail = item;
+        tail = &item->next;
+
+        skip_blanks(jp);
+        if (jp->p >= jp->end) return NULL;
+        if (*jp->p == ',') {
+            jp->p++;
+            continue;
+        }
+        if (*jp->p != close) return NULL;
+        jp->p++;
+        jp->depth--;
+        return v;
+    }
+}
+
+/* Matches a literal (true, false, null) at the current position. */
+static int literal(json_parser *jp, const char *word) {
+    size_t n = strlen(word);
+    if ((size_t)(jp->end - jp->p) < n || strncmp(jp->p, word, n) != 0) return 0;
+    jp->p += n;
+    return 1;
+}
+
+static json_value *parse_value(json_parser *jp) {
+    json_value *v;
+
+    skip_blanks(jp);
+    if (jp->p >= jp->end) return NULL;
+    switch (*jp->p) {
+    case '{':
+        return parse_container(jp, JSON_OBJECT);
+    case '[':
+        return parse_container(jp, JSON_ARRAY);
+    case '"':
+        v = new_value(jp, JSON_STRING);
+        if (!v || !(v->text = parse_string(jp, &v->length))) return NULL;
+        return v;
+    case 't':
+    case 'f':
+        v = new_value(jp, JSON_BOOL);
+        if (!v) return NULL;
+        v->number = *jp->p == 't';
+        return literal(jp, v->number ? "true" : "false") ? v : NULL;
+    case 'n':
+        v = new_value(jp, JSON_NULL);
+        return v && literal(jp, "null") ? v : NULL;
+    default: {
+        /* Number: copied out, since the text need not be NUL terminated */
+        char digits[64];
+        char *stop;
+        int n = 0;
+        while (jp->p + n < jp->end && n < 63 && strchr("+-0123456789.eE", jp->p[n]))
+            n++;
+        if (n == 0 || n == 63) return NULL;
+        memcpy(digits, jp->p, n);
+        digits[n] = '\0';
+        v = new_value(jp, JSON_NUMBER);
+        if (!v) return NULL;
+        v->number = strtod(digits, &stop);
+        if (*stop != '\0') return NULL;
+        jp->p += n;
+        return v;
+    }
+    }
+}
+
+json_value *json_parse(arena *mem, const char *text, long length) {
+    json_parser jp;
+    json_value *root;
+
+    jp.p = text;
+    jp.end = text + length;
+    jp.mem = mem;
+    jp.depth = 0;
+    root = parse_value(&jp);
+    skip_blanks(&jp);
+    return root && jp.p == jp.end ? root : NULL;
+}
+
+const json_value *json_member(const json_value *object, const char *key) {
+    const json_value *v;
+    if (!object || object->type != JSON_OBJECT) return NULL;
+    for (v = object->child; v; v = v->next)
+        if (strcmp(v->key, key) == 0) return v;
+    return NULL;
+}
+
+long json_integer(const json_value *value, long fallback) {
+    if (!value || value->type != JSON_NUMBER) return fallback;
+    return (long)value->number;
+}
+
+const char *json_string(const json_value *value) {
+    if (!value || value->type != JSON_STRING) return NULL;
+    return value->text;
+}
+
+/*
+ * json_append_string
+ * Quotes and backslashes are escaped, control characters written as
+ * \u00XX; everything else (UTF-8 included) is copied as is.
+ */
+void json_append_string(out_buffer *out, const char *text, long length) {
+    long i, run = 0;
+
+    out_append(out, "\"", 1);
+    for (i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)text[i];
+        char escape[8];
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        out_append(out, text + run, i - run);
+        if (c == '"' || c == '\\') {
+            escape[0] = '\\';
+            escape[1] = (char)c;
+            out_append(out, escape, 2);
+        } else if (c == '\n') {
+            out_append(out, "\\n", 2);
+        } else {
+            out_append(out, escape, sprintf(escape, "\\u%04x", c));
+        }
+        run = i + 1;
+    }
+    out_append(out, text + run, length - run);
+    out_append(out, "\"", 1);
+}
+
+void json_append_value(out_buffer *out, const json_value *value) {
+    char number[32];
+    const json_value *v;
+
+    if (!value) {
+        out_append(out, "null", 4);
+        return;
+    }
+    switch (value->type) {
+    case JSON_BOOL:
+        if (value->number) out_append(out, "true", 4);
+        else out_append(out, "false", 5);
+        break;
+    case JSON_NUMBER:
+        if (value->number > -1e15 && value->number < 1e15 &&
+            value->number == (long)value->number)
+            out_append(out, number, sprintf(number, "%ld", (long)value->number));
+        else
+            out_append(out, number, sprintf(number, "%.17g", value->number));
+        break;
+    case JSON_STRING:
+        json_append_string(out, value->text, value->length);
+        break;
+    case JSON_ARRAY:
+    case JSON_OBJECT:
+        out_append(out, value->type == JSON_ARRAY ? "[" : "{", 1);
+        for (v = value->child; v; v = v->next) {
+            if (v != value->child) out_append(out, ",", 1);
+            if (v->key) {
+                json_append_string(out, v->key, (long)strlen(v->key));
+                out_append(out, ":", 1);
+            }
+            json_append_value(out, v);
+        }
+        out_append(out, value->type == JSON_ARRAY ? "]" : "}", 1);
+        break;
+    default:
+        out_append(out, "null", 4);
+        break;
+    }
+}
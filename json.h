@@ -0,0 +1,71 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include "arena.h"
+#include "output.h"
+
+/*
+ * Minimal JSON support for the language server (the --lsp option):
+ * - json_parse() turns one message into a tree of json_value nodes, all
+ *   allocated in an arena that is reset after the message is handled.
+ * - Replies are built directly in an out_buffer; json_append_string()
+ *   and json_append_value() write the parts that need escaping.
+ */
+
+/* Types of values */
+#define JSON_NULL   0
+#define JSON_BOOL   1
+#define JSON_NUMBER 2
+#define JSON_STRING 3
+#define JSON_ARRAY  4
+#define JSON_OBJECT 5
+
+/* Arrays and objects nest at most this deep */
+#define JSON_MAX_DEPTH 64
+
+typedef struct json_value {
+    int type;                  /* JSON_* */
+    const char *key;           /* Member name inside an object, else NULL */
+    const char *text;          /* JSON_STRING: contents, unescaped (UTF-8, NUL terminated) */
+    long length;               /* Bytes in text */
+    double number;             /* JSON_NUMBER; JSON_BOOL: 0 or 1 */
+    struct json_value *child;  /* First element or member */
+    struct json_value *next;   /* Next element or member of the parent */
+} json_value;
+
+/*
+ * Parses length bytes of text (a complete JSON document).
+ * Returns the root value, or NULL if the text is not valid JSON or memory
+ * ran out.
+ */
+json_value *json_parse(arena *mem, const char *text, long length);
+
+/*
+ * Returns the member of an object with the given name, or NULL (also if
+ * object is NULL or not an object).
+ */
+const json_value *json_member(const json_value *object, const char *key);
+
+/*
+ * Returns the number held by a value as a long, or fallback if the value
+ * is missing or not a number.
+ */
+long json_integer(const json_value *value, long fallback);
+
+/*
+ * Returns the text of a string value, or NULL if the value is missing or
+ * not a string.
+ */
+const char *json_string(const json_value *value);
+
+/*
+ * Appends text as a quoted JSON string, escaping what needs it.
+ */
+void json_append_string(out_buffer *out, const char *text, long length);
+
+/*
+ * Appends a parsed value back as JSON (used to echo request ids).
+ */
+void json_append_value(out_buffer *out, const json_value *value);
+
+#endif /* JSON_H */
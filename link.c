@@ -0,0 +1,355 @@
+/* link.c - Links assembled modules (--binary object files) into one .ob file */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "source.h"
+#include "output.h"
+#include "arena.h"
+#include "names.h"
+#include "object.h"
+#include "parallel.h"
+
+/*
+ * A module of the program:
+ * - Read by the first round (one task per module): its .obj file, opened
+ *   in place and checked to be relocatable. Its code was assembled at
+ *   OBJ_CODE_ADDRESS and its data right after the code.
+ * - Placed by the layout: its code goes after the code of the modules
+ *   before it, its data after all the code and the data before it.
+ * - Resolved by the second round: its words are copied into the program,
+ *   relocated, and every extern use site is patched with the address of
+ *   the entry of that name.
+ */
+typedef struct link_module {
+    const char *name;          /* As given on the command line */
+    char *path;                /* <name>.obj */
+    source_text file;
+    int loaded;
+    obj_view view;
+    const char *error;         /* Why the module cannot be linked, or NULL */
+    long code_base;            /* Program address of its code segment... */
+    long data_base;            /* ...and of its data segment */
+    long code_index;           /* Program word index of its first code word... */
+    long data_index;           /* ...and of its first data word */
+    long *missing;             /* Extern records no entry resolves */
+    long missing_count;
+} link_module;
+
+/* The program being linked, shared by the tasks of both rounds */
+typedef struct link_job {
+    link_module *modules;
+    int count;
+    name_pool entry_names;     /* Names of the entries of every module */
+    long *entry_address;       /* Program address of each entry, by name id */
+    int *entry_owner;          /* Module that defines it, by name id */
+    int *words;                /* Code words of every module, then data words */
+    long code_length;
+    long data_length;
+} link_job;
+
+/* Prints the command line usage */
+static void print_usage(const char *prog) {
+    printf("Usage: %s [--jobs <count>] <output> <module> [module ...]\n", prog);
+    printf("  Links <module>.obj files (assembled with --binary) into <output>.ob\n");
+    printf("  --jobs  reads and resolves up to <count> modules at once\n");
+}
+
+/* Joins a source name and an extension into a new string (NULL if memory ran out). */
+static char *output_name(const char *source, const char *extension) {
+    char *name = malloc(strlen(source) + strlen(extension) + 1);
+    if (name) {
+        strcpy(name, source);
+        strcat(name, extension);
+    }
+    return name;
+}
+
+/*
+ * Program address of a label of a module: its offset from the origin of
+ * its segment, added to where the layout put that segment.
+ */
+static long relocate(const link_module *m, long address, int segment) {
+    if (segment == OBJ_SEGMENT_DATA) return m->data_base + (address - OBJ_DATA_ADDRESS(m->view.code_length));
+    return m->code_base + (address - OBJ_CODE_ADDRESS);
+}
+
+/* First round: reads and checks the object file of one module. */
+static void read_module(void *context, int index) {
+    link_module *m = &((link_job *)context)->modules[index];
+
+    if (!source_load(&m->file, m->path)) {
+        m->error = "cannot be read";
+        return;
+    }
+    m->loaded = 1;
+    if (!obj_open(&m->view, m->file.text, m->file.length)) {
+        m->error = "is not a valid object file";
+    } else if (!(m->view.flags & OBJ_RELOCATABLE)) {
+        m->error = "is not relocatable (assemble the module with --binary)";
+    }
+}
+
+/*
+ * Second round: copies the words of one module into the program,
+ * relocates its label words and patches its extern use sites. Only
+ * reads the entry table, so the modules are resolved at the same time.
+ */
+static void resolve_module(void *context, int index) {
+    link_job *job = context;
+    link_module *m = &job->modules[index];
+    int *code = job->words + m->code_index;
+    int *data = job->words + job->code_length + m->data_index;
+    obj_relocation rel;
+    obj_symbol sym;
+    long i, at;
+    int id;
+
+    for (i = 0; i < m->view.code_length; i++)
+        code[i] = obj_word(&m->view, i);
+    for (i = 0; i < m->view.data_length; i++)
+        data[i] = obj_word(&m->view, m->view.code_length + i);
+
+    for (i = 0; i < m->view.relocation_count; i++) {
+        if (!obj_relocation_at(&m->view, i, &rel) ||
+            (at = rel.address - OBJ_CODE_ADDRESS) < 0 || at >= m->view.code_length) {
+            m->error = "has a damaged relocation record";
+            return;
+        }
+        code[at] = (int)relocate(m, code[at], rel.segment);
+    }
+
+    m->missing = malloc((size_t)(m->view.counts[OBJ_EXTERNS] + 1) * sizeof(long));
+    if (!m->missing) {
+        m->error = "cannot be resolved: out of memory";
+        return;
+    }
+    for (i = 0; i < m->view.counts[OBJ_EXTERNS]; i++) {
+        if (!obj_symbol_at(&m->view, OBJ_EXTERNS, i, &sym) ||
+            (at = sym.address - OBJ_CODE_ADDRESS) < 0 || at >= m->view.code_length) {
+            m->error = "has a damaged extern record";
+            return;
+        }
+        id = find_name(&job->entry_names, sym.name, (int)strlen(sym.name));
+        if (id == NO_NAME) m->missing[m->missing_count++] = i;
+        else code[at] = (int)job->entry_address[id];
+    }
+}
+
+/* Prints the modules that failed a round. Returns how many did. */
+static int report_module_errors(const link_job *job) {
+    int failures = 0, i;
+
+    for (i = 0; i < job->count; i++) {
+        if (!job->modules[i].error) continue;
+        fprintf(stderr, "Error: %s %s\n", job->modules[i].path, job->modules[i].error);
+        failures++;
+    }
+    return failures;
+}
+
+/*
+ * Places the segments of the modules: the code of each module in command
+ * line order, from OBJ_CODE_ADDRESS, then their data in the same order. Returns 1, or 0 if memory ran out.
+ */
+static int lay_out(link_job *job) {
+    long i;
+
+    job->code_length = job->data_length = 0;
+    for (i = 0; i < job->count; i++) {
+        job->modules[i].code_index = job->code_length;
+        job->modules[i].data_index = job->data_length;
+        job->code_length += job->modules[i].view.code_length;
+        job->data_length += job->modules[i].view.data_length;
+    }
+
+    for (i = 0; i < job->count; i++) {
+        job->modules[i].code_base = OBJ_CODE_ADDRESS + job->modules[i].code_index;
+        job->modules[i].data_base = OBJ_DATA_ADDRESS(job->code_length) + job->modules[i].data_index;
+    }
+
+    job->words = malloc((size_t)(job->code_length + job->data_length + 1) * sizeof(int));
+    return job->words != NULL;
+}
+
+/*
+ * Builds the table of every entry of the program, with the address the
+ * layout gives it. An entry's segment follows from its address: data
+ * labels come after the module's code. Returns the number of entries
+ * defined twice (each reported), or -1 on a damaged record or if memory
+ * ran out.
+ */
+static int collect_entries(link_job *job) {
+    long total = 0, k;
+    obj_symbol sym;
+    link_module *m;
+    int duplicates = 0, count, i, id;
+
+    for (i = 0; i < job->count; i++)
+        total += job->modules[i].view.counts[OBJ_ENTRIES];
+    job->entry_address = malloc((size_t)(total + 1) * sizeof(long));
+    job->entry_owner = malloc((size_t)(total + 1) * sizeof(int));
+    if (!job->entry_address || !job->entry_owner) {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+
+    for (i = 0; i < job->count; i++) {
+        m = &job->modules[i];
+        for (k = 0; k < m->view.counts[OBJ_ENTRIES]; k++) {
+            if (!obj_symbol_at(&m->view, OBJ_ENTRIES, k, &sym)) {
+                fprintf(stderr, "Error: %s has a damaged entry record\n", m->path);
+                return -1;
+            }
+            count = job->entry_names.count;
+            id = intern_name(&job->entry_names, sym.name, (int)strlen(sym.name));
+            if (job->entry_names.count == count) {
+                fprintf(stderr, "Error: entry '%s' of %s is already defined by %s\n",
+                        sym.name, m->path, job->modules[job->entry_owner[id]].path);
+                duplicates++;
+            } else {
+                job->entry_owner[id] = i;
+                job->entry_address[id] = relocate(m, sym.address,
+                                                  sym.address >= OBJ_DATA_ADDRESS(m->view.code_length) ?
+                                                  OBJ_SEGMENT_DATA : OBJ_SEGMENT_CODE);
+            }
+        }
+    }
+    return duplicates;
+}
+
+/*
+ * Reports every extern use site no entry resolves, in module order.
+ * Returns how many there are.
+ */
+static long report_missing(const link_job *job) {
+    const link_module *m;
+    obj_symbol sym;
+    long missing = 0, k;
+    int i;
+
+    for (i = 0; i < job->count; i++) {
+        m = &job->modules[i];
+        for (k = 0; k < m->missing_count; k++) {
+            obj_symbol_at(&m->view, OBJ_EXTERNS, m->missing[k], &sym);
+            fprintf(stderr, "Error: undefined external '%s' used by %s at %04ld\n",
+                    sym.name, m->path, sym.address);
+        }
+        missing += m->missing_count;
+    }
+    return missing;
+}
+
+/*
+ * Writes the linked program as an .ob file. The text comes from
+ * obj_to_text(), so it is in the exact format of the assembler's .ob.
+ * Returns 1 on success, 0 on failure.
+ */
+static int write_program(const link_job *job, const char *path) {
+    out_buffer obj = {NULL, 0, 0, 0}, ob = {NULL, 0, 0, 0};
+    out_buffer ent = {NULL, 0, 0, 0}, ext = {NULL, 0, 0, 0};
+    obj_image img;
+    obj_view view;
+    int ok;
+
+    memset(&img, 0, sizeof(img));
+    img.word_bits = 16;
+    img.code_length = job->code_length;
+    img.data_length = job->data_length;
+    img.words = job->words;
+    ok = obj_write(&obj, &img) && obj_open(&view, obj.data, obj.length) &&
+         obj_to_text(&view, &ob, &ent, &ext) && commit_output(path, &ob, 0);
+
+    out_free(&obj);
+    out_free(&ob);
+    out_free(&ent);
+    out_free(&ext);
+    return ok;
+}
+
+/* Releases the modules and tables of a job. */
+static void free_job(link_job *job) {
+    int i;
+
+    for (i = 0; i < job->count; i++) {
+        if (job->modules[i].loaded) source_free(&job->modules[i].file);
+        free(job->modules[i].path);
+        free(job->modules[i].missing);
+    }
+    free(job->modules);
+    free(job->entry_address);
+    free(job->entry_owner);
+    free(job->words);
+    free_name_pool(&job->entry_names);
+}
+
+/*
+ * Links the modules named on the command line:
+ * 1. Reads their object files, one task per module.
+ * 2. Lays out their segments and builds the table of their entries,
+ *    reporting the names more than one module enters.
+ * 3. Copies, relocates and patches the words of every module, one task
+ *    per module, and reports the externs no module enters.
+ * 4. Writes the program if nothing failed.
+ */
+int main(int argc, char *argv[]) {
+    arena names_mem = {NULL, NULL};   /* Texts of the entry names */
+    link_job job;
+    char *ob_name;
+    int first = 1, failed = 0, duplicates = 0, i;
+
+    if (argc > 2 && strcmp(argv[1], "--jobs") == 0) {
+        set_parallel_jobs(atoi(argv[2]));
+        first = 3;
+    }
+    if (argc - first < 2) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    memset(&job, 0, sizeof(job));
+    job.entry_names.mem = &names_mem;
+    job.count = argc - first - 1;
+    job.modules = calloc((size_t)job.count, sizeof(link_module));
+    ob_name = output_name(argv[first], ".ob");
+    if (!job.modules || !ob_name) {
+        fprintf(stderr, "Out of memory\n");
+        free(job.modules);
+        free(ob_name);
+        return 1;
+    }
+    for (i = 0; i < job.count; i++) {
+        job.modules[i].name = argv[first + 1 + i];
+        job.modules[i].path = output_name(job.modules[i].name, ".obj");
+        if (!job.modules[i].path) failed = 1;
+    }
+
+    if (failed) {
+        fprintf(stderr, "Out of memory\n");
+    } else {
+        run_parallel(read_module, &job, job.count);
+        failed = report_module_errors(&job) != 0;
+    }
+    if (!failed && !lay_out(&job)) {
+        fprintf(stderr, "Out of memory\n");
+        failed = 1;
+    }
+    if (!failed) {
+        duplicates = collect_entries(&job);
+        failed = duplicates < 0;
+    }
+    if (!failed) {
+        run_parallel(resolve_module, &job, job.count);
+        failed = report_module_errors(&job) != 0;
+        if (!failed) failed = report_missing(&job) != 0 || duplicates != 0;
+    }
+    if (!failed && !write_program(&job, ob_name)) {
+        fprintf(stderr, "Error writing %s\n", ob_name);
+        failed = 1;
+    }
+
+    free_job(&job);
+    arena_free(&names_mem);
+    free(ob_name);
+    return failed ? 1 : 0;
+}
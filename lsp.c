@@ -0,0 +1,317 @@
+/* lsp.c - JSON-RPC language server over standard input and output */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+#include "output.h"
+#include "json.h"
+#include "analysis.h"
+#include "lsp.h"
+
+/* Longest header line read */
+#define MAX_HEADER_LENGTH 256
+
+/* A position past the end of any document (clamped by doc_change()) */
+#define DOC_END 0x7FFFFFFF
+
+/* JSON-RPC error codes */
+#define RPC_PARSE_ERROR      (-32700)
+#define RPC_INVALID_REQUEST  (-32600)
+#define RPC_METHOD_NOT_FOUND (-32601)
+
+/* An open document */
+typedef struct open_document {
+    char *uri;
+    document *doc;
+    struct open_document *next;
+} open_document;
+
+static open_document *documents;
+static node *library;
+static out_buffer message;       /* Message being written */
+static arena request_arena;      /* Parsed request, reset after each one */
+
+/*
+ * Reads the headers and body of the next message. Returns the body (its
+ * length in *length), NULL at the end of the input. A message without a
+ * Content-Length header is skipped.
+ */
+static char *read_message(long *length) {
+    char header[MAX_HEADER_LENGTH];
+    long content_length = -1;
+    char *body;
+
+    for (;;) {
+        if (!fgets(header, sizeof(header), stdin)) return NULL;
+        if (strcmp(header, "\r\n") == 0 || strcmp(header, "\n") == 0) {
+            if (content_length >= 0) break;
+            continue;
+        }
+        if (strncmp(header, "Content-Length:", 15) == 0)
+            content_length = strtol(header + 15, NULL, 10);
+    }
+
+    body = malloc(content_length + 1);
+    if (!body) return NULL;
+    if ((long)fread(body, 1, content_length, stdin) != content_length) {
+        free(body);
+        return NULL;
+    }
+    body[content_length] = '\0';
+    *length = content_length;
+    return body;
+}
+
+/* Writes the message built in the message buffer and empties it. */
+static void send_message(void) {
+    if (!message.failed) {
+        printf("Content-Length: %ld\r\n\r\n", message.length);
+        fwrite(message.data, 1, message.length, stdout);
+        fflush(stdout);
+    }
+    out_reset(&message);
+}
+
+#define APPEND(text) out_append(&message, text, (long)strlen(text))
+
+/* Starts a response to the request with the given id. */
+static void begin_response(const json_value *id) {
+    APPEND("{\"jsonrpc\":\"2.0\",\"id\":");
+    json_append_value(&message, id);
+    APPEND(",\"result\":");
+}
+
+static void send_result(const json_value *id, const char *result) {
+    begin_response(id);
+    APPEND(result);
+    APPEND("}");
+    send_message();
+}
+
+static void send_error(const json_value *id, int code, const char *text) {
+    char number[32];
+    APPEND("{\"jsonrpc\":\"2.0\",\"id\":");
+    json_append_value(&message, id);
+    APPEND(",\"error\":{\"code\":");
+    out_append(&message, number, sprintf(number, "%d", code));
+    APPEND(",\"message\":");
+    json_append_string(&message, text, (long)strlen(text));
+    APPEND("}}");
+    send_message();
+}
+
+/* Appends an LSP range on one line. */
+static void append_range(int line, int start, int end) {
+    char range[128];
+    out_append(&message, range,
+               sprintf(range, "{\"start\":{\"line\":%d,\"character\":%d},\"end\":{\"line\":%d,\"character\":%d}}",
+                       line, start, line, end));
+}
+
+/* Publishes the diagnostics of a document (none if doc is NULL). */
+static void publish_diagnostics(const char *uri, document *doc) {
+    const doc_diagnostic *list;
+    int count = doc ? doc_diagnostics(doc, &list) : 0;
+    int i;
+
+    APPEND("{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/publishDiagnostics\",\"params\":{\"uri\":");
+    json_append_string(&message, uri, (long)strlen(uri));
+    APPEND(",\"diagnostics\":[");
+    for (i = 0; i < count; i++) {
+        if (i > 0) APPEND(",");
+        APPEND("{\"range\":");
+        append_range(list[i].line, list[i].start, list[i].end);
+        APPEND(",\"severity\":1,\"source\":\"assembler\",\"message\":");
+        json_append_string(&message, list[i].message, (long)strlen(list[i].message));
+        APPEND("}");
+    }
+    APPEND("]}}");
+    send_message();
+}
+
+/* Finds an open document by uri; returns the link that points to it. */
+static open_document **find_document(const char *uri) {
+    open_document **link = &documents;
+    while (*link && strcmp((*link)->uri, uri) != 0)
+        link = &(*link)->next;
+    return link;
+}
+
+static void close_document(open_document **link) {
+    open_document *od = *link;
+    *link = od->next;
+    doc_close(od->doc);
+    free(od->uri);
+    free(od);
+}
+
+/* uri of the params' textDocument */
+static const char *document_uri(const json_value *params) {
+    return json_string(json_member(json_member(params, "textDocument"), "uri"));
+}
+
+static void did_open(const json_value *params) {
+    const json_value *item = json_member(params, "textDocument");
+    const char *uri = json_string(json_member(item, "uri"));
+    const json_value *text = json_member(item, "text");
+    open_document *od;
+
+    if (!uri || !text || text->type != JSON_STRING) return;
+    if (*find_document(uri)) close_document(find_document(uri));
+    od = malloc(sizeof(open_document));
+    if (!od) return;
+    od->uri = malloc(strlen(uri) + 1);
+    od->doc = doc_open(text->text, text->length, library);
+    if (!od->uri || !od->doc) {
+        if (od->doc) doc_close(od->doc);
+        free(od->uri);
+        free(od);
+        return;
+    }
+    strcpy(od->uri, uri);
+    od->next = documents;
+    documents = od;
+    publish_diagnostics(uri, od->doc);
+}
+
+/* Applies each change in order: a range and its new text, or the full text. */
+static void did_change(const json_value *params) {
+    const char *uri = document_uri(params);
+    const json_value *change;
+    open_document *od;
+
+    if (!uri || !(od = *find_document(uri))) return;
+    change = json_member(params, "contentChanges");
+    for (change = change ? change->child : NULL; change; change = change->next) {
+        const json_value *range = json_member(change, "range");
+        const json_value *text = json_member(change, "text");
+        const json_value *start = json_member(range, "start");
+        const json_value *end = json_member(range, "end");
+
+        if (!text || text->type != JSON_STRING) continue;
+        if (range)
+            doc_change(od->doc,
+                       (int)json_integer(json_member(start, "line"), 0),
+                       (int)json_integer(json_member(start, "character"), 0),
+                       (int)json_integer(json_member(end, "line"), 0),
+                       (int)json_integer(json_member(end, "character"), 0),
+                       text->text, text->length);
+        else
+            doc_change(od->doc, 0, 0, DOC_END, DOC_END, text->text, text->length);
+    }
+    publish_diagnostics(uri, od->doc);
+}
+
+static void did_close(const json_value *params) {
+    const char *uri = document_uri(params);
+    open_document **link;
+
+    if (!uri || !*(link = find_document(uri))) return;
+    close_document(link);
+    publish_diagnostics(uri, NULL);
+}
+
+/* Document and position of a textDocument/definition or hover request */
+static document *request_position(const json_value *params, int *line, int *column) {
+    const char *uri = document_uri(params);
+    const json_value *position = json_member(params, "position");
+    open_document *od;
+
+    if (!uri || !(od = *find_document(uri))) return NULL;
+    *line = (int)json_integer(json_member(position, "line"), -1);
+    *column = (int)json_integer(json_member(position, "character"), 0);
+    return od->doc;
+}
+
+static void definition(const json_value *id, const json_value *params) {
+    int line, column, def_line, def_start, def_end;
+    document *doc = request_position(params, &line, &column);
+
+    if (!doc || !doc_definition(doc, line, column, &def_line, &def_start, &def_end)) {
+        send_result(id, "null");
+        return;
+    }
+    begin_response(id);
+    APPEND("{\"uri\":");
+    json_append_string(&message, document_uri(params), (long)strlen(document_uri(params)));
+    APPEND(",\"range\":");
+    append_range(def_line, def_start, def_end);
+    APPEND("}}");
+    send_message();
+}
+
+static void hover(const json_value *id, const json_value *params) {
+    int line, column;
+    document *doc = request_position(params, &line, &column);
+    out_buffer text;
+
+    memset(&text, 0, sizeof(text));
+    if (!doc || !doc_hover(doc, line, column, &text) || text.failed) {
+        out_free(&text);
+        send_result(id, "null");
+        return;
+    }
+    begin_response(id);
+    APPEND("{\"contents\":{\"kind\":\"plaintext\",\"value\":");
+    json_append_string(&message, text.data, text.length);
+    APPEND("}}}");
+    send_message();
+    out_free(&text);
+}
+
+/*
+ * lsp_serve
+ * Requests are answered in the order they arrive; every notification
+ * that changes a document publishes its diagnostics right away.
+ */
+int lsp_serve(node *shared_macros) {
+    char *body;
+    long length;
+    int shut_down = 0, exited = 0;
+
+    library = shared_macros;
+    while ((body = read_message(&length)) != NULL) {
+        const json_value *request = json_parse(&request_arena, body, length);
+        const json_value *id = json_member(request, "id");
+        const json_value *params = json_member(request, "params");
+        const char *method = json_string(json_member(request, "method"));
+
+        if (!request) {
+            send_error(NULL, RPC_PARSE_ERROR, "Parse error");
+        } else if (!method) {
+            if (id) send_error(id, RPC_INVALID_REQUEST, "Invalid request");
+        } else if (strcmp(method, "initialize") == 0) {
+            send_result(id, "{\"capabilities\":{\"textDocumentSync\":{\"openClose\":true,\"change\":2},"
+                            "\"definitionProvider\":true,\"hoverProvider\":true},"
+                            "\"serverInfo\":{\"name\":\"assembler\"}}");
+        } else if (strcmp(method, "textDocument/didOpen") == 0) {
+            did_open(params);
+        } else if (strcmp(method, "textDocument/didChange") == 0) {
+            did_change(params);
+        } else if (strcmp(method, "textDocument/didClose") == 0) {
+            did_close(params);
+        } else if (strcmp(method, "textDocument/definition") == 0) {
+            definition(id, params);
+        } else if (strcmp(method, "textDocument/hover") == 0) {
+            hover(id, params);
+        } else if (strcmp(method, "shutdown") == 0) {
+            shut_down = 1;
+            send_result(id, "null");
+        } else if (strcmp(method, "exit") == 0) {
+            exited = 1;
+        } else if (id) {
+            /* Notifications the server does not handle are ignored */
+            send_error(id, RPC_METHOD_NOT_FOUND, "Method not found");
+        }
+        free(body);
+        arena_reset(&request_arena);
+        if (exited) break;
+    }
+
+    while (documents)
+        close_document(&documents);
+    out_free(&message);
+    arena_free(&request_arena);
+    return exited && shut_down ? 0 : 1;
+}
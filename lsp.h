@@ -0,0 +1,25 @@
+#ifndef LSP_H
+#define LSP_H
+
+#include "data_struct.h"
+
+/*
+ * Language server (the --lsp option):
+ * - Speaks JSON-RPC over standard input and output, framed with
+ *   Content-Length headers, the way editors start language servers.
+ * - Supports the part of the Language Server Protocol the analysis
+ *   provides (see analysis.h): opening, changing (incrementally or in
+ *   full) and closing documents, diagnostics published after every
+ *   change, go to the definition of a label, and hover with addresses
+ *   and encodings.
+ * - Columns are byte offsets, not UTF-16 units; sources are ASCII.
+ */
+
+/*
+ * Serves requests until the client sends exit or closes standard input.
+ * shared_macros (may be NULL) are the library macros calls may use.
+ * Returns 0 after a shutdown request and exit, 1 otherwise.
+ */
+int lsp_serve(node *shared_macros);
+
+#endif /* LSP_H */
@@ -1,198 +1,965 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include "data_struct.h"
-#include "util.h"
-#include <ctype.h>
-#include "globals.h"
-
-/*
- * Checks if a line is the start of a macro definition.
- * Handles optional label before the "mcro" keyword.
- * If found, stores the macro name in macro_name and returns 1.
- * Otherwise, returns 0.
- */
-int is_macro_start(const char *line, char *macro_name) {
-    const char *p = line;
-
-    /* Skip label if present */
-    if (strchr(p, ':') != NULL) {
-        p = strchr(p, ':') + 1;
-    }
-
-    /* Skip whitespace */
-    while (*p == ' ' || *p == '\t') {
-        p++;
-    }
-
-    /* Check for 'mcro' keyword */
-    if (strncmp(p, "mcro", 4) == 0) {
-        p += 4;
-        while (*p == ' ' || *p == '\t') {
-            p++;
-        }
-        sscanf(p, "%31s", macro_name);
-        return 1;
-    }
-
-    return 0;
-}
-
-
-
-/*
- * Checks if a line is the end of a macro definition.
- * Returns 1 if "endmcro" appears anywhere in the line, else 0.
- */
-int is_macro_end(const char *line) {
-    return strstr(line, "endmcro") != NULL;
-}
-
-/*
- * Looks for a macro by name in the macro list.
- * Returns pointer to node if found, else NULL.
- */
-node *find_macro(node *head, const char *name) {
-    while (head) {
-        if (strcmp(head->name, name) == 0)
-            return head;
-        head = head->next;
-    }
-    return NULL;
-}
-
-/*
- * Extracts the first word from a line, skipping optional label and whitespace.
- * Used to check if a line is a macro call (possibly after a label).
- * - line: input line (may start with "LABEL: macrocall ...")
- * - opcode: output buffer for macro name (max 32 chars)
- */
-void get_opcode_from_line(const char *line, char *opcode) {
-    const char *p = line;
-    int i = 0;
-    opcode[0] = '\0';
-
-    /* Skip whitespace at start of line */
-    while (*p == ' ' || *p == '\t') p++;
-
-    /* Skip label if present (look for ':') */
-    if (*p && !isspace((unsigned char)*p)) {
-        const char *colon = strchr(p, ':');
-        if (colon && colon < p + 32) { /* Only if label is reasonably short */
-            p = colon + 1;
-            while (*p == ' ' || *p == '\t') p++;
-        }
-    }
-
-    /* Extract first word (macro call or instruction) */
-    while (*p && !isspace((unsigned char)*p) && *p != '\n' && i < 31)
-        opcode[i++] = *p++;
-    opcode[i] = '\0';
-}
-
-/*
- * Processes a file to expand macros.
- * For each macro definition, stores its lines in a linked list.
- * When a macro call is found, replaces it with its body.
- * Writes output to a .am file.
- * Returns 1 on success, 0 on failure.
- */
-int mcro_exec(char *filename) {
-    FILE *in_fp;         /* Input (original) file */
-    char *out_filename;  /* Output (.am) filename */
-    FILE *out_fp;        /* Output file */
-    char line[MAX_LINE_LENGTH];
-    char macro_name[32];
-    node *macro_list = NULL;     /* Linked list of all macros found */
-    node *current_macro = NULL;  /* Macro being currently defined */
-    int in_macro = 0;            /* Flag: inside macro definition */
-    int line_num = 0;            /* Track input line number for error reporting */
-    int skip_macro = 0;          /* Flag: skip lines until endmcro after duplicate */
-
-    in_fp = fopen(filename, "r");
-    if (!in_fp) return 0;
-
-    /* Create new .am output filename and file */
-    out_filename = add_new_file(filename, ".am");
-    if (!out_filename) {
-        fclose(in_fp);
-        return 0;
-    }
-
-    out_fp = fopen(out_filename, "w");
-    if (!out_fp) {
-        fclose(in_fp);
-        free(out_filename);
-        return 0;
-    }
-
-    /* Main loop: process each line */
-    while (fgets(line, MAX_LINE_LENGTH, in_fp)) {
-
-        if (strchr(line, '\n') == NULL && !feof(in_fp)) {
-            fprintf(stderr, "Error (line %d): Line exceeds maximum allowed length of %d characters.\n", line_num, MAX_LINE_LENGTH);
-            error_flag = 1;
-            /* Optional: skip to end of long line */
-            while (fgetc(in_fp) != '\n' && !feof(in_fp));
-            continue;
-        }
-
-        line_num++;
-
-        /* If skipping macro after duplicate, continue until endmcro */
-        if (skip_macro) {
-            if (is_macro_end(line)) {
-                skip_macro = 0;
-            }
-            continue;
-        }
-
-        /* Macro definition start: begin recording macro lines */
-        if (!in_macro && is_macro_start(line, macro_name)) {
-            if (find_macro(macro_list, macro_name)) {
-                fprintf(stderr, "Error (line %d): Duplicate macro name '%s'. Skipping this macro definition.\n", line_num, macro_name);
-                skip_macro = 1;
-                continue;
-            }
-            in_macro = 1;
-            current_macro = create_macro(&macro_list, macro_name);
-            continue;
-        }
-
-        /* Inside a macro: store each line, stop when end is found */
-        if (in_macro) {
-            if (is_macro_end(line)) {
-                in_macro = 0;
-                current_macro = NULL;
-            } else {
-                add_line_to_macro(current_macro, line);
-            }
-            continue;
-        }
-
-        /* If not a macro definition, check if the line calls a macro */
-        {
-            char opcode[32];
-            node *macro;
-            int i;
-
-            get_opcode_from_line(line, opcode);
-            macro = find_macro(macro_list, opcode);
-            if (macro) {
-                /* If it's a macro call, write macro's lines to output */
-                for (i = 0; i < macro->line_count; i++)
-                    fprintf(out_fp, "%s", macro->lines[i]);
-            } else if (opcode[0] != '\0') {
-                /* Not a macro: copy line as-is to output */
-                fprintf(out_fp, "%s", line);
-            }
-        }
-    }
-
-    /* Cleanup: close files and free macro memory */
-    fclose(in_fp);
-    fclose(out_fp);
-    free(out_filename);
-    free_macro_list(macro_list);
-    return 1;
-}
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "data_struct.h"
+#include "util.h"
+#include <ctype.h>
+#include "globals.h"
+#include "macros.h"
+#include "source.h"
+#include "scanner.h"
+#include "names.h"
+#include "errors.h"
+#include "output.h"
+#include "async_io.h"
+#include "stream.h"
+
+/* Macros defined by the file being assembled (kept until cleanup) */
+node *file_macros = NULL;
+
+/* Macro calls expanded into the current .am file, in line order */
+macro_call *macro_calls = NULL;
+
+/* Contents of the .am file written by the last mcro_exec() */
+out_buffer am_output = {NULL, 0, 0, 0};
+
+/*
+ * Releases the macros and macro calls of the current file.
+ */
+void free_file_macros(void) {
+    free_macro_list(file_macros);
+    file_macros = NULL;
+    macro_calls = NULL;
+}
+
+/*
+ * Checks if a line is the start of a macro definition.
+ * Handles optional label before the "mcro" keyword (found through the
+ * line's scan info instead of searching the line).
+ * If found, stores the macro name in macro_name and returns 1.
+ * Otherwise, returns 0.
+ */
+int is_macro_start(const char *line, const line_info *info, char *macro_name) {
+    const char *p = line;
+
+    /* Skip label if present */
+    if (info->colon >= 0) {
+        p = line + info->colon + 1;
+    }
+
+    /* Skip whitespace */
+    while (*p == ' ' || *p == '\t') {
+        p++;
+    }
+
+    /* Check for 'mcro' keyword */
+    if (strncmp(p, "mcro", 4) == 0) {
+        p += 4;
+        while (*p == ' ' || *p == '\t') {
+            p++;
+        }
+        sscanf(p, "%31s", macro_name);
+        return 1;
+    }
+
+    return 0;
+}
+
+
+
+/*
+ * Checks if a line is the end of a macro definition.
+ * Returns 1 if "endmcro" appears anywhere in the line, else 0.
+ */
+int is_macro_end(const char *line) {
+    return strstr(line, "endmcro") != NULL;
+}
+
+/*
+ * Looks for a macro by name id in the macro list (ids of the list's pool).
+ * Returns pointer to node if found, else NULL.
+ */
+node *find_macro(node *head, int name) {
+    while (head) {
+        if (head->name == name)
+            return head;
+        head = head->next;
+    }
+    return NULL;
+}
+
+/*
+ * Extracts the first word from a line, skipping optional label and whitespace.
+ * Used to check if a line is a macro call (possibly after a label).
+ * - line: input line (may start with "LABEL: macrocall ...")
+ * - info: scan info of the line (locates the label colon)
+ * - opcode: output buffer for macro name (max 32 chars)
+ */
+void get_opcode_from_line(const char *line, const line_info *info, char *opcode) {
+    const char *p = line;
+    int i = 0;
+    opcode[0] = '\0';
+
+    /* Skip whitespace at start of line */
+    while (*p == ' ' || *p == '\t') p++;
+
+    /* Skip label if present (look for ':') */
+    if (*p && !isspace((unsigned char)*p)) {
+        const char *colon = info->colon >= 0 ? line + info->colon : NULL;
+        if (colon && colon < p + 32) { /* Only if label is reasonably short */
+            p = colon + 1;
+            while (*p == ' ' || *p == '\t') p++;
+        }
+    }
+
+    /* Extract first word (macro call or instruction) */
+    while (*p && !isspace((unsigned char)*p) && *p != '\n' && i < 31)
+        opcode[i++] = *p++;
+    opcode[i] = '\0';
+}
+
+/*
+ * State of the macro definition recogniser, shared by mcro_exec() and
+ * load_macro_library() so both treat mcro/endmcro blocks the same way.
+ */
+typedef struct macro_reader {
+    node **list;           /* Macro list definitions are added to */
+    name_pool *names;      /* Pool the list's macro names are interned in */
+    arena *mem;            /* Arena the list is allocated in */
+    node *current;         /* Macro being currently defined */
+    int in_macro;          /* Flag: inside macro definition */
+    int skip_macro;        /* Flag: skip lines until endmcro after duplicate */
+} macro_reader;
+
+/*
+ * Kind of a conditional assembly directive line.
+ */
+#define COND_NONE   0
+#define COND_IFDEF  1
+#define COND_IFNDEF 2
+#define COND_ELSE   3
+#define COND_ENDIF  4
+
+/* Maximum nesting depth of .ifdef/.ifndef blocks */
+#define MAX_COND_DEPTH 32
+
+/*
+ * Line reader over an in-memory source:
+ * - Hands out lines like fgets(MAX_LINE_LENGTH) would, reporting and
+ *   dropping over-long lines.
+ * - Evaluates .ifdef/.ifndef/.else/.endif itself, so its callers only
+ *   ever see the lines of enabled regions.
+ */
+typedef struct line_reader {
+    const char *text;                    /* Source being read (current block when streamed) */
+    line_index index;                    /* Its lines, classified by scan_lines() */
+    source_stream *stream;               /* Source of further blocks, or NULL */
+    int next;                            /* Index of the next line to read */
+    const line_info *info;               /* Scan info of the last line read */
+    int line_num;                        /* Number of the last line read */
+    int depth;                           /* Open conditional blocks */
+    int parent_on[MAX_COND_DEPTH];       /* Was the enclosing region enabled */
+    int cond_true[MAX_COND_DEPTH];       /* Did the block's condition hold */
+    int in_else[MAX_COND_DEPTH];         /* Is the block past its .else */
+    int errors;                          /* Conditional structure errors */
+} line_reader;
+
+/* Names defined with -D for conditional assembly */
+static char **defined_names = NULL;
+static int defined_count = 0;
+
+/*
+ * Defines a name for .ifdef/.ifndef.
+ * Returns 1 on success, 0 on allocation failure.
+ */
+int define_name(const char *name) {
+    char **names;
+    char *copy;
+
+    names = realloc(defined_names, (defined_count + 1) * sizeof(char *));
+    if (!names) return 0;
+    defined_names = names;
+    copy = malloc(strlen(name) + 1);
+    if (!copy) return 0;
+    strcpy(copy, name);
+    defined_names[defined_count++] = copy;
+    return 1;
+}
+
+/* Frees every name defined with define_name(). */
+void free_defined_names(void) {
+    int i;
+    for (i = 0; i < defined_count; i++)
+        free(defined_names[i]);
+    free(defined_names);
+    defined_names = NULL;
+    defined_count = 0;
+}
+
+/* Returns 1 if name was defined with define_name(). */
+static int is_defined(const char *name) {
+    int i;
+    for (i = 0; i < defined_count; i++) {
+        if (strcmp(defined_names[i], name) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+/*
+ * Checks if p (the start of a line) is a conditional directive.
+ * If name is not NULL the directive's operand is copied into it.
+ * Returns one of the COND_* kinds.
+ */
+static int conditional_directive(const char *p, char *name) {
+    int kind = COND_NONE, len = 0, i = 0;
+
+    while (*p == ' ' || *p == '\t') p++;
+    if (*p != '.') return COND_NONE;
+
+    if (strncmp(p, ".ifdef", 6) == 0) { kind = COND_IFDEF; len = 6; }
+    else if (strncmp(p, ".ifndef", 7) == 0) { kind = COND_IFNDEF; len = 7; }
+    else if (strncmp(p, ".else", 5) == 0) { kind = COND_ELSE; len = 5; }
+    else if (strncmp(p, ".endif", 6) == 0) { kind = COND_ENDIF; len = 6; }
+    else return COND_NONE;
+
+    p += len;
+    if (*p != '\0' && !isspace((unsigned char)*p)) return COND_NONE;
+
+    if (name) {
+        while (*p == ' ' || *p == '\t') p++;
+        while (*p && !isspace((unsigned char)*p) && i < 31)
+            name[i++] = *p++;
+        name[i] = '\0';
+    }
+    return kind;
+}
+
+/* Returns 1 if the lines at the reader's position are enabled. */
+static int reader_enabled(const line_reader *r) {
+    int level = r->depth - 1;
+    if (level < 0) return 1;
+    return r->parent_on[level] && (r->in_else[level] ? !r->cond_true[level] : r->cond_true[level]);
+}
+
+/*
+ * Skips a disabled region up to the next conditional directive line.
+ * Only the first non-blank character of each line (known from the scan)
+ * is looked at, so disabled blocks are never copied or parsed.
+ */
+static int reader_refill(line_reader *r);
+
+static void skip_disabled_lines(line_reader *r) {
+    while (r->next < r->index.count || reader_refill(r)) {
+        const line_info *info = &r->index.lines[r->next];
+        const char *first = r->text + info->offset + info->indent;
+
+        if (info->indent < info->length && *first == '.' &&
+            conditional_directive(first, NULL) != COND_NONE)
+            break;
+        r->next++;
+        r->line_num++;
+    }
+}
+
+/*
+ * Applies a conditional directive to the reader's block stack.
+ * Returns 1 if the line was a conditional directive, 0 otherwise.
+ */
+static int handle_conditional(line_reader *r, const char *line) {
+    char name[32];
+    int kind = conditional_directive(line, name);
+    int level = r->depth - 1;
+
+    switch (kind) {
+    case COND_IFDEF:
+    case COND_IFNDEF:
+        if (name[0] == '\0') {
+            report_error("Missing name after conditional directive.", r->line_num);
+            r->errors++;
+        }
+        if (r->depth >= MAX_COND_DEPTH) {
+            report_errorf(r->line_num, "Conditional blocks nested too deeply (max = %d).", MAX_COND_DEPTH);
+            r->errors++;
+            return 1;
+        }
+        r->parent_on[r->depth] = reader_enabled(r);
+        r->cond_true[r->depth] = (kind == COND_IFDEF) == (is_defined(name) != 0);
+        r->in_else[r->depth] = 0;
+        r->depth++;
+        return 1;
+    case COND_ELSE:
+        if (level < 0 || r->in_else[level]) {
+            report_error("'.else' without a matching '.ifdef' or '.ifndef'.", r->line_num);
+            r->errors++;
+        } else {
+            r->in_else[level] = 1;
+        }
+        return 1;
+    case COND_ENDIF:
+        if (level < 0) {
+            report_error("'.endif' without a matching '.ifdef' or '.ifndef'.", r->line_num);
+            r->errors++;
+        } else {
+            r->depth--;
+        }
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Prepares a line reader over a loaded source and its line index (the
+ * reader takes over the index).
+ */
+static void reader_start(line_reader *r, const source_text *src, const line_index *index) {
+    r->text = src->text;
+    r->index = *index;
+    r->stream = NULL;
+    r->next = 0;
+    r->info = NULL;
+    r->line_num = 0;
+    r->depth = 0;
+    r->errors = 0;
+}
+
+/*
+ * Moves a streamed reader on to the next block once its lines are used up.
+ * Returns 1 if there are more lines, 0 at the end of the source.
+ */
+static int reader_refill(line_reader *r) {
+    source_text block;
+
+    if (!r->stream) return 0;
+    free_line_index(&r->index);
+    r->next = 0;
+    if (!stream_next(r->stream, &block, &r->index)) return 0;
+    r->text = block.text;
+    return 1;
+}
+
+/*
+ * Prepares a line reader over a loaded source.
+ * Returns 1 on success, 0 if the source could not be scanned.
+ */
+static int reader_init(line_reader *r, const source_text *src) {
+    line_index index;
+    if (!scan_lines(src->text, src->length, &index)) return 0;
+    reader_start(r, src, &index);
+    return 1;
+}
+
+/*
+ * Reads the next line of an enabled region into line (at most
+ * MAX_LINE_LENGTH chars). Lines that exceed the maximum length are
+ * reported and skipped, conditional directives are consumed.
+ * Returns 1 when a line was read, 0 at end of file.
+ */
+static int read_source_line(line_reader *r, char *line) {
+    const line_info *info;
+    int len;
+
+    while (1) {
+        if (!reader_enabled(r))
+            skip_disabled_lines(r);
+
+        if (r->next >= r->index.count && !reader_refill(r)) break;
+        info = &r->index.lines[r->next++];
+
+        /* Same limit as reading with fgets(line, MAX_LINE_LENGTH, fp) */
+        if (info->length >= MAX_LINE_LENGTH - 1) {
+            report_errorf(r->line_num, "Line exceeds maximum allowed length of %d characters.", MAX_LINE_LENGTH);
+            error_flag = 1;
+            continue;
+        }
+        len = info->length + info->has_newline;
+        memcpy(line, r->text + info->offset, len);
+        line[len] = '\0';
+        r->info = info;
+        r->line_num++;
+
+        if (handle_conditional(r, line))
+            continue;
+        return 1;
+    }
+
+    if (r->depth > 0) {
+        report_error("Missing '.endif' at end of file.", r->line_num);
+        r->errors++;
+        r->depth = 0;
+    }
+    return 0;
+}
+
+/*
+ * Feeds one line to the macro definition recogniser.
+ * Returns 1 if the line belongs to a macro definition (and was consumed),
+ * 0 if it is an ordinary line the caller has to handle.
+ */
+static int handle_macro_definition(macro_reader *r, const char *line, const line_info *info, int line_num) {
+    char macro_name[32];
+
+    macro_name[0] = '\0';
+
+    /* If skipping macro after duplicate, continue until endmcro */
+    if (r->skip_macro) {
+        if (is_macro_end(line)) {
+            r->skip_macro = 0;
+        }
+        return 1;
+    }
+
+    /* Macro definition start: begin recording macro lines */
+    if (!r->in_macro && is_macro_start(line, info, macro_name)) {
+        int name = intern_name(r->names, macro_name, (int)strlen(macro_name));
+        if (find_macro(*r->list, name)) {
+            report_errorf(line_num, "Duplicate macro name '%s'. Skipping this macro definition.", macro_name);
+            r->skip_macro = 1;
+            return 1;
+        }
+        r->in_macro = 1;
+        r->current = create_macro(r->mem, r->list, name, r->names == &batch_names);
+        return 1;
+    }
+
+    /* Inside a macro: store each line, stop when end is found */
+    if (r->in_macro) {
+        if (is_macro_end(line)) {
+            r->in_macro = 0;
+            r->current = NULL;
+        } else {
+            add_line_to_macro(r->mem, r->current, line);
+        }
+        return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Loads a macro library into a list shared by all files of the batch.
+ * Only macro definitions, comments and empty lines are allowed outside
+ * of mcro/endmcro blocks.
+ * Returns 1 on success, 0 on failure.
+ */
+int load_macro_library(const char *filename, node **out) {
+    source_text src;
+    line_reader in;
+    char line[MAX_LINE_LENGTH];
+    int ok = 1;
+    macro_reader reader;
+
+    *out = NULL;
+    if (!source_load(&src, filename)) return 0;
+    if (!reader_init(&in, &src)) {
+        source_free(&src);
+        return 0;
+    }
+
+    reader.list = out;
+    reader.names = &batch_names;
+    reader.mem = &batch_arena;
+    reader.current = NULL;
+    reader.in_macro = 0;
+    reader.skip_macro = 0;
+
+    while (!error_limit_reached() && read_source_line(&in, line)) {
+        char opcode[32];
+
+        if (handle_macro_definition(&reader, line, in.info, in.line_num))
+            continue;
+
+        get_opcode_from_line(line, in.info, opcode);
+        if (opcode[0] != '\0' && opcode[0] != ';') {
+            report_errorf(in.line_num, "Only macro definitions are allowed in macro library '%.200s'.", filename);
+            ok = 0;
+        }
+    }
+
+    if (reader.in_macro) {
+        report_errorf(in.line_num, "Missing 'endmcro' at end of macro library '%.200s'.", filename);
+        ok = 0;
+    }
+    if (in.errors || error_limit_reached())
+        ok = 0;
+
+    free_line_index(&in.index);
+    source_free(&src);
+    if (!ok) {
+        free_macro_list(*out);
+        *out = NULL;
+    }
+    return ok;
+}
+
+/* Maximum depth of nested .include directives */
+#define MAX_INCLUDE_DEPTH 16
+
+/*
+ * Include file cache node:
+ * - Every included file is mapped and scanned once per run. Its macro
+ *   definitions and the index of its remaining lines (enabled by the
+ *   conditionals, outside of macro definitions) are kept for the whole
+ *   batch and replayed into every file that includes it.
+ * - Nodes, paths and macros are allocated per file (not in batch_arena),
+ *   so the --watch mode can drop a file that changed.
+ */
+typedef struct include_file {
+    char *path;                  /* Path the file was opened with */
+    source_text src;             /* File contents, kept while the cache lives */
+    line_index index;            /* Scan of the whole file */
+    int *lines;                  /* Index entries to replay into the including file */
+    int line_count;
+    node *macros;                /* Macros defined by the file */
+    arena mem;                   /* Macro nodes and lines */
+    int ok;                      /* 0 if the file could not be read or parsed */
+    struct include_file *next;
+} include_file;
+
+/* Include files parsed so far in this run */
+static include_file *include_cache = NULL;
+
+/*
+ * Include dependency: a source file pulled in another file, directly or
+ * through another include, the last time it was expanded.
+ */
+typedef struct include_use {
+    char *source;                /* Source file being expanded */
+    char *path;                  /* File it included */
+    struct include_use *next;
+} include_use;
+
+/* Include dependencies of every source expanded in this run */
+static include_use *include_uses = NULL;
+
+/*
+ * Macro expansion state of one source file:
+ * - Output position, the include files already pulled in (include guard
+ *   and macro lookup) and the include chain being expanded (cycles).
+ */
+typedef struct expander {
+    out_buffer *out;                          /* .am contents */
+    int out_line;                             /* Lines written to the .am file so far */
+    macro_call *last_call;                    /* Tail of macro_calls */
+    node *shared;                             /* Library macros (may be NULL) */
+    include_file **included;                  /* Files already included, in order */
+    int included_count;
+    int included_capacity;
+    include_file *chain[MAX_INCLUDE_DEPTH];   /* Includes currently being expanded */
+    const char *source;                       /* Source file being expanded */
+    int depth;
+    int errors;                               /* Include errors */
+} expander;
+
+/*
+ * Checks if a line is a `.include "file"` directive.
+ * Stores the quoted file name in name (empty if it is malformed).
+ * Returns 1 for an include directive, 0 for any other line.
+ */
+static int is_include_directive(const char *line, char *name) {
+    const char *p = line;
+    const char *end;
+    int len;
+
+    name[0] = '\0';
+    while (*p == ' ' || *p == '\t') p++;
+    if (strncmp(p, ".include", 8) != 0 || (p[8] && !isspace((unsigned char)p[8])))
+        return 0;
+
+    p += 8;
+    while (*p == ' ' || *p == '\t') p++;
+    if (*p != '"') return 1;
+    end = strchr(++p, '"');
+    if (!end) return 1;
+    len = (int)(end - p);
+    if (len >= FILENAME_MAX) return 1;
+    strncpy(name, p, len);
+    name[len] = '\0';
+    return 1;
+}
+
+/*
+ * Resolves an include name relative to the directory of the file that
+ * contains the directive. The result is dynamically allocated.
+ */
+static char *resolve_include_path(const char *base, const char *name) {
+    const char *slash = strrchr(base, '/');
+    int dir_len = (name[0] == '/' || !slash) ? 0 : (int)(slash - base) + 1;
+    char *path = malloc(dir_len + strlen(name) + 1);
+
+    if (!path) return NULL;
+    strncpy(path, base, dir_len);
+    strcpy(path + dir_len, name);
+    return path;
+}
+
+/*
+ * Returns the cached parse of an include file, mapping and scanning the
+ * file the first time it is requested in this run.
+ * Returns NULL only on allocation failure.
+ */
+static include_file *load_include(const char *path) {
+    include_file *inc;
+    line_reader in;
+    macro_reader reader;
+    char line[MAX_LINE_LENGTH];
+    int capacity = 0;
+
+    for (inc = include_cache; inc; inc = inc->next) {
+        if (strcmp(inc->path, path) == 0)
+            return inc;
+    }
+
+    inc = malloc(sizeof(include_file));
+    if (!inc) return NULL;
+    memset(inc, 0, sizeof(include_file));
+    inc->path = malloc(strlen(path) + 1);
+    if (!inc->path) {
+        free(inc);
+        return NULL;
+    }
+    strcpy(inc->path, path);
+    inc->next = include_cache;
+    include_cache = inc;
+
+    if (!source_load(&inc->src, path))
+        return inc;
+
+    if (!reader_init(&in, &inc->src))
+        return inc;
+    reader.list = &inc->macros;
+    reader.names = &batch_names;
+    reader.mem = &inc->mem;
+    reader.current = NULL;
+    reader.in_macro = 0;
+    reader.skip_macro = 0;
+
+    inc->ok = 1;
+    while (read_source_line(&in, line)) {
+        if (handle_macro_definition(&reader, line, in.info, in.line_num))
+            continue;
+
+        if (inc->line_count == capacity) {
+            int *lines;
+            capacity = capacity ? capacity * 2 : 64;
+            lines = realloc(inc->lines, capacity * sizeof(int));
+            if (!lines) {
+                inc->ok = 0;
+                break;
+            }
+            inc->lines = lines;
+        }
+        inc->lines[inc->line_count++] = (int)(in.info - in.index.lines);
+    }
+    inc->index = in.index;
+    if (in.errors || reader.in_macro)
+        inc->ok = 0;
+    return inc;
+}
+
+/*
+ * Frees every cached include file with its macros; the next include of
+ * a file reads it again.
+ */
+void forget_includes(void) {
+    include_file *next;
+    while (include_cache) {
+        next = include_cache->next;
+        source_free(&include_cache->src);
+        free_line_index(&include_cache->index);
+        free(include_cache->lines);
+        free_macro_list(include_cache->macros);
+        arena_free(&include_cache->mem);
+        free(include_cache->path);
+        free(include_cache);
+        include_cache = next;
+    }
+}
+
+/* Frees the include dependencies recorded for source. */
+static void forget_include_uses(const char *source) {
+    include_use **link = &include_uses;
+    while (*link) {
+        include_use *use = *link;
+        if (strcmp(use->source, source) == 0) {
+            *link = use->next;
+            free(use->source);
+            free(use->path);
+            free(use);
+        } else {
+            link = &use->next;
+        }
+    }
+}
+
+/* Records that source includes path (allocation failures are ignored). */
+static void add_include_use(const char *source, const char *path) {
+    include_use *use = malloc(sizeof(include_use));
+
+    if (!use) return;
+    use->source = malloc(strlen(source) + 1);
+    use->path = malloc(strlen(path) + 1);
+    if (!use->source || !use->path) {
+        free(use->source);
+        free(use->path);
+        free(use);
+        return;
+    }
+    strcpy(use->source, source);
+    strcpy(use->path, path);
+    use->next = include_uses;
+    include_uses = use;
+}
+
+/*
+ * include_user
+ * Walks the dependency list, counting the sources that included path.
+ */
+const char *include_user(const char *path, int n) {
+    include_use *use;
+    for (use = include_uses; use; use = use->next) {
+        if (strcmp(use->path, path) == 0 && n-- == 0)
+            return use->source;
+    }
+    return NULL;
+}
+
+void free_include_cache(void) {
+    include_use *next;
+    forget_includes();
+    while (include_uses) {
+        next = include_uses->next;
+        free(include_uses->source);
+        free(include_uses->path);
+        free(include_uses);
+        include_uses = next;
+    }
+}
+
+/*
+ * Looks a macro up in the file's own macros, then in the included files
+ * (latest first) and finally in the library. The name is only looked up
+ * in the pools, never added: a name that is not interned cannot belong
+ * to any macro.
+ */
+static node *lookup_macro(const expander *ex, const char *name) {
+    int length = (int)strlen(name);
+    int id;
+    node *macro = NULL;
+    int i;
+
+    if (length == 0) return NULL;
+    id = find_name(&file_names, name, length);
+    if (id != NO_NAME)
+        macro = find_macro(file_macros, id);
+    if (macro) return macro;
+
+    id = find_name(&batch_names, name, length);
+    if (id == NO_NAME) return NULL;
+    for (i = ex->included_count - 1; !macro && i >= 0; i--)
+        macro = find_macro(ex->included[i]->macros, id);
+    if (!macro)
+        macro = find_macro(ex->shared, id);
+    return macro;
+}
+
+static void expand_line(expander *ex, const char *line, const line_info *info,
+                        const char *base, int line_num);
+
+/*
+ * Pulls an included file into the output: its macros become visible and
+ * its lines are expanded in place. A file that was already included is
+ * skipped (include guard); including a file from itself is an error.
+ */
+static void expand_include(expander *ex, const char *name, const char *base, int line_num) {
+    char line[MAX_LINE_LENGTH];
+    include_file *inc;
+    char *path;
+    int i;
+
+    if (name[0] == '\0') {
+        report_error("Expected a quoted file name after '.include'.", line_num);
+        ex->errors++;
+        return;
+    }
+
+    path = resolve_include_path(base, name);
+    inc = path ? load_include(path) : NULL;
+    free(path);
+    if (!inc || !inc->ok) {
+        report_errorf(line_num, "Cannot include file '%s'.", name);
+        ex->errors++;
+        return;
+    }
+
+    for (i = 0; i < ex->depth; i++) {
+        if (ex->chain[i] == inc) {
+            report_errorf(line_num, "Include cycle: '%s' is already being included.", name);
+            ex->errors++;
+            return;
+        }
+    }
+    for (i = 0; i < ex->included_count; i++) {
+        if (ex->included[i] == inc)
+            return;
+    }
+    if (ex->depth >= MAX_INCLUDE_DEPTH) {
+        report_errorf(line_num, "Includes nested too deeply (max = %d).", MAX_INCLUDE_DEPTH);
+        ex->errors++;
+        return;
+    }
+
+    if (ex->included_count == ex->included_capacity) {
+        include_file **list;
+        int capacity = ex->included_capacity ? ex->included_capacity * 2 : 8;
+        list = realloc(ex->included, capacity * sizeof(include_file *));
+        if (!list) {
+            ex->errors++;
+            return;
+        }
+        ex->included = list;
+        ex->included_capacity = capacity;
+    }
+    ex->included[ex->included_count++] = inc;
+    add_include_use(ex->source, inc->path);
+
+    ex->chain[ex->depth++] = inc;
+    for (i = 0; i < inc->line_count; i++) {
+        const line_info *info = &inc->index.lines[inc->lines[i]];
+        int len = info->length + info->has_newline;
+        memcpy(line, inc->src.text + info->offset, len);
+        line[len] = '\0';
+        expand_line(ex, line, info, inc->path, line_num);
+    }
+    ex->depth--;
+}
+
+/*
+ * Writes one ordinary (non-definition) line to the output: include
+ * directives and macro calls are expanded, anything else is copied.
+ * info is the line's scan info, base the file the line comes from and
+ * line_num the line of the source file being assembled (for errors).
+ */
+static void expand_line(expander *ex, const char *line, const line_info *info,
+                        const char *base, int line_num) {
+    char name[FILENAME_MAX];
+    char opcode[32];
+    node *macro;
+    int i;
+
+    if (is_include_directive(line, name)) {
+        expand_include(ex, name, base, line_num);
+        return;
+    }
+
+    get_opcode_from_line(line, info, opcode);
+    macro = lookup_macro(ex, opcode);
+    if (macro) {
+        /* If it's a macro call, write macro's lines to output */
+        if (macro->line_count > 0)
+            add_macro_call(&file_arena, &macro_calls, &ex->last_call, ex->out_line + 1, macro);
+        for (i = 0; i < macro->line_count; i++)
+            out_append(ex->out, macro->lines[i], (long)strlen(macro->lines[i]));
+        ex->out_line += macro->line_count;
+    } else if (opcode[0] != '\0') {
+        /* Not a macro: copy line as-is to output */
+        out_append(ex->out, line, (long)strlen(line));
+        ex->out_line++;
+    }
+}
+
+/*
+ * Processes a file to expand macros.
+ * For each macro definition, stores its lines in a linked list.
+ * When a macro call is found, replaces it with its body; the file's own
+ * macros take precedence over included and shared (library) ones.
+ * Lines in regions disabled by .ifdef/.ifndef/.else/.endif are dropped
+ * and .include directives are replaced by the included file.
+ * Writes output to a .am file (kept in memory only for standard input)
+ * and records every call in macro_calls.
+ * In stream mode the source is read in blocks and the .am file is written
+ * as it grows, so neither is ever held whole.
+ * Returns 1 on success, 0 on failure.
+ */
+int mcro_exec(char *filename, node *shared_macros) {
+    source_text src;     /* Input (original) file */
+    line_index index;    /* Its lines */
+    source_stream stream;    /* Input read in blocks (stream mode) */
+    out_stream am_stream;    /* .am file written as it grows (stream mode) */
+    line_reader in;      /* Line reader over the input */
+    char *out_filename;  /* Output (.am) filename */
+    char line[MAX_LINE_LENGTH];
+    macro_reader reader;
+    expander ex;
+
+    free_file_macros();
+    forget_include_uses(filename);
+
+    if (stream_mode) {
+        if (!stream_open(&stream, filename)) return 0;
+        src.text = NULL;
+        src.length = 0;
+        src.mapped = 0;
+        index.lines = NULL;
+        index.count = 0;
+    } else if (!io_load_lines(&src, &index, filename)) {
+        return 0;
+    }
+
+    /* Create new .am output filename and file */
+    out_filename = add_new_file(&file_arena, filename, ".am");
+    if (!out_filename || (stream_mode && !out_stream_open(&am_stream, out_filename))) {
+        if (stream_mode) stream_close(&stream);
+        free_line_index(&index);
+        source_free(&src);
+        return 0;
+    }
+
+    out_reset(&am_output);
+    ex.out = &am_output;
+    ex.out_line = 0;
+    ex.last_call = NULL;
+    ex.shared = shared_macros;
+    ex.included = NULL;
+    ex.included_count = 0;
+    ex.included_capacity = 0;
+    ex.depth = 0;
+    ex.source = filename;
+    ex.errors = 0;
+    reader_start(&in, &src, &index);
+    if (stream_mode) in.stream = &stream;
+
+    reader.list = &file_macros;
+    reader.names = &file_names;
+    reader.mem = &file_arena;
+    reader.current = NULL;
+    reader.in_macro = 0;
+    reader.skip_macro = 0;
+
+    /* Main loop: process each line, until the error limit is reached */
+    while (!error_limit_reached() && read_source_line(&in, line)) {
+
+        if (handle_macro_definition(&reader, line, in.info, in.line_num))
+            continue;
+
+        /* Not a macro definition: expand includes and macro calls */
+        expand_line(&ex, line, in.info, filename, in.line_num);
+        if (stream_mode && am_output.length >= STREAM_BLOCK)
+            out_stream_drain(&am_stream, &am_output);
+    }
+
+    /* Cleanup: macros and the .am text are kept for the passes */
+    free_line_index(&in.index);
+    source_free(&src);
+    free(ex.included);
+    if (stream_mode) {
+        int read_ok = !stream.failed;
+        stream_close(&stream);
+        if (!out_stream_close(&am_stream, out_filename, &am_output) || !read_ok)
+            return 0;
+    } else if (strcmp(filename, STDIN_NAME) != 0 && !commit_output(out_filename, &am_output, 0)) {
+        /* Standard input leaves no .am file behind */
+        return 0;
+    }
+    return in.errors == 0 && ex.errors == 0 && !error_limit_reached();
+}
@@ -0,0 +1,111 @@
+#ifndef MACROS_H
+#define MACROS_H
+
+#include "data_struct.h"
+#include "output.h"
+#include "scanner.h"
+
+/* Macros defined by the file being assembled */
+extern node *file_macros;
+
+/* Macro calls expanded into the current .am file, in line order */
+extern macro_call *macro_calls;
+
+/*
+ * Expanded text of the current file, as written to its .am file; the
+ * passes read it from here instead of loading the .am file again.
+ */
+extern out_buffer am_output;
+
+/*
+ * Loads a macro library file (a source made only of macro definitions
+ * and comments) into a macro list that can be shared by every file of
+ * a batch. The library is parsed once; the resulting list is read-only
+ * for the rest of the run and must be released with free_macro_list().
+ *
+ * Parameters:
+ *   filename - path of the library file
+ *   out      - receives the head of the loaded macro list
+ *
+ * Returns:
+ *   1 on success, 0 if the file cannot be read or contains errors.
+ */
+int load_macro_library(const char *filename, node **out);
+
+/*
+ * Expands the macros of a source file into am_output and writes it to
+ * the matching .am file (see commit_output()).
+ * Macros defined in the file itself are looked up first, then the ones
+ * in shared_macros (may be NULL), so a file can override library macros.
+ * Regions disabled by .ifdef/.ifndef/.else/.endif are skipped here and
+ * never reach the .am file. `.include "file"` directives are replaced by
+ * the included file, which is parsed only once per run (see
+ * free_include_cache()) and pulled in at most once per source file.
+ * The file's macros and the list of expanded calls are kept in
+ * file_macros and macro_calls until free_file_macros() is called.
+ * Returns 1 on success, 0 on failure.
+ */
+int mcro_exec(char *filename, node *shared_macros);
+
+/*
+ * Releases file_macros and macro_calls.
+ */
+void free_file_macros(void);
+
+/*
+ * Frees the include files cached during the run, including their macros,
+ * and the record of which source included which file.
+ */
+void free_include_cache(void);
+
+/*
+ * Drops every cached include file, so the next include of a file reads
+ * it again (the --watch mode calls it after files change on disk).
+ * The record of which source included which file is kept.
+ */
+void forget_includes(void);
+
+/*
+ * Returns the n-th (from 0) source file that included path, directly or
+ * through another include, when it was last expanded; NULL past the last
+ * one. The text stays valid until that source is expanded again.
+ */
+const char *include_user(const char *path, int n);
+
+/*
+ * Checks if a line starts a macro definition ("mcro NAME", after an
+ * optional label); info is the line's scan info. Stores the name in
+ * macro_name and returns 1 if so, 0 otherwise.
+ */
+int is_macro_start(const char *line, const line_info *info, char *macro_name);
+
+/*
+ * Returns 1 if the line ends a macro definition ("endmcro"), 0 otherwise.
+ */
+int is_macro_end(const char *line);
+
+/*
+ * Stores the first word of a line after an optional label (a macro call
+ * candidate) in opcode, which holds up to MAX_LABEL_LENGTH characters.
+ */
+void get_opcode_from_line(const char *line, const line_info *info, char *opcode);
+
+/*
+ * Returns the macro of the list with the given name id (an id of the
+ * list's name pool), or NULL if there is none.
+ */
+node *find_macro(node *head, int name);
+
+/*
+ * Defines a name for conditional assembly (the -D NAME option), making
+ * ".ifdef NAME" blocks enabled and ".ifndef NAME" blocks disabled.
+ * Returns 1 on success, 0 on allocation failure.
+ */
+int define_name(const char *name);
+
+/*
+ * Frees every name defined with define_name().
+ */
+void free_defined_names(void);
+
+#endif /* MACROS_H */
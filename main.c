@@ -1,87 +1,467 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include "globals.h"
-#include "table.h"   /* For label_entry and symbol_table */
-#include "util.h"    /* For add_new_file */
-
-/* Forward declarations */
-int mcro_exec(char *filename);              /* Macro expansion stage */
-int first_pass(FILE *fp);                   /* First pass of assembler */
-void second_pass(const char *filename);     /* Second pass (generate .ob, .ent, .ext) */
-void free_symbol_table(label_entry *head);  /* Free memory used by the symbol table */
-
-/* Global variable shared with second pass */
-FILE *am_file = NULL;
-
-/* Cleanup any global state between files */
-void cleanup_all(void) {
-    free_symbol_table(symbol_table);
-}
-
-/* Main assembler function */
-int main(int argc, char *argv[]) {
-    int i;
-
-    if (argc < 2) {
-        printf("Usage: %s <source_file1> [source_file2 ...]\n", argv[0]);
-        return 1;
-    }
-
-    for (i = 1; i < argc; i++) {
-        char *src_filename;
-        char *am_filename;
-
-        src_filename = argv[i];
-        am_filename = NULL;
-
-        printf("----- Assembling: %s -----\n", src_filename);
-
-        /* Step 1: Macro processing */
-        if (!mcro_exec(src_filename)) {
-            printf("❌ Macro expansion failed for %s\n", src_filename);
-            continue;
-        } else {
-            printf("✅ Macro expansion OK for %s\n", src_filename);
-        }
-
-        /* Step 2: Get .am filename */
-        am_filename = add_new_file(src_filename, ".am");
-        if (!am_filename) {
-            printf("❌ Failed to generate .am filename for %s\n", src_filename);
-            continue;
-        }
-
-        am_file = fopen(am_filename, "r");
-        if (!am_file) {
-            printf("❌ Failed to open .am file %s\n", am_filename);
-            free(am_filename);
-            continue;
-        }
-
-        /* Step 3: First pass */
-        if (first_pass(am_file) != 0) {
-            printf("❌ First pass failed for %s\n", src_filename);
-            fclose(am_file);
-            free(am_filename);
-            cleanup_all();
-            continue;
-        }
-
-        printf("DEBUG after first_pass: data_counter = %d\n", data_counter);
-
-        rewind(am_file); /* For second pass reread */
-
-        /* Step 4: Second pass */
-        second_pass(src_filename);
-
-        /* Cleanup after file */
-        fclose(am_file);
-        free(am_filename);
-        cleanup_all();
-
-        printf("----- Done: %s -----\n", src_filename);
-    }
-
-    return 0;
-}
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "globals.h"
+#include "table.h"   /* For label_entry and symbol_table */
+#include "util.h"    /* For add_new_file and print_status */
+#include "macros.h"  /* For mcro_exec and the shared macro library */
+#include "source.h"  /* For the expanded source text */
+#include "scanner.h" /* For the .am line index */
+#include "names.h"   /* For the interned name pools */
+#include "arena.h"   /* For the per-file and per-run arenas */
+#include "errors.h"  /* For the buffered diagnostics */
+#include "output.h"  /* For the write-if-changed and bundle modes */
+#include "bundle.h"  /* For the --bundle archive */
+#include "async_io.h" /* For read-ahead and background writes */
+#include "parallel.h" /* For set_parallel_jobs */
+#include "watch.h"    /* For the --watch mode */
+#include "lsp.h"      /* For the --lsp language server */
+#include "second_pass.h" /* For the second pass and its outputs */
+
+/* Forward declarations */
+int first_pass(const source_text *am, const line_index *lines);   /* First pass of assembler */
+int first_pass_stream(const char *am_path);                        /* First pass reading the .am file in blocks */
+
+/*
+ * Cleanup any global state between files: the file's symbols, macros,
+ * names and file names all live in file_arena, which is reset in one go.
+ * Errors the file still has buffered are written out first, and its
+ * queued output writes are submitted.
+ */
+void cleanup_all(void) {
+    flush_errors();
+    io_submit();
+    symbol_table = NULL;
+    free_file_macros();
+    reset_name_pool(&file_names);
+    arena_reset(&file_arena);
+}
+
+/* Prints the command line usage */
+static void print_usage(const char *prog) {
+    printf("Usage: %s [--macro-lib <library_file>] [-D <name> ...] [--max-errors <count>] [--write-if-changed] [--bundle <archive>] [--async-io[=threads]] [--io-threads[=<read>,<write>]] [--jobs <count>] [--stream] [--watch <dir>] [--lsp] [--binary] <source_file1> [source_file2 ...] (- reads standard input)\n", prog);
+}
+
+/*
+ * Parses the count of --max-errors or --jobs (a positive decimal number
+ * up to max).
+ * Returns the count, or 0 if the text is not a valid count.
+ */
+static int parse_count(const char *text, long max) {
+    char *end;
+    long count = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || count <= 0 || count > max) return 0;
+    return (int)count;
+}
+
+/*
+ * Parses the thread counts of --io-threads=<read>,<write> (each from 1 to
+ * IO_MAX_STAGE_THREADS).
+ * Returns 1 if both are valid, 0 otherwise.
+ */
+static int parse_stage_threads(const char *text, int *read_threads, int *write_threads) {
+    char *end;
+    long read_count = strtol(text, &end, 10), write_count;
+    if (end == text || *end != ',') return 0;
+    text = end + 1;
+    write_count = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || read_count <= 0 || write_count <= 0 ||
+        read_count > IO_MAX_STAGE_THREADS || write_count > IO_MAX_STAGE_THREADS)
+        return 0;
+    *read_threads = (int)read_count;
+    *write_threads = (int)write_count;
+    return 1;
+}
+
+/*
+ * Assembles one source file: macro expansion, then both passes, then the
+ * outputs. Clears the file's state (cleanup_all()) before returning.
+ * Returns 1 if the file assembled and its outputs were produced, 0 if it
+ * failed at any step.
+ */
+static int assemble_file(char *src_filename, node *library_macros) {
+    source_text am_text;    /* Expanded source, shared by both passes */
+    line_index am_lines;    /* Its line index */
+    const char *am_filename = NULL;   /* The .am file the passes read (stream mode) */
+    int status, ok;
+
+    print_status("----- Assembling: %s -----\n", src_filename);
+
+    /* Step 1: Macro processing */
+    set_error_stage(STAGE_MACROS);
+    if (!mcro_exec(src_filename, library_macros)) {
+        flush_errors();
+        print_status("❌ Macro expansion failed for %s\n", src_filename);
+        discard_outputs(src_filename);
+        cleanup_all();
+        return 0;
+    } else {
+        print_status("✅ Macro expansion OK for %s\n", src_filename);
+    }
+
+    /*
+     * Step 2: Scan the expanded text (kept in memory) once for both
+     * passes; in stream mode each pass reads the .am file back instead
+     */
+    am_lines.lines = NULL;
+    am_lines.count = 0;
+    if (stream_mode) {
+        am_filename = add_new_file(&file_arena, src_filename, ".am");
+        if (!am_filename) {
+            print_status("❌ Failed to read the expanded source of %s\n", src_filename);
+            discard_outputs(src_filename);
+            cleanup_all();
+            return 0;
+        }
+    } else {
+        am_text.text = out_text(&am_output);
+        am_text.length = am_output.length;
+        am_text.mapped = 0;
+        if (!am_text.text || !scan_lines(am_text.text, am_text.length, &am_lines)) {
+            print_status("❌ Failed to scan the expanded source of %s\n", src_filename);
+            discard_outputs(src_filename);
+            cleanup_all();
+            return 0;
+        }
+    }
+
+    /* Step 3: First pass */
+    set_error_stage(STAGE_FIRST_PASS);
+    status = stream_mode ? first_pass_stream(am_filename) : first_pass(&am_text, &am_lines);
+    if (status != 0) {
+        flush_errors();
+        if (status < 0)
+            print_status("❌ Failed to read the expanded source of %s\n", src_filename);
+        else
+            print_status("❌ First pass failed for %s\n", src_filename);
+        free_line_index(&am_lines);
+        discard_outputs(src_filename);
+        cleanup_all();
+        return 0;
+    }
+
+    /* Step 4: Second pass */
+    set_error_stage(STAGE_SECOND_PASS);
+    if (stream_mode) {
+        if (second_pass_stream(src_filename, am_filename) < 0) {
+            flush_errors();
+            print_status("❌ Failed to read the expanded source of %s\n", src_filename);
+            discard_outputs(src_filename);
+            cleanup_all();
+            return 0;
+        }
+    } else {
+        second_pass(src_filename, &am_text, &am_lines);
+    }
+    ok = !error_flag;
+    flush_errors();
+
+    /* Cleanup after file */
+    free_line_index(&am_lines);
+    cleanup_all();
+
+    print_status("----- Done: %s -----\n", src_filename);
+    return ok;
+}
+
+/*
+ * Adds a source to assemble in this burst (a copy of path), unless it is
+ * already listed. Returns 0 on allocation failure.
+ */
+static int add_watch_target(watch_change **targets, int *count, int *capacity,
+                            const char *path, double changed_at) {
+    char *copy;
+    int i;
+
+    for (i = 0; i < *count; i++)
+        if (strcmp((*targets)[i].path, path) == 0) return 1;
+    if (*count == *capacity) {
+        int new_capacity = *capacity ? *capacity * 2 : 16;
+        watch_change *list = realloc(*targets, new_capacity * sizeof(watch_change));
+        if (!list) return 0;
+        *targets = list;
+        *capacity = new_capacity;
+    }
+    copy = malloc(strlen(path) + 1);
+    if (!copy) return 0;
+    strcpy(copy, path);
+    (*targets)[*count].path = copy;
+    (*targets)[*count].changed_at = changed_at;
+    (*targets)[*count].source = 1;
+    (*count)++;
+    return 1;
+}
+
+/*
+ * Watch mode: assembles the .as files of the tree under dir, then again
+ * every file that changes, once per burst of saves (see watch.h). The
+ * process, its macro library and its arenas stay warm between changes.
+ * Any change drops the include cache, and the sources that included a
+ * changed file (directly or not) are assembled again with the new text.
+ * Each change reports its latency: the assembly time and the time since
+ * the save. Runs until it is interrupted, or until watching fails.
+ */
+static void watch_sources(const char *dir, node *library_macros) {
+    const watch_change *changes;
+    watch_change *targets = NULL;   /* Sources to assemble in this burst */
+    int target_count = 0, target_capacity = 0;
+    int count, k, n;
+
+    if (!watch_start(dir)) {
+        print_status("❌ Cannot watch %s\n", dir);
+        return;
+    }
+    print_status("Watching %s for changed .as files\n", dir);
+    while ((count = watch_next(&changes)) > 0) {
+        /* Paths are copied: assembling a source replaces its include records */
+        for (k = 0; k < count; k++) {
+            const char *user;
+            if (changes[k].source)
+                add_watch_target(&targets, &target_count, &target_capacity,
+                                 changes[k].path, changes[k].changed_at);
+            for (n = 0; (user = include_user(changes[k].path, n)) != NULL; n++)
+                add_watch_target(&targets, &target_count, &target_capacity,
+                                 user, changes[k].changed_at);
+        }
+        forget_includes();
+
+        for (k = 0; k < target_count; k++) {
+            double started = watch_now();
+            assemble_file((char *)targets[k].path, library_macros);
+            if (io_flush() > 0)
+                print_status("❌ Some output files could not be written\n");
+            print_status("⏱ %s: assembled in %.1f ms, %.1f ms after the save\n", targets[k].path,
+                         watch_now() - started, watch_now() - targets[k].changed_at);
+            free((char *)targets[k].path);
+        }
+        target_count = 0;
+        fflush(stdout);
+    }
+    free(targets);
+    print_status("❌ Stopped watching %s\n", dir);
+    watch_stop();
+}
+
+/* Main assembler function */
+int main(int argc, char *argv[]) {
+    int i;
+    char **files;                 /* Source files named on the command line */
+    int file_count = 0;
+    const char *library_file = NULL;
+    int report_writes = 0;        /* --write-if-changed given */
+    const char *bundle_file = NULL;
+    bundle_writer bundle;         /* Archive of every output (--bundle) */
+    int async_io = 0;             /* 1: --async-io, 2: --async-io=threads or --io-threads */
+    int prefetched = 0;           /* Files handed to io_prefetch() so far */
+    int from_stdin = 0;           /* A source is read from standard input */
+    int stdin_failed = 0;         /* ... and produced no output (exit status 1) */
+    const char *watch_dir = NULL; /* --watch directory */
+    int lsp_mode = 0;             /* --lsp given */
+    node *library_macros = NULL;  /* Macros shared by every file in the batch */
+
+    files = malloc(argc * sizeof(char *));
+    if (!files) return 1;
+
+    /* Parse options; everything else is a source file */
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--macro-lib") == 0 || strcmp(argv[i], "-D") == 0 ||
+            strcmp(argv[i], "--bundle") == 0 || strcmp(argv[i], "--watch") == 0) {
+            if (i + 1 >= argc) {
+                print_usage(argv[0]);
+                free(files);
+                free_defined_names();
+                return 1;
+            }
+            if (argv[i][1] == 'D')
+                define_name(argv[i + 1]);
+            else if (argv[i][2] == 'b')
+                bundle_file = argv[i + 1];
+            else if (argv[i][2] == 'w')
+                watch_dir = argv[i + 1];
+            else
+                library_file = argv[i + 1];
+            i++;
+        } else if (strcmp(argv[i], "--max-errors") == 0 || strcmp(argv[i], "--jobs") == 0) {
+            int jobs = argv[i][2] == 'j';
+            int count = i + 1 < argc ? parse_count(argv[i + 1], jobs ? MAX_JOBS : 1000000L) : 0;
+            if (count == 0) {
+                print_usage(argv[0]);
+                free(files);
+                free_defined_names();
+                return 1;
+            }
+            if (jobs)
+                set_parallel_jobs(count);
+            else
+                set_max_errors(count);
+            i++;
+        } else if (strcmp(argv[i], "--async-io") == 0) {
+            async_io = 1;
+        } else if (strcmp(argv[i], "--async-io=threads") == 0 || strcmp(argv[i], "--io-threads") == 0) {
+            async_io = 2;
+        } else if (strncmp(argv[i], "--io-threads=", 13) == 0) {
+            int read_threads, write_threads;
+            if (!parse_stage_threads(argv[i] + 13, &read_threads, &write_threads)) {
+                print_usage(argv[0]);
+                free(files);
+                free_defined_names();
+                return 1;
+            }
+            io_set_stage_threads(read_threads, write_threads);
+            async_io = 2;
+        } else if (strcmp(argv[i], "--write-if-changed") == 0) {
+            set_skip_unchanged(1);
+            report_writes = 1;
+        } else if (strcmp(argv[i], "--stream") == 0) {
+            stream_mode = 1;
+        } else if (strcmp(argv[i], "--lsp") == 0) {
+            lsp_mode = 1;
+        } else if (strcmp(argv[i], "--binary") == 0) {
+            binary_object = 1;
+        } else if (strncmp(argv[i], "-D", 2) == 0) {
+            define_name(argv[i] + 2);
+        } else {
+            files[file_count++] = argv[i];
+        }
+    }
+
+    /* The language server owns standard input and output */
+    if (lsp_mode && (file_count > 0 || watch_dir || bundle_file)) {
+        print_status("--lsp cannot be combined with source files, --watch or --bundle\n");
+        free(files);
+        free_defined_names();
+        return 1;
+    }
+    if (lsp_mode) set_status_stream(stderr);
+
+    if (file_count == 0 && !watch_dir && !lsp_mode) {
+        print_usage(argv[0]);
+        free(files);
+        free_defined_names();
+        return 1;
+    }
+
+    /*
+     * Standard output carries the assembled code of "-", so the progress
+     * messages move to stderr; the passes of --stream read the .am back
+     * from disk, which "-" never writes
+     */
+    for (i = 0; i < file_count; i++)
+        if (strcmp(files[i], STDIN_NAME) == 0) from_stdin = 1;
+    if (from_stdin) {
+        set_status_stream(stderr);
+        if (stream_mode || watch_dir) {
+            print_status("--stream and --watch cannot be used with a source read from standard input\n");
+            free(files);
+            free_defined_names();
+            return 1;
+        }
+    }
+
+    /* Both need each output whole in memory, which --stream avoids */
+    if (stream_mode && (bundle_file || report_writes)) {
+        print_status("--stream cannot be combined with --bundle or --write-if-changed\n");
+        free(files);
+        free_defined_names();
+        return 1;
+    }
+
+    /* A bundle is only complete once the run ends, which --watch never does */
+    if (watch_dir && bundle_file) {
+        print_status("--watch cannot be combined with --bundle\n");
+        free(files);
+        free_defined_names();
+        return 1;
+    }
+
+    /* The library is loaded after every -D so its conditionals see them */
+    set_error_stage(STAGE_MACROS);
+    if (library_file && !load_macro_library(library_file, &library_macros)) {
+        flush_errors();
+        print_status("❌ Failed to load macro library %s\n", library_file);
+        free(files);
+        free_defined_names();
+        free_name_pool(&batch_names);
+        arena_free(&batch_arena);
+        free_errors();
+        return 1;
+    }
+    flush_errors();
+
+    if (lsp_mode) {
+        int status = lsp_serve(library_macros);
+        free_macro_list(library_macros);
+        free(files);
+        free_defined_names();
+        free_name_pool(&file_names);
+        free_name_pool(&batch_names);
+        arena_free(&file_arena);
+        arena_free(&batch_arena);
+        free_errors();
+        return status;
+    }
+
+    if (bundle_file) {
+        if (!bundle_create(&bundle, bundle_file)) {
+            print_status("❌ Failed to create bundle %s\n", bundle_file);
+            free_macro_list(library_macros);
+            free(files);
+            free_defined_names();
+            free_name_pool(&batch_names);
+            arena_free(&batch_arena);
+            free_errors();
+            return 1;
+        }
+        set_output_bundle(&bundle);
+    }
+
+    if (async_io && io_start(async_io == 1) == IO_BACKEND_NONE)
+        print_status("Asynchronous I/O is not available, using blocking I/O\n");
+
+
+    for (i = 0; i < file_count; i++) {
+        /* Keep the next few sources reading while this one is assembled */
+        while (!stream_mode && io_backend() != IO_BACKEND_NONE && prefetched < file_count &&
+               prefetched <= i + IO_PREFETCH_AHEAD)
+            io_prefetch(files[prefetched++]);
+
+        if (!assemble_file(files[i], library_macros) && strcmp(files[i], STDIN_NAME) == 0)
+            stdin_failed = 1;
+    }
+    if (from_stdin && ferror(stdout)) stdin_failed = 1;
+
+    /* Watch mode only returns if watching fails */
+    if (watch_dir) {
+        watch_sources(watch_dir, library_macros);
+        stdin_failed = 1;
+    }
+
+    if (io_flush() > 0)
+        print_status("❌ Some output files could not be written\n");
+    io_stop();
+
+    if (bundle_file) {
+        set_output_bundle(NULL);
+        if (!bundle_close(&bundle))
+            print_status("❌ Failed to write bundle %s\n", bundle_file);
+    }
+
+    if (report_writes) {
+        int unchanged;
+        int written = outputs_written(&unchanged);
+        print_status("Outputs rewritten: %d, unchanged: %d\n", written, unchanged);
+    }
+
+    free_macro_list(library_macros);
+    free_include_cache();
+    free_defined_names();
+    free_name_pool(&file_names);
+    free_name_pool(&batch_names);
+    arena_free(&file_arena);
+    arena_free(&batch_arena);
+    free_errors();
+    free_second_pass_outputs();
+    out_free(&am_output);
+    free(files);
+    return stdin_failed ? 1 : 0;
+}
@@ -0,0 +1,119 @@
+/* names.c - Interned identifiers (labels and macro names) */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "names.h"
+
+typedef struct name_entry {
+    const char *text;
+    int length;
+    unsigned long hash;
+} name_entry;
+
+name_pool file_names = { NULL, 0, 0, NULL, 0, &file_arena };
+name_pool batch_names = { NULL, 0, 0, NULL, 0, &batch_arena };
+
+/* FNV-1a hash of a name */
+static unsigned long hash_name(const char *name, int length) {
+    unsigned long h = 2166136261UL;
+    int i;
+    for (i = 0; i < length; i++) {
+        h ^= (unsigned char)name[i];
+        h = (h * 16777619UL) & 0xFFFFFFFFUL;
+    }
+    return h;
+}
+
+static void out_of_memory(void) {
+    fprintf(stderr, "Memory allocation error while interning a name\n");
+    exit(1);
+}
+
+/* Slot of the table holding name, or the free slot where it belongs. */
+static int find_slot(const name_pool *pool, const char *name, int length, unsigned long hash) {
+    int mask = pool->table_size - 1;
+    int i = (int)(hash & mask);
+
+    while (pool->table[i]) {
+        const name_entry *e = &pool->entries[pool->table[i] - 1];
+        if (e->hash == hash && e->length == length && memcmp(e->text, name, length) == 0)
+            break;
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+/* Doubles the hash table (keeping it at most half full) and re-inserts every id. */
+static void grow_table(name_pool *pool) {
+    int size = pool->table_size ? pool->table_size * 2 : 64;
+    int id;
+
+    free(pool->table);
+    pool->table = calloc(size, sizeof(int));
+    if (!pool->table) out_of_memory();
+    pool->table_size = size;
+    for (id = 0; id < pool->count; id++) {
+        int i = (int)(pool->entries[id].hash & (size - 1));
+        while (pool->table[i]) i = (i + 1) & (size - 1);
+        pool->table[i] = id + 1;
+    }
+}
+
+/*
+ * intern_name
+ * Looks the name up in the hash table and adds it (text in the pool's
+ * arena, entry and table slot) when it is not there yet.
+ */
+int intern_name(name_pool *pool, const char *name, int length) {
+    unsigned long hash = hash_name(name, length);
+    name_entry *e;
+    int slot;
+
+    if ((pool->count + 1) * 2 > pool->table_size)
+        grow_table(pool);
+    slot = find_slot(pool, name, length, hash);
+    if (pool->table[slot])
+        return pool->table[slot] - 1;
+
+    if (pool->count == pool->capacity) {
+        int capacity = pool->capacity ? pool->capacity * 2 : 64;
+        name_entry *entries = realloc(pool->entries, capacity * sizeof(name_entry));
+        if (!entries) out_of_memory();
+        pool->entries = entries;
+        pool->capacity = capacity;
+    }
+    e = &pool->entries[pool->count];
+    e->text = arena_strndup(pool->mem, name, length);
+    if (!e->text) out_of_memory();
+    e->length = length;
+    e->hash = hash;
+    pool->table[slot] = ++pool->count;
+    return pool->count - 1;
+}
+
+int find_name(const name_pool *pool, const char *name, int length) {
+    int slot;
+    if (pool->count == 0) return NO_NAME;
+    slot = find_slot(pool, name, length, hash_name(name, length));
+    return pool->table[slot] - 1;
+}
+
+const char *name_text(const name_pool *pool, int id) {
+    return pool->entries[id].text;
+}
+
+/* Clears the table; the entries array is kept for reuse. */
+void reset_name_pool(name_pool *pool) {
+    if (pool->table)
+        memset(pool->table, 0, pool->table_size * sizeof(int));
+    pool->count = 0;
+}
+
+void free_name_pool(name_pool *pool) {
+    free(pool->entries);
+    free(pool->table);
+    pool->entries = NULL;
+    pool->table = NULL;
+    pool->count = pool->capacity = pool->table_size = 0;
+}
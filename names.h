@@ -0,0 +1,74 @@
+#ifndef NAMES_H
+#define NAMES_H
+
+/*
+ * Interned identifiers:
+ * - Every distinct name is stored once in a pool and referred to by a
+ *   small integer id, so two names of the same pool are equal exactly
+ *   when their ids are.
+ * - Ids are only meaningful within their pool. The names of the file
+ *   being assembled (labels, its own macros) live in file_names, which
+ *   is reset after every file; names that outlive a file (library and
+ *   included macros) live in batch_names.
+ */
+
+/* Id of no name (name not found) */
+#define NO_NAME (-1)
+
+#include "arena.h"
+
+struct name_entry;
+
+/*
+ * Pool of interned names:
+ * - entries: text and hash of each name, indexed by id.
+ * - table:   open addressing hash table of id + 1 (0 marks a free slot).
+ * - mem:     arena the texts are stored in; it must be reset together
+ *            with the pool (file_names lives in file_arena, batch_names
+ *            in batch_arena).
+ */
+typedef struct name_pool {
+    struct name_entry *entries;
+    int count;
+    int capacity;
+    int *table;
+    int table_size;                  /* Power of two (0 before first use) */
+    arena *mem;
+} name_pool;
+
+/* Names of the file being assembled */
+extern name_pool file_names;
+
+/* Names that stay valid for the whole run */
+extern name_pool batch_names;
+
+/*
+ * Returns the id of a name, adding it to the pool if it is new.
+ * name need not be NUL terminated; length characters of it are used.
+ * Exits the program if memory is exhausted (like add_symbol()).
+ */
+int intern_name(name_pool *pool, const char *name, int length);
+
+/*
+ * Returns the id of a name already in the pool, or NO_NAME.
+ */
+int find_name(const name_pool *pool, const char *name, int length);
+
+/*
+ * Returns the NUL terminated text of an interned name.
+ */
+const char *name_text(const name_pool *pool, int id);
+
+/*
+ * Forgets every name of the pool; its tables are kept for the next file.
+ * Ids handed out before the reset become invalid. The texts are released
+ * by resetting the pool's arena.
+ */
+void reset_name_pool(name_pool *pool);
+
+/*
+ * Releases the tables of the pool (the texts belong to its arena).
+ */
+void free_name_pool(name_pool *pool);
+
+#endif /* NAMES_H */
@@ -0,0 +1,90 @@
+/* numbers.c - Decimal literals of .data, .mat and immediate operands
+ *
+ * Up to four digits are converted at once (SWAR: "SIMD within a
+ * register"): the bytes are loaded into one unsigned long, checked for
+ * being digits with a couple of masks and combined pairwise with two
+ * multiplications instead of one multiply-add per digit.
+ */
+
+#include "globals.h"
+#include "numbers.h"
+
+/* Once the magnitude passes this it is out of range for good; it is
+ * clamped here so the remaining digits cannot overflow a long. */
+#define MAGNITUDE_CAP 100000L
+
+static const long power_of_ten[5] = { 1L, 10L, 100L, 1000L, 10000L };
+
+/*
+ * Looks at the four bytes at s and returns how many of them, from the
+ * first, are decimal digits. *chunk receives the value of those digits.
+ */
+static int digit_chunk(const unsigned char *s, long *chunk) {
+    unsigned long w, bad, t;
+    int n;
+
+    w = (unsigned long)s[0] | (unsigned long)s[1] << 8 |
+        (unsigned long)s[2] << 16 | (unsigned long)s[3] << 24;
+    w ^= 0x30303030UL;  /* Digits become 0..9 */
+
+    /* Bit 7 of each byte is set unless the byte is 0..9; no carries
+     * cross bytes because the high bit is masked off before the add. */
+    bad = (((w & 0x7F7F7F7FUL) + 0x76767676UL) | w) & 0x80808080UL;
+    if (!bad) n = 4;
+    else if (bad & 0x80UL) n = 0;
+    else if (bad & 0x8000UL) n = 1;
+    else if (bad & 0x800000UL) n = 2;
+    else n = 3;
+    if (n == 0) return 0;
+
+    /* Keep the n digits and right-align them: leading zero bytes pad the
+     * number to four digits, the first digit being the most significant. */
+    w &= 0xFFFFFFFFUL >> (8 * (4 - n));
+    w = (w << (8 * (4 - n))) & 0xFFFFFFFFUL;
+
+    /* Pairs: byte 0 = d0 * 10 + d1, byte 2 = d2 * 10 + d3 */
+    t = (w * 10 + (w >> 8)) & 0x00FF00FFUL;
+    *chunk = (long)(t & 0xFF) * 100 + (long)((t >> 16) & 0xFF);
+    return n;
+}
+
+/*
+ * parse_word_value
+ * Reads the sign, then the digits in chunks of four while at least four
+ * bytes remain, and the last few one at a time.
+ */
+int parse_word_value(const char *text, const char *end, const char **stop, int *value) {
+    const char *p = text;
+    const char *digits;
+    long magnitude = 0, chunk;
+    int neg = 0, n;
+
+    if (p < end && (*p == '+' || *p == '-')) {
+        neg = (*p == '-');
+        p++;
+    }
+    digits = p;
+
+    while (end - p >= 4) {
+        n = digit_chunk((const unsigned char *)p, &chunk);
+        if (n == 0) break;
+        magnitude = magnitude * power_of_ten[n] + chunk;
+        if (magnitude > MAGNITUDE_CAP) magnitude = MAGNITUDE_CAP;
+        p += n;
+        if (n < 4) break;
+    }
+    while (p < end && *p >= '0' && *p <= '9') {
+        magnitude = magnitude * 10 + (*p++ - '0');
+        if (magnitude > MAGNITUDE_CAP) magnitude = MAGNITUDE_CAP;
+    }
+
+    if (p == digits) {
+        *stop = text;
+        return NUM_MISSING;
+    }
+    *stop = p;
+    if (neg ? -magnitude < WORD_MIN_VALUE : magnitude > WORD_MAX_VALUE)
+        return NUM_RANGE;
+    *value = (int)(neg ? -magnitude : magnitude);
+    return NUM_OK;
+}
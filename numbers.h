@@ -0,0 +1,27 @@
+#ifndef NUMBERS_H
+#define NUMBERS_H
+
+/* Results of parse_word_value() */
+#define NUM_OK      0   /* A value that fits in a machine word */
+#define NUM_MISSING 1   /* No digits where a number was expected */
+#define NUM_RANGE   2   /* Digits were read but the value does not fit */
+
+/*
+ * Parses a decimal integer with an optional sign from text[0..end) and
+ * checks that it fits in a signed machine word (WORD_MIN_VALUE to
+ * WORD_MAX_VALUE). Leading blanks are not skipped.
+ * Digits are converted four at a time where the text allows it.
+ *
+ * Parameters:
+ *   text  - Start of the number
+ *   end   - End of the text; nothing at or after it is read
+ *   stop  - Receives the first character after the number (text itself
+ *           if there were no digits)
+ *   value - Receives the value when NUM_OK is returned
+ *
+ * Returns:
+ *   NUM_OK, NUM_MISSING or NUM_RANGE.
+ */
+int parse_word_value(const char *text, const char *end, const char **stop, int *value);
+
+#endif /* NUMBERS_H */
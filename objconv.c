@@ -0,0 +1,152 @@
+/* objconv.c - Converts between the .ob/.ent/.ext text outputs and .obj files */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "source.h"
+#include "output.h"
+#include "arena.h"
+#include "object.h"
+
+/* Prints the command line usage */
+static void print_usage(const char *prog) {
+    printf("Usage: %s [-t | -16] <source_file> [source_file ...]\n", prog);
+    printf("  Converts <source_file>.ob, .ent and .ext into <source_file>.obj\n");
+    printf("  -t   converts <source_file>.obj back into .ob, .ent and .ext\n");
+    printf("  -16  stores 16 bits per word instead of packed 10 bit words\n");
+}
+
+/* Joins a source name and an extension into a new string (NULL if memory ran out). */
+static char *output_name(const char *source, const char *extension) {
+    char *name = malloc(strlen(source) + strlen(extension) + 1);
+    if (name) {
+        strcpy(name, source);
+        strcat(name, extension);
+    }
+    return name;
+}
+
+/*
+ * Loads an optional output of the assembler: a file that does not exist
+ * reads as empty, like the .ent and .ext files the assembler skips.
+ * Returns 1 on success, 0 if the file exists but cannot be read.
+ */
+static int load_optional(source_text *src, const char *path) {
+    FILE *fp = fopen(path, "rb");
+
+    src->text = NULL;
+    src->length = 0;
+    src->mapped = 0;
+    if (!fp) return 1;
+    fclose(fp);
+    return source_load(src, path);
+}
+
+/* Frees a buffer from load_optional(). */
+static void free_optional(source_text *src) {
+    if (src->text) source_free(src);
+}
+
+/*
+ * Converts the text outputs of a source into its .obj file.
+ * Returns 1 on success, 0 on failure (after printing why).
+ */
+static int to_binary(const char *source, int word_bits) {
+    char *ob_name = output_name(source, ".ob"), *ent_name = output_name(source, ".ent");
+    char *ext_name = output_name(source, ".ext"), *obj_name = output_name(source, ".obj");
+    source_text ob, ent = {NULL, 0, 0}, ext = {NULL, 0, 0};
+    out_buffer out = {NULL, 0, 0, 0};
+    arena mem = {NULL, NULL};   /* The parsed text */
+    obj_image img;
+    int ok = 0;
+
+    if (!ob_name || !ent_name || !ext_name || !obj_name) {
+        fprintf(stderr, "Out of memory\n");
+    } else if (!source_load(&ob, ob_name)) {
+        fprintf(stderr, "Cannot read %s\n", ob_name);
+    } else {
+        if (!load_optional(&ent, ent_name) || !load_optional(&ext, ext_name)) {
+            fprintf(stderr, "Cannot read the .ent or .ext file of %s\n", source);
+        } else if (!obj_from_text(&img, &mem, ob.text, ob.length, ent.text, ent.length,
+                                  ext.text, ext.length)) {
+            fprintf(stderr, "%s is not in the assembler's output format\n", source);
+        } else {
+            img.word_bits = word_bits;
+            ok = obj_write(&out, &img) && commit_output(obj_name, &out, 1);
+            if (!ok) fprintf(stderr, "Error writing %s\n", obj_name);
+        }
+        free_optional(&ent);
+        free_optional(&ext);
+        source_free(&ob);
+    }
+
+    out_free(&out);
+    arena_free(&mem);
+    free(ob_name);
+    free(ent_name);
+    free(ext_name);
+    free(obj_name);
+    return ok;
+}
+
+/*
+ * Converts the .obj file of a source back into its text outputs. An
+ * empty .ent or .ext is not created, as the assembler does.
+ * Returns 1 on success, 0 on failure (after printing why).
+ */
+static int to_text(const char *source) {
+    char *ob_name = output_name(source, ".ob"), *ent_name = output_name(source, ".ent");
+    char *ext_name = output_name(source, ".ext"), *obj_name = output_name(source, ".obj");
+    out_buffer ob = {NULL, 0, 0, 0}, ent = {NULL, 0, 0, 0}, ext = {NULL, 0, 0, 0};
+    source_text obj;
+    obj_view view;
+    int ok = 0;
+
+    if (!ob_name || !ent_name || !ext_name || !obj_name) {
+        fprintf(stderr, "Out of memory\n");
+    } else if (!source_load(&obj, obj_name)) {
+        fprintf(stderr, "Cannot read %s\n", obj_name);
+    } else {
+        if (!obj_open(&view, obj.text, obj.length) || !obj_to_text(&view, &ob, &ent, &ext)) {
+            fprintf(stderr, "%s is not a valid object file\n", obj_name);
+        } else {
+            ok = commit_output(ob_name, &ob, 0);
+            if (ent.length == 0) discard_output(ent_name);
+            else if (!commit_output(ent_name, &ent, 0)) ok = 0;
+            if (ext.length == 0) discard_output(ext_name);
+            else if (!commit_output(ext_name, &ext, 0)) ok = 0;
+            if (!ok) fprintf(stderr, "Error writing the outputs of %s\n", source);
+        }
+        source_free(&obj);
+    }
+
+    out_free(&ob);
+    out_free(&ent);
+    out_free(&ext);
+    free(ob_name);
+    free(ent_name);
+    free(ext_name);
+    free(obj_name);
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    int text = 0, word_bits = 10, first = 1, failures = 0, i;
+
+    if (argc > 1 && strcmp(argv[1], "-t") == 0) {
+        text = 1;
+        first = 2;
+    } else if (argc > 1 && strcmp(argv[1], "-16") == 0) {
+        word_bits = 16;
+        first = 2;
+    }
+    if (first >= argc) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    for (i = first; i < argc; i++)
+        if (!(text ? to_text(argv[i]) : to_binary(argv[i], word_bits)))
+            failures++;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,316 @@
+/* object.c - Binary object files and their conversion to and from text */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "object.h"
+
+/* Digits of the .ob header fields and words (see write_object_file()) */
+#define CODE_LENGTH_DIGITS 3
+#define DATA_LENGTH_DIGITS 2
+#define WORD_DIGITS 5
+
+static void put_u16(unsigned char *p, unsigned long n) {
+    p[0] = (unsigned char)(n & 0xFF);
+    p[1] = (unsigned char)((n >> 8) & 0xFF);
+}
+
+static void put_u32(unsigned char *p, unsigned long n) {
+    put_u16(p, n & 0xFFFF);
+    put_u16(p + 2, (n >> 16) & 0xFFFF);
+}
+
+static unsigned long get_u16(const unsigned char *p) {
+    return (unsigned long)p[0] | ((unsigned long)p[1] << 8);
+}
+
+static unsigned long get_u32(const unsigned char *p) {
+    return get_u16(p) | (get_u16(p + 2) << 16);
+}
+
+/* Bytes the words of an object take, padding included */
+static long words_size(int word_bits, long count) {
+    long bytes = word_bits == 10 ? (count * 10 + 7) / 8 : count * 2;
+    return (bytes + 3) & ~3L;
+}
+
+/* Appends the records of a table; offset is where its first name goes in the string table. */
+static void write_records(out_buffer *out, const obj_symbol *list, long count, unsigned long *offset) {
+    unsigned char record[OBJ_RECORD_SIZE];
+    long i;
+
+    for (i = 0; i < count; i++) {
+        put_u32(record, *offset);
+        put_u32(record + 4, (unsigned long)list[i].address);
+        out_append(out, (const char *)record, OBJ_RECORD_SIZE);
+        *offset += strlen(list[i].name) + 1;
+    }
+}
+
+static void write_names(out_buffer *out, const obj_symbol *list, long count) {
+    long i;
+    for (i = 0; i < count; i++)
+        out_append(out, list[i].name, (long)strlen(list[i].name) + 1);
+}
+
+/*
+ * obj_write
+ * Packed words are shifted into an accumulator and written a byte at a
+ * time; the string table follows the records it is referenced by.
+ */
+int obj_write(out_buffer *out, const obj_image *img) {
+    unsigned char header[OBJ_HEADER_SIZE];
+    unsigned char bytes[2];
+    unsigned char record[OBJ_RECORD_SIZE];
+    unsigned long strings = 0, offset = 0, acc = 0;
+    long count = img->code_length + img->data_length, written = 0, i;
+    int bits = 0;
+
+    for (i = 0; i < img->entry_count; i++) strings += strlen(img->entries[i].name) + 1;
+    for (i = 0; i < img->extern_count; i++) strings += strlen(img->externs[i].name) + 1;
+
+    memcpy(header, OBJ_MAGIC, 8);
+    put_u16(header + 8, OBJ_VERSION);
+    put_u16(header + 10, (unsigned long)img->word_bits);
+    put_u32(header + 12, (unsigned long)img->code_length);
+    put_u32(header + 16, (unsigned long)img->data_length);
+    put_u32(header + 20, (unsigned long)img->entry_count);
+    put_u32(header + 24, (unsigned long)img->extern_count);
+    put_u32(header + 28, (unsigned long)img->relocation_count);
+    put_u32(header + 32, strings);
+    put_u32(header + 36, (unsigned long)img->flags);
+    out_append(out, (const char *)header, OBJ_HEADER_SIZE);
+
+    for (i = 0; i < count; i++) {
+        unsigned long word = (unsigned long)img->words[i] & 0x3FF;
+        if (img->word_bits == 16) {
+            put_u16(bytes, word);
+            out_append(out, (const char *)bytes, 2);
+            written += 2;
+            continue;
+        }
+        acc |= word << bits;
+        bits += 10;
+        while (bits >= 8) {
+            bytes[0] = (unsigned char)(acc & 0xFF);
+            out_append(out, (const char *)bytes, 1);
+            written++;
+            acc >>= 8;
+            bits -= 8;
+        }
+    }
+    if (bits > 0) {
+        bytes[0] = (unsigned char)acc;
+        out_append(out, (const char *)bytes, 1);
+        written++;
+    }
+    memset(header, 0, 4);
+    out_append(out, (const char *)header, words_size(img->word_bits, count) - written);
+
+    write_records(out, img->entries, img->entry_count, &offset);
+    write_records(out, img->externs, img->extern_count, &offset);
+    for (i = 0; i < img->relocation_count; i++) {
+        put_u32(record, (unsigned long)img->relocations[i].address);
+        put_u32(record + 4, (unsigned long)img->relocations[i].segment);
+        out_append(out, (const char *)record, OBJ_RECORD_SIZE);
+    }
+    write_names(out, img->entries, img->entry_count);
+    write_names(out, img->externs, img->extern_count);
+    return !out->failed;
+}
+
+/* Reads digits base-4 letters ('a' to 'd'); returns the value, or -1. */
+static long read_base4(const char *p, int digits) {
+    long n = 0;
+    int i;
+    for (i = 0; i < digits; i++) {
+        if (p[i] < 'a' || p[i] > 'd') return -1;
+        n = n * 4 + (p[i] - 'a');
+    }
+    return n;
+}
+
+/*
+ * obj_read_symbols
+ * A line must read back exactly as "%s %04ld\n" writes it, so the text
+ * can be reproduced from the records.
+ */
+int obj_read_symbols(const char *text, long length, arena *mem, obj_symbol **list, long *count) {
+    const char *p = text, *end = text + length;
+    long lines = 0, i;
+
+    for (i = 0; i < length; i++)
+        if (text[i] == '\n') lines++;
+    if (length > 0 && text[length - 1] != '\n') return 0;
+    *count = lines;
+    *list = arena_alloc(mem, (size_t)(lines ? lines : 1) * sizeof(obj_symbol));
+    if (!*list) return 0;
+
+    for (i = 0; i < lines; i++) {
+        const char *space = p, *digits;
+        long address = 0;
+
+        while (space < end && *space != ' ' && *space != '\n') space++;
+        if (space == p || space >= end || *space != ' ') return 0;
+        for (digits = space + 1; digits < end && *digits >= '0' && *digits <= '9'; digits++) {
+            if (address > 99999999L) return 0;
+            address = address * 10 + (*digits - '0');
+        }
+        /* At least 4 digits, and no leading zero beyond the padding */
+        if (*digits != '\n' || digits - space - 1 < 4 ||
+            (digits - space - 1 > 4 && space[1] == '0'))
+            return 0;
+        (*list)[i].name = arena_strndup(mem, p, (size_t)(space - p));
+        (*list)[i].address = address;
+        if (!(*list)[i].name) return 0;
+        p = digits + 1;
+    }
+    return 1;
+}
+
+/*
+ * obj_from_text
+ * The .ob header only keeps the low bits of the segment lengths (3 and
+ * 2 base-4 digits), so the lengths are worked out from the number of
+ * words: the smallest data length that matches both header fields.
+ */
+int obj_from_text(obj_image *img, arena *mem, const char *ob, long ob_length,
+                  const char *ent, long ent_length, const char *ext, long ext_length) {
+    const long code_mod = 1L << (2 * CODE_LENGTH_DIGITS);
+    const long data_mod = 1L << (2 * DATA_LENGTH_DIGITS);
+    const long header_length = CODE_LENGTH_DIGITS + 1 + DATA_LENGTH_DIGITS + 1;
+    long code_field, data_field, count, data, i;
+    int *words;
+
+    if (ob_length < header_length || ob[CODE_LENGTH_DIGITS] != ' ' || ob[header_length - 1] != '\n' ||
+        (ob_length - header_length) % (WORD_DIGITS + 1) != 0)
+        return 0;
+    code_field = read_base4(ob, CODE_LENGTH_DIGITS);
+    data_field = read_base4(ob + CODE_LENGTH_DIGITS + 1, DATA_LENGTH_DIGITS);
+    if (code_field < 0 || data_field < 0) return 0;
+    count = (ob_length - header_length) / (WORD_DIGITS + 1);
+
+    for (data = data_field; data <= count && (count - data) % code_mod != code_field; data += data_mod)
+        ;
+    if (data > count) return 0;
+
+    words = arena_alloc(mem, (size_t)(count ? count : 1) * sizeof(int));
+    if (!words) return 0;
+    for (i = 0; i < count; i++) {
+        const char *line = ob + header_length + i * (WORD_DIGITS + 1);
+        long word = read_base4(line, WORD_DIGITS);
+        if (word < 0 || line[WORD_DIGITS] != '\n') return 0;
+        words[i] = (int)word;
+    }
+
+    img->word_bits = 10;
+    img->code_length = count - data;
+    img->data_length = data;
+    img->words = words;
+    img->relocations = NULL;
+    img->relocation_count = 0;
+    img->flags = 0;
+    return obj_read_symbols(ent, ent_length, mem, &img->entries, &img->entry_count) &&
+           obj_read_symbols(ext, ext_length, mem, &img->externs, &img->extern_count);
+}
+
+int obj_open(obj_view *v, const void *data, long length) {
+    const unsigned char *p = data;
+    long count, size;
+
+    if (length < OBJ_HEADER_SIZE || memcmp(p, OBJ_MAGIC, 8) != 0 || get_u16(p + 8) != OBJ_VERSION)
+        return 0;
+    v->data = p;
+    v->word_bits = (int)get_u16(p + 10);
+    v->code_length = (long)get_u32(p + 12);
+    v->data_length = (long)get_u32(p + 16);
+    v->counts[OBJ_ENTRIES] = (long)get_u32(p + 20);
+    v->counts[OBJ_EXTERNS] = (long)get_u32(p + 24);
+    v->relocation_count = (long)get_u32(p + 28);
+    v->strings_length = (long)get_u32(p + 32);
+    v->flags = (int)get_u32(p + 36);
+    if (v->word_bits != 10 && v->word_bits != 16) return 0;
+
+    /* Each count is checked against the length first, so the sums cannot overflow */
+    if (v->code_length > length || v->data_length > length || v->counts[0] > length ||
+        v->counts[1] > length || v->relocation_count > length || v->strings_length > length)
+        return 0;
+    count = v->code_length + v->data_length;
+    size = OBJ_HEADER_SIZE + words_size(v->word_bits, count) +
+           (v->counts[0] + v->counts[1] + v->relocation_count) * OBJ_RECORD_SIZE + v->strings_length;
+    if (size != length) return 0;
+    if (v->strings_length > 0 && p[length - 1] != '\0') return 0;
+
+    v->words = p + OBJ_HEADER_SIZE;
+    v->records[OBJ_ENTRIES] = v->words + words_size(v->word_bits, count);
+    v->records[OBJ_EXTERNS] = v->records[OBJ_ENTRIES] + v->counts[0] * OBJ_RECORD_SIZE;
+    v->relocations = v->records[OBJ_EXTERNS] + v->counts[1] * OBJ_RECORD_SIZE;
+    v->strings = (const char *)(v->relocations + v->relocation_count * OBJ_RECORD_SIZE);
+    return 1;
+}
+
+/* A packed word spans two bytes: it starts at most 6 bits into the first. */
+int obj_word(const obj_view *v, long index) {
+    const unsigned char *p;
+    int shift;
+
+    if (v->word_bits == 16) return (int)get_u16(v->words + index * 2);
+    p = v->words + index * 10 / 8;
+    shift = (int)(index * 10 % 8);
+    return (int)((get_u16(p) >> shift) & 0x3FF);
+}
+
+int obj_symbol_at(const obj_view *v, int table, long index, obj_symbol *sym) {
+    const unsigned char *record;
+    unsigned long offset;
+
+    if (index < 0 || index >= v->counts[table]) return 0;
+    record = v->records[table] + index * OBJ_RECORD_SIZE;
+    offset = get_u32(record);
+    if (offset >= (unsigned long)v->strings_length) return 0;
+    sym->name = v->strings + offset;
+    sym->address = (long)get_u32(record + 4);
+    return 1;
+}
+
+int obj_relocation_at(const obj_view *v, long index, obj_relocation *rel) {
+    const unsigned char *record;
+    unsigned long segment;
+
+    if (index < 0 || index >= v->relocation_count) return 0;
+    record = v->relocations + index * OBJ_RECORD_SIZE;
+    segment = get_u32(record + 4);
+    if (segment != OBJ_SEGMENT_CODE && segment != OBJ_SEGMENT_DATA) return 0;
+    rel->address = (long)get_u32(record);
+    rel->segment = (int)segment;
+    return 1;
+}
+
+/* Appends the lines of a table in the .ent/.ext form. */
+static int symbols_to_text(const obj_view *v, int table, out_buffer *out) {
+    char line[32];
+    obj_symbol sym;
+    long i;
+
+    for (i = 0; i < v->counts[table]; i++) {
+        if (!obj_symbol_at(v, table, i, &sym)) return 0;
+        out_append(out, sym.name, (long)strlen(sym.name));
+        out_append(out, line, sprintf(line, " %04ld\n", sym.address));
+    }
+    return 1;
+}
+
+int obj_to_text(const obj_view *v, out_buffer *ob, out_buffer *ent, out_buffer *ext) {
+    long count = v->code_length + v->data_length, i;
+
+    out_base4(ob, (int)(v->code_length % (1L << (2 * CODE_LENGTH_DIGITS))), CODE_LENGTH_DIGITS);
+    out_append(ob, " ", 1);
+    out_base4(ob, (int)(v->data_length % (1L << (2 * DATA_LENGTH_DIGITS))), DATA_LENGTH_DIGITS);
+    out_append(ob, "\n", 1);
+    for (i = 0; i < count; i++) {
+        out_base4(ob, obj_word(v, i) & 0x3FF, WORD_DIGITS);
+        out_append(ob, "\n", 1);
+    }
+    if (!symbols_to_text(v, OBJ_ENTRIES, ent) || !symbols_to_text(v, OBJ_EXTERNS, ext)) return 0;
+    return !ob->failed && !ent->failed && !ext->failed;
+}
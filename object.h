@@ -0,0 +1,161 @@
+#ifndef OBJECT_H
+#define OBJECT_H
+
+#include "arena.h"
+#include "output.h"
+
+/*
+ * Binary object file (the --binary option, and the objconv and link tools):
+ * - Holds what the .ob, .ent and .ext files hold, without the text: the
+ *   segment lengths, the code and data words, and the entry and extern
+ *   tables. It is written next to the .ob as "<source>.obj".
+ * - Objects written by the assembler are relocatable: a relocation
+ *   record names every code word that holds the address of a label of
+ *   the module, and the segment the label is in. The code segment is
+ *   always assembled at OBJ_CODE_ADDRESS and the data segment right
+ *   after it, so such a word holds the segment's origin plus the
+ *   label's offset in it; a loader placing the segment at base B stores
+ *   B + (word - origin) instead. Words that refer to an extern label
+ *   hold 0 and are listed by the extern records.
+ * - Layout, all numbers little endian:
+ *     header (40 bytes): "MMN14OBJ", version (2 bytes), bits per word
+ *       (2 bytes, 10 or 16), code length, data length, entry count,
+ *       extern count, relocation count, string table length and flags
+ *       (4 bytes each);
+ *     the words, code then data: a packed stream of 10 bit words (word
+ *       i in bits 10i to 10i+9, lowest bits first) or 16 bits each,
+ *       padded to a multiple of 4 bytes;
+ *     the entry records, then the extern records (8 bytes each: offset
+ *       of the name in the string table, address);
+ *     the relocation records (8 bytes each: address of the word,
+ *       OBJ_SEGMENT_CODE or OBJ_SEGMENT_DATA);
+ *     the string table: the names, each followed by a NUL byte.
+ * - Word addresses (records and relocations) are the addresses of the
+ *   .ob: the code segment's words are at 100 and up.
+ * - Every part is at an offset the header determines, so a file can be
+ *   used in place (mapped by source_load()) after a constant time check
+ *   of the header: obj_open() does no parsing, and obj_word() and
+ *   obj_symbol() read single fields.
+ * - The conversion is lossless: obj_to_text() writes back the exact
+ *   .ob, .ent and .ext text obj_from_text() read. The text has no
+ *   relocations, so an object made from it is not relocatable.
+ */
+
+#define OBJ_MAGIC "MMN14OBJ"
+#define OBJ_VERSION 3
+#define OBJ_HEADER_SIZE 40
+#define OBJ_RECORD_SIZE 8
+
+/* Address of the first code word in the .ob (the assembler's IC_START) */
+#define OBJ_CODE_ADDRESS 100
+
+/* Origin of the data segment of an object: the address after its code */
+#define OBJ_DATA_ADDRESS(code_length) (OBJ_CODE_ADDRESS + (code_length))
+
+/* Header flags */
+#define OBJ_RELOCATABLE 1   /* Every address word has a relocation record */
+
+/* Segments a relocated word refers to */
+#define OBJ_SEGMENT_CODE 0
+#define OBJ_SEGMENT_DATA 1
+
+/* Tables of symbol records */
+#define OBJ_ENTRIES 0
+#define OBJ_EXTERNS 1
+
+/* An entry or extern record */
+typedef struct obj_symbol {
+    const char *name;
+    long address;
+} obj_symbol;
+
+/* A relocation record */
+typedef struct obj_relocation {
+    long address;            /* Address of the word */
+    int segment;             /* OBJ_SEGMENT_* of the label it holds */
+} obj_relocation;
+
+/* Contents of an object, to be written */
+typedef struct obj_image {
+    int word_bits;           /* 10 (packed) or 16 */
+    long code_length;        /* Words in the code segment... */
+    long data_length;        /* ...and in the data segment */
+    const int *words;        /* Code words then data words (low 10 bits used) */
+    obj_symbol *entries;
+    long entry_count;
+    obj_symbol *externs;
+    long extern_count;
+    obj_relocation *relocations;
+    long relocation_count;
+    int flags;               /* OBJ_RELOCATABLE or 0 */
+} obj_image;
+
+/* An object file in memory, used in place */
+typedef struct obj_view {
+    const unsigned char *data;
+    int word_bits;
+    long code_length;
+    long data_length;
+    long counts[2];          /* Records of OBJ_ENTRIES and OBJ_EXTERNS */
+    long relocation_count;
+    int flags;
+    const unsigned char *words;
+    const unsigned char *records[2];
+    const unsigned char *relocations;
+    const char *strings;
+    long strings_length;
+} obj_view;
+
+/*
+ * Appends the binary form of an object to out.
+ * Returns 1 on success, 0 if memory ran out.
+ */
+int obj_write(out_buffer *out, const obj_image *img);
+
+/*
+ * Parses the lines of an .ent or .ext text ("NAME 0123") into records
+ * allocated in mem.
+ * Returns 1 on success, 0 if a line is not in that form or memory ran out.
+ */
+int obj_read_symbols(const char *text, long length, arena *mem, obj_symbol **list, long *count);
+
+/*
+ * Builds an object from the text of an .ob file and of its .ent and .ext
+ * files (empty when the file does not exist), allocated in mem.
+ * Returns 1 on success, 0 if the text is not in the assembler's format
+ * or memory ran out.
+ */
+int obj_from_text(obj_image *img, arena *mem, const char *ob, long ob_length,
+                  const char *ent, long ent_length, const char *ext, long ext_length);
+
+/*
+ * Checks the header of an object file of length bytes and sets up a
+ * view of it. Takes constant time: names are only checked when read.
+ * Returns 1 on success, 0 if the data is not a complete object file.
+ */
+int obj_open(obj_view *v, const void *data, long length);
+
+/*
+ * Returns word index of an object (code words first, then data words).
+ */
+int obj_word(const obj_view *v, long index);
+
+/*
+ * Reads record index of a table (OBJ_ENTRIES or OBJ_EXTERNS).
+ * Returns 1, or 0 if the record's name lies outside the string table.
+ */
+int obj_symbol_at(const obj_view *v, int table, long index, obj_symbol *sym);
+
+/*
+ * Reads relocation record index.
+ * Returns 1, or 0 if there is no such record or its segment is unknown.
+ */
+int obj_relocation_at(const obj_view *v, long index, obj_relocation *rel);
+
+/*
+ * Writes an object back as the text of its .ob, .ent and .ext files.
+ * Returns 1 on success, 0 if a record is damaged or memory ran out.
+ */
+int obj_to_text(const obj_view *v, out_buffer *ob, out_buffer *ent, out_buffer *ext);
+
+#endif /* OBJECT_H */
@@ -0,0 +1,218 @@
+/* output.c - In-memory output files, committed with a rename */
+
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200112L
+#define OUTPUT_USE_STAT
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "output.h"
+#include "source.h"
+#include "async_io.h"
+
+#ifdef OUTPUT_USE_STAT
+#include <sys/stat.h>
+#endif
+
+/* Suffix of the temporary file an output is written to first */
+#define TEMP_SUFFIX ".tmp"
+
+static bundle_writer *bundle = NULL;   /* --bundle archive, if any */
+static int skip_unchanged = 0;   /* --write-if-changed */
+static int written_count = 0;
+static int unchanged_count = 0;
+
+/*
+ * out_append
+ * Grows the buffer (doubling, starting at 4 KB) and copies text in.
+ */
+int out_append(out_buffer *out, const char *text, long length) {
+    if (out->failed) return 0;
+    if (out->length + length > out->capacity) {
+        long capacity = out->capacity ? out->capacity : 4096;
+        char *data;
+        while (out->length + length > capacity) capacity *= 2;
+        data = realloc(out->data, capacity);
+        if (!data) {
+            out->failed = 1;
+            return 0;
+        }
+        out->data = data;
+        out->capacity = capacity;
+    }
+    memcpy(out->data + out->length, text, length);
+    out->length += length;
+    return 1;
+}
+
+/* Appends n in base 4 ('a' = 0 ... 'd' = 3), most significant digit first. */
+void out_base4(out_buffer *out, int n, int digits) {
+    char buf[16];
+    int i;
+    for (i = digits - 1; i >= 0; i--) {
+        buf[digits - 1 - i] = "abcd"[(n >> (i * 2)) & 0x3];
+    }
+    out_append(out, buf, digits);
+}
+
+const char *out_text(out_buffer *out) {
+    if (!out_append(out, "", 1)) return NULL;
+    out->length--;
+    return out->data;
+}
+
+void out_reset(out_buffer *out) {
+    out->length = 0;
+    out->failed = 0;
+}
+
+void out_free(out_buffer *out) {
+    free(out->data);
+    out->data = NULL;
+    out->length = 0;
+    out->capacity = 0;
+    out->failed = 0;
+}
+
+/*
+ * Returns 1 if the file at path holds exactly the buffer's contents.
+ * The sizes are compared first (from stat() where available); only a
+ * file of the right size is loaded, mapped if possible, and compared.
+ */
+static int same_contents(const char *path, const out_buffer *out) {
+    source_text old;
+    int same;
+#ifdef OUTPUT_USE_STAT
+    struct stat st;
+
+    if (stat(path, &st) != 0 || (long)st.st_size != out->length) return 0;
+#endif
+    if (!source_load(&old, path)) return 0;
+    same = old.length == out->length &&
+           (out->length == 0 || memcmp(old.text, out->data, out->length) == 0);
+    source_free(&old);
+    return same;
+}
+
+/*
+ * commit_output
+ * Writes path.tmp in one fwrite() and renames it to path. Where rename()
+ * does not replace an existing file (Windows) the old file is removed
+ * first. In bundle mode the contents are appended to the archive, and
+ * with asynchronous I/O the write is queued (see io_write(); it only
+ * runs on POSIX hosts, where text and binary files are the same).
+ */
+int commit_output(const char *path, const out_buffer *out, int binary) {
+    char *temp;
+    FILE *fp;
+    int ok;
+
+    if (out->failed) return 0;
+    if (bundle) {
+        ok = bundle_add(bundle, path, out->data, (unsigned long)out->length);
+        if (ok) written_count++;
+        return ok;
+    }
+    io_settle(path);
+    if (skip_unchanged && same_contents(path, out)) {
+        unchanged_count++;
+        return 1;
+    }
+    if (io_backend() != IO_BACKEND_NONE && io_write(path, out->data, out->length))
+        return 1;   /* Counted by io_written() once it is renamed into place */
+    temp = malloc(strlen(path) + sizeof(TEMP_SUFFIX));
+    if (!temp) return 0;
+    strcpy(temp, path);
+    strcat(temp, TEMP_SUFFIX);
+
+    fp = fopen(temp, binary ? "wb" : "w");
+    if (!fp) {
+        free(temp);
+        return 0;
+    }
+    ok = fwrite(out->data, 1, out->length, fp) == (size_t)out->length;
+    if (fclose(fp) != 0) ok = 0;
+
+    if (ok && rename(temp, path) != 0) {
+        remove(path);
+        ok = rename(temp, path) == 0;
+    }
+    if (!ok) remove(temp);
+    else written_count++;
+    free(temp);
+    return ok;
+}
+
+int out_stream_open(out_stream *s, const char *path) {
+    s->failed = 0;
+    s->fp = NULL;
+    s->temp = malloc(strlen(path) + sizeof(TEMP_SUFFIX));
+    if (!s->temp) return 0;
+    strcpy(s->temp, path);
+    strcat(s->temp, TEMP_SUFFIX);
+    io_settle(path);
+    s->fp = fopen(s->temp, "w");
+    if (!s->fp) {
+        free(s->temp);
+        s->temp = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+void out_stream_drain(out_stream *s, out_buffer *out) {
+    if (out->failed ||
+        (out->length > 0 && fwrite(out->data, 1, out->length, s->fp) != (size_t)out->length))
+        s->failed = 1;
+    out_reset(out);
+}
+
+/*
+ * out_stream_close
+ * Same replacement rules as commit_output(): the output only changes
+ * once the whole file is written.
+ */
+int out_stream_close(out_stream *s, const char *path, out_buffer *out) {
+    int ok;
+
+    out_stream_drain(s, out);
+    ok = !s->failed;
+    if (fclose(s->fp) != 0) ok = 0;
+    if (ok && rename(s->temp, path) != 0) {
+        remove(path);
+        ok = rename(s->temp, path) == 0;
+    }
+    if (!ok) remove(s->temp);
+    else written_count++;
+    free(s->temp);
+    s->temp = NULL;
+    s->fp = NULL;
+    return ok;
+}
+
+int write_frame(FILE *fp, const char *section, const out_buffer *out) {
+    if (out->failed) return 0;
+    if (fprintf(fp, "%s %ld\n", section, out->length) < 0) return 0;
+    return out->length == 0 || fwrite(out->data, 1, (size_t)out->length, fp) == (size_t)out->length;
+}
+
+void discard_output(const char *path) {
+    if (bundle) return;
+    io_settle(path);
+    remove(path);
+}
+
+void set_output_bundle(bundle_writer *b) {
+    bundle = b;
+}
+
+void set_skip_unchanged(int enabled) {
+    skip_unchanged = enabled;
+}
+
+int outputs_written(int *unchanged) {
+    *unchanged = unchanged_count;
+    return written_count + io_written();
+}
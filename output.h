@@ -0,0 +1,128 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+/*
+ * In-memory output files:
+ * - The second pass builds the .ob, .ent and .ext contents in buffers
+ *   and only writes them once the whole file assembled without errors.
+ * - Each file is written once, to a temporary name that is then renamed
+ *   over the final one, so a reader never sees a partial output and a
+ *   failed run leaves no half-written file behind.
+ * - In bundle mode (see set_output_bundle()) outputs become members of
+ *   one archive instead of files.
+ * - A source read from standard input has no file names to derive; its
+ *   outputs are written to standard output as one framed stream instead
+ *   (see write_frame()).
+ */
+
+#include <stdio.h>
+#include "bundle.h"
+
+typedef struct out_buffer {
+    char *data;
+    long length;
+    long capacity;
+    int failed;        /* Set if memory ran out; the contents are incomplete */
+} out_buffer;
+
+/*
+ * Appends length characters of text to the buffer.
+ * On allocation failure the buffer is marked failed and 0 is returned.
+ */
+int out_append(out_buffer *out, const char *text, long length);
+
+/*
+ * Appends n as a base 4 number of the given number of digits, using the
+ * letters a-d for 0-3.
+ */
+void out_base4(out_buffer *out, int n, int digits);
+
+/*
+ * Returns the contents followed by a NUL byte (not counted in length),
+ * or NULL if the buffer is incomplete.
+ */
+const char *out_text(out_buffer *out);
+
+/*
+ * Empties the buffer; its memory is kept for the next file.
+ */
+void out_reset(out_buffer *out);
+
+/*
+ * Frees the memory of the buffer.
+ */
+void out_free(out_buffer *out);
+
+/*
+ * Writes the buffer to path through a temporary file and a rename.
+ * binary is 1 for a binary output (a .obj), which is written byte for
+ * byte; text outputs are written in text mode, so they get the host's
+ * line endings. With skip-unchanged mode on, a file whose contents already equal the
+ * buffer is left alone (its modification time is kept).
+ * Returns 1 on success, 0 if the buffer is incomplete or the file could
+ * not be written (path is then left as it was).
+ */
+int commit_output(const char *path, const out_buffer *out, int binary);
+
+/* Output file written piece by piece (the --stream mode) */
+typedef struct out_stream {
+    FILE *fp;
+    char *temp;        /* Temporary file, renamed over the output when closed */
+    int failed;        /* Set after a write error */
+} out_stream;
+
+/*
+ * Starts writing path through its temporary file.
+ * Returns 1 on success, 0 if the temporary file cannot be created.
+ */
+int out_stream_open(out_stream *s, const char *path);
+
+/*
+ * Writes the buffer's contents to the stream and empties the buffer, so
+ * the buffer never holds more than one stretch of the output.
+ */
+void out_stream_drain(out_stream *s, out_buffer *out);
+
+/*
+ * Writes what is left in the buffer, closes the stream and renames the
+ * temporary file to path (it is removed instead if anything failed).
+ * Returns 1 on success, 0 otherwise (path is then left as it was).
+ */
+int out_stream_close(out_stream *s, const char *path, out_buffer *out);
+
+/*
+ * Writes one section of a framed stream: a header line holding the
+ * section name and the length of its contents in bytes ("ob 412\n"),
+ * then exactly that many bytes. The assembler frames the "ob", "ent" and
+ * "ext" sections of a source read from standard input, in that order and
+ * always all three (an empty one has length 0).
+ * Returns 1 on success, 0 if the buffer is incomplete or the write failed.
+ */
+int write_frame(FILE *fp, const char *section, const out_buffer *out);
+
+/*
+ * Removes an output file left by an earlier run, when an output is not
+ * produced this time. Does nothing in bundle mode.
+ */
+void discard_output(const char *path);
+
+/*
+ * Sends every output committed from now on to an archive (NULL to go
+ * back to writing files).
+ */
+void set_output_bundle(bundle_writer *b);
+
+/*
+ * Turns skip-unchanged mode (the --write-if-changed option) on or off.
+ */
+void set_skip_unchanged(int enabled);
+
+/*
+ * Returns the number of outputs commit_output() wrote, and stores the
+ * number it left alone because they were unchanged in *unchanged. A
+ * background write counts once it is in place, so with asynchronous
+ * I/O call it after io_flush().
+ */
+int outputs_written(int *unchanged);
+
+#endif /* OUTPUT_H */
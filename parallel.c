@@ -0,0 +1,98 @@
+/* parallel.c - Runs the chunks of a pass on several threads */
+
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200112L
+#define PARALLEL_POSIX
+#endif
+
+#include <stdio.h>
+#include "parallel.h"
+
+#ifdef PARALLEL_POSIX
+#include <pthread.h>
+#endif
+
+static int jobs = 1;
+
+void set_parallel_jobs(int count) {
+    if (count < 1) count = 1;
+    if (count > MAX_JOBS) count = MAX_JOBS;
+    jobs = count;
+}
+
+int parallel_jobs(void) {
+    return jobs;
+}
+
+int parallel_chunks(int line_count) {
+    int chunks = line_count / MIN_CHUNK_LINES;
+    if (chunks > jobs) chunks = jobs;
+    return chunks < 1 ? 1 : chunks;
+}
+
+/* Share of the tasks run by one thread: indexes first, first+step, ... */
+typedef struct task_share {
+    parallel_task task;
+    void *context;
+    int first;
+    int step;
+    int count;
+} task_share;
+
+static void run_share(const task_share *share) {
+    int i;
+    for (i = share->first; i < share->count; i += share->step)
+        share->task(share->context, i);
+}
+
+#ifdef PARALLEL_POSIX
+
+static void *share_main(void *arg) {
+    run_share((const task_share *)arg);
+    return NULL;
+}
+
+/*
+ * run_parallel
+ * Starts one thread per share but the first, which the calling thread
+ * runs itself. Shares whose thread could not be started are run by the
+ * calling thread once its own share is done.
+ */
+void run_parallel(parallel_task task, void *context, int count) {
+    pthread_t threads[MAX_JOBS];
+    int started[MAX_JOBS];
+    task_share shares[MAX_JOBS];
+    int threads_used = count < jobs ? count : jobs;
+    int i;
+
+    for (i = 0; i < threads_used; i++) {
+        shares[i].task = task;
+        shares[i].context = context;
+        shares[i].first = i;
+        shares[i].step = threads_used;
+        shares[i].count = count;
+        started[i] = i > 0 && pthread_create(&threads[i], NULL, share_main, &shares[i]) == 0;
+    }
+    if (threads_used > 0)
+        run_share(&shares[0]);
+    for (i = 1; i < threads_used; i++) {
+        if (started[i])
+            pthread_join(threads[i], NULL);
+        else
+            run_share(&shares[i]);
+    }
+}
+
+#else /* !PARALLEL_POSIX: the tasks run on the calling thread */
+
+void run_parallel(parallel_task task, void *context, int count) {
+    task_share share;
+    share.task = task;
+    share.context = context;
+    share.first = 0;
+    share.step = 1;
+    share.count = count;
+    run_share(&share);
+}
+
+#endif /* PARALLEL_POSIX */
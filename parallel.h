@@ -0,0 +1,46 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+/*
+ * Parallel work inside one file (the --jobs option):
+ * - A pass splits its lines into chunks and runs one task per chunk with
+ *   run_parallel(); the tasks only read shared state and write to their
+ *   own chunk, and the pass merges the chunks in order afterwards.
+ * - With one job (the default), or where threads are not available,
+ *   the tasks simply run one after another on the calling thread.
+ */
+
+/* Most threads a pass may use */
+#define MAX_JOBS 64
+
+/* Fewest lines worth handing to a thread of their own */
+#define MIN_CHUNK_LINES 256
+
+/* A task: runs chunk index of the work described by context */
+typedef void (*parallel_task)(void *context, int index);
+
+/*
+ * Sets the number of threads a pass may use (clamped to 1..MAX_JOBS).
+ */
+void set_parallel_jobs(int jobs);
+
+/*
+ * Returns the number of threads a pass may use.
+ */
+int parallel_jobs(void);
+
+/*
+ * Returns the number of chunks to split line_count lines into: one per
+ * job, but no chunk shorter than MIN_CHUNK_LINES. 1 means the pass should
+ * keep its sequential path.
+ */
+int parallel_chunks(int line_count);
+
+/*
+ * Runs task(context, i) for every i from 0 to count-1 and waits for all
+ * of them. The calling thread takes part; if a thread cannot be started
+ * its tasks run on the calling thread instead.
+ */
+void run_parallel(parallel_task task, void *context, int count);
+
+#endif /* PARALLEL_H */
@@ -0,0 +1,262 @@
+/* scanner.c - One-pass line and delimiter scanner for the front end
+ *
+ * Stage 1 compares the text against every character class the front end
+ * cares about and stores the results as bitmaps (one bit per byte).
+ * With SSE2/AVX2 this takes a handful of vector compares per 16/32 bytes.
+ * Stage 2 walks the newline bitmap and answers "first X on this line"
+ * with bit scans, producing one line_info per line.
+ */
+
+#include <stdlib.h>
+#include <limits.h>
+#include "scanner.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* Character classes, one bitmap each */
+#define CLS_NEWLINE   0
+#define CLS_BLANK     1
+#define CLS_COLON     2
+#define CLS_SEMICOLON 3
+#define CLS_COMMA     4
+#define CLS_QUOTE     5
+#define CLS_BRACKET   6
+#define CLASS_COUNT   7
+
+/* Bits per bitmap word */
+#define WORD_BITS ((long)(sizeof(unsigned long) * CHAR_BIT))
+
+/* Index of the lowest set bit of a non-zero word */
+static int lowest_bit(unsigned long bits) {
+#if defined(__GNUC__)
+    return __builtin_ctzl(bits);
+#else
+    int n = 0;
+    while (!(bits & 1UL)) {
+        bits >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+/* Number of set bits in a word */
+static int count_bits(unsigned long bits) {
+#if defined(__GNUC__)
+    return __builtin_popcountl(bits);
+#else
+    int n = 0;
+    while (bits) {
+        bits &= bits - 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+/* Classifies text[from..to) one byte at a time (tail and fallback path). */
+static void classify_scalar(const unsigned char *text, long from, long to,
+                            unsigned long *maps, long words) {
+    long i;
+    for (i = from; i < to; i++) {
+        unsigned long bit = 1UL << (i % WORD_BITS);
+        long w = i / WORD_BITS;
+        switch (text[i]) {
+        case '\n': maps[CLS_NEWLINE * words + w] |= bit; break;
+        case ' ': case '\t': case '\r': case '\v': case '\f':
+                   maps[CLS_BLANK * words + w] |= bit; break;
+        case ':':  maps[CLS_COLON * words + w] |= bit; break;
+        case ';':  maps[CLS_SEMICOLON * words + w] |= bit; break;
+        case ',':  maps[CLS_COMMA * words + w] |= bit; break;
+        case '"':  maps[CLS_QUOTE * words + w] |= bit; break;
+        case '[':  maps[CLS_BRACKET * words + w] |= bit; break;
+        }
+    }
+}
+
+/* ORs a vector compare mask for the bytes starting at pos into a bitmap. */
+#define PUT_MASK(maps, words, cls, pos, m) \
+    ((maps)[(cls) * (words) + (pos) / WORD_BITS] |= (unsigned long)(m) << ((pos) % WORD_BITS))
+
+/*
+ * Classifies as much of the text as fits in whole vectors.
+ * Returns the number of bytes handled; the rest goes through the scalar path.
+ */
+static long classify_vector(const unsigned char *text, long length,
+                            unsigned long *maps, long words) {
+    long i = 0;
+#if defined(__AVX2__)
+    const __m256i nl = _mm256_set1_epi8('\n');
+    const __m256i sp = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i vt = _mm256_set1_epi8('\v');
+    const __m256i ff = _mm256_set1_epi8('\f');
+    const __m256i colon = _mm256_set1_epi8(':');
+    const __m256i semi = _mm256_set1_epi8(';');
+    const __m256i comma = _mm256_set1_epi8(',');
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i bracket = _mm256_set1_epi8('[');
+
+    for (; i + 32 <= length; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(text + i));
+        __m256i blank = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, sp), _mm256_cmpeq_epi8(v, tab)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, cr),
+                            _mm256_or_si256(_mm256_cmpeq_epi8(v, vt), _mm256_cmpeq_epi8(v, ff))));
+        PUT_MASK(maps, words, CLS_NEWLINE, i, (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl)));
+        PUT_MASK(maps, words, CLS_BLANK, i, (unsigned)_mm256_movemask_epi8(blank));
+        PUT_MASK(maps, words, CLS_COLON, i, (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, colon)));
+        PUT_MASK(maps, words, CLS_SEMICOLON, i, (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, semi)));
+        PUT_MASK(maps, words, CLS_COMMA, i, (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, comma)));
+        PUT_MASK(maps, words, CLS_QUOTE, i, (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, quote)));
+        PUT_MASK(maps, words, CLS_BRACKET, i, (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, bracket)));
+    }
+#elif defined(__SSE2__)
+    const __m128i nl = _mm_set1_epi8('\n');
+    const __m128i sp = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i vt = _mm_set1_epi8('\v');
+    const __m128i ff = _mm_set1_epi8('\f');
+    const __m128i colon = _mm_set1_epi8(':');
+    const __m128i semi = _mm_set1_epi8(';');
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i bracket = _mm_set1_epi8('[');
+
+    for (; i + 16 <= length; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(text + i));
+        __m128i blank = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, sp), _mm_cmpeq_epi8(v, tab)),
+            _mm_or_si128(_mm_cmpeq_epi8(v, cr),
+                         _mm_or_si128(_mm_cmpeq_epi8(v, vt), _mm_cmpeq_epi8(v, ff))));
+        PUT_MASK(maps, words, CLS_NEWLINE, i, (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl)));
+        PUT_MASK(maps, words, CLS_BLANK, i, (unsigned)_mm_movemask_epi8(blank));
+        PUT_MASK(maps, words, CLS_COLON, i, (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, colon)));
+        PUT_MASK(maps, words, CLS_SEMICOLON, i, (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, semi)));
+        PUT_MASK(maps, words, CLS_COMMA, i, (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, comma)));
+        PUT_MASK(maps, words, CLS_QUOTE, i, (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, quote)));
+        PUT_MASK(maps, words, CLS_BRACKET, i, (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, bracket)));
+    }
+#else
+    (void)text;
+    (void)length;
+    (void)maps;
+    (void)words;
+#endif
+    return i;
+}
+
+/*
+ * Returns the position of the first set (want == 1) or clear (want == 0)
+ * bit of map in [from, to), or -1 if there is none.
+ */
+static long find_bit(const unsigned long *map, long from, long to, int want) {
+    long w;
+    unsigned long bits;
+
+    if (from >= to) return -1;
+    w = from / WORD_BITS;
+    bits = (want ? map[w] : ~map[w]) & (~0UL << (from % WORD_BITS));
+    while (!bits) {
+        w++;
+        if (w * WORD_BITS >= to) return -1;
+        bits = want ? map[w] : ~map[w];
+    }
+    w = w * WORD_BITS + lowest_bit(bits);
+    return w < to ? w : -1;
+}
+
+/* First occurrence of a class on a line, relative to its start, or -1. */
+static int first_of(const unsigned long *maps, long words, int cls, long start, long end) {
+    long pos = find_bit(maps + cls * words, start, end, 1);
+    return pos < 0 ? -1 : (int)(pos - start);
+}
+
+/* First non-blank at or after from, relative to start (end - start if none). */
+static int first_non_blank(const unsigned long *maps, long words, long from, long start, long end) {
+    long pos = find_bit(maps + CLS_BLANK * words, from, end, 0);
+    return (int)((pos < 0 ? end : pos) - start);
+}
+
+/* Fills one line_info from the class bitmaps. */
+static void describe_line(line_info *info, const unsigned long *maps, long words,
+                          long start, long end, int has_newline) {
+    long word_end;
+
+    info->offset = start;
+    info->length = (int)(end - start);
+    info->has_newline = has_newline;
+    info->indent = first_non_blank(maps, words, start, start, end);
+
+    word_end = find_bit(maps + CLS_BLANK * words, start + info->indent, end, 1);
+    info->word_end = (int)((word_end < 0 ? end : word_end) - start);
+
+    info->colon = first_of(maps, words, CLS_COLON, start, end);
+    info->after_colon = info->colon < 0 ? -1
+                      : first_non_blank(maps, words, start + info->colon + 1, start, end);
+    info->semicolon = first_of(maps, words, CLS_SEMICOLON, start, end);
+    info->comma = first_of(maps, words, CLS_COMMA, start, end);
+    info->quote = first_of(maps, words, CLS_QUOTE, start, end);
+    info->bracket = first_of(maps, words, CLS_BRACKET, start, end);
+
+    info->mask = 0;
+    if (info->colon >= 0) info->mask |= SCAN_COLON;
+    if (info->semicolon >= 0) info->mask |= SCAN_SEMICOLON;
+    if (info->comma >= 0) info->mask |= SCAN_COMMA;
+    if (info->quote >= 0) info->mask |= SCAN_QUOTE;
+    if (info->bracket >= 0) info->mask |= SCAN_BRACKET;
+}
+
+/*
+ * scan_lines
+ * Builds the class bitmaps for the whole text, then one line_info per
+ * line (a last line without '\n' counts as a line too).
+ */
+int scan_lines(const char *text, long length, line_index *index) {
+    const unsigned char *t = (const unsigned char *)text;
+    long words = length / WORD_BITS + 1;
+    unsigned long *maps;
+    long done, w, start, nl;
+    int count = 0;
+
+    index->lines = NULL;
+    index->count = 0;
+
+    maps = calloc(CLASS_COUNT * words, sizeof(unsigned long));
+    if (!maps) return 0;
+
+    done = classify_vector(t, length, maps, words);
+    classify_scalar(t, done, length, maps, words);
+
+    for (w = 0; w < words; w++)
+        count += count_bits(maps[CLS_NEWLINE * words + w]);
+    index->lines = malloc((count + 1) * sizeof(line_info));
+    if (!index->lines) {
+        free(maps);
+        return 0;
+    }
+
+    start = 0;
+    while ((nl = find_bit(maps + CLS_NEWLINE * words, start, length, 1)) >= 0) {
+        describe_line(&index->lines[index->count++], maps, words, start, nl, 1);
+        start = nl + 1;
+    }
+    if (start < length)
+        describe_line(&index->lines[index->count++], maps, words, start, length, 0);
+
+    free(maps);
+    return 1;
+}
+
+/* Frees the lines of a line index and marks it empty. */
+void free_line_index(line_index *index) {
+    free(index->lines);
+    index->lines = NULL;
+    index->count = 0;
+}
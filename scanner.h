@@ -0,0 +1,65 @@
+#ifndef SCANNER_H
+#define SCANNER_H
+
+/*
+ * Delimiter classes, as bits of line_info.mask:
+ * - Set when the class occurs at least once on the line.
+ */
+#define SCAN_COLON     0x01   /* ':' */
+#define SCAN_SEMICOLON 0x02   /* ';' */
+#define SCAN_COMMA     0x04   /* ',' */
+#define SCAN_QUOTE     0x08   /* '"' */
+#define SCAN_BRACKET   0x10   /* '[' */
+
+/*
+ * Classification of one line of text:
+ * - All positions are offsets from the start of the line. Missing
+ *   delimiters are -1.
+ * - "Blank" means ' ', '\t', '\r', '\v' or '\f' (isspace() without '\n').
+ */
+typedef struct line_info {
+    long offset;        /* Start of the line in the scanned text */
+    int length;         /* Characters before the newline (or end of text) */
+    int has_newline;    /* 1 if the line is terminated by '\n' */
+    int indent;         /* First non-blank character (length if none) */
+    int word_end;       /* First blank after indent (length if none) */
+    int colon;          /* First ':' */
+    int after_colon;    /* First non-blank after the first ':' (length if none) */
+    int semicolon;      /* First ';' */
+    int comma;          /* First ',' */
+    int quote;          /* First '"' */
+    int bracket;        /* First '[' */
+    unsigned mask;      /* SCAN_* classes present on the line */
+} line_info;
+
+/*
+ * Line index of a whole text, built by scan_lines().
+ */
+typedef struct line_index {
+    line_info *lines;
+    int count;
+} line_index;
+
+/*
+ * Classifies a whole block of text in one pass.
+ * Newlines, blanks and the SCAN_* delimiters are located with SIMD
+ * compares (AVX2 or SSE2 when the compiler targets them, plain C
+ * otherwise) into per-class bitmaps, from which one line_info per line
+ * is derived.
+ *
+ * Parameters:
+ *   text   - The text to scan (need not be NUL terminated)
+ *   length - Number of bytes in text
+ *   index  - Receives the line index; release with free_line_index()
+ *
+ * Returns:
+ *   1 on success, 0 on allocation failure.
+ */
+int scan_lines(const char *text, long length, line_index *index);
+
+/*
+ * Frees the lines of an index built by scan_lines().
+ */
+void free_line_index(line_index *index);
+
+#endif /* SCANNER_H */
@@ -1,279 +1,625 @@
-#include <stdio.h>
-#include <string.h>
-#include <stdlib.h>
-#include "globals.h"
-#include "table.h"
-#include "code_conversion.h"
-#include "errors.h"
-#include "util.h"
-#include <ctype.h>
-
-
-#define MAX_OPCODE_LENGTH 16
-#define MAX_LABEL_LENGTH 32
-
-
-
-
-/*
- * Returns 1 if the line is empty or a comment, 0 otherwise.
- */
-int is_empty_or_comment(const char *line) {
-    const char *p = line;
-    while (*p && (*p == ' ' || *p == '\t')) p++;
-    return (*p == ';' || *p == '\n' || *p == '\0');
-}
-
-/*
- * Attempts to extract a label from the beginning of a line.
- * If found, stores the label in 'label' and returns 1. Otherwise returns 0.
- */
-int extract_label(const char *line, char *label) {
-    int i = 0;
-    const char *p = line;
-    while (*p && *p != ':' && i < MAX_LABEL_LENGTH - 1) {
-        label[i++] = *p++;
-    }
-    if (*p == ':') {
-        label[i] = '\0';
-        return 1;
-    }
-    label[0] = '\0';
-    return 0;
-}
-
-/*
- * Returns a pointer to the first character after a label (if any).
- * Skips whitespace after the label.
- */
-const char *skip_label(const char *line) {
-    const char *p = line;
-    while (*p && *p != ':') p++;
-    if (*p == ':') p++;
-    while (*p && (*p == ' ' || *p == '\t')) p++;
-    return p;
-}
-
-/*
- * Extracts the opcode from a line (skipping label if present).
- * Returns 1 if opcode was found, 0 otherwise.
- */
-int extract_opcode(const char *line, char *opcode) {
-    int i = 0;
-    const char *p = line;
-
-    /* Skip whitespace */
-    while (*p == ' ' || *p == '\t') p++;
-
-    /* Skip label if present */
-    if (*p && !isspace((unsigned char)*p)) {
-        const char *label_end = strchr(p, ':');
-        if (label_end && (label_end - p < MAX_LABEL_LENGTH)) {
-            p = label_end + 1;
-            while (*p == ' ' || *p == '\t') p++;
-        }
-    }
-
-    /* Read opcode */
-    while (*p && !isspace((unsigned char)*p) && *p != '\n' && i < MAX_OPCODE_LENGTH-1) {
-        opcode[i++] = *p++;
-    }
-    opcode[i] = '\0';
-
-    /* Do not treat directives, macro, or empty as opcode */
-    if (opcode[0] == '\0' ||
-        opcode[0] == '.'  ||
-        strcmp(opcode, "macro") == 0 ||
-        strcmp(opcode, "endmcro") == 0 ||
-        opcode[0] == ';')
-        return 0;
-    return 1;
-}
-
-/* Extern global variables */
-extern int inst_counter;
-extern int data_counter;
-extern int code_array[];
-extern int data_memory[];
-extern label_entry *symbol_table;
-extern FILE *am_file;
-extern int error_flag;  /* Error flag for this file */
-
-FILE *ob_file = NULL;
-FILE *ent_file = NULL;
-FILE *ext_file = NULL;
-
-
-/* Internal function prototypes */
-void write_object_file(void);
-void write_entry_file(void);
-void process_instruction_line(const char *line, int line_num);
-
-/*
- * Main function for the assembler's second pass.
- * Reads each line of the preprocessed (.am) file, encodes instructions,
- * and writes output files (.ob, .ent, .ext).
- */
-void second_pass(const char *filename)
-{
-    char line[MAX_LINE_LENGTH];
-    int line_num = 0;
-    char ob_filename[FILENAME_MAX];
-    char ent_filename[FILENAME_MAX];
-    char ext_filename[FILENAME_MAX];
-
-    inst_counter = 100;       /* Reset instruction counter for this file */
-    error_flag = 0;  /* Reset error flag */
-
-    /* Compose output filenames */
-    strcpy(ob_filename, filename); strcat(ob_filename, ".ob");
-    strcpy(ent_filename, filename); strcat(ent_filename, ".ent");
-    strcpy(ext_filename, filename); strcat(ext_filename, ".ext");
-
-    ob_file = fopen(ob_filename, "w");
-    if (!ob_file) {
-        perror("Error opening .ob file");
-        return;
-    }
-    ent_file = fopen(ent_filename, "w");
-    ext_file = fopen(ext_filename, "w");
-
-    rewind(am_file);
-    line[0] = '\0'; /* make sure buffer is clear */
-
-    while (1) {
-        char *fgets_result;
-        fgets_result = fgets(line, MAX_LINE_LENGTH, am_file);
-
-        if (!fgets_result) {
-            /* Handle last line if not followed by a newline */
-            if (line[0] != '\0') {
-                line_num++;
-                if (!is_empty_or_comment(line)) {
-                    process_instruction_line(line, line_num);
-                }
-            }
-            break;
-        }
-
-        line_num++;
-        /* Remove trailing newline if present */
-        {
-            int len = strlen(line);
-            if (len > 0 && line[len-1] == '\n') {
-                line[len-1] = '\0';
-            }
-        }
-
-        if (is_empty_or_comment(line)) continue;
-        process_instruction_line(line, line_num);
-
-        line[0] = '\0'; /* clear for possible partial final read */
-    }
-
-
-    /* Handle the last line if the file does not end with a newline */
-    if (line[0] != '\0' && line[strlen(line)-1] != '\n') {
-        /* Make sure we didn't already process it */
-        if (!is_empty_or_comment(line)) {
-            line_num++;
-            process_instruction_line(line, line_num);
-        }
-    }
-
-
-    /*
-     * If any errors were detected during the pass,
-     * delete the output files (no output should be produced).
-     */
-    if (error_flag) {
-        if (ob_file) fclose(ob_file);
-        remove(ob_filename);
-        if (ent_file) fclose(ent_file);
-        if (ext_file) fclose(ext_file);
-        printf("----- Done: %s -----\n  ❌ No output file\n", filename);
-        return;
-    }
-
-    write_object_file();
-    write_entry_file();
-
-    if (ent_file) fclose(ent_file);
-    if (ext_file) fclose(ext_file);
-    fclose(ob_file);
-}
-
-/*
- * Processes a single line during the second pass.
- * Skips labels and comments, and passes valid instructions to encode_instruction().
- */
-void process_instruction_line(const char *line, int line_num)
-{
-    char label[MAX_LABEL_LENGTH];
-    char opcode[MAX_OPCODE_LENGTH];
-    const char *inst_line = line;
-
-    /* If line starts with a label, skip it */
-    if (extract_label(line, label)) {
-        inst_line = skip_label(line);
-    }
-
-    /* Attempt to extract an opcode */
-    if (!extract_opcode(inst_line, opcode)) {
-        return; /* Not an instruction line */
-    }
-
-    if (opcode[0] == '\0') return;
-    if (inst_line[0] == '\0' || inst_line[0] == ';' || inst_line[0] == '\n') return;
-
-
-
-    /* Pass instruction line to the encoder for translation to machine code */
-assemble_instruction(inst_line, opcode, line_num);
-}
-
-/*
- * Writes the object code (.ob) file.
- * The first line contains the code/data lengths.
- * Code words are written from address 100 to inst_counter-1.
- * Data words are written starting at inst_counter.
- */
-void write_object_file(void)
-{
-    int i;
-    int start = 100;
-    int code_len = inst_counter - start + 1;
-
-    /* Header in base 4 */
-    print_base4(ob_file, code_len, 3);
-    fprintf(ob_file, " ");
-    print_base4(ob_file, data_counter, 2);
-    fprintf(ob_file, "\n");
-
-    /* Write code words in base 4 */
-    for (i = start; i <= inst_counter; i++) {
-        write_encoded_word(ob_file, code_array[i]);
-    }
-
-    /* Write data words in base 4 */
-    for (i = 0; i < data_counter; i++) {
-        write_encoded_word(ob_file, data_memory[i]);
-    }
-}
-
-
-
-
-/*
- * Writes the entry symbols (if any) to the .ent file.
- */
-void write_entry_file(void)
-{
-    label_entry *curr = symbol_table;
-    while (curr) {
-        if (curr->attributes & ENTRY_ATTRIBUTE) {
-            fprintf(ent_file, "%s %04d\n", curr->name, curr->address);
-        }
-        curr = curr->next;
-    }
-}
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "globals.h"
+#include "table.h"
+#include "names.h"
+#include "code_conversion.h"
+#include "errors.h"
+#include "util.h"
+#include "macros.h"
+#include "source.h"
+#include "scanner.h"
+#include "output.h"
+#include "parallel.h"
+#include "stream.h"
+#include "object.h"
+#include "arena.h"
+#include "second_pass.h"
+#include <ctype.h>
+
+
+#define MAX_LABEL_LENGTH 32
+
+
+
+
+/*
+ * Returns 1 if the line is empty or a comment, 0 otherwise.
+ */
+int is_empty_or_comment(const char *line) {
+    const char *p = line;
+    while (*p && (*p == ' ' || *p == '\t')) p++;
+    return (*p == ';' || *p == '\n' || *p == '\0');
+}
+
+/*
+ * Attempts to extract a label from the beginning of a line.
+ * If found, stores the label in 'label' and returns 1. Otherwise returns 0.
+ */
+int extract_label(const char *line, char *label) {
+    int i = 0;
+    const char *p = line;
+    while (*p && *p != ':' && i < MAX_LABEL_LENGTH - 1) {
+        label[i++] = *p++;
+    }
+    if (*p == ':') {
+        label[i] = '\0';
+        return 1;
+    }
+    label[0] = '\0';
+    return 0;
+}
+
+/*
+ * Returns a pointer to the first character after a label (if any).
+ * Skips whitespace after the label.
+ */
+const char *skip_label(const char *line) {
+    const char *p = line;
+    while (*p && *p != ':') p++;
+    if (*p == ':') p++;
+    while (*p && (*p == ' ' || *p == '\t')) p++;
+    return p;
+}
+
+/*
+ * Extracts the opcode from a line (skipping label if present).
+ * Returns 1 if opcode was found, 0 otherwise.
+ */
+int extract_opcode(const char *line, char *opcode) {
+    int i = 0;
+    const char *p = line;
+
+    /* Skip whitespace */
+    while (*p == ' ' || *p == '\t') p++;
+
+    /* Skip label if present */
+    if (*p && !isspace((unsigned char)*p)) {
+        const char *label_end = strchr(p, ':');
+        if (label_end && (label_end - p < MAX_LABEL_LENGTH)) {
+            p = label_end + 1;
+            while (*p == ' ' || *p == '\t') p++;
+        }
+    }
+
+    /* Read opcode */
+    while (*p && !isspace((unsigned char)*p) && *p != '\n' && i < MAX_OPCODE_LENGTH-1) {
+        opcode[i++] = *p++;
+    }
+    opcode[i] = '\0';
+
+    /* Do not treat directives, macro, or empty as opcode */
+    if (opcode[0] == '\0' ||
+        opcode[0] == '.'  ||
+        strcmp(opcode, "macro") == 0 ||
+        strcmp(opcode, "endmcro") == 0 ||
+        opcode[0] == ';')
+        return 0;
+    return 1;
+}
+
+/* Extern global variables */
+extern int inst_counter;
+extern int data_counter;
+extern int code_array[];
+extern int data_memory[];
+extern label_entry *symbol_table;
+extern int error_flag;  /* Error flag for this file */
+
+/* Contents of the output files, committed only if the file assembles */
+out_buffer ob_output = {NULL, 0, 0, 0};
+out_buffer ent_output = {NULL, 0, 0, 0};
+out_buffer ext_output = {NULL, 0, 0, 0};
+static out_buffer obj_output = {NULL, 0, 0, 0};   /* Binary object (--binary) */
+
+
+/* Internal function prototypes */
+void write_object_file(void);
+void write_entry_file(void);
+static void commit_outputs(const char *ob_filename, const char *ent_filename,
+                           const char *ext_filename);
+static void frame_outputs(void);
+static int write_binary_object(void);
+static int encode_parallel(const source_text *am, const line_index *lines);
+/* State of the line loop, kept between the blocks of a streamed file */
+static macro_call *next_call;     /* Next macro expansion in the file */
+static int skip_lines;            /* Body lines already encoded by a template */
+static int record_lines;          /* Body lines left while recording a template */
+
+/* Starts the second pass of a file. */
+static void second_pass_begin(void)
+{
+    inst_counter = IC_START;  /* Reset instruction counter for this file */
+    memset(code_relocation, RELOC_NONE, sizeof(code_relocation));
+    error_flag = 0;  /* Reset error flag */
+
+    out_reset(&ob_output);
+    out_reset(&ent_output);
+    out_reset(&ext_output);
+
+    next_call = macro_calls;
+    skip_lines = 0;
+    record_lines = 0;
+}
+
+/*
+ * Encodes the instructions of a stretch of the .am text; first_line is
+ * the number of lines before it.
+ */
+static void second_pass_lines(const source_text *am, const line_index *lines, int first_line)
+{
+    char line[MAX_LINE_LENGTH];
+    char opcode[MAX_OPCODE_LENGTH];
+    const char *inst_line;
+    int line_num = first_line;
+    int k;
+
+    for (k = 0; k < lines->count && !error_limit_reached(); k++) {
+        /* Copy the line without its trailing newline */
+        {
+            int len = lines->lines[k].length;
+            if (len > MAX_LINE_LENGTH - 1) len = MAX_LINE_LENGTH - 1;
+            memcpy(line, am->text + lines->lines[k].offset, len);
+            line[len] = '\0';
+        }
+        line_num++;
+
+        /* Rest of a macro body that was encoded from its template */
+        if (skip_lines > 0) {
+            skip_lines--;
+            continue;
+        }
+
+        /* First line of a macro expansion: stamp or record its template */
+        if (next_call && next_call->line == line_num) {
+            node *macro = next_call->macro;
+            next_call = next_call->next;
+            if (macro->tmpl && stamp_template(macro->tmpl, line_num)) {
+                skip_lines = macro->line_count - 1;
+                continue;
+            }
+            if (!macro->tmpl)
+                macro->tmpl = calloc(1, sizeof(macro_template));
+            if (macro->tmpl) {
+                begin_template(macro->tmpl, line_num, macro->shared);
+                record_lines = macro->line_count;
+            }
+        }
+
+        inst_line = find_instruction(line, opcode);
+        if (inst_line)
+            assemble_instruction(inst_line, opcode, line_num);
+
+        if (record_lines > 0 && --record_lines == 0)
+            end_template();
+    }
+}
+
+/*
+ * Removes the outputs an earlier run left for filename, when this run
+ * produces none. Standard input has no output files to remove.
+ */
+void discard_outputs(const char *filename)
+{
+    static const char *const extensions[] = { ".ob", ".ent", ".ext", ".obj" };
+    int count = binary_object ? 4 : 3;    /* .obj only with --binary */
+    char path[FILENAME_MAX];
+    int i;
+
+    if (strcmp(filename, STDIN_NAME) == 0)
+        return;
+    for (i = 0; i < count; i++) {
+        strcpy(path, filename);
+        strcat(path, extensions[i]);
+        discard_output(path);
+    }
+}
+
+/*
+ * Finishes the second pass and writes the outputs of filename.
+ */
+static void second_pass_end(const char *filename)
+{
+    char ob_filename[FILENAME_MAX];
+    char ent_filename[FILENAME_MAX];
+    char ext_filename[FILENAME_MAX];
+    char obj_filename[FILENAME_MAX];
+
+    if (record_lines > 0)
+        end_template();
+
+    /* Compose output filenames */
+    strcpy(ob_filename, filename); strcat(ob_filename, ".ob");
+    strcpy(ent_filename, filename); strcat(ent_filename, ".ent");
+    strcpy(ext_filename, filename); strcat(ext_filename, ".ext");
+    strcpy(obj_filename, filename); strcat(obj_filename, ".obj");
+
+    /*
+     * If any errors were detected during the pass, nothing is written
+     * and outputs left by an earlier run are removed (no output should
+     * be produced).
+     */
+    if (error_flag) {
+        discard_outputs(filename);
+        print_status("----- Done: %s -----\n  ❌ No output file\n", filename);
+        return;
+    }
+
+    write_object_file();
+    write_entry_file();
+    if (binary_object && !write_binary_object())
+        obj_output.failed = 1;
+    if (strcmp(filename, STDIN_NAME) == 0)
+        frame_outputs();
+    else
+        commit_outputs(ob_filename, ent_filename, ext_filename);
+    if (binary_object && strcmp(filename, STDIN_NAME) != 0 && !commit_output(obj_filename, &obj_output, 1))
+        perror("Error writing .obj file");
+}
+
+/*
+ * Main function for the assembler's second pass.
+ * Walks each line of the preprocessed (.am) text, encodes instructions,
+ * and builds the output files (.ob, .ent, .ext) in memory. They are
+ * written only if the whole file encoded without errors; empty .ent and
+ * .ext files are not written at all.
+ * Macro bodies are encoded once per macro and then stamped at every
+ * further call site (see stamp_template()).
+ * Large files are encoded by several threads when --jobs allows it (see
+ * encode_parallel()); the line loop is the fallback.
+ */
+void second_pass(const char *filename, const source_text *am, const line_index *lines)
+{
+    second_pass_begin();
+    if (error_limit_reached() || !encode_parallel(am, lines))
+        second_pass_lines(am, lines, 0);
+    second_pass_end(filename);
+}
+
+/*
+ * Second pass in stream mode: the .am file is read back in blocks (see
+ * stream.h). The outputs only hold encoded words, so they stay within
+ * the fixed code and data segments whatever the size of the text.
+ * Returns 0, or -1 if the file could not be read (nothing is written).
+ */
+int second_pass_stream(const char *filename, const char *am_path)
+{
+    source_stream stream;
+    source_text block;
+    line_index lines;
+    int line_count = 0, ok;
+
+    second_pass_begin();
+    if (!stream_open(&stream, am_path)) return -1;
+    while (!error_limit_reached() && stream_next(&stream, &block, &lines)) {
+        second_pass_lines(&block, &lines, line_count);
+        line_count += lines.count;
+        free_line_index(&lines);
+    }
+    ok = !stream.failed;
+    stream_close(&stream);
+    if (!ok) {
+        if (record_lines > 0)
+            end_template();
+        return -1;
+    }
+    second_pass_end(filename);
+    return 0;
+}
+
+/*
+ * Writes the outputs built by the pass. An empty .ent or .ext is not
+ * created, and one left by an earlier run of the same source is removed.
+ */
+static void commit_outputs(const char *ob_filename, const char *ent_filename,
+                           const char *ext_filename)
+{
+    if (!commit_output(ob_filename, &ob_output, 0))
+        perror("Error writing .ob file");
+
+    if (ent_output.length == 0 && !ent_output.failed)
+        discard_output(ent_filename);
+    else if (!commit_output(ent_filename, &ent_output, 0))
+        perror("Error writing .ent file");
+
+    if (ext_output.length == 0 && !ext_output.failed)
+        discard_output(ext_filename);
+    else if (!commit_output(ext_filename, &ext_output, 0))
+        perror("Error writing .ext file");
+}
+
+/*
+ * Writes the outputs of a source read from standard input to standard
+ * output as one framed stream (see write_frame()).
+ */
+static void frame_outputs(void)
+{
+    if (!write_frame(stdout, "ob", &ob_output) ||
+        !write_frame(stdout, "ent", &ent_output) ||
+        !write_frame(stdout, "ext", &ext_output) ||
+        (binary_object && !write_frame(stdout, "obj", &obj_output)) ||
+        fflush(stdout) != 0)
+        perror("Error writing to standard output");
+}
+
+/* One chunk of lines encoded by its own thread */
+typedef struct encode_chunk {
+    int first_line;                /* Line index range [first_line, end_line) */
+    int end_line;
+    int *words;                    /* Encoded words, symbol words still 0 */
+    int *names;                    /* Symbol of each word, or NO_NAME (same block as words) */
+    int count;                     /* Words in the chunk */
+    int base;                      /* Address of its first word */
+    int failed;                    /* Set if the file needs the sequential pass */
+    out_buffer ext;                /* The chunk's .ext lines */
+} encode_chunk;
+
+/* Work shared by the threads of encode_parallel() */
+typedef struct encode_job {
+    const source_text *am;
+    const line_index *lines;
+    encode_chunk *chunks;
+} encode_job;
+
+/*
+ * First round: encodes the instructions of one chunk into the chunk
+ * (their addresses are not known yet). The word buffers are sized for
+ * the chunk's lines, at most MAX_INSTRUCTION_WORDS each.
+ */
+static void encode_chunk_words(void *context, int index)
+{
+    encode_job *job = context;
+    encode_chunk *chunk = &job->chunks[index];
+    char line[MAX_LINE_LENGTH];
+    char opcode[MAX_OPCODE_LENGTH];
+    int words[MAX_INSTRUCTION_WORDS];
+    int names[MAX_INSTRUCTION_WORDS];
+    const char *inst_line;
+    int k, count;
+    long capacity = (long)(chunk->end_line - chunk->first_line) * MAX_INSTRUCTION_WORDS;
+
+    if (capacity > MAX_INSTRUCTIONS) capacity = MAX_INSTRUCTIONS;
+    chunk->words = malloc(2 * capacity * sizeof(int));
+    if (!chunk->words) {
+        chunk->failed = 1;
+        return;
+    }
+    chunk->names = chunk->words + capacity;
+
+    for (k = chunk->first_line; k < chunk->end_line; k++) {
+        /* Copy the line exactly as second_pass() does */
+        int len = job->lines->lines[k].length;
+        if (len > MAX_LINE_LENGTH - 1) len = MAX_LINE_LENGTH - 1;
+        memcpy(line, job->am->text + job->lines->lines[k].offset, len);
+        line[len] = '\0';
+
+        inst_line = find_instruction(line, opcode);
+        if (!inst_line) continue;
+        count = instruction_words(inst_line, opcode, words, names);
+        if (count < 0 || chunk->count + count > capacity) {
+            chunk->failed = 1;
+            return;
+        }
+        memcpy(chunk->words + chunk->count, words, count * sizeof(int));
+        memcpy(chunk->names + chunk->count, names, count * sizeof(int));
+        chunk->count += count;
+    }
+}
+
+/*
+ * Second round: stores the words of one chunk in its slice of the code
+ * segment, resolving symbol words and listing extern references.
+ */
+static void store_chunk_words(void *context, int index)
+{
+    encode_job *job = context;
+    encode_chunk *chunk = &job->chunks[index];
+    char ext_line[MAX_LINE_LENGTH + 16];
+    int i;
+
+    for (i = 0; i < chunk->count; i++) {
+        int word = chunk->words[i];
+        int relocation = RELOC_NONE;
+        if (chunk->names[i] != NO_NAME) {
+            label_entry *sym = find_symbol(symbol_table, chunk->names[i]);
+            if (!sym) {
+                chunk->failed = 1;   /* Undefined label: reported sequentially */
+                return;
+            }
+            word = sym->address;
+            relocation = symbol_relocation(sym);
+            if (sym->attributes & EXTERN_ATTRIBUTE)
+                out_append(&chunk->ext, ext_line,
+                           sprintf(ext_line, "%s %04d\n", name_text(&file_names, chunk->names[i]),
+                                   chunk->base + i));
+        }
+        code_array[chunk->base + i] = word & 0x3FF;
+        code_relocation[chunk->base + i] = (unsigned char)relocation;
+    }
+}
+
+/*
+ * Encodes the file on several threads. Each chunk of lines is encoded on
+ * its own; the chunks' sizes then give every chunk its base address, and
+ * each chunk is stored straight into its slice of the code segment. The
+ * chunks' .ext lines are appended in chunk order, i.e. by address, so the
+ * outputs are the same as the sequential pass produces.
+ * Nothing is reported here: returns 0 (having changed nothing the
+ * sequential pass depends on) if the file is too small to split or has
+ * any error, so the sequential pass runs and reports it.
+ */
+static int encode_parallel(const source_text *am, const line_index *lines)
+{
+    encode_job job;
+    int chunk_count = parallel_chunks(lines->count);
+    int address = IC_START;
+    int ok = 1;
+    int i;
+
+    if (chunk_count < 2) return 0;
+    job.am = am;
+    job.lines = lines;
+    job.chunks = calloc(chunk_count, sizeof(encode_chunk));
+    if (!job.chunks) return 0;
+
+    for (i = 0; i < chunk_count; i++) {
+        job.chunks[i].first_line = (int)((long)lines->count * i / chunk_count);
+        job.chunks[i].end_line = (int)((long)lines->count * (i + 1) / chunk_count);
+    }
+    run_parallel(encode_chunk_words, &job, chunk_count);
+
+    /* Base addresses: prefix sums of the chunk sizes */
+    for (i = 0; i < chunk_count && ok; i++) {
+        job.chunks[i].base = address;
+        address += job.chunks[i].count;
+        if (job.chunks[i].failed || address > MAX_INSTRUCTIONS - 1) ok = 0;
+    }
+    if (ok) {
+        run_parallel(store_chunk_words, &job, chunk_count);
+        for (i = 0; i < chunk_count; i++)
+            if (job.chunks[i].failed) ok = 0;
+    }
+    if (ok) {
+        for (i = 0; i < chunk_count; i++) {
+            if (job.chunks[i].ext.failed) ext_output.failed = 1;
+            if (job.chunks[i].ext.length)
+                out_append(&ext_output, job.chunks[i].ext.data, job.chunks[i].ext.length);
+        }
+        inst_counter = address;
+    }
+
+    for (i = 0; i < chunk_count; i++) {
+        free(job.chunks[i].words);
+        out_free(&job.chunks[i].ext);
+    }
+    free(job.chunks);
+    return ok;
+}
+
+/*
+ * Frees the output buffers kept between files.
+ */
+void free_second_pass_outputs(void)
+{
+    out_free(&ob_output);
+    out_free(&ent_output);
+    out_free(&ext_output);
+    out_free(&obj_output);
+}
+
+/*
+ * Locates the instruction on a line of the .am text: skips comments,
+ * empty lines and a leading label, and extracts the opcode.
+ * Returns the text to pass to the encoder (opcode stored in opcode, at
+ * least MAX_OPCODE_LENGTH chars), or NULL if the line holds no instruction.
+ * The first pass uses it too, to see lines exactly as they are encoded.
+ */
+const char *find_instruction(const char *line, char *opcode)
+{
+    char label[MAX_LABEL_LENGTH];
+    const char *inst_line = line;
+
+    if (is_empty_or_comment(line)) return NULL;
+
+    /* If line starts with a label, skip it */
+    if (extract_label(line, label)) {
+        inst_line = skip_label(line);
+    }
+
+    /* Attempt to extract an opcode */
+    if (!extract_opcode(inst_line, opcode)) {
+        return NULL; /* Not an instruction line */
+    }
+
+    if (opcode[0] == '\0') return NULL;
+    if (inst_line[0] == '\0' || inst_line[0] == ';' || inst_line[0] == '\n') return NULL;
+    return inst_line;
+}
+
+/*
+ * Writes the object code (.ob) file.
+ * The first line contains the code/data lengths.
+ * Code words are written from address IC_START to inst_counter-1.
+ * Data words are written starting at inst_counter.
+ */
+void write_object_file(void)
+{
+    int i;
+    int start = IC_START;
+    int code_len = inst_counter - start;
+
+    /* Header in base 4 */
+    out_base4(&ob_output, code_len, 3);
+    out_append(&ob_output, " ", 1);
+    out_base4(&ob_output, data_counter, 2);
+    out_append(&ob_output, "\n", 1);
+
+    /* Write code words in base 4 */
+    for (i = start; i < inst_counter; i++) {
+        write_encoded_word(&ob_output, code_array[i]);
+    }
+
+    /* Write data words in base 4 */
+    for (i = 0; i < data_counter; i++) {
+        write_encoded_word(&ob_output, data_memory[i]);
+    }
+}
+
+
+
+
+/*
+ * Writes the entry symbols (if any) to the .ent contents.
+ */
+void write_entry_file(void)
+{
+    label_entry *curr = symbol_table;
+    char ent_line[MAX_LINE_LENGTH + 16];
+    while (curr) {
+        if (curr->attributes & ENTRY_ATTRIBUTE) {
+            out_append(&ent_output, ent_line,
+                       sprintf(ent_line, "%s %04d\n", name_text(&file_names, curr->name), curr->address));
+        }
+        curr = curr->next;
+    }
+}
+
+/*
+ * Builds the binary object (--binary): the words come from the same
+ * arrays as the .ob, the records from the .ent and .ext contents, and
+ * a relocation record from every word code_relocation marks as holding
+ * the address of a code or data label.
+ * Returns 1 on success, 0 if memory ran out.
+ */
+static int write_binary_object(void)
+{
+    obj_image img;
+    long code_len = inst_counter - IC_START;
+    int *words = arena_alloc(&file_arena, (size_t)(code_len + data_counter + 1) * sizeof(int));
+    obj_relocation *relocations = arena_alloc(&file_arena, (size_t)(code_len + 1) * sizeof(obj_relocation));
+    long i;
+
+    out_reset(&obj_output);
+    if (!words || !relocations) return 0;
+    memcpy(words, code_array + IC_START, (size_t)code_len * sizeof(int));
+    memcpy(words + code_len, data_memory, (size_t)data_counter * sizeof(int));
+
+    img.relocation_count = 0;
+    for (i = IC_START; i < IC_START + code_len; i++) {
+        if (code_relocation[i] != RELOC_CODE && code_relocation[i] != RELOC_DATA) continue;
+        relocations[img.relocation_count].address = i;
+        relocations[img.relocation_count++].segment =
+            code_relocation[i] == RELOC_CODE ? OBJ_SEGMENT_CODE : OBJ_SEGMENT_DATA;
+    }
+
+    img.word_bits = 10;
+    img.code_length = code_len;
+    img.data_length = data_counter;
+    img.words = words;
+    img.relocations = relocations;
+    img.flags = OBJ_RELOCATABLE;
+    return obj_read_symbols(ent_output.data, ent_output.length, &file_arena, &img.entries, &img.entry_count) &&
+           obj_read_symbols(ext_output.data, ext_output.length, &file_arena, &img.externs, &img.extern_count) &&
+           obj_write(&obj_output, &img);
+}
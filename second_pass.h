@@ -0,0 +1,42 @@
+#ifndef SECOND_PASS_H
+#define SECOND_PASS_H
+
+#include "source.h"
+#include "scanner.h"
+
+/* Size of the opcode buffer find_instruction() fills */
+#define MAX_OPCODE_LENGTH 16
+
+/*
+ * Encodes the .am text of filename (see first_pass()) and writes its
+ * .ob, .ent and .ext outputs, plus the .obj with --binary.
+ */
+void second_pass(const char *filename, const source_text *am, const line_index *lines);
+
+/*
+ * Second pass reading the .am file in blocks (the --stream mode).
+ * Returns 0, or -1 if the file could not be read (nothing is written).
+ */
+int second_pass_stream(const char *filename, const char *am_path);
+
+/*
+ * Removes the outputs an earlier run left for filename, when this run
+ * produces none.
+ */
+void discard_outputs(const char *filename);
+
+/*
+ * Frees the output buffers kept between files.
+ */
+void free_second_pass_outputs(void);
+
+/*
+ * Locates the instruction on a line of the .am text, the way the encoder
+ * sees it: skips a leading label and stores the opcode in opcode (at
+ * least MAX_OPCODE_LENGTH chars). Returns the text to encode, or NULL if
+ * the line holds no instruction. The first pass and the analysis use it
+ * too.
+ */
+const char *find_instruction(const char *line, char *opcode);
+
+#endif /* SECOND_PASS_H */
@@ -0,0 +1,146 @@
+/* source.c - Whole-file source buffers */
+
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200112L
+#define SOURCE_USE_MMAP
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "source.h"
+
+#ifdef SOURCE_USE_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * Maps a file read-only. The mapping is only used when the file does not
+ * end on a page boundary: the rest of the last page then reads as zero,
+ * which gives the text its terminating NUL for free.
+ * Returns 1 if the file was mapped, 0 if it has to be read instead.
+ */
+static int source_map(source_text *src, const char *filename) {
+    struct stat st;
+    long page = sysconf(_SC_PAGESIZE);
+    void *map;
+    int fd;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0) return 0;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0 || page <= 0 || st.st_size % page == 0) {
+        close(fd);
+        return 0;
+    }
+
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return 0;
+
+    src->text = map;
+    src->length = (long)st.st_size;
+    src->mapped = 1;
+    return 1;
+}
+#endif
+
+/*
+ * Reads a stream of unknown size (standard input) into a buffer that
+ * doubles as it fills.
+ * Returns 1 on success, 0 on a read error or if memory is exhausted.
+ */
+static int source_read_all(source_text *src, FILE *fp) {
+    char *text = NULL;
+    long length = 0, capacity = 0;
+    size_t got;
+
+    do {
+        if (capacity - length < 4096) {
+            char *grown;
+            capacity = capacity ? capacity * 2 : 65536L;
+            grown = realloc(text, capacity + 1);
+            if (!grown) {
+                free(text);
+                return 0;
+            }
+            text = grown;
+        }
+        got = fread(text + length, 1, (size_t)(capacity - length), fp);
+        length += (long)got;
+    } while (got > 0);
+
+    if (ferror(fp)) {
+        free(text);
+        return 0;
+    }
+    text[length] = '\0';
+    src->text = text;
+    src->length = length;
+    return 1;
+}
+
+/*
+ * source_load
+ * Maps the file, or reads it into a freshly allocated buffer; either way
+ * the text is followed by a NUL byte.
+ *
+ * Parameters:
+ *   src      - Receives the buffer and its length
+ *   filename - Path of the file to read
+ *
+ * Returns:
+ *   1 on success, 0 if the file cannot be opened or memory is exhausted.
+ */
+int source_load(source_text *src, const char *filename) {
+    FILE *fp;
+    long size;
+    size_t got;
+    char *text;
+
+    src->text = NULL;
+    src->length = 0;
+    src->mapped = 0;
+
+    if (strcmp(filename, STDIN_NAME) == 0)
+        return source_read_all(src, stdin);
+
+#ifdef SOURCE_USE_MMAP
+    if (source_map(src, filename)) return 1;
+#endif
+
+    fp = fopen(filename, "rb");
+    if (!fp) return 0;
+
+    if (fseek(fp, 0L, SEEK_END) != 0 || (size = ftell(fp)) < 0 || fseek(fp, 0L, SEEK_SET) != 0) {
+        fclose(fp);
+        return 0;
+    }
+
+    text = malloc(size + 1);
+    if (!text) {
+        fclose(fp);
+        return 0;
+    }
+
+    got = fread(text, 1, size, fp);
+    fclose(fp);
+    text[got] = '\0';
+    src->text = text;
+    src->length = (long)got;
+    return 1;
+}
+
+/* Frees (or unmaps) the buffer of a loaded source and marks it empty. */
+void source_free(source_text *src) {
+#ifdef SOURCE_USE_MMAP
+    if (src->mapped) {
+        munmap((void *)src->text, (size_t)src->length);
+    } else
+#endif
+    free((void *)src->text);
+    src->text = NULL;
+    src->length = 0;
+    src->mapped = 0;
+}
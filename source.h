@@ -0,0 +1,31 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+/*
+ * In-memory source file:
+ * - The whole file is read once; the front end walks it with a cursor
+ *   instead of reading it line by line from the stream.
+ * - Where possible the file is mapped rather than copied.
+ */
+typedef struct source_text {
+    const char *text;  /* File contents (always followed by a NUL byte) */
+    long length;       /* Number of bytes in text, excluding the NUL */
+    int mapped;        /* 1 if text is a read-only file mapping */
+} source_text;
+
+/* File name that stands for standard input (the "-" argument) */
+#define STDIN_NAME "-"
+
+/*
+ * Reads a whole file into memory, mapping it when the platform allows.
+ * STDIN_NAME reads standard input to its end instead.
+ * Returns 1 on success, 0 if the file cannot be opened or read.
+ */
+int source_load(source_text *src, const char *filename);
+
+/*
+ * Releases the memory of a loaded source (safe on an empty source).
+ */
+void source_free(source_text *src);
+
+#endif /* SOURCE_H */
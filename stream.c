@@ -0,0 +1,101 @@
+/* stream.c - Reads a source in fixed-size blocks of whole lines */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stream.h"
+
+int stream_open(source_stream *s, const char *path) {
+    s->length = 0;
+    s->consumed = 0;
+    s->saved = '\0';
+    s->skipping = 0;
+    s->eof = 0;
+    s->failed = 0;
+    s->buffer = malloc(STREAM_BLOCK + 1);
+    if (!s->buffer) return 0;
+    s->fp = fopen(path, "rb");
+    if (!s->fp) {
+        free(s->buffer);
+        s->buffer = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+/* Tops the buffer up from the file. */
+static void fill_buffer(source_stream *s) {
+    size_t n;
+
+    if (s->eof || s->length == STREAM_BLOCK) return;
+    n = fread(s->buffer + s->length, 1, (size_t)(STREAM_BLOCK - s->length), s->fp);
+    s->length += (long)n;
+    if (s->length < STREAM_BLOCK) {
+        s->eof = 1;
+        if (ferror(s->fp)) s->failed = 1;
+    }
+}
+
+/*
+ * stream_next
+ * Drops what the last block used, refills the buffer and hands out
+ * everything up to its last newline (or the rest of the file).
+ */
+int stream_next(source_stream *s, source_text *block, line_index *lines) {
+    long end;
+
+    /* Undo the last block's terminator and drop its lines */
+    if (s->consumed > 0) {
+        s->buffer[s->consumed] = s->saved;
+        memmove(s->buffer, s->buffer + s->consumed, (size_t)(s->length - s->consumed));
+        s->length -= s->consumed;
+        s->consumed = 0;
+    }
+
+    while (1) {
+        fill_buffer(s);
+        if (s->failed || s->length == 0) return 0;
+        if (!s->skipping) break;
+
+        /* Rest of an over-long line: drop it up to its newline */
+        {
+            char *nl = memchr(s->buffer, '\n', (size_t)s->length);
+            long drop = nl ? (long)(nl - s->buffer) + 1 : s->length;
+            memmove(s->buffer, s->buffer + drop, (size_t)(s->length - drop));
+            s->length -= drop;
+            if (nl) s->skipping = 0;
+        }
+    }
+
+    end = s->length;
+    while (end > 0 && s->buffer[end - 1] != '\n') end--;
+    if (end == 0) {
+        if (s->length == STREAM_BLOCK) {
+            s->skipping = 1;      /* One line fills the whole buffer */
+            end = s->length;
+        } else {
+            end = s->length;      /* Last line of the file, without a newline */
+        }
+    } else if (s->eof) {
+        end = s->length;          /* Everything left, including a last unterminated line */
+    }
+
+    s->consumed = end;
+    s->saved = s->buffer[end];
+    s->buffer[end] = '\0';
+    block->text = s->buffer;
+    block->length = end;
+    block->mapped = 0;
+    if (!scan_lines(block->text, block->length, lines)) {
+        s->failed = 1;
+        return 0;
+    }
+    return 1;
+}
+
+void stream_close(source_stream *s) {
+    if (s->fp) fclose(s->fp);
+    free(s->buffer);
+    s->fp = NULL;
+    s->buffer = NULL;
+}
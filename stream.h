@@ -0,0 +1,53 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdio.h>
+#include "source.h"
+#include "scanner.h"
+
+/*
+ * Source read in blocks (the --stream mode):
+ * - The file is read through one fixed-size buffer; each block handed
+ *   out holds whole lines only and comes with its line index, so the
+ *   front end walks it exactly like a fully loaded source.
+ * - A line longer than a whole block is handed out truncated to the
+ *   block (still too long for the assembler, so it is reported) and the
+ *   rest of it is dropped.
+ */
+
+/* Size of the read buffer (at least a few MAX_LINE_LENGTH) */
+#ifndef STREAM_BLOCK
+#define STREAM_BLOCK 65536L
+#endif
+
+typedef struct source_stream {
+    FILE *fp;
+    char *buffer;       /* STREAM_BLOCK bytes and a NUL */
+    long length;        /* Bytes in the buffer */
+    long consumed;      /* Bytes handed out by the last block */
+    char saved;         /* Byte replaced by the last block's NUL */
+    int skipping;       /* Dropping the rest of an over-long line */
+    int eof;
+    int failed;         /* Set after a read or allocation error */
+} source_stream;
+
+/*
+ * Opens a file for block reading.
+ * Returns 1 on success, 0 if the file cannot be opened.
+ */
+int stream_open(source_stream *s, const char *path);
+
+/*
+ * Reads the next block of lines. block points into the stream's buffer
+ * (NUL terminated) and stays valid until the next call; lines receives
+ * its index (release with free_line_index()).
+ * Returns 1 if a block was read, 0 at end of file or on error.
+ */
+int stream_next(source_stream *s, source_text *block, line_index *lines);
+
+/*
+ * Closes the file and frees the buffer.
+ */
+void stream_close(source_stream *s);
+
+#endif /* STREAM_H */
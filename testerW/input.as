@@ -11,7 +11,7 @@ jmp YES
 prn A
 prn #48
 YES: cmp A, X
-X: .data 2047   , 0, 0  , 0   ,  0 , -2047
+X: .data 511   , 0, 0  , 0   ,  0 , -512
 dec r5
 dec r5
 dec r5
@@ -30,7 +30,7 @@ lea myString, r2
 .extern swag22
 ENOUGH: stop
 GOBACK: rts
-cmp swag22 , #-2047
+cmp swag22 , #-512
 
 
 
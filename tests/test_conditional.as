@@ -0,0 +1,17 @@
+; build variants
+.ifdef FAST
+MAIN:   mov r1, r2
+.else
+MAIN:   mov r3, r4
+  .ifndef QUIET
+        prn #7
+  .endif
+.endif
+.ifdef FAST
+  .ifdef QUIET
+        inc r1
+  .else
+        dec r1
+  .endif
+.endif
+        stop
@@ -0,0 +1,7 @@
+; include a shared file (the second include is skipped by the guard)
+.include "common.inc"
+.include "common.inc"
+MAIN:   mov r1, r2
+        PRINT_R1
+        lea TABLE, r3
+        stop
@@ -40,8 +40,8 @@ stop
 add
 
 ; טווחי נתונים
-.data 32767, -32768     ; ערכים קצה חוקיים
-.data 32768, -32769     ; ערכים לא חוקיים
+.data 511, -512         ; ערכים קצה חוקיים
+.data 512, -513         ; ערכים לא חוקיים
 
 ; פסיק מיותר
 mov r1,,r2
@@ -0,0 +1,116 @@
+/* unpack.c - Lists and extracts the members of a --bundle archive */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bundle.h"
+
+/* Prints the command line usage */
+static void print_usage(const char *prog) {
+    printf("Usage: %s [-l] <archive> [member ...]\n", prog);
+    printf("  -l  list the members instead of extracting them\n");
+}
+
+/*
+ * Returns 1 if a member name is safe to create as a file: a relative
+ * path without ".." components.
+ */
+static int safe_name(const char *name) {
+    const char *p = name;
+
+    if (name[0] == '\0' || name[0] == '/' || name[0] == '\\') return 0;
+    while (*p) {
+        if (p[0] == '.' && p[1] == '.' && (p[2] == '\0' || p[2] == '/' || p[2] == '\\') &&
+            (p == name || p[-1] == '/' || p[-1] == '\\'))
+            return 0;
+        p++;
+    }
+    return 1;
+}
+
+/*
+ * Returns 1 for a binary object (a .obj), which is extracted byte for
+ * byte; the other members are text and get the host's line endings, as
+ * when the assembler writes them.
+ */
+static int binary_member(const char *name) {
+    size_t len = strlen(name);
+    return len >= 4 && strcmp(name + len - 4, ".obj") == 0;
+}
+
+/*
+ * Writes one member to the file of the same name.
+ * Returns 1 on success, 0 on failure (after printing why).
+ */
+static int extract_member(const bundle_reader *r, const bundle_member *m) {
+    FILE *fp;
+    char *data;
+    int ok;
+
+    if (!safe_name(m->name)) {
+        fprintf(stderr, "Skipping unsafe member name '%s'\n", m->name);
+        return 0;
+    }
+    data = bundle_read(r, m);
+    if (!data) {
+        fprintf(stderr, "Cannot read member '%s'\n", m->name);
+        return 0;
+    }
+    fp = fopen(m->name, binary_member(m->name) ? "wb" : "w");
+    if (!fp) {
+        fprintf(stderr, "Cannot create '%s'\n", m->name);
+        free(data);
+        return 0;
+    }
+    ok = fwrite(data, 1, m->length, fp) == m->length;
+    if (fclose(fp) != 0) ok = 0;
+    if (!ok) fprintf(stderr, "Error writing '%s'\n", m->name);
+    free(data);
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    bundle_reader r;
+    int list = 0, first = 1, failures = 0, i;
+
+    if (argc > 1 && strcmp(argv[1], "-l") == 0) {
+        list = 1;
+        first = 2;
+    }
+    if (first >= argc) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    if (!bundle_open(&r, argv[first])) {
+        fprintf(stderr, "Cannot open archive %s\n", argv[first]);
+        return 1;
+    }
+
+    if (first + 1 < argc) {
+        /* Only the named members */
+        for (i = first + 1; i < argc; i++) {
+            const bundle_member *m = bundle_find(&r, argv[i]);
+            if (!m) {
+                fprintf(stderr, "No member '%s' in %s\n", argv[i], argv[first]);
+                failures++;
+            } else if (list) {
+                printf("%8lu %s\n", m->length, m->name);
+            } else if (!extract_member(&r, m)) {
+                failures++;
+            }
+        }
+    } else {
+        /* Every member, skipping the ones replaced by a later member */
+        for (i = 0; i < r.count; i++) {
+            const bundle_member *m = &r.members[i];
+            if (bundle_find(&r, m->name) != m) continue;
+            if (list)
+                printf("%8lu %s\n", m->length, m->name);
+            else if (!extract_member(&r, m))
+                failures++;
+        }
+    }
+
+    bundle_close_reader(&r);
+    return failures ? 1 : 0;
+}
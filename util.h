@@ -1,22 +1,39 @@
-#ifndef UTIL_H
-#define UTIL_H
-
-/*
- * add_new_file
- * Returns a new string with the file extension replaced.
- * Example: add_new_file("foo.as", ".am") → "foo.am"
- * The returned string is dynamically allocated and must be freed by the caller.
- *
- * Parameters:
- *   filename   - original file name (may contain an extension)
- *   extension  - new extension, including dot (e.g., ".am")
- *
- * Returns:
- *   Pointer to new string, or NULL if memory allocation fails.
- */
-char *add_new_file(const char *filename, const char *extension);
-
-void print_base4(FILE *f, int n, int digits);
-
-
-#endif /* UTIL_H */
+#ifndef UTIL_H
+#define UTIL_H
+
+#include <stdio.h>
+#include "arena.h"
+
+/*
+ * add_new_file
+ * Returns a new string with the file extension replaced.
+ * Example: add_new_file(&file_arena, "foo.as", ".am") → "foo.am"
+ * The returned string is allocated in mem and released with it.
+ *
+ * Parameters:
+ *   mem        - arena to allocate the name in
+ *   filename   - original file name (may contain an extension)
+ *   extension  - new extension, including dot (e.g., ".am")
+ *
+ * Returns:
+ *   Pointer to new string, or NULL if memory allocation fails.
+ */
+char *add_new_file(arena *mem, const char *filename, const char *extension);
+
+/*
+ * print_status
+ * Prints a progress message ("----- Assembling: ...", "✅ ...", "❌ ...")
+ * like printf, to standard output unless set_status_stream() chose
+ * another stream.
+ */
+void print_status(const char *format, ...);
+
+/*
+ * set_status_stream
+ * Sends the progress messages to fp, e.g. to stderr while standard output
+ * carries assembled code.
+ */
+void set_status_stream(FILE *fp);
+
+
+#endif /* UTIL_H */
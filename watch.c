@@ -0,0 +1,313 @@
+/* watch.c - Watches a directory tree for changed sources (inotify)
+ *
+ * Every watched directory has an inotify watch for files written
+ * (IN_CLOSE_WRITE) or moved in (IN_MOVED_TO, the way many editors save)
+ * and for directories created below it, which are then watched too.
+ * Changed files are collected in the pending list until the events
+ * stop for WATCH_DEBOUNCE_MS; watch_next() then hands the list out.
+ */
+
+#if defined(__linux__)
+#define _POSIX_C_SOURCE 200112L
+#define WATCH_INOTIFY
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "watch.h"
+
+#ifdef WATCH_INOTIFY
+#include <errno.h>
+#include <dirent.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR)
+
+/* A watched directory */
+typedef struct watched_dir {
+    int wd;          /* inotify watch, or -1 once the directory is gone */
+    char *path;
+} watched_dir;
+
+static int watch_fd = -1;
+static watched_dir *dirs = NULL;
+static int dir_count = 0;
+static int dir_capacity = 0;
+
+/* Files changed in the current burst (handed out by watch_next()) */
+static watch_change *pending = NULL;
+static int pending_count = 0;
+static int pending_capacity = 0;
+static int handed_out = 0;      /* The list was returned; empty it first */
+
+double watch_now(void) {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) return 0.0;
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/* Returns dir/name in a new buffer, or NULL on allocation failure. */
+static char *join_path(const char *dir, const char *name) {
+    size_t dir_length = strlen(dir);
+    char *path = malloc(dir_length + strlen(name) + 2);
+
+    if (!path) return NULL;
+    memcpy(path, dir, dir_length);
+    if (dir_length == 0 || dir[dir_length - 1] != '/')
+        path[dir_length++] = '/';
+    strcpy(path + dir_length, name);
+    return path;
+}
+
+/* Returns 1 if name is a source file name ("*.as"). */
+static int is_source(const char *name) {
+    size_t length = strlen(name);
+    return length > 3 && strcmp(name + length - 3, ".as") == 0;
+}
+
+/*
+ * Adds a changed file (taking over path) to the burst, or moves the time
+ * of its last change if it is already there.
+ */
+static void add_pending(char *path, double when, int source) {
+    int i;
+
+    for (i = 0; i < pending_count; i++) {
+        if (strcmp(pending[i].path, path) == 0) {
+            pending[i].changed_at = when;
+            free(path);
+            return;
+        }
+    }
+    if (pending_count == pending_capacity) {
+        int capacity = pending_capacity ? pending_capacity * 2 : 16;
+        watch_change *list = realloc(pending, capacity * sizeof(watch_change));
+        if (!list) {
+            free(path);
+            return;
+        }
+        pending = list;
+        pending_capacity = capacity;
+    }
+    pending[pending_count].path = path;
+    pending[pending_count].changed_at = when;
+    pending[pending_count].source = source;
+    pending_count++;
+}
+
+/* Frees the paths of the burst handed out last. */
+static void release_pending(void) {
+    int i;
+    for (i = 0; i < pending_count; i++)
+        free((char *)pending[i].path);
+    pending_count = 0;
+    handed_out = 0;
+}
+
+/* Returns the path of a watch, or NULL if it is unknown. */
+static const char *find_dir(int wd) {
+    int i;
+    for (i = 0; i < dir_count; i++)
+        if (dirs[i].wd == wd) return dirs[i].path;
+    return NULL;
+}
+
+/*
+ * Watches a directory (taking over path), then adds its .as files to the
+ * burst and watches its subdirectories in turn. The watch is set before
+ * the directory is listed, so no file can slip in unnoticed.
+ * Returns 1 on success, 0 if the directory cannot be watched.
+ */
+static int add_dir(char *path) {
+    DIR *dir;
+    struct dirent *entry;
+    int wd;
+
+    wd = inotify_add_watch(watch_fd, path, WATCH_EVENTS);
+    if (wd < 0 || find_dir(wd)) {
+        /* Not a directory, or one already watched under another name */
+        free(path);
+        return wd >= 0;
+    }
+    if (dir_count == dir_capacity) {
+        int capacity = dir_capacity ? dir_capacity * 2 : 16;
+        watched_dir *list = realloc(dirs, capacity * sizeof(watched_dir));
+        if (!list) {
+            inotify_rm_watch(watch_fd, wd);
+            free(path);
+            return 0;
+        }
+        dirs = list;
+        dir_capacity = capacity;
+    }
+    dirs[dir_count].wd = wd;
+    dirs[dir_count].path = path;
+    dir_count++;
+
+    dir = opendir(path);
+    if (!dir) return 1;
+    while ((entry = readdir(dir)) != NULL) {
+        struct stat st;
+        char *child;
+
+        if (entry->d_name[0] == '.') continue;
+        child = join_path(path, entry->d_name);
+        if (!child) continue;
+        if (stat(child, &st) != 0)
+            free(child);
+        else if (S_ISDIR(st.st_mode))
+            add_dir(child);
+        else if (S_ISREG(st.st_mode) && is_source(entry->d_name))
+            add_pending(child, watch_now(), 1);
+        else
+            free(child);
+    }
+    closedir(dir);
+    return 1;
+}
+
+/*
+ * Handles one inotify event.
+ * Returns 1 if it belongs to the burst (a file or a new directory).
+ */
+static int handle_event(const struct inotify_event *event) {
+    const char *dir;
+    char *path;
+    int i;
+
+    if (event->mask & IN_IGNORED) {
+        /* The directory was removed; its watch is gone */
+        for (i = 0; i < dir_count; i++)
+            if (dirs[i].wd == event->wd) dirs[i].wd = -1;
+        return 0;
+    }
+    if (event->len == 0 || event->name[0] == '.') return 0;
+    dir = find_dir(event->wd);
+    if (!dir) return 0;
+
+    if (event->mask & IN_ISDIR) {
+        if (!(event->mask & (IN_CREATE | IN_MOVED_TO))) return 0;
+        path = join_path(dir, event->name);
+        if (path) add_dir(path);
+        return 1;
+    }
+    /* A created file is only complete once it is closed */
+    if (!(event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)))
+        return 0;
+    path = join_path(dir, event->name);
+    if (path) add_pending(path, watch_now(), is_source(event->name));
+    return 1;
+}
+
+int watch_start(const char *dir) {
+    char *path;
+
+    watch_fd = inotify_init();
+    if (watch_fd < 0) return 0;
+    path = malloc(strlen(dir) + 1);
+    if (!path) {
+        watch_stop();
+        return 0;
+    }
+    strcpy(path, dir);
+    if (!add_dir(path) || dir_count == 0) {
+        watch_stop();
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * watch_next
+ * Reads events until a burst has been quiet for WATCH_DEBOUNCE_MS. With
+ * nothing pending it blocks until the first event arrives.
+ */
+int watch_next(const watch_change **changes) {
+    union {
+        struct inotify_event event;   /* Aligns the buffer for the events */
+        char bytes[4096];
+    } buf;
+    struct pollfd pfd;
+    double last = watch_now();   /* Time of the last event of the burst */
+
+    *changes = NULL;
+    if (watch_fd < 0) return 0;
+    if (handed_out) release_pending();
+
+    pfd.fd = watch_fd;
+    pfd.events = POLLIN;
+    for (;;) {
+        int timeout = -1;
+        ssize_t n;
+        char *p;
+
+        if (pending_count > 0) {
+            double left = WATCH_DEBOUNCE_MS - (watch_now() - last);
+            if (left <= 0) break;
+            timeout = (int)left + 1;
+        }
+        if (poll(&pfd, 1, timeout) < 0) {
+            if (errno == EINTR) continue;
+            return 0;
+        }
+        if (!(pfd.revents & POLLIN)) continue;
+
+        n = read(watch_fd, buf.bytes, sizeof(buf.bytes));
+        if (n < 0) {
+            if (errno == EINTR || errno == EAGAIN) continue;
+            return 0;
+        }
+        for (p = buf.bytes; p < buf.bytes + n; ) {
+            const struct inotify_event *event = (const struct inotify_event *)p;
+            if (handle_event(event))
+                last = watch_now();
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    handed_out = 1;
+    *changes = pending;
+    return pending_count;
+}
+
+void watch_stop(void) {
+    int i;
+
+    release_pending();
+    free(pending);
+    pending = NULL;
+    pending_capacity = 0;
+    for (i = 0; i < dir_count; i++)
+        free(dirs[i].path);
+    free(dirs);
+    dirs = NULL;
+    dir_count = dir_capacity = 0;
+    if (watch_fd >= 0) close(watch_fd);
+    watch_fd = -1;
+}
+
+#else /* !WATCH_INOTIFY: watch mode is not available */
+
+int watch_start(const char *dir) {
+    (void)dir;
+    return 0;
+}
+
+int watch_next(const watch_change **changes) {
+    *changes = NULL;
+    return 0;
+}
+
+double watch_now(void) {
+    return (double)clock() * 1000.0 / CLOCKS_PER_SEC;
+}
+
+void watch_stop(void) {
+}
+
+#endif /* WATCH_INOTIFY */
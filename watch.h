@@ -0,0 +1,52 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+/*
+ * Watch mode (the --watch option):
+ * - A directory and every directory below it are watched for files that
+ *   are written or moved into place. Changed .as files are assembled
+ *   again by the same process, so its tables and arenas stay warm, and
+ *   so are the sources that include a changed file.
+ * - Editors often save in bursts (write, rename, touch). The events of a
+ *   burst are collected until the tree has been quiet for
+ *   WATCH_DEBOUNCE_MS, so each file is assembled once per burst.
+ * - Uses inotify, so it is only available on Linux; elsewhere
+ *   watch_start() fails.
+ */
+
+/* Quiet time that ends a burst of changes, in milliseconds */
+#define WATCH_DEBOUNCE_MS 100
+
+/* A file changed by a burst */
+typedef struct watch_change {
+    const char *path;     /* Watched directory joined with the file name */
+    double changed_at;    /* watch_now() of the file's last event */
+    int source;           /* 1 for a source file (*.as) */
+} watch_change;
+
+/*
+ * Starts watching dir and the directories below it (hidden ones are
+ * skipped). The .as files already there make up the first burst.
+ * Returns 1 on success, 0 if the directory cannot be watched.
+ */
+int watch_start(const char *dir);
+
+/*
+ * Waits for the next burst of changes and stores its files in
+ * *changes, each once, in the order they first changed. The array and
+ * its paths stay valid until the next call.
+ * Returns the number of files, or 0 if watching failed.
+ */
+int watch_next(const watch_change **changes);
+
+/*
+ * Returns a monotonic clock reading in milliseconds, for latencies.
+ */
+double watch_now(void);
+
+/*
+ * Stops watching and frees the watch state.
+ */
+void watch_stop(void);
+
+#endif /* WATCH_H */